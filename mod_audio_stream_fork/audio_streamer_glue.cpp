@@ -9,65 +9,113 @@
 #include <unordered_set>
 #include <atomic>
 #include <vector>
-#include "base64.h"
+#include "stream_base64.h"
+#include "stream_json.h"
+#include "stream_config.h"
+#include "stream_protocol.h"
+#include "g711.h"
+#include "ws_pool.h"
+#include "send_queue.h"
+#include "stream_reconnect.h"
+#include "stream_closer.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstddef>
+#include <random>
 
 #define FRAME_SIZE_8000  320 /* 1000x0.02 (20ms)= 160 x(16bit= 2 bytes) 320 frame size*/
-
-static switch_log_level_t get_stream_log_level(switch_core_session_t *session, switch_log_level_t default_level) {
-    switch_channel_t *channel = switch_core_session_get_channel(session);
-    const char *level = switch_channel_get_variable(channel, "STREAM_LOG_LEVEL");
-    if (!level || !*level) return default_level;
-    if (!strcasecmp(level, "ERROR")) return SWITCH_LOG_ERROR;
-    if (!strcasecmp(level, "WARNING")) return SWITCH_LOG_WARNING;
-    if (!strcasecmp(level, "INFO")) return SWITCH_LOG_INFO;
-    if (!strcasecmp(level, "DEBUG")) return SWITCH_LOG_DEBUG;
-    return default_level;
-}
-
-static inline uint8_t linear_to_ulaw(int16_t pcm_val) {
-    static const int16_t BIAS = 0x84;
-    static const int16_t CLIP = 32635;
-    static const uint8_t exp_lut[256] = {
-        0,0,1,1,2,2,2,2,3,3,3,3,3,3,3,3,
-        4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
-        5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,
-        5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,
-        6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,
-        6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,
-        6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,
-        6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,
-        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
-        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
-        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
-        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
-        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
-        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
-        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
-        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7
+#define SEND_BUF_MAX_PTIME_MS 120 /* largest single frame the capture send buffer must absorb */
+#define SEND_CONGESTED_US     2000 /* STREAM_SEND_ADAPTIVE: average send cost that doubles the batch */
+#define SEND_IDLE_US          500  /* ...and below which it is halved again */
+#define SEND_QUEUE_CLOSE_MS   200  /* outbound queue drain allowed at cleanup */
+#define DRAIN_CLOSE_MS        1000 /* of a graceful-shutdown deadline, kept for the closes */
+#define DRAIN_POLL_MS         20   /* graceful-shutdown: playback check interval */
+
+class AudioStreamer : public WsPoolSink, public SendQueueSink, public ReconnectTarget, public CloseTarget {
+    /* One connection: a libwsc client, or a stream on a pooled connection */
+    struct Link {
+        std::unique_ptr<WebSocketClient> client;   /* direct mode */
+        WsPoolStream pool;                         /* pooled mode */
+        uint32_t id = 0;
     };
-    int sign = (pcm_val >> 8) & 0x80;
-    if (sign) pcm_val = -pcm_val;
-    if (pcm_val > CLIP) pcm_val = CLIP;
-    pcm_val = pcm_val + BIAS;
-    int exponent = exp_lut[(pcm_val >> 7) & 0xFF];
-    int mantissa = (pcm_val >> (exponent + 3)) & 0x0F;
-    return (uint8_t)~(sign | (exponent << 4) | mantissa);
-}
 
-class AudioStreamer {
 public:
 
     AudioStreamer(const char* uuid, const char* wsUri, responseHandler_t callback, int deflate, int heart_beat,
                     bool suppressLog, const char* extra_headers, bool no_reconnect,
                     const char* tls_cafile, const char* tls_keyfile, const char* tls_certfile,
-                    bool tls_disable_hostname_validation): m_sessionId(uuid), m_notify(callback),
-                    m_suppress_log(suppressLog), m_extra_headers(extra_headers), m_playFile(0){
+                    bool tls_disable_hostname_validation, bool binary_playback,
+                    bool pooled, int pool_max_streams): m_sessionId(uuid), m_uri(wsUri), m_notify(callback),
+                    m_suppress_log(suppressLog), m_extra_headers(extra_headers), m_playFile(0),
+                    m_binaryPlayback(binary_playback), m_pooled(pooled), m_noReconnect(no_reconnect){
+
+        /* NETPLAY v2.7: kept for every (re)connect; pooled mode shares a connection, see ws_pool.h */
+        m_opts.uri = wsUri;
+        if (extra_headers) m_opts.extra_headers = extra_headers;
+        if (tls_cafile) m_opts.tls_cafile = tls_cafile;
+        if (tls_keyfile) m_opts.tls_keyfile = tls_keyfile;
+        if (tls_certfile) m_opts.tls_certfile = tls_certfile;
+        m_opts.tls_disable_hostname_validation = tls_disable_hostname_validation;
+        m_opts.deflate = deflate;
+        m_opts.heart_beat = heart_beat;
+        m_opts.binary_playback = binary_playback;
+        m_opts.max_streams = pool_max_streams;
+
+        /* NETPLAY v2.7: identifies this stream to the backend across reconnects */
+        std::random_device rd;
+        char token[33];
+        switch_snprintf(token, sizeof(token), "%08x%08x%08x%08x", rd(), rd(), rd(), rd());
+        m_resumeToken = token;
+    }
+
+    /* NETPLAY v2.7: reconnect backoff and give-up time (STREAM_RECONNECT_*), before open() */
+    void setReconnect(uint32_t backoff_ms, uint32_t backoff_max_ms, uint32_t timeout_ms) {
+        m_backoffMs = backoff_ms;
+        m_backoffMaxMs = backoff_max_ms;
+        m_reconnectTimeoutUs = (switch_time_t)timeout_ms * 1000;
+    }
 
+    /* NETPLAY v2.7: an add_sink destination, before open(). It only receives capture:
+     * playback and barge-in stay with the primary stream, and what it reports goes out
+     * as EVENT_SINK / EVENT_SINK_JSON */
+    void makeSink(const char* metadata) {
+        m_sink = true;
+        if (metadata) m_sinkMetadata = metadata;
+    }
+
+    bool isSink() const {
+        return m_sink;
+    }
+
+    stream_sink_stats_t* sinkStats() {
+        return &m_sinkStats;
+    }
+
+    void open() {
+        openLink();
+    }
+
+    /* Opens a new connection that replaces the current one. Events of an
+     * older connection are ignored from here on. */
+    void openLink() {
+        std::shared_ptr<Link> link = std::make_shared<Link>();
+        link->id = m_linkId.fetch_add(1, std::memory_order_acq_rel) + 1;
+
+        if (m_pooled) {
+            ws_pool::attach(m_opts, m_sessionId, this, link->pool);
+            std::atomic_store(&m_link, link);
+            return;
+        }
+
+        link->client.reset(new WebSocketClient());
+        WebSocketClient& client = *link->client;
         WebSocketHeaders hdrs;
         WebSocketTLSOptions tls;
 
-        if (m_extra_headers) {
-            cJSON *headers_json = cJSON_Parse(m_extra_headers);
+        if (!m_opts.extra_headers.empty()) {
+            cJSON *headers_json = cJSON_Parse(m_opts.extra_headers.c_str());
             if (headers_json) {
                 cJSON *iterator = headers_json->child;
                 while (iterator) {
@@ -80,91 +128,211 @@ public:
             }
         }
 
-        client.setUrl(wsUri);
+        client.setUrl(m_opts.uri);
 
         // Setup eventual TLS options.
         // tls_cafile may hold the special values
         // NONE, which disables validation and SYSTEM which uses
         // the system CAs bundle
-        if (tls_cafile) {
-            tls.caFile = tls_cafile;
+        if (!m_opts.tls_cafile.empty()) {
+            tls.caFile = m_opts.tls_cafile;
         }
 
-        if (tls_keyfile) {
-            tls.keyFile = tls_keyfile;
+        if (!m_opts.tls_keyfile.empty()) {
+            tls.keyFile = m_opts.tls_keyfile;
         }
 
-        if (tls_certfile) {
-            tls.certFile = tls_certfile;
+        if (!m_opts.tls_certfile.empty()) {
+            tls.certFile = m_opts.tls_certfile;
         }
 
-        tls.disableHostnameValidation = tls_disable_hostname_validation;
+        tls.disableHostnameValidation = m_opts.tls_disable_hostname_validation;
         client.setTLSOptions(tls);
 
         // Optional heart beat, sent every xx seconds when there is not any traffic
         // to make sure that load balancers do not kill an idle connection.
-        if(heart_beat)
-            client.setPingInterval(heart_beat);
+        if(m_opts.heart_beat)
+            client.setPingInterval(m_opts.heart_beat);
 
         // Per message deflate connection is enabled by default. You can tweak its parameters or disable it
-        if(deflate)
+        if(m_opts.deflate)
             client.enableCompression(false);
 
+        // NETPLAY v2.7: advertise binary playback framing to the server
+        if(m_binaryPlayback)
+            hdrs.set(STREAM_PLAYBACK_HANDSHAKE_HEADER, STREAM_PLAYBACK_HANDSHAKE_VALUE);
+
         // Set extra headers if any
         if(!hdrs.empty())
             client.setHeaders(hdrs);
 
         // Setup a callback to be fired when a message or an event (open, close, error) is received
-        client.setMessageCallback([this](const std::string& message) {
-            if (this->isCleanedUp()) return;
+        const uint32_t id = link->id;
+        client.setMessageCallback([this, id](const std::string& message) {
+            if (this->isCleanedUp() || !isCurrentLink(id)) return;
             eventCallback(MESSAGE, message.c_str());
         });
 
-        client.setOpenCallback([this]() {
-            cJSON *root;
-            root = cJSON_CreateObject();
-            cJSON_AddStringToObject(root, "status", "connected");
-            char *json_str = cJSON_PrintUnformatted(root);
-            eventCallback(CONNECT_SUCCESS, json_str);
-            cJSON_Delete(root);
-            switch_safe_free(json_str);
-        });
+        if(m_binaryPlayback) {
+            client.setBinaryCallback([this, id](const void* data, size_t len) {
+                if (this->isCleanedUp() || !isCurrentLink(id)) return;
+                binaryCallback(static_cast<const uint8_t*>(data), len);
+            });
+        }
 
-        client.setErrorCallback([this](int code, const std::string &msg) {
-            cJSON *root, *message;
-            root = cJSON_CreateObject();
-            cJSON_AddStringToObject(root, "status", "error");
-            message = cJSON_CreateObject();
-            cJSON_AddNumberToObject(message, "code", code);
-            cJSON_AddStringToObject(message, "error", msg.c_str());
-            cJSON_AddItemToObject(root, "message", message);
+        client.setOpenCallback([this, id]() { if (isCurrentLink(id)) handleOpen(); });
+        client.setErrorCallback([this, id](int code, const std::string &msg) { if (isCurrentLink(id)) handleError(code, msg); });
+        client.setCloseCallback([this, id](int code, const std::string &reason) { if (isCurrentLink(id)) handleClose(code, reason); });
 
-            char *json_str = cJSON_PrintUnformatted(root);
+        /* Published before connecting, so the open callback already sees it */
+        std::atomic_store(&m_link, link);
 
-            eventCallback(CONNECT_ERROR, json_str);
+        // Now that our callback is setup, we can start our background thread and receive messages
+        client.connect();
+    }
 
-            cJSON_Delete(root);
-            switch_safe_free(json_str);
-        });
+    bool isCurrentLink(uint32_t id) const {
+        return m_linkId.load(std::memory_order_acquire) == id;
+    }
 
-        client.setCloseCallback([this](int code, const std::string &reason) {
-            cJSON *root, *message;
-            root = cJSON_CreateObject();
-            cJSON_AddStringToObject(root, "status", "disconnected");
-            message = cJSON_CreateObject();
-            cJSON_AddNumberToObject(message, "code", code);
-            cJSON_AddStringToObject(message, "reason", reason.c_str());
-            cJSON_AddItemToObject(root, "message", message);
-            char *json_str = cJSON_PrintUnformatted(root);
+    /* NETPLAY v2.7: connections opened so far; the media thread resumes when it changes */
+    uint32_t linkId() const {
+        return m_linkId.load(std::memory_order_acquire);
+    }
 
-            eventCallback(CONNECTION_DROPPED, json_str);
+    const std::string& resumeToken() const {
+        return m_resumeToken;
+    }
 
-            cJSON_Delete(root);
-            switch_safe_free(json_str);
-        });
+    void handleOpen() {
+        {
+            std::lock_guard<std::mutex> lock(m_reconnectMutex);
+            m_reconnectAttempt = 0;
+            m_outageStart = 0;
+        }
+        cJSON *root;
+        root = cJSON_CreateObject();
+        cJSON_AddStringToObject(root, "status", "connected");
+        if (linkId() > 1) cJSON_AddBoolToObject(root, "resumed", 1);
+        char *json_str = cJSON_PrintUnformatted(root);
+        eventCallback(CONNECT_SUCCESS, json_str);
+        cJSON_Delete(root);
+        switch_safe_free(json_str);
+    }
 
-        // Now that our callback is setup, we can start our background thread and receive messages
-        client.connect();
+    /* NETPLAY v2.7: a normal close (1000) is the backend ending the stream; anything
+     * else is retried until STREAM_RECONNECT_TIMEOUT_MS of outage. Websocket thread. */
+    bool scheduleReconnect(int code, const char* what) {
+        if (m_noReconnect || isCleanedUp() || code == 1000) return false;
+        uint32_t attempt, delay;
+        {
+            std::lock_guard<std::mutex> lock(m_reconnectMutex);
+            if (m_reconnectClosed) return false;
+            const switch_time_t now = switch_micro_time_now();
+            if (!m_outageStart) m_outageStart = now;
+            if (now - m_outageStart >= m_reconnectTimeoutUs) {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "(%s) no connection for %" SWITCH_UINT64_T_FMT "ms, giving up\n",
+                                  m_sessionId.c_str(), (uint64_t)(now - m_outageStart) / 1000);
+                return false;
+            }
+            attempt = ++m_reconnectAttempt;
+            delay = stream_reconnect::backoff_ms(attempt - 1, m_backoffMs, m_backoffMaxMs);
+            stream_reconnect::schedule(this, delay);
+        }
+        cJSON *root = cJSON_CreateObject();
+        cJSON_AddStringToObject(root, "status", "reconnecting");
+        cJSON_AddStringToObject(root, "cause", what);
+        cJSON_AddNumberToObject(root, "code", code);
+        cJSON_AddNumberToObject(root, "attempt", attempt);
+        cJSON_AddNumberToObject(root, "delayMs", delay);
+        char *json_str = cJSON_PrintUnformatted(root);
+        eventCallback(RECONNECTING, json_str);
+        cJSON_Delete(root);
+        switch_safe_free(json_str);
+        return true;
+    }
+
+    /* ReconnectTarget, scheduler thread: open the next connection, then tear the old one down */
+    void reconnectNow() override {
+        if (isCleanedUp()) return;
+        std::shared_ptr<Link> old = std::atomic_load(&m_link);
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "(%s) reconnecting to %s\n", m_sessionId.c_str(), m_uri.c_str());
+        /* A new backend gets the metadata again, ahead of the resume */
+        m_metadataSent.store(false, std::memory_order_release);
+        openLink();
+        closeLink(old);
+    }
+
+    /* Stop scheduling reconnects and wait for one in progress (cleanup) */
+    void stopReconnect() {
+        {
+            std::lock_guard<std::mutex> lock(m_reconnectMutex);
+            m_reconnectClosed = true;
+        }
+        stream_reconnect::cancel(this);
+    }
+
+    void handleError(int code, const std::string &msg) {
+        if (scheduleReconnect(code, "error")) return;
+        m_failed.store(true, std::memory_order_release);
+        cJSON *root, *message;
+        root = cJSON_CreateObject();
+        cJSON_AddStringToObject(root, "status", "error");
+        message = cJSON_CreateObject();
+        cJSON_AddNumberToObject(message, "code", code);
+        cJSON_AddStringToObject(message, "error", msg.c_str());
+        cJSON_AddItemToObject(root, "message", message);
+
+        char *json_str = cJSON_PrintUnformatted(root);
+
+        eventCallback(CONNECT_ERROR, json_str);
+
+        cJSON_Delete(root);
+        switch_safe_free(json_str);
+    }
+
+    void handleClose(int code, const std::string &reason) {
+        if (scheduleReconnect(code, "disconnected")) return;
+        m_failed.store(true, std::memory_order_release);
+        cJSON *root, *message;
+        root = cJSON_CreateObject();
+        cJSON_AddStringToObject(root, "status", "disconnected");
+        message = cJSON_CreateObject();
+        cJSON_AddNumberToObject(message, "code", code);
+        cJSON_AddStringToObject(message, "reason", reason.c_str());
+        cJSON_AddItemToObject(root, "message", message);
+        char *json_str = cJSON_PrintUnformatted(root);
+
+        eventCallback(CONNECTION_DROPPED, json_str);
+
+        cJSON_Delete(root);
+        switch_safe_free(json_str);
+    }
+
+    /* WsPoolSink: events of this call's stream on a pooled connection */
+    void onPoolOpen() override {
+        if (isCleanedUp()) return;
+        handleOpen();
+    }
+
+    void onPoolMessage(const std::string& message) override {
+        if (isCleanedUp()) return;
+        eventCallback(MESSAGE, message.c_str());
+    }
+
+    void onPoolBinary(const uint8_t* data, size_t len) override {
+        if (isCleanedUp() || !m_binaryPlayback) return;
+        binaryCallback(data, len);
+    }
+
+    void onPoolError(int code, const std::string& message) override {
+        if (isCleanedUp()) return;
+        handleError(code, message);
+    }
+
+    void onPoolClose(int code, const std::string& reason) override {
+        if (isCleanedUp()) return;
+        handleClose(code, reason);
     }
 
     switch_media_bug_t *get_media_bug(switch_core_session_t *session) {
@@ -188,28 +356,139 @@ public:
     inline void send_initial_metadata(switch_core_session_t *session) {
         auto *bug = get_media_bug(session);
         if(bug) {
-            auto* tech_pvt = (private_t*) switch_core_media_bug_get_user_data(bug);
-            if(tech_pvt && strlen(tech_pvt->initialMetadata) > 0) {
-                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG,
-                                          "sending initial metadata %s\n", tech_pvt->initialMetadata);
-                writeText(tech_pvt->initialMetadata);
+            sendInitialMetadata((private_t*) switch_core_media_bug_get_user_data(bug));
+        }
+    }
+
+    /* NETPLAY v2.7: a prepared connection may open before the media bug exists, so the
+     * metadata goes out exactly once, from the open callback or the first connected frame */
+    void sendInitialMetadata(private_t* tech_pvt) {
+        if(!tech_pvt || m_metadataSent.load(std::memory_order_acquire) || !isConnected()) return;
+        if(m_metadataSent.exchange(true, std::memory_order_acq_rel)) return;
+        const char* metadata = m_sink ? m_sinkMetadata.c_str() : tech_pvt->initialMetadata;
+        if(metadata && *metadata) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG,
+                                      "(%s) sending initial metadata %s\n", m_sessionId.c_str(), metadata);
+            writeText(metadata);
+        }
+    }
+
+    void setSuppressLog(bool suppress) {
+        m_suppress_log.store(suppress, std::memory_order_relaxed);
+    }
+
+    bool metadataSent() const {
+        return m_metadataSent.load(std::memory_order_acquire);
+    }
+
+    /* NETPLAY v2.7: the session and tech_pvt of a running stream, handed to the websocket
+     * callbacks without a switch_core_session_locate (global hash + read lock) per message.
+     * The media thread binds them once the bug runs; cleanup unbinds and waits for the
+     * callbacks still holding them before tech_pvt is destroyed. */
+    void bindSession(switch_core_session_t* session, private_t* tech_pvt) {
+        m_session = session;
+        m_techPvt.store(tech_pvt, std::memory_order_seq_cst);
+    }
+
+    /* Never from a callback of this streamer: it would wait for itself */
+    void unbindSession() {
+        m_techPvt.store(nullptr, std::memory_order_seq_cst);
+        while (m_callbacks.load(std::memory_order_seq_cst)) {
+            std::this_thread::yield();
+        }
+    }
+
+    /* Pins the bound tech_pvt for one callback; null when unbound */
+    class BoundSession {
+    public:
+        explicit BoundSession(AudioStreamer* as) : m_as(as) {
+            /* seq_cst on both sides: either unbindSession sees this callback, or it sees null */
+            m_as->m_callbacks.fetch_add(1, std::memory_order_seq_cst);
+            tech_pvt = m_as->m_techPvt.load(std::memory_order_seq_cst);
+        }
+        ~BoundSession() {
+            m_as->m_callbacks.fetch_sub(1, std::memory_order_release);
+        }
+        BoundSession(const BoundSession&) = delete;
+        BoundSession& operator=(const BoundSession&) = delete;
+        private_t* tech_pvt;
+    private:
+        AudioStreamer* m_as;
+    };
+
+    /* NETPLAY v2.7: stopAudio and streamAudio are taken from a scan of the message
+     * (stream_json.h); only other messages, and ones the scan cannot vouch for, are
+     * parsed with cJSON. Whatever is not handled goes out as EVENT_JSON unchanged. */
+    void handleMessage(switch_core_session_t* session, private_t* tech_pvt, const char* message) {
+        m_rxTs = switch_micro_time_now();
+        if (m_sink) {
+            /* No playback authority: nothing a sink sends touches the call */
+            m_notify(session, EVENT_SINK_JSON, message);
+            if(!m_suppress_log)
+                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "sink %s response: %s\n", m_uri.c_str(), message);
+            return;
+        }
+        stream_json_msg_t scan;
+        switch_bool_t handled;
+        {
+            std::lock_guard<std::mutex> lock(m_playbackMutex);
+            if (stream_json_scan(message, strlen(message), &scan) &&
+                (stream_json_span_eq(&scan.type, "stopAudio") || stream_json_span_eq(&scan.type, "streamAudio"))) {
+                handled = processScanned(session, tech_pvt, scan);
+            } else {
+                handled = processMessage(session, tech_pvt, message);
             }
         }
+        if(handled != SWITCH_TRUE) {
+            m_notify(session, EVENT_JSON, message);
+        }
+        if(!m_suppress_log)
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "response: %s\n", message);
     }
 
     void eventCallback(notifyEvent_t event, const char* message) {
+        /* Hot path: downstream messages of a running stream. Connection events are rare and
+         * may close the bug (which unbinds), so they keep the session lookup */
+        if (event == MESSAGE) {
+            /* Held on the lookup path too: once unbindSession returns, a callback that is
+             * still running cannot be using the tech_pvt being destroyed */
+            BoundSession bound(this);
+            if (bound.tech_pvt) {
+                handleMessage(m_session, bound.tech_pvt, message);
+                return;
+            }
+            switch_core_session_t* psession = switch_core_session_locate(m_sessionId.c_str());
+            if (psession) {
+                handleMessage(psession, get_tech_pvt(psession), message);
+                switch_core_session_rwunlock(psession);
+            }
+            return;
+        }
         switch_core_session_t* psession = switch_core_session_locate(m_sessionId.c_str());
-        if(psession) {
+        if(psession && m_sink) {
+            sinkEvent(psession, event, message);
+            switch_core_session_rwunlock(psession);
+        } else if(psession) {
+            private_t* tech_pvt = get_tech_pvt(psession);
             switch (event) {
                 case CONNECT_SUCCESS:
+                    if (tech_pvt) stream_stat_inc(&tech_pvt->stats.connects);
+                    if (tech_pvt && linkId() > 1) stream_stat_inc(&tech_pvt->stats.reconnects);
                     send_initial_metadata(psession);
                     m_notify(psession, EVENT_CONNECT, message);
                     break;
                 case CONNECTION_DROPPED:
+                    if (tech_pvt) stream_stat_inc(&tech_pvt->stats.disconnects);
                     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(psession), SWITCH_LOG_INFO, "connection closed\n");
                     m_notify(psession, EVENT_DISCONNECT, message);
                     break;
+                case RECONNECTING:
+                    if (tech_pvt) stream_stat_inc(&tech_pvt->stats.reconnect_attempts);
+                    switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(psession), SWITCH_LOG_INFO, "connection lost, %s\n", message);
+                    m_notify(psession, EVENT_RECONNECTING, message);
+                    break;
                 case CONNECT_ERROR:
+                    if (tech_pvt) stream_stat_inc(&tech_pvt->stats.errors);
                     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(psession), SWITCH_LOG_INFO, "connection error\n");
                     m_notify(psession, EVENT_ERROR, message);
 
@@ -217,172 +496,674 @@ public:
 
                     break;
                 case MESSAGE:
-                    std::string msg(message);
-                    if(processMessage(psession, msg) != SWITCH_TRUE) {
-                        m_notify(psession, EVENT_JSON, msg.c_str());
-                    }
-                    if(!m_suppress_log)
-                        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(psession), SWITCH_LOG_DEBUG, "response: %s\n", msg.c_str());
+                    /* handled above */
                     break;
             }
             switch_core_session_rwunlock(psession);
         }
     }
 
-    switch_bool_t processMessage(switch_core_session_t* session, std::string& message) {
-        cJSON* json = cJSON_Parse(message.c_str());
+    /* NETPLAY v2.7: connection events of an add_sink destination. A failed sink only
+     * stops receiving capture; the call and the primary stream are not affected */
+    void sinkEvent(switch_core_session_t* session, notifyEvent_t event, const char* message) {
+        switch (event) {
+            case CONNECT_SUCCESS:
+                stream_stat_inc(&m_sinkStats.connects);
+                send_initial_metadata(session);
+                break;
+            case CONNECTION_DROPPED:
+                stream_stat_inc(&m_sinkStats.disconnects);
+                break;
+            case RECONNECTING:
+                stream_stat_inc(&m_sinkStats.reconnect_attempts);
+                break;
+            case CONNECT_ERROR:
+                stream_stat_inc(&m_sinkStats.errors);
+                break;
+            case MESSAGE:
+                break;
+        }
+        cJSON* root = cJSON_Parse(message);
+        if (!root) root = cJSON_CreateObject();
+        cJSON_AddStringToObject(root, "sink", m_uri.c_str());
+        char* json_str = cJSON_PrintUnformatted(root);
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "sink %s\n", json_str);
+        m_notify(session, EVENT_SINK, json_str);
+        cJSON_Delete(root);
+        switch_safe_free(json_str);
+    }
+
+    /* NETPLAY v2.7: playback resampler, created on first use and retuned when the
+     * backend changes rate. Websocket thread only.
+     */
+    SpeexResamplerState* playbackResampler(switch_core_session_t* session, private_t* tech_pvt, uint32_t rate) {
+        if (tech_pvt->playback_resampler && tech_pvt->playback_resampler_rate == rate) {
+            return tech_pvt->playback_resampler;
+        }
+        if (tech_pvt->playback_resampler) {
+            speex_resampler_set_rate(tech_pvt->playback_resampler, rate, tech_pvt->playback_rate);
+            speex_resampler_reset_mem(tech_pvt->playback_resampler);
+        } else {
+            int err = 0;
+            tech_pvt->playback_resampler = speex_resampler_init(1, rate, tech_pvt->playback_rate, SWITCH_RESAMPLE_QUALITY, &err);
+            if (0 != err || !tech_pvt->playback_resampler) {
+                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                    "(%s) [PLAYBACK] error initializing resampler %u -> %u: %s\n",
+                    m_sessionId.c_str(), rate, tech_pvt->playback_rate, speex_resampler_strerror(err));
+                tech_pvt->playback_resampler = nullptr;
+                return nullptr;
+            }
+        }
+        tech_pvt->playback_resampler_rate = rate;
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG,
+            "(%s) [PLAYBACK] resampling %u -> %u\n", m_sessionId.c_str(), rate, tech_pvt->playback_rate);
+        return tech_pvt->playback_resampler;
+    }
+
+    /* NETPLAY v2.7: bring an inbound chunk to the ring format (tech_pvt->playback_format
+     * at tech_pvt->playback_rate). Matching G.711 is passed through untouched; anything
+     * else is decoded, resampled and encoded once here, a whole chunk per call, on the
+     * websocket thread, so the media thread only copies frames out.
+     * Returns the data to buffer and updates len (0 on error); may point into the scratch buffers.
+     */
+    const uint8_t* convertPlayback(switch_core_session_t* session, private_t* tech_pvt, const uint8_t* data, size_t& len,
+                                   uint8_t codec, uint32_t rate) {
+        const uint8_t ring_format = tech_pvt->playback_format;
+        const bool resample = rate != tech_pvt->playback_rate;
+        if (codec == ring_format && !resample) {
+            return data;
+        }
+
+        /* 1. to L16 */
+        const int16_t* pcm;
+        size_t samples;
+        if (codec == STREAM_CODEC_L16) {
+            pcm = reinterpret_cast<const int16_t*>(data);
+            samples = len / 2;
+        } else {
+            samples = len;
+            m_pcmScratch.resize(samples);
+            if (codec == STREAM_CODEC_PCMU) {
+                g711_ulaw_decode(data, m_pcmScratch.data(), samples);
+            } else {
+                g711_alaw_decode(data, m_pcmScratch.data(), samples);
+            }
+            pcm = m_pcmScratch.data();
+        }
+
+        /* 2. to the ring rate */
+        if (resample) {
+            SpeexResamplerState* resampler = playbackResampler(session, tech_pvt, rate);
+            if (!resampler) {
+                len = 0;
+                return data;
+            }
+            spx_uint32_t in_len = (spx_uint32_t)samples;
+            spx_uint32_t out_len = (spx_uint32_t)((uint64_t)samples * tech_pvt->playback_rate / rate) + 64;
+            m_resampleScratch.resize(out_len);
+            speex_resampler_process_interleaved_int(resampler, pcm, &in_len, m_resampleScratch.data(), &out_len);
+            pcm = m_resampleScratch.data();
+            samples = out_len;
+        }
+
+        /* 3. to the ring format */
+        if (ring_format == STREAM_CODEC_L16) {
+            len = samples * 2;
+            return reinterpret_cast<const uint8_t*>(pcm);
+        }
+        m_playbackScratch.resize(samples);
+        if (ring_format == STREAM_CODEC_PCMU) {
+            g711_ulaw_encode(pcm, m_playbackScratch.data(), samples);
+        } else {
+            g711_alaw_encode(pcm, m_playbackScratch.data(), samples);
+        }
+        len = samples;
+        return m_playbackScratch.data();
+    }
+
+    /* NETPLAY v2.7: chunk lateness for adaptive playout, RFC 3550 style but one-sided: only
+     * arriving later than the audio already delivered counts. A gap of more than a second is
+     * a new turn rather than jitter. Websocket thread only. */
+    void trackArrival(private_t* tech_pvt, size_t len) {
+        const uint64_t now = m_rxTs ? (uint64_t)m_rxTs : (uint64_t)switch_micro_time_now();
+        const uint64_t prev = tech_pvt->playback_last_arrival_ts;
+        if (prev && now > prev && now - prev < 1000000) {
+            const uint64_t gap = now - prev;
+            const uint64_t late = gap > tech_pvt->playback_last_chunk_us ? gap - tech_pvt->playback_last_chunk_us : 0;
+            uint64_t jitter = tech_pvt->playback_jitter_us;
+            jitter = late > jitter ? jitter + (late - jitter) / 16 : jitter - (jitter - late) / 16;
+            __atomic_store_n(&tech_pvt->playback_jitter_us, jitter, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&tech_pvt->playback_last_arrival_ts, now, __ATOMIC_RELAXED);
+        tech_pvt->playback_last_chunk_us = (uint64_t)len * 1000 / tech_pvt->playback_bytes_per_ms;
+    }
+
+    /* NETPLAY v2.7: epoch check before any decoding. Stale chunks (cancelled by stopAudio)
+     * are dropped here; the first chunk of a new epoch leaves a mark at the ring position
+     * where its audio starts, so the media thread can tell what it played of each one. */
+    bool acceptEpoch(switch_core_session_t* session, private_t* tech_pvt, uint32_t epoch, size_t encoded_len) {
+        if (stream_epoch_before(epoch, tech_pvt->playback_epoch_floor)) {
+            stream_stat_inc(&tech_pvt->stats.stale_chunks);
+            stream_stat_add(&tech_pvt->stats.stale_bytes, encoded_len);
+            return false;
+        }
+        if (epoch != tech_pvt->playback_epoch) {
+            const uint32_t head = tech_pvt->playback_marks_head;
+            if (head - __atomic_load_n(&tech_pvt->playback_marks_tail, __ATOMIC_ACQUIRE) < PLAYBACK_EPOCH_MARKS) {
+                playback_epoch_mark_t* mark = &tech_pvt->playback_marks[head % PLAYBACK_EPOCH_MARKS];
+                mark->epoch = epoch;
+                mark->pos = playback_ring_write_pos(tech_pvt->playback_ring);
+                __atomic_store_n(&tech_pvt->playback_marks_head, head + 1, __ATOMIC_RELEASE);
+            } else {
+                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), stream_log_level(&tech_pvt->config, SWITCH_LOG_DEBUG),
+                    "(%s) [PLAYBACK] epoch marks full, epoch %u counted with the previous one\n",
+                    m_sessionId.c_str(), epoch);
+            }
+            tech_pvt->playback_epoch = epoch;
+        }
+        return true;
+    }
+
+    /* An epoch outside uint32_t, or not finite (e.g. 1e400), counts as no epoch */
+    static bool epochValue(double value, uint32_t& epoch) {
+        if (!(value >= 0 && value < 4294967296.0)) return false;
+        epoch = (uint32_t)value;
+        return true;
+    }
+
+    static bool jsonEpoch(cJSON* obj, uint32_t& epoch) {
+        cJSON* js = obj ? cJSON_GetObjectItem(obj, "epoch") : nullptr;
+        return js && js->type == cJSON_Number && epochValue(js->valuedouble, epoch);
+    }
+
+    /* NETPLAY: append a chunk to the playback buffer, discarding the oldest
+     * data when the buffer would overflow. Shared by the JSON and binary paths.
+     * codec is the chunk encoding (STREAM_CODEC_*), rate its sample rate.
+     */
+    void writePlayback(switch_core_session_t* session, private_t* tech_pvt, const uint8_t* data, size_t len,
+                       uint8_t codec, uint32_t rate) {
+        if (codec == STREAM_CODEC_L16) {
+            len &= ~(size_t)1;
+        }
+        if (len == 0) {
+            return;
+        }
+        if (tech_pvt->first_audio_ts == 0) {
+            tech_pvt->first_audio_ts = switch_micro_time_now();
+        }
+        data = convertPlayback(session, tech_pvt, data, len, codec, rate);
+        if (len == 0) {
+            return;
+        }
+
+        if (tech_pvt->playback_adaptive) {
+            trackArrival(tech_pvt, len);
+        }
+
+        /* Drop-oldest on overrun happens inside the ring, without blocking the media thread */
+        const switch_size_t buffer_capacity = playbackCapacity(tech_pvt);
+        switch_size_t dropped = 0;
+        playback_ring_write(tech_pvt->playback_ring, data, len, buffer_capacity, &dropped);
+        playbackWritten(session, tech_pvt, len, buffer_capacity, dropped);
+    }
+
+    static switch_size_t playbackCapacity(const private_t* tech_pvt) {
+        return tech_pvt->playback_buflen ? tech_pvt->playback_buflen : 32000;
+    }
+
+    /* Accounting and logs of len bytes just written to the playback ring */
+    void playbackWritten(switch_core_session_t* session, private_t* tech_pvt, size_t len,
+                         switch_size_t buffer_capacity, switch_size_t dropped) {
+        switch_size_t buffered = playback_ring_inuse(tech_pvt->playback_ring);
+        stream_stat_inc(&tech_pvt->stats.playback_chunks);
+        stream_stat_add(&tech_pvt->stats.playback_bytes, len);
+        uint32_t suppressed;
+        if (dropped > 0) {
+            stream_stat_inc(&tech_pvt->stats.playback_overruns);
+            stream_stat_add(&tech_pvt->stats.playback_dropped_bytes, dropped);
+            /* A backend pushing faster than real time overruns on every chunk */
+            if (stream_log_limit(&tech_pvt->log_overrun, &suppressed)) {
+                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
+                    "(%s) [BUFFER] overrun: discarded %zuB (capacity=%zuB, payload=%zuB, %u not logged)\n",
+                    m_sessionId.c_str(), dropped, buffer_capacity, len, suppressed);
+            }
+        }
+        stream_stat_max(&tech_pvt->stats.playback_max_buffered, buffered);
+        if (tech_pvt->latency && m_rxTs) {
+            stream_hist_record(&tech_pvt->latency->receive_to_buffer, (uint64_t)(switch_micro_time_now() - m_rxTs));
+        }
+        
+        /* Log every 50 chunks of this call or on significant events */
+        if (stream_stat_get(&tech_pvt->stats.playback_chunks) % 50 == 1 || buffered < 1000) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session),
+                stream_log_level(&tech_pvt->config, SWITCH_LOG_DEBUG),
+                "(%s) [BUFFER] +%zuB (total=%zuB, active=%d)\n",
+                m_sessionId.c_str(), len, buffered, tech_pvt->playback_active);
+        }
+    }
+
+    /* NETPLAY v2.7: binary playback frame (see stream_protocol.h).
+     * The payload is written straight into the playback buffer, no JSON or base64.
+     */
+    void processBinary(switch_core_session_t* session, private_t* tech_pvt, const uint8_t* data, size_t len) {
+        std::lock_guard<std::mutex> lock(m_playbackMutex);
+        stream_frame_header_t hdr;
+        if (stream_frame_header_parse(data, len, &hdr) != 0) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
+                "(%s) [BINARY] invalid frame (%zuB), ignoring\n", m_sessionId.c_str(), len);
+            return;
+        }
+        if (hdr.type != STREAM_FRAME_TYPE_AUDIO) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG,
+                "(%s) [BINARY] unknown frame type %u, ignoring\n", m_sessionId.c_str(), hdr.type);
+            return;
+        }
+
+        if (!tech_pvt || !tech_pvt->playback_ring) {
+            return;
+        }
+
+        const uint32_t rate = hdr.sample_rate ? hdr.sample_rate : tech_pvt->playback_in_rate;
+        if (hdr.codec > STREAM_CODEC_PCMA || !stream_playback_rate_valid(hdr.codec, rate)) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
+                "(%s) [BINARY] unsupported payload codec=%u rate=%u, dropping\n",
+                m_sessionId.c_str(), hdr.codec, rate);
+            return;
+        }
+
+        uint32_t suppressed;
+        if (tech_pvt->playback_seq_valid && hdr.seq != tech_pvt->playback_seq + 1) {
+            tech_pvt->playback_seq_gaps++;
+            if (stream_log_limit(&tech_pvt->log_seq_gap, &suppressed)) {
+                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), stream_log_level(&tech_pvt->config, SWITCH_LOG_DEBUG),
+                    "(%s) [BINARY] sequence gap: expected %u, got %u (%u gaps so far, %u not logged)\n",
+                    m_sessionId.c_str(), tech_pvt->playback_seq + 1, hdr.seq, tech_pvt->playback_seq_gaps, suppressed);
+            }
+        }
+        tech_pvt->playback_seq = hdr.seq;
+        tech_pvt->playback_seq_valid = 1;
+
+        if ((hdr.flags & STREAM_FRAME_FLAG_EPOCH) && !acceptEpoch(session, tech_pvt, hdr.epoch, len - hdr.header_len)) {
+            return;
+        }
+        writePlayback(session, tech_pvt, data + hdr.header_len, len - hdr.header_len, hdr.codec, rate);
+    }
+
+    private_t* get_tech_pvt(switch_core_session_t* session) {
+        switch_media_bug_t* bug = get_media_bug(session);
+        return bug ? (private_t*)switch_core_media_bug_get_user_data(bug) : nullptr;
+    }
+
+    void binaryCallback(const uint8_t* data, size_t len) {
+        BoundSession bound(this);
+        if (bound.tech_pvt) {
+            m_rxTs = switch_micro_time_now();
+            processBinary(m_session, bound.tech_pvt, data, len);
+            return;
+        }
+        switch_core_session_t* psession = switch_core_session_locate(m_sessionId.c_str());
+        if(psession) {
+            m_rxTs = switch_micro_time_now();
+            processBinary(psession, get_tech_pvt(psession), data, len);
+            switch_core_session_rwunlock(psession);
+        }
+    }
+
+    /* barge-in: cancel the epoch and hand the cut to the media thread, which fades
+     * out, discards everything written so far and re-enters warmup */
+    void stopAudio(switch_core_session_t* session, private_t* tech_pvt, bool hasEpoch, uint32_t epoch) {
+        if (!tech_pvt || !tech_pvt->playback_ring) {
+            return;
+        }
+        const uint32_t cancelled = hasEpoch ? epoch : tech_pvt->playback_epoch;
+        if (!stream_epoch_before(cancelled + 1, tech_pvt->playback_epoch_floor)) {
+            tech_pvt->playback_epoch_floor = cancelled + 1;
+        }
+        __atomic_store_n(&tech_pvt->barge_in_ts, (uint64_t)m_rxTs, __ATOMIC_RELAXED);
+        __atomic_store_n(&tech_pvt->playback_stop_pos, playback_ring_write_pos(tech_pvt->playback_ring), __ATOMIC_RELAXED);
+        __atomic_store_n(&tech_pvt->playback_stop_seq, tech_pvt->playback_stop_seq + 1, __ATOMIC_RELEASE);
+        stream_stat_inc(&tech_pvt->stats.barge_ins);
+        if (tech_pvt->playback_resampler) {
+            speex_resampler_reset_mem(tech_pvt->playback_resampler);
+        }
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
+            "(%s) [PLAYBACK] stopped (barge-in, epoch %u)\n", m_sessionId.c_str(), cancelled);
+    }
+
+    /* Decode base64 into the playback ring's free region and publish it. Returns the bytes
+     * written, STREAM_BASE64_INVALID, or 0 when the payload needs the scratch path (odd L16
+     * length, empty, larger than the buffer, or not fitting without dropping buffered audio:
+     * the scratch path validates the payload before anything is dropped for it) */
+    long decodeIntoRing(switch_core_session_t* session, private_t* tech_pvt, const char* audio, size_t audioLen,
+                        uint8_t codec) {
+        const long len = stream_base64_decoded_len(audio, audioLen);
+        const switch_size_t buffer_capacity = playbackCapacity(tech_pvt);
+        if (len < 0) return STREAM_BASE64_INVALID;
+        if (len == 0 || (codec == STREAM_CODEC_L16 && (len & 1)) || (switch_size_t)len > buffer_capacity) return 0;
+        /* Only the media thread frees room meanwhile, so this reserve drops nothing */
+        if (playback_ring_inuse(tech_pvt->playback_ring) + (switch_size_t)len > buffer_capacity) return 0;
+
+        playback_ring_span_t span;
+        if (!playback_ring_reserve(tech_pvt->playback_ring, (switch_size_t)len, buffer_capacity, &span)) return 0;
+        const long decoded = stream_base64_decode_split(audio, audioLen, span.first, span.first_len,
+                                                        span.second, span.second_len);
+        if (decoded != len) {
+            if (span.dropped) {
+                stream_stat_inc(&tech_pvt->stats.playback_overruns);
+                stream_stat_add(&tech_pvt->stats.playback_dropped_bytes, span.dropped);
+            }
+            return decoded < 0 ? STREAM_BASE64_INVALID : 0;
+        }
+
+        if (tech_pvt->first_audio_ts == 0) {
+            tech_pvt->first_audio_ts = switch_micro_time_now();
+        }
+        if (tech_pvt->playback_adaptive) {
+            trackArrival(tech_pvt, (size_t)len);
+        }
+        switch_size_t dropped = 0;
+        playback_ring_commit(tech_pvt->playback_ring, &span, (switch_size_t)len, buffer_capacity, &dropped);
+        playbackWritten(session, tech_pvt, (size_t)len, buffer_capacity, dropped);
+        return len;
+    }
+
+    /* streamAudio: decode audio (base64, audioLen characters) and write it to the playback
+     * buffer. rate is 0 when the message has none. */
+    switch_bool_t streamAudio(switch_core_session_t* session, private_t* tech_pvt, bool hasData, const char* codecName,
+                              int rate, bool hasEpoch, uint32_t epoch, const char* audio, size_t audioLen) {
+        if (!hasData || !tech_pvt || !tech_pvt->playback_ring) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                "(%s) streamAudio - missing data or buffer\n", m_sessionId.c_str());
+            return SWITCH_FALSE;
+        }
+        const int codec = stream_codec_from_name(codecName);
+        const uint32_t inRate = rate > 0 ? (uint32_t)rate : tech_pvt->playback_in_rate;
+
+        if (hasEpoch && !acceptEpoch(session, tech_pvt, epoch, audio ? audioLen : 0)) {
+            /* Cancelled response still in flight: not worth a base64 decode */
+            return SWITCH_TRUE;
+        }
+        if (codec >= 0 && !stream_playback_rate_valid(codec, inRate)) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
+                "(%s) streamAudio - unsupported %s sample rate %u, dropping\n",
+                m_sessionId.c_str(), stream_codec_name(codec), inRate);
+            return SWITCH_FALSE;
+        }
+        if (codec < 0 || !audio) {
+            return SWITCH_FALSE;
+        }
+
+        /* NETPLAY v2.7: already in the ring format and rate, decode straight into the ring */
+        if ((uint8_t)codec == tech_pvt->playback_format && inRate == tech_pvt->playback_rate) {
+            const long direct = decodeIntoRing(session, tech_pvt, audio, audioLen, (uint8_t)codec);
+            if (direct == STREAM_BASE64_INVALID) {
+                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                    "(%s) base64 decode error: invalid base64 audioData\n", m_sessionId.c_str());
+                return SWITCH_FALSE;
+            }
+            if (direct > 0) return SWITCH_TRUE;
+        }
+
+        /* Scratch kept across messages: no allocation once it fits the largest chunk */
+        const size_t room = stream_base64_decoded_max(audioLen);
+        if (m_audioScratch.size() < room) m_audioScratch.resize(room);
+        const long decoded = stream_base64_decode(audio, audioLen, m_audioScratch.data());
+        if (decoded < 0) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                "(%s) base64 decode error: invalid base64 audioData\n", m_sessionId.c_str());
+            return SWITCH_FALSE;
+        }
+        size_t len = (size_t)decoded;
+        if (len == 0) {
+            return SWITCH_FALSE;
+        }
+        if (codec == STREAM_CODEC_L16 && len % 2 != 0) {
+            len--;
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session),
+                stream_log_level(&tech_pvt->config, SWITCH_LOG_DEBUG),
+                "(%s) [BUFFER] ajuste: payload com tamanho ímpar, truncando 1B\n",
+                m_sessionId.c_str());
+        }
+
+        writePlayback(session, tech_pvt, m_audioScratch.data(), len, (uint8_t)codec, inRate);
+        return SWITCH_TRUE;
+    }
+
+    /* NETPLAY v2.7: playCached - queue a clip of the shared cache (playback_cache.h) behind
+     * the audio already buffered; the media thread plays it straight from the cache.
+     * A refused clip goes out as EVENT_PLAY (and to the backend), which can then stream
+     * the audio itself. Returns whether the clip was queued; m_playbackMutex held. */
+    bool playCached(switch_core_session_t* session, private_t* tech_pvt, const char* id, const char* hash,
+                    bool hasEpoch, uint32_t epoch) {
+        if (!tech_pvt || !tech_pvt->playback_ring || !id) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                "(%s) playCached - missing id or buffer\n", m_sessionId.c_str());
+            return false;
+        }
+        if (hasEpoch && !acceptEpoch(session, tech_pvt, epoch, 0)) {
+            return false;
+        }
+
+        const uint32_t head = tech_pvt->playback_cues_head;
+        playback_cache_status_t status = PLAYBACK_CACHE_OK;
+        playback_clip_t* clip = nullptr;
+        const char* error = nullptr;
+        if (head - __atomic_load_n(&tech_pvt->playback_cues_tail, __ATOMIC_ACQUIRE) >= PLAYBACK_CUES) {
+            error = "queue full";
+        } else if (!(clip = playback_cache_acquire(id, hash, tech_pvt->playback_format, tech_pvt->playback_rate, &status))) {
+            error = playback_cache_status_name(status);
+        }
+        if (error) {
+            stream_stat_inc(&tech_pvt->stats.cached_errors);
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
+                "(%s) [PLAYBACK] cached clip %s not played: %s\n", m_sessionId.c_str(), id, error);
+            cJSON* root = cJSON_CreateObject();
+            cJSON_AddStringToObject(root, "type", "playCached");
+            cJSON_AddStringToObject(root, "id", id);
+            cJSON_AddNumberToObject(root, "epoch", hasEpoch ? epoch : tech_pvt->playback_epoch);
+            cJSON_AddStringToObject(root, "status", "error");
+            cJSON_AddStringToObject(root, "error", error);
+            char* json_str = cJSON_PrintUnformatted(root);
+            m_notify(session, EVENT_PLAY, json_str);
+            if (json_str) writeText(json_str);
+            cJSON_Delete(root);
+            switch_safe_free(json_str);
+            return false;
+        }
+
+        playback_cue_t* cue = &tech_pvt->playback_cues[head % PLAYBACK_CUES];
+        cue->clip = clip;
+        cue->pos = playback_ring_write_pos(tech_pvt->playback_ring);
+        cue->stop_seq = tech_pvt->playback_stop_seq;
+        cue->epoch = tech_pvt->playback_epoch;
+        if (tech_pvt->first_audio_ts == 0) {
+            tech_pvt->first_audio_ts = switch_micro_time_now();
+        }
+        __atomic_store_n(&tech_pvt->playback_cues_head, head + 1, __ATOMIC_RELEASE);
+        stream_stat_inc(&tech_pvt->stats.cached_plays);
+        stream_stat_add(&tech_pvt->stats.cached_bytes, playback_clip_len(clip));
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), stream_log_level(&tech_pvt->config, SWITCH_LOG_INFO),
+            "(%s) [PLAYBACK] cached clip %s queued (%zuB, epoch %u)\n", m_sessionId.c_str(), id,
+            playback_clip_len(clip), cue->epoch);
+        return true;
+    }
+
+    /* uuid_audio_stream play_cached: an API thread, serialized with the websocket callbacks */
+    bool playCachedCommand(switch_core_session_t* session, private_t* tech_pvt, const char* id, const char* hash) {
+        std::lock_guard<std::mutex> lock(m_playbackMutex);
+        return playCached(session, tech_pvt, id, hash, false, 0);
+    }
+
+    /* Same conversions as the cJSON path: a number's valueint, an epoch through epochValue */
+    static int jsonInt(double value) {
+        if (value >= INT_MAX) return INT_MAX;
+        if (value <= (double)INT_MIN) return INT_MIN;
+        return (int)value;
+    }
+
+    static bool scannedEpoch(int has, double value, uint32_t& epoch) {
+        return has && epochValue(value, epoch);
+    }
+
+    switch_bool_t processScanned(switch_core_session_t* session, private_t* tech_pvt, const stream_json_msg_t& scan) {
+        uint32_t epoch = 0;
+        if (stream_json_span_eq(&scan.type, "stopAudio")) {
+            bool hasEpoch = scannedEpoch(scan.has_epoch, scan.epoch, epoch) ||
+                            (scan.has_data && scannedEpoch(scan.has_data_epoch, scan.data_epoch, epoch));
+            stopAudio(session, tech_pvt, hasEpoch, epoch);
+            return SWITCH_TRUE;
+        }
+
+        /* Codec names are short; a longer one is unknown anyway */
+        char codecName[16];
+        const char* codec = nullptr;
+        if (scan.audio_data_type.ptr && scan.audio_data_type.len < sizeof(codecName)) {
+            memcpy(codecName, scan.audio_data_type.ptr, scan.audio_data_type.len);
+            codecName[scan.audio_data_type.len] = '\0';
+            codec = codecName;
+        } else if (scan.audio_data_type.ptr) {
+            codec = "";
+        }
+        const int rate = scan.has_sample_rate ? jsonInt(scan.sample_rate) : 0;
+        const bool hasEpoch = scannedEpoch(scan.has_data_epoch, scan.data_epoch, epoch);
+        return streamAudio(session, tech_pvt, scan.has_data != 0, codec, rate, hasEpoch, epoch,
+                           scan.audio_data.ptr, scan.audio_data.len);
+    }
+
+    /* Full parse: messages other than stopAudio/streamAudio, or ones stream_json_scan
+     * turned down. tech_pvt is null while no stream is running (prepared connection). */
+    switch_bool_t processMessage(switch_core_session_t* session, private_t* tech_pvt, const char* message) {
+        cJSON* json = cJSON_Parse(message);
         switch_bool_t status = SWITCH_FALSE;
         if (!json) {
             return status;
         }
         
-        /* Get tech_pvt for playback buffer access 
-         * The channel stores the media bug, not tech_pvt directly.
-         * We need to get the bug first, then extract user_data.
-         */
-        switch_channel_t *channel = switch_core_session_get_channel(session);
-        switch_media_bug_t *bug = (switch_media_bug_t *)switch_channel_get_private(channel, MY_BUG_NAME);
-        private_t *tech_pvt = NULL;
-        if (bug) {
-            tech_pvt = (private_t *)switch_core_media_bug_get_user_data(bug);
-        }
-        
         const char* jsType = cJSON_GetObjectCstr(json, "type");
         
         // NETPLAY: stopAudio - clear playback buffer (barge-in)
         if(jsType && strcmp(jsType, "stopAudio") == 0) {
-            if (tech_pvt && tech_pvt->playback_buffer) {
-                switch_mutex_lock(tech_pvt->playback_mutex);
-                switch_buffer_zero(tech_pvt->playback_buffer);
-                tech_pvt->playback_active = 0;
-                switch_mutex_unlock(tech_pvt->playback_mutex);
-                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
-                    "(%s) [PLAYBACK] stopped (barge-in)\n", m_sessionId.c_str());
-            }
+            uint32_t epoch = 0;
+            const bool hasEpoch = jsonEpoch(json, epoch) || jsonEpoch(cJSON_GetObjectItem(json, "data"), epoch);
+            stopAudio(session, tech_pvt, hasEpoch, epoch);
             status = SWITCH_TRUE;
         }
         // NETPLAY v2.0: streamAudio - write directly to playback buffer (true streaming)
         else if(jsType && strcmp(jsType, "streamAudio") == 0) {
             cJSON* jsonData = cJSON_GetObjectItem(json, "data");
-            if(jsonData && tech_pvt && tech_pvt->playback_buffer) {
-                cJSON* jsonAudio = cJSON_DetachItemFromObject(jsonData, "audioData");
-                const char* jsAudioDataType = cJSON_GetObjectCstr(jsonData, "audioDataType");
-                
-                if (jsAudioDataType && strcmp(jsAudioDataType, "raw") == 0 && jsonAudio && jsonAudio->valuestring) {
-                    std::string rawAudio;
-                    try {
-                        rawAudio = base64_decode(jsonAudio->valuestring);
-                    } catch (const std::exception& e) {
-                        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, 
-                            "(%s) base64 decode error: %s\n", m_sessionId.c_str(), e.what());
-                        cJSON_Delete(jsonAudio); 
-                        cJSON_Delete(json);
-                        return status;
-                    }
-                    
-                    if (rawAudio.size() < 2) {
-                        cJSON_Delete(jsonAudio);
-                        cJSON_Delete(json);
-                        return status;
-                    }
-                    if (rawAudio.size() % 2 != 0) {
-                        rawAudio.pop_back();
-                        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session),
-                            get_stream_log_level(session, SWITCH_LOG_DEBUG),
-                            "(%s) [BUFFER] ajuste: payload com tamanho ímpar, truncando 1B\n",
-                            m_sessionId.c_str());
-                    }
-
-                    switch_mutex_lock(tech_pvt->playback_mutex);
-                    if (tech_pvt->first_audio_ts == 0) {
-                        tech_pvt->first_audio_ts = switch_micro_time_now();
-                    }
-                    
-                    /* Check for buffer overrun - if near full, discard oldest data */
-                    const switch_size_t buffer_capacity = tech_pvt->playback_buflen ? tech_pvt->playback_buflen : 32000;
-                    const switch_size_t high_water_mark = buffer_capacity > rawAudio.size()
-                        ? (buffer_capacity - rawAudio.size())
-                        : 0;
-                    switch_size_t current_size = switch_buffer_inuse(tech_pvt->playback_buffer);
-                    
-                    if (rawAudio.size() > buffer_capacity) {
-                        switch_buffer_zero(tech_pvt->playback_buffer);
-                        const size_t offset = rawAudio.size() - buffer_capacity;
-                        switch_buffer_write(tech_pvt->playback_buffer, rawAudio.data() + offset, buffer_capacity);
-                        tech_pvt->buffer_overruns++;
-                        current_size = switch_buffer_inuse(tech_pvt->playback_buffer);
-                        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
-                            "(%s) [BUFFER] overrun: payload %zuB > buffer %zuB, truncating\n",
-                            m_sessionId.c_str(), rawAudio.size(), buffer_capacity);
-                    } else if (current_size > high_water_mark) {
-                        /* Buffer nearly full - discard oldest data to make room */
-                        switch_size_t to_discard = current_size - high_water_mark + rawAudio.size();
-                        char discard_buf[1024];
-                        while (to_discard > 0) {
-                            switch_size_t chunk = (to_discard > sizeof(discard_buf)) ? sizeof(discard_buf) : to_discard;
-                            switch_buffer_read(tech_pvt->playback_buffer, discard_buf, chunk);
-                            to_discard -= chunk;
-                        }
-                        tech_pvt->buffer_overruns++;
-                        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
-                            "(%s) [BUFFER] overrun: discarded %zuB (capacity=%zuB, used=%zuB)\n",
-                            m_sessionId.c_str(), (size_t)(current_size - high_water_mark + rawAudio.size()),
-                            buffer_capacity, current_size);
-                    }
-                    
-                    /* Write new audio to buffer */
-                    if (rawAudio.size() <= buffer_capacity) {
-                        switch_buffer_write(tech_pvt->playback_buffer, rawAudio.data(), rawAudio.size());
-                    }
-                    
-                    switch_size_t buffered = switch_buffer_inuse(tech_pvt->playback_buffer);
-                    if (buffered > tech_pvt->buffer_max_used) {
-                        tech_pvt->buffer_max_used = buffered;
-                    }
-                    switch_mutex_unlock(tech_pvt->playback_mutex);
-                    
-                    /* Log every 50 chunks or on significant events */
-                    static int chunk_count = 0;
-                    if (++chunk_count % 50 == 1 || buffered < 1000) {
-                        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session),
-                            get_stream_log_level(session, SWITCH_LOG_DEBUG),
-                            "(%s) [BUFFER] +%zuB (total=%zuB, active=%d)\n",
-                            m_sessionId.c_str(), rawAudio.size(), buffered, tech_pvt->playback_active);
-                    }
-                    
-                    status = SWITCH_TRUE;
-                }
-                
-                if (jsonAudio)
-                    cJSON_Delete(jsonAudio);
-            } else {
-                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, 
-                    "(%s) streamAudio - missing data or buffer\n", m_sessionId.c_str());
-            }
+            cJSON* jsonAudio = jsonData ? cJSON_GetObjectItem(jsonData, "audioData") : nullptr;
+            cJSON* jsRate = jsonData ? cJSON_GetObjectItem(jsonData, "sampleRate") : nullptr;
+            const char* audio = jsonAudio ? jsonAudio->valuestring : nullptr;
+            uint32_t epoch = 0;
+            const bool hasEpoch = jsonEpoch(jsonData, epoch);
+            status = streamAudio(session, tech_pvt, jsonData != nullptr,
+                                 jsonData ? cJSON_GetObjectCstr(jsonData, "audioDataType") : nullptr,
+                                 jsRate && jsRate->type == cJSON_Number ? jsRate->valueint : 0,
+                                 hasEpoch, epoch, audio, audio ? strlen(audio) : 0);
+        }
+        // NETPLAY v2.7: playCached - a clip of the shared prompt cache
+        else if(jsType && strcmp(jsType, "playCached") == 0) {
+            cJSON* jsonData = cJSON_GetObjectItem(json, "data");
+            uint32_t epoch = 0;
+            const bool hasEpoch = jsonEpoch(jsonData, epoch);
+            playCached(session, tech_pvt, jsonData ? cJSON_GetObjectCstr(jsonData, "id") : nullptr,
+                       jsonData ? cJSON_GetObjectCstr(jsonData, "hash") : nullptr, hasEpoch, epoch);
+            status = SWITCH_TRUE;
         }
         cJSON_Delete(json);
         return status;
     }
 
-    ~AudioStreamer()= default;
+    ~AudioStreamer() override {
+        stopReconnect();
+        closeSendQueue(0);
+        if (auto link = std::atomic_load(&m_link)) ws_pool::detach(link->pool);
+    }
 
     void disconnect() {
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "disconnecting...\n");
-        client.disconnect();
+        stopReconnect();
+        closeLink(std::atomic_load(&m_link));
+    }
+
+    /* CloseTarget: on a closer thread, after finish() */
+    void closeNow() override {
+        closeSendQueue(SEND_QUEUE_CLOSE_MS);
+        disconnect();
+    }
+
+    static void closeLink(const std::shared_ptr<Link>& link) {
+        if (!link) return;
+        if (link->client) link->client->disconnect();
+        ws_pool::detach(link->pool);
     }
 
     bool isConnected() {
-        return client.isConnected();
+        auto link = std::atomic_load(&m_link);
+        if (!link) return false;
+        if (m_pooled) return ws_pool::isConnected(link->pool);
+        return link->client->isConnected();
     }
 
-    void writeBinary(uint8_t* buffer, size_t len) {
+    /* NETPLAY v2.7: with an outbound queue (STREAM_SEND_QUEUE_MS) messages are only queued
+     * here and sent by a sender thread, see send_queue.h; push reports what the queue did */
+    void writeBinary(uint8_t* buffer, size_t len, SendQueuePush* push = nullptr) {
         if(!this->isConnected()) return;
-        client.sendBinary(buffer, len);
+        if (m_sendQueue) {
+            SendQueuePush ignored;
+            m_sendQueue->pushBinary(buffer, len, push ? *push : ignored);
+            return;
+        }
+        sendQueuedBinary(buffer, len);
+        if (push) push->queued = true;
     }
 
     void writeText(const char* text) {
         if(!this->isConnected()) return;
-        client.sendMessage(text, strlen(text));
+        if (m_sendQueue) {
+            m_sendQueue->pushText(text);
+            return;
+        }
+        sendQueuedText(text);
+    }
+
+    void sendQueuedBinary(const uint8_t* buffer, size_t len) override {
+        auto link = std::atomic_load(&m_link);
+        if (!link) return;
+        if (m_pooled) {
+            ws_pool::sendBinary(link->pool, buffer, len);
+            return;
+        }
+        if (!link->client->isConnected()) return;
+        link->client->sendBinary(buffer, len);
+    }
+
+    void sendQueuedText(const char* text) override {
+        auto link = std::atomic_load(&m_link);
+        if (!link) return;
+        if (m_pooled) {
+            ws_pool::sendText(link->pool, text);
+            return;
+        }
+        if (!link->client->isConnected()) return;
+        link->client->sendMessage(text, strlen(text));
+    }
+
+    void enableSendQueue(size_t limit, size_t high_water, SendQueuePolicy policy) {
+        if (!m_sendQueue) m_sendQueue.reset(new SendQueue(this, limit, high_water, policy));
+    }
+
+    /* Before disconnect: give queued messages drain_ms to go out */
+    void closeSendQueue(uint32_t drain_ms) {
+        if (m_sendQueue) m_sendQueue->close(drain_ms);
+    }
+
+    size_t sendQueueBytes() {
+        return m_sendQueue ? m_sendQueue->queuedBytes() : 0;
+    }
+
+    const SendQueue* sendQueue() const {
+        return m_sendQueue.get();
     }
 
     void deleteFiles() {
@@ -396,55 +1177,171 @@ public:
     void markCleanedUp() {
         m_cleanedUp.store(true, std::memory_order_release);
         // clear callbacks to prevent dangling calls
-        client.setMessageCallback({});
+        auto link = std::atomic_load(&m_link);
+        if (link && link->client) link->client->setMessageCallback({});
     }
 
     bool isCleanedUp() const {
         return m_cleanedUp.load(std::memory_order_acquire);
     }
 
+    /* NETPLAY v2.7: prepared connections (uuid_audio_stream prepare) */
+    const std::string& uri() const {
+        return m_uri;
+    }
+
+    bool binaryPlayback() const {
+        return m_binaryPlayback;
+    }
+
+    bool hasFailed() const {
+        return m_failed.load(std::memory_order_acquire);
+    }
+
+    bool isPooled() const {
+        return m_pooled;
+    }
+
+    /* NETPLAY v2.7: audio queued but not yet on the wire. Only the pool batches
+     * outside the call; a direct client hands messages to libwsc immediately. */
+    size_t queuedBytes() {
+        auto link = std::atomic_load(&m_link);
+        return m_pooled && link ? ws_pool::queuedBytes(link->pool) : 0;
+    }
+
 private:
+
     std::string m_sessionId;
+    std::string m_uri;
     responseHandler_t m_notify;
-    WebSocketClient client;
-    bool m_suppress_log;
+    WsPoolOptions m_opts;                     /* connection settings, for every reconnect */
+    std::shared_ptr<Link> m_link;             /* std::atomic_load/store: swapped by reconnects */
+    std::atomic<uint32_t> m_linkId{0};        /* id of the newest connection, 1 for the first */
+    std::atomic<bool> m_suppress_log;         /* NETPLAY v2.7: follows uuid_audio_stream refresh */
     const char* m_extra_headers;
     int m_playFile;
     std::unordered_set<std::string> m_Files;
+    std::mutex m_playbackMutex;               /* NETPLAY v2.7: playback input producers, see playCachedCommand */
     std::atomic<bool> m_cleanedUp{false};
+    std::atomic<bool> m_failed{false};        /* error or close seen, the connection is not coming back */
+    std::atomic<bool> m_metadataSent{false};
+    switch_time_t m_rxTs = 0;                 /* receive time of the message being handled, websocket thread */
+    bool m_binaryPlayback;
+    bool m_pooled;
+    /* NETPLAY v2.7: add_sink destination, see makeSink */
+    bool m_sink = false;
+    std::string m_sinkMetadata;
+    stream_sink_stats_t m_sinkStats{};
+    /* NETPLAY v2.7: reconnect (STREAM_NO_RECONNECT, STREAM_RECONNECT_*) */
+    bool m_noReconnect;
+    std::string m_resumeToken;
+    uint32_t m_backoffMs = STREAM_RECONNECT_BACKOFF_MS;
+    uint32_t m_backoffMaxMs = STREAM_RECONNECT_BACKOFF_MAX_MS;
+    switch_time_t m_reconnectTimeoutUs = (switch_time_t)STREAM_RECONNECT_TIMEOUT_MS * 1000;
+    std::mutex m_reconnectMutex;              /* the fields below, and scheduling vs. stopReconnect */
+    bool m_reconnectClosed = false;
+    uint32_t m_reconnectAttempt = 0;
+    switch_time_t m_outageStart = 0;          /* first failure of the current outage, 0 = connected */
+    /* convertPlayback scratch, websocket thread only */
+    std::vector<int16_t> m_pcmScratch;
+    std::vector<spx_int16_t> m_resampleScratch;
+    std::vector<uint8_t> m_playbackScratch;
+    std::vector<uint8_t> m_audioScratch;      /* decoded streamAudio payload, websocket thread only */
+    std::unique_ptr<SendQueue> m_sendQueue;   /* NETPLAY v2.7: STREAM_SEND_QUEUE_MS, media thread pushes */
+    switch_core_session_t* m_session = nullptr;     /* valid while m_techPvt is set, see bindSession */
+    std::atomic<private_t*> m_techPvt{nullptr};
+    std::atomic<uint32_t> m_callbacks{0};     /* callbacks inside a BoundSession */
 };
 
 
 namespace {
 
+    /* NETPLAY v2.7: audio_stream.conf, set once by the module load before any call */
+    stream_module_config_t g_module_config;
+
+    /* NETPLAY v2.7: capture fan-out (add_sink). The one media bug reads and resamples each
+     * frame once and encodes it once per format in use; every sink batches the encoded
+     * frames into its own buffer and has its own streamer, outbound queue and counters. */
+    struct CaptureSink {
+        AudioStreamer* streamer;
+        int audio_format;              /* AUDIO_FORMAT_L16, _PCMU or _PCMA */
+        std::vector<uint8_t> buf;      /* batch plus one max frame, media thread */
+        size_t len = 0;
+        size_t batch = 0;
+    };
+
+    struct CaptureSinks {
+        std::mutex mutex;              /* list changes vs. stats; changes also hold tech_pvt->mutex,
+                                        * which is what the media thread reads the list under */
+        std::vector<CaptureSink*> list;
+        std::vector<uint8_t> ulaw;     /* the frame in G.711, encoded at most once per frame */
+        std::vector<uint8_t> alaw;
+    };
+
+    /* One captured frame, L16 at the stream rate, and its encodings made so far */
+    struct SinkFrame {
+        const int16_t* pcm;
+        size_t samples;                /* all channels */
+        const uint8_t* enc[AUDIO_FORMAT_PCMA + 1];
+    };
+
+    /* Connection settings come from channel variables, read when the websocket is opened:
+     * at start, or earlier by uuid_audio_stream prepare */
+    AudioStreamer* create_streamer(switch_core_session_t *session, const char *wsUri, responseHandler_t responseHandler,
+                                   const stream_config_t *cfg, bool sink = false, const char *sink_metadata = nullptr) {
+        /* NETPLAY v2.7: pool-default in audio_stream.conf, STREAM_POOL=false still opts out */
+        const bool pooled = cfg->pool != STREAM_CONFIG_UNSET ? cfg->pool != 0 : g_module_config.pool_default != 0;
+        int pool_max_streams = g_module_config.pool_max_streams > 0 ? g_module_config.pool_max_streams : WS_POOL_DEFAULT_MAX_STREAMS;
+        if (pooled && cfg->pool_max_streams > 0) {
+            pool_max_streams = cfg->pool_max_streams;
+        }
+
+        auto* as = new AudioStreamer(switch_core_session_get_uuid(session), wsUri, responseHandler, cfg->deflate, cfg->heart_beat,
+                                     cfg->suppress_log != 0, cfg->extra_headers, cfg->no_reconnect != 0,
+                                     cfg->tls_cafile, cfg->tls_keyfile, cfg->tls_certfile, cfg->tls_disable_hostname_validation != 0,
+                                     cfg->binary_playback != 0 && !sink, pooled, pool_max_streams);
+        if (sink) as->makeSink(sink_metadata);
+        int backoff_ms = cfg->reconnect_backoff_ms;
+        int backoff_max_ms = cfg->reconnect_backoff_max_ms;
+        if (backoff_ms < 50) backoff_ms = 50;
+        if (backoff_max_ms < backoff_ms) backoff_max_ms = backoff_ms;
+        as->setReconnect((uint32_t)backoff_ms, (uint32_t)backoff_max_ms,
+                         cfg->reconnect_timeout_ms > 0 ? (uint32_t)cfg->reconnect_timeout_ms : 0);
+        as->open();
+        return as;
+    }
+
     switch_status_t stream_data_init(private_t *tech_pvt, switch_core_session_t *session, char *wsUri,
-                                     uint32_t sampling, int desiredSampling, int channels, int audio_format, char *metadata, responseHandler_t responseHandler,
-                                     int deflate, int heart_beat, bool suppressLog, int rtp_packets, const char* extra_headers,
-                                     bool no_reconnect, const char *tls_cafile, const char *tls_keyfile,
-                                     const char *tls_certfile, bool tls_disable_hostname_validation)
+                                     uint32_t sampling, int desiredSampling, int channels, int mix, int audio_format, char *metadata, responseHandler_t responseHandler,
+                                     int rtp_packets, AudioStreamer *as, uint32_t playback_in_rate, const stream_config_t *cfg)
     {
         int err; //speex
 
         switch_memory_pool_t *pool = switch_core_session_get_pool(session);
 
         memset(tech_pvt, 0, sizeof(private_t));
+        tech_pvt->config = *cfg;
 
         /* Use strncpy with explicit null-termination to prevent buffer overread */
         strncpy(tech_pvt->sessionId, switch_core_session_get_uuid(session), MAX_SESSION_ID - 1);
         tech_pvt->sessionId[MAX_SESSION_ID - 1] = '\0';
-        strncpy(tech_pvt->ws_uri, wsUri, MAX_WS_URI - 1);
-        tech_pvt->ws_uri[MAX_WS_URI - 1] = '\0';
+        tech_pvt->ws_uri = switch_core_session_strdup(session, wsUri);
         tech_pvt->sampling = desiredSampling;
         tech_pvt->responseHandler = responseHandler;
         tech_pvt->rtp_packets = rtp_packets;
         tech_pvt->channels = channels;
+        tech_pvt->mix = mix;
         tech_pvt->audio_paused = 0;
         tech_pvt->audio_format = audio_format;
         tech_pvt->codec_initialized = 0;
-
-        if (metadata) {
-            strncpy(tech_pvt->initialMetadata, metadata, MAX_METADATA_LEN - 1);
-            tech_pvt->initialMetadata[MAX_METADATA_LEN - 1] = '\0';
+        tech_pvt->binary_playback = as->binaryPlayback() ? 1 : 0;
+
+        /* NETPLAY v2.7: exactly as long as the metadata, still capped at MAX_METADATA_LEN - 1 */
+        if (metadata && *metadata) {
+            const size_t metadata_len = strnlen(metadata, MAX_METADATA_LEN - 1);
+            tech_pvt->initialMetadata = (char *)switch_core_session_alloc(session, metadata_len + 1);
+            memcpy(tech_pvt->initialMetadata, metadata, metadata_len);
+            tech_pvt->initialMetadata[metadata_len] = '\0';
         }
 
         /* Calculate buffer length with overflow protection
@@ -452,34 +1349,123 @@ namespace {
          * FRAME_SIZE_8000 = 320 bytes (20ms @ 8kHz stereo L16)
          * Max reasonable values: 48kHz, 2 channels, 10 rtp_packets = 320 * 6 * 2 * 10 = 38400
          */
-        const size_t buflen = ((size_t)FRAME_SIZE_8000 * (size_t)desiredSampling / 8000) * 
-                              (size_t)channels * (size_t)rtp_packets;
+        size_t buflen = ((size_t)FRAME_SIZE_8000 * (size_t)desiredSampling / 8000) * 
+                        (size_t)channels * (size_t)rtp_packets;
+        if (audio_format == AUDIO_FORMAT_PCMU || audio_format == AUDIO_FORMAT_PCMA) {
+            buflen /= 2; /* G.711: one byte per sample */
+        }
+        /* Slack for one frame of up to SEND_BUF_MAX_PTIME_MS at the higher of the two rates,
+         * so a frame can always be appended before the batch is flushed */
+        const size_t max_rate = sampling > (uint32_t)desiredSampling ? sampling : (uint32_t)desiredSampling;
+        size_t slack = max_rate * (size_t)channels * sizeof(int16_t) * SEND_BUF_MAX_PTIME_MS / 1000;
+        size_t opus_bytes_per_ms = 0;
+
+        /* NETPLAY v2.7: Opus upstream. A batch is rtp_packets packets at the average bitrate;
+         * the resampled frame is staged in send_buf as L16 before it is encoded over itself */
+        if (audio_format == AUDIO_FORMAT_OPUS) {
+            int bitrate = cfg->opus_bitrate;
+            int complexity = cfg->opus_complexity;
+            char err[128] = "";
+            if (bitrate < 6000) bitrate = 6000;
+            if (bitrate > 64000 * channels) bitrate = 64000 * channels;
+            if (complexity < 0) complexity = 0;
+            if (complexity > 10) complexity = 10;
+            tech_pvt->opus = capture_opus_create(pool, (uint32_t)desiredSampling, (uint32_t)channels, (uint32_t)bitrate,
+                                                 (uint32_t)complexity, (uint32_t)(slack / sizeof(int16_t)), err, sizeof(err));
+            if (!tech_pvt->opus) {
+                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                    "(%s) opus encoder: %s\n", tech_pvt->sessionId, err);
+                return SWITCH_STATUS_FALSE;
+            }
+            buflen = (size_t)rtp_packets * ((size_t)bitrate / 8 * CAPTURE_OPUS_FRAME_MS / 1000 + STREAM_OPUS_PACKET_HEADER_LEN);
+            const size_t packets_slack = (SEND_BUF_MAX_PTIME_MS / CAPTURE_OPUS_FRAME_MS + 1) * capture_opus_packet_bytes(tech_pvt->opus);
+            if (slack < packets_slack) slack = packets_slack;
+            opus_bytes_per_ms = (size_t)bitrate / 8000 ? (size_t)bitrate / 8000 : 1;
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
+                "(%s) opus encoding enabled (%dHz x%d, %dbps, complexity %d)\n",
+                tech_pvt->sessionId, desiredSampling, channels, bitrate, complexity);
+        }
 
-        auto* as = new AudioStreamer(tech_pvt->sessionId, wsUri, responseHandler, deflate, heart_beat,
-                                        suppressLog, extra_headers, no_reconnect,
-                                        tls_cafile, tls_keyfile, tls_certfile, tls_disable_hostname_validation);
+        /* Opus is variable rate: batch, pre-roll sizes and silence markers use the average bitrate */
+        const size_t capture_bytes_per_ms = opus_bytes_per_ms ? opus_bytes_per_ms :
+            (size_t)desiredSampling / 1000 * (size_t)channels *
+            ((audio_format == AUDIO_FORMAT_PCMU || audio_format == AUDIO_FORMAT_PCMA) ? 1 : sizeof(int16_t));
 
         tech_pvt->pAudioStreamer = static_cast<void *>(as);
 
         switch_mutex_init(&tech_pvt->mutex, SWITCH_MUTEX_NESTED, pool);
-        
-        if (switch_buffer_create(pool, &tech_pvt->sbuffer, buflen) != SWITCH_STATUS_SUCCESS) {
+
+        /* NETPLAY v2.7: a batch goes out when it reaches send_batch or when its oldest frame has
+         * waited STREAM_SEND_MAX_HOLD_MS. With STREAM_SEND_ADAPTIVE, send_batch starts at
+         * STREAM_SEND_BATCH_MIN_MS and doubles while the websocket pushes back, up to
+         * STREAM_SEND_BATCH_MAX_MS; without it, it stays at rtp_packets (STREAM_BUFFER_SIZE) */
+        int batch_ms = rtp_packets * 20;
+        int batch_min_ms = batch_ms;
+        int batch_max_ms = batch_ms;
+        if (cfg->send_adaptive) {
+            batch_min_ms = cfg->send_batch_min_ms;
+            batch_max_ms = cfg->send_batch_max_ms != STREAM_CONFIG_UNSET ? cfg->send_batch_max_ms : (batch_ms > 200 ? batch_ms : 200);
+            if (batch_min_ms < 10) batch_min_ms = 10;
+            if (batch_max_ms > 1000) batch_max_ms = 1000;
+            if (batch_max_ms < batch_min_ms) batch_max_ms = batch_min_ms;
+            tech_pvt->send_adaptive = 1;
+        }
+        int hold_ms = cfg->send_max_hold_ms != STREAM_CONFIG_UNSET ? cfg->send_max_hold_ms : batch_max_ms + 20;
+        if (hold_ms < 10) hold_ms = 10;
+        if (hold_ms > 2000) hold_ms = 2000;
+        tech_pvt->send_hold_us = (switch_time_t)hold_ms * 1000;
+        if (tech_pvt->send_adaptive) {
+            tech_pvt->send_batch_min = (size_t)batch_min_ms * capture_bytes_per_ms;
+            tech_pvt->send_batch_max = (size_t)batch_max_ms * capture_bytes_per_ms;
+            buflen = tech_pvt->send_batch_min;
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
+                "(%s) adaptive send batch %d-%dms, max hold %dms\n", tech_pvt->sessionId, batch_min_ms, batch_max_ms, hold_ms);
+        } else {
+            tech_pvt->send_batch_min = buflen;
+            tech_pvt->send_batch_max = buflen;
+        }
+
+        tech_pvt->send_batch = buflen;
+        tech_pvt->send_cap = tech_pvt->send_batch_max + slack;
+        tech_pvt->capture_bytes_per_ms = capture_bytes_per_ms;
+
+        /* NETPLAY v2.7: bounded outbound queue, the media thread never waits on the websocket.
+         * It holds at least two of the largest batches */
+        int queue_ms = cfg->send_queue_ms;
+        if (queue_ms < 0) queue_ms = 0;
+        if (queue_ms > 10000) queue_ms = 10000;
+        if (queue_ms > 0) {
+            const char *policy_str = cfg->send_queue_policy;
+            SendQueuePolicy policy = SendQueuePolicy::DropOldest;
+            if (policy_str && !send_queue_parse_policy(policy_str, policy)) {
+                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
+                    "(%s) invalid STREAM_SEND_QUEUE_POLICY %s, using drop_oldest\n", tech_pvt->sessionId, policy_str);
+            }
+            if (queue_ms < 2 * batch_max_ms) queue_ms = 2 * batch_max_ms;
+            int high_water_ms = cfg->send_queue_high_water_ms != STREAM_CONFIG_UNSET ? cfg->send_queue_high_water_ms : queue_ms / 2;
+            if (high_water_ms < batch_max_ms) high_water_ms = batch_max_ms;
+            if (high_water_ms > queue_ms) high_water_ms = queue_ms;
+            as->enableSendQueue((size_t)queue_ms * capture_bytes_per_ms, (size_t)high_water_ms * capture_bytes_per_ms, policy);
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG,
+                "(%s) outbound queue %dms (high water %dms, %s)\n", tech_pvt->sessionId, queue_ms, high_water_ms,
+                send_queue_policy_name(policy));
+        }
+        tech_pvt->send_len = 0;
+        tech_pvt->send_buf = (uint8_t *)switch_core_session_alloc(session, tech_pvt->send_cap);
+        if (!tech_pvt->send_buf) {
             switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
-                "%s: Error creating switch buffer.\n", tech_pvt->sessionId);
+                "%s: Error creating send buffer.\n", tech_pvt->sessionId);
             return SWITCH_STATUS_FALSE;
         }
         
         /* NETPLAY: Create playback buffer for streaming audio from WebSocket */
-        /* Buffer size default: 2 seconds of L16 audio @ 8kHz = 32000 bytes */
-        switch_channel_t *channel = switch_core_session_get_channel(session);
-        const char *buffer_ms_str = switch_channel_get_variable(channel, "STREAM_PLAYBACK_BUFFER_MS");
-        const char *warmup_ms_str = switch_channel_get_variable(channel, "STREAM_PLAYBACK_WARMUP_MS");
-        const char *low_water_ms_str = switch_channel_get_variable(channel, "STREAM_PLAYBACK_LOW_WATER_MS");
-        const char *underrun_grace_ms_str = switch_channel_get_variable(channel, "STREAM_PLAYBACK_UNDERRUN_GRACE_MS");
-        int buffer_ms = buffer_ms_str ? atoi(buffer_ms_str) : 2000;
-        int warmup_ms = warmup_ms_str ? atoi(warmup_ms_str) : 400;
-        int low_water_ms = low_water_ms_str ? atoi(low_water_ms_str) : 160;
-        int underrun_grace_ms = underrun_grace_ms_str ? atoi(underrun_grace_ms_str) : 60;
+        /* Buffer size default: 2 seconds of playback (32000 bytes of L16 @ 8kHz, 16000 of G.711) */
+        int buffer_ms = cfg->playback_buffer_ms;
+        /* NETPLAY v2.7: a paced playback does not have to absorb inbound RTP jitter */
+        int warmup_ms = cfg->playback_warmup_ms != STREAM_CONFIG_UNSET ? cfg->playback_warmup_ms :
+                        (cfg->playback_pacing ? 120 : 400);
+        int low_water_ms = cfg->playback_low_water_ms;
+        int underrun_grace_ms = cfg->playback_underrun_grace_ms;
         if (buffer_ms < 200) buffer_ms = 200;
         if (buffer_ms > 10000) buffer_ms = 10000;
         if (warmup_ms < 40) warmup_ms = 40;
@@ -487,27 +1473,221 @@ namespace {
         if (underrun_grace_ms < 0) underrun_grace_ms = 0;
         if (warmup_ms >= buffer_ms) warmup_ms = buffer_ms / 2;
         if (low_water_ms >= buffer_ms) low_water_ms = buffer_ms / 4;
-        const size_t playback_buflen = (size_t)buffer_ms * 16; /* 8kHz L16 = 16 bytes/ms */
-        if (switch_buffer_create(pool, &tech_pvt->playback_buffer, playback_buflen) != SWITCH_STATUS_SUCCESS) {
+        /* NETPLAY v2.7: follow the session write codec. A G.711 write codec gets its own
+         * encoding in the ring and is written without transcoding; anything else (G.722, Opus,
+         * L16...) is injected as L16 and FreeSWITCH encodes it once to the real codec. */
+        const switch_codec_t *write_codec = switch_core_session_get_write_codec(session);
+        const switch_codec_implementation_t *write_impl = write_codec ? write_codec->implementation : nullptr;
+        int ptime_ms = (write_impl && write_impl->microseconds_per_packet > 0) ? write_impl->microseconds_per_packet / 1000 : 20;
+        if (ptime_ms < 10 || ptime_ms > SEND_BUF_MAX_PTIME_MS) ptime_ms = 20;
+        const uint32_t write_rate = write_impl ? write_impl->actual_samples_per_second : 8000;
+        tech_pvt->playback_format = STREAM_CODEC_L16;
+        if (write_impl && write_impl->iananame && write_rate == 8000 && write_impl->number_of_channels <= 1) {
+            if (!strcasecmp(write_impl->iananame, "PCMU")) tech_pvt->playback_format = STREAM_CODEC_PCMU;
+            else if (!strcasecmp(write_impl->iananame, "PCMA")) tech_pvt->playback_format = STREAM_CODEC_PCMA;
+        }
+        /* NETPLAY v2.7: L16 is buffered at the write codec rate, so wideband calls keep their
+         * bandwidth and the only resampling happens on the websocket thread */
+        tech_pvt->playback_rate = stream_playback_rate_valid(STREAM_CODEC_L16, write_rate) ? write_rate : 8000;
+        if (tech_pvt->playback_format != STREAM_CODEC_L16) tech_pvt->playback_rate = 8000;
+        tech_pvt->playback_in_rate = playback_in_rate;
+        const size_t sample_bytes = STREAM_CODEC_SAMPLE_BYTES(tech_pvt->playback_format);
+        const size_t bytes_per_ms = tech_pvt->playback_rate / 1000 * sample_bytes;
+        tech_pvt->playback_frame_samples = tech_pvt->playback_rate / 1000 * (uint32_t)ptime_ms;
+        tech_pvt->playback_frame_bytes = tech_pvt->playback_frame_samples * sample_bytes;
+        tech_pvt->playback_frame = (uint8_t *)switch_core_session_alloc(session, tech_pvt->playback_frame_bytes);
+        tech_pvt->playback_pcm = (int16_t *)switch_core_session_alloc(session, tech_pvt->playback_frame_samples * sizeof(int16_t));
+        if (!tech_pvt->playback_frame || !tech_pvt->playback_pcm) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                "%s: Error creating playback frame.\n", tech_pvt->sessionId);
+            return SWITCH_STATUS_FALSE;
+        }
+        /* Always available: the injection path for non-G.711 write codecs, and the fallback
+         * when a re-INVITE changes the write codec away from the ring format */
+        if (switch_core_codec_init(&tech_pvt->playback_codec, "L16", NULL, NULL, tech_pvt->playback_rate, ptime_ms, 1,
+                                   SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, pool) != SWITCH_STATUS_SUCCESS) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                "%s: Error initializing L16 playback codec.\n", tech_pvt->sessionId);
+            return SWITCH_STATUS_FALSE;
+        }
+        tech_pvt->playback_codec_initialized = 1;
+
+        const size_t playback_buflen = (size_t)buffer_ms * bytes_per_ms;
+        /* Ring capacity is the next power of two; playback_buflen stays the logical limit */
+        tech_pvt->playback_ring = playback_ring_create(playback_buflen);
+        if (!tech_pvt->playback_ring) {
             switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
                 "%s: Error creating playback buffer.\n", tech_pvt->sessionId);
             return SWITCH_STATUS_FALSE;
         }
-        switch_mutex_init(&tech_pvt->playback_mutex, SWITCH_MUTEX_NESTED, pool);
         tech_pvt->playback_active = 0;
         tech_pvt->playback_buflen = playback_buflen;
-        tech_pvt->warmup_threshold = (switch_size_t)warmup_ms * 16;
-        tech_pvt->low_water_mark = (switch_size_t)low_water_ms * 16;
+        tech_pvt->warmup_threshold = (switch_size_t)warmup_ms * bytes_per_ms;
+        tech_pvt->low_water_mark = (switch_size_t)low_water_ms * bytes_per_ms;
         tech_pvt->first_audio_ts = 0;
         tech_pvt->playback_start_ts = 0;
-        tech_pvt->buffer_overruns = 0;
-        tech_pvt->buffer_underruns = 0;
-        tech_pvt->buffer_max_used = 0;
         tech_pvt->underrun_streak = 0;
-        tech_pvt->underrun_grace_frames = (uint32_t)(underrun_grace_ms / 20);
+        tech_pvt->underrun_grace_frames = (uint32_t)(underrun_grace_ms / ptime_ms);
+        tech_pvt->playback_bytes_per_ms = bytes_per_ms;
+
+        /* NETPLAY v2.7: barge-in ramps the playing audio down instead of cutting it */
+        int fade_ms = cfg->playback_fade_ms;
+        if (fade_ms < 0) fade_ms = 0;
+        if (fade_ms > ptime_ms) fade_ms = ptime_ms;
+        tech_pvt->playback_fade_samples = tech_pvt->playback_rate / 1000 * (uint32_t)fade_ms;
+
+        /* NETPLAY v2.7: drain backlog by playing up to TIME_STRETCH_MAX_SPEED instead of
+         * waiting for the ring to overflow */
+        if (cfg->playback_time_stretch) {
+            tech_pvt->playback_stretch = time_stretch_create(pool, tech_pvt->playback_rate, tech_pvt->playback_frame_samples);
+            if (!tech_pvt->playback_stretch) {
+                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                    "%s: Error creating playback time stretch.\n", tech_pvt->sessionId);
+                return SWITCH_STATUS_FALSE;
+            }
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
+                "(%s) [PLAYBACK] time stretch enabled (%.2f-%.2fx above target)\n", tech_pvt->sessionId,
+                TIME_STRETCH_MIN_SPEED, TIME_STRETCH_MAX_SPEED);
+        }
+
+        /* NETPLAY v2.7: adaptive playout replaces warmup/low water with a target depth that
+         * starts low and grows on real underruns; grace frames are concealed, not silent */
+        if (cfg->playback_adaptive) {
+            int target_ms = cfg->playback_target_ms;
+            int target_max_ms = cfg->playback_target_max_ms;
+            if (target_ms < ptime_ms) target_ms = ptime_ms;
+            if (target_ms > buffer_ms / 2) target_ms = buffer_ms / 2;
+            if (target_max_ms < target_ms) target_max_ms = target_ms;
+            if (target_max_ms > buffer_ms / 2) target_max_ms = buffer_ms / 2;
+            tech_pvt->playback_plc = playback_plc_create(pool, tech_pvt->playback_rate, tech_pvt->playback_frame_samples);
+            if (!tech_pvt->playback_plc) {
+                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                    "%s: Error creating playback concealment.\n", tech_pvt->sessionId);
+                return SWITCH_STATUS_FALSE;
+            }
+            tech_pvt->playback_adaptive = 1;
+            tech_pvt->playback_target_min = (switch_size_t)target_ms * bytes_per_ms;
+            tech_pvt->playback_target_max = (switch_size_t)target_max_ms * bytes_per_ms;
+            tech_pvt->playback_target = tech_pvt->playback_target_min;
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
+                "(%s) [PLAYBACK] adaptive playout (target=%dms, max=%dms)\n", tech_pvt->sessionId, target_ms, target_max_ms);
+        }
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
+            "(%s) [PLAYBACK] buffer created (%zuB, warmup=%dms, low_water=%dms, underrun_grace=%dms, binary=%s, pacing=%s)\n",
+            tech_pvt->sessionId, playback_buflen, warmup_ms, low_water_ms, underrun_grace_ms,
+            tech_pvt->binary_playback ? "on" : "off", cfg->playback_pacing ? "timer" : "read");
         switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
-            "(%s) [PLAYBACK] buffer created (%zuB, warmup=%dms, low_water=%dms, underrun_grace=%dms)\n",
-            tech_pvt->sessionId, playback_buflen, warmup_ms, low_water_ms, underrun_grace_ms);
+            "(%s) [PLAYBACK] write codec %s@%uHz ptime=%dms, injecting %s@%uHz (%zuB/frame), input %uHz\n",
+            tech_pvt->sessionId, (write_impl && write_impl->iananame) ? write_impl->iananame : "none",
+            write_impl ? write_impl->actual_samples_per_second : 0, ptime_ms,
+            tech_pvt->playback_format == STREAM_CODEC_L16 ? "L16 (core transcode)" : stream_codec_name(tech_pvt->playback_format),
+            tech_pvt->playback_rate, tech_pvt->playback_frame_bytes, tech_pvt->playback_in_rate);
+
+        /* NETPLAY v2.7: optional latency histograms, session pool memory is zeroed */
+        if (cfg->latency_histograms) {
+            tech_pvt->latency = (stream_latency_t *)switch_core_session_alloc(session, sizeof(stream_latency_t));
+        }
+
+        /* NETPLAY v2.7: capture pre-roll. Frames captured before the websocket is up are kept
+         * (encoded, in the outgoing format) and sent as one message once it connects */
+        int preroll_ms = cfg->preroll_ms;
+        if (preroll_ms < 0) preroll_ms = 0;
+        if (preroll_ms > 5000) preroll_ms = 5000;
+        if (preroll_ms > 0) {
+            tech_pvt->preroll_limit = (size_t)preroll_ms * capture_bytes_per_ms;
+            tech_pvt->preroll_ring = playback_ring_create(tech_pvt->preroll_limit);
+            tech_pvt->preroll_buf = (uint8_t *)switch_core_session_alloc(session, tech_pvt->preroll_limit);
+            if (!tech_pvt->preroll_ring || !tech_pvt->preroll_buf) {
+                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                    "%s: Error creating pre-roll buffer.\n", tech_pvt->sessionId);
+                return SWITCH_STATUS_FALSE;
+            }
+        }
+
+        /* NETPLAY v2.7: replay window for reconnects. The newest capture, sent or not, is
+         * kept so a new connection can be given what the old one may have lost */
+        int resume_ms = cfg->no_reconnect ? 0 : cfg->reconnect_buffer_ms;
+        if (resume_ms < 0) resume_ms = 0;
+        if (resume_ms > 10000) resume_ms = 10000;
+        if (resume_ms > 0) {
+            tech_pvt->resume_limit = (size_t)resume_ms * capture_bytes_per_ms;
+            tech_pvt->resume_ring = playback_ring_create(tech_pvt->resume_limit);
+            tech_pvt->resume_buf = (uint8_t *)switch_core_session_alloc(session, tech_pvt->resume_limit);
+            if (!tech_pvt->resume_ring || !tech_pvt->resume_buf) {
+                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                    "%s: Error creating reconnect replay buffer.\n", tech_pvt->sessionId);
+                return SWITCH_STATUS_FALSE;
+            }
+        }
+
+        /* NETPLAY v2.7: echo reference export (start ... reference) and in-module AEC (STREAM_AEC).
+         * Both pair each mic frame with what injection played in the same ptime, so the
+         * capture must run at the rate the ring is played at */
+        bool aec = cfg->aec != 0;
+        if (aec && mix != CAPTURE_MIX_MONO && mix != CAPTURE_MIX_REFERENCE) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
+                "(%s) STREAM_AEC needs mono or reference capture, echo cancellation disabled\n", tech_pvt->sessionId);
+            aec = false;
+        }
+        if ((aec || mix == CAPTURE_MIX_REFERENCE) && sampling != tech_pvt->playback_rate) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
+                "(%s) capture at %uHz, playback at %uHz: no echo reference or cancellation for this call\n",
+                tech_pvt->sessionId, sampling, tech_pvt->playback_rate);
+            aec = false;
+        } else if (aec || mix == CAPTURE_MIX_REFERENCE) {
+            int tail_ms = cfg->aec_tail_ms;
+            if (tail_ms < 20) tail_ms = 20;
+            if (tail_ms > 500) tail_ms = 500;
+            tech_pvt->echo = capture_echo_create(pool, sampling, sampling * SEND_BUF_MAX_PTIME_MS / 1000,
+                                                 mix == CAPTURE_MIX_REFERENCE, aec ? (uint32_t)tail_ms : 0);
+            if (!tech_pvt->echo) {
+                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                    "%s: Error creating echo reference.\n", tech_pvt->sessionId);
+                return SWITCH_STATUS_FALSE;
+            }
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
+                "(%s) [ECHO] %s%s%s\n", tech_pvt->sessionId,
+                mix == CAPTURE_MIX_REFERENCE ? "playback reference on the right channel" : "",
+                mix == CAPTURE_MIX_REFERENCE && aec ? ", " : "",
+                aec ? "echo cancellation on the caller" : "");
+        }
+        if (cfg->vad && mix == CAPTURE_MIX_REFERENCE) {
+            /* The reference channel would open the gate on every prompt */
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
+                "(%s) STREAM_VAD is not applied to reference capture\n", tech_pvt->sessionId);
+        }
+
+        /* NETPLAY v2.7: VAD-gated capture. Silence is held back (the newest STREAM_VAD_PREROLL_MS of it
+         * go out ahead of the next speech) and replaced by periodic silence markers */
+        if (cfg->vad && mix != CAPTURE_MIX_REFERENCE) {
+            int threshold_db = cfg->vad_threshold_db;
+            int hangover_ms = cfg->vad_hangover_ms;
+            int vad_preroll_ms = cfg->vad_preroll_ms;
+            int cn_ms = cfg->vad_cn_interval_ms;
+            if (threshold_db < 3) threshold_db = 3;
+            if (threshold_db > 40) threshold_db = 40;
+            if (hangover_ms < 0) hangover_ms = 0;
+            if (hangover_ms > 5000) hangover_ms = 5000;
+            if (vad_preroll_ms < 0) vad_preroll_ms = 0;
+            if (vad_preroll_ms > 1000) vad_preroll_ms = 1000;
+            if (cn_ms < 0) cn_ms = 0;
+            tech_pvt->vad = capture_vad_create(pool, (uint32_t)desiredSampling, (uint32_t)channels, threshold_db, (uint32_t)hangover_ms);
+            if (vad_preroll_ms > 0) {
+                tech_pvt->vad_limit = (size_t)vad_preroll_ms * capture_bytes_per_ms;
+                tech_pvt->vad_ring = playback_ring_create(tech_pvt->vad_limit);
+                tech_pvt->vad_buf = (uint8_t *)switch_core_session_alloc(session, tech_pvt->vad_limit);
+            }
+            if (!tech_pvt->vad || (vad_preroll_ms > 0 && (!tech_pvt->vad_ring || !tech_pvt->vad_buf))) {
+                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                    "%s: Error creating capture VAD.\n", tech_pvt->sessionId);
+                return SWITCH_STATUS_FALSE;
+            }
+            tech_pvt->vad_bytes_per_ms = capture_bytes_per_ms;
+            tech_pvt->vad_cn_bytes = (size_t)cn_ms * capture_bytes_per_ms;
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
+                "(%s) [VAD] capture gated (threshold=%ddB, hangover=%dms, preroll=%dms, markers=%dms)\n",
+                tech_pvt->sessionId, threshold_db, hangover_ms, vad_preroll_ms, cn_ms);
+        }
 
         if (desiredSampling != sampling) {
             switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "(%s) resampling from %u to %u\n", tech_pvt->sessionId, sampling, desiredSampling);
@@ -530,85 +1710,351 @@ namespace {
                 switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
                     "(%s) G.711 (%s) requires 8kHz sample rate, got %d Hz\n", 
                     tech_pvt->sessionId, codec_name, desiredSampling);
-                /* Clean up AudioStreamer before returning to prevent memory leak */
-                if (tech_pvt->pAudioStreamer) {
-                    auto* as = static_cast<AudioStreamer*>(tech_pvt->pAudioStreamer);
-                    as->markCleanedUp();
-                    as->disconnect();
-                    delete as;
-                    tech_pvt->pAudioStreamer = nullptr;
-                }
                 return SWITCH_STATUS_FALSE;
             }
             
-            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, 
-                "(%s) Initializing %s codec for G.711 encoding\n", tech_pvt->sessionId, codec_name);
-            
-            if (switch_core_codec_init(&tech_pvt->write_codec,
-                                       codec_name,
-                                       NULL,
-                                       NULL,
-                                       8000,      /* G.711 is always 8kHz */
-                                       20,        /* 20ms ptime */
-                                       channels,
-                                       SWITCH_CODEC_FLAG_ENCODE,
-                                       NULL,
-                                       pool) != SWITCH_STATUS_SUCCESS) {
-                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
-                    "(%s) Failed to initialize %s codec\n", tech_pvt->sessionId, codec_name);
-                /* Clean up AudioStreamer before returning to prevent memory leak */
-                if (tech_pvt->pAudioStreamer) {
-                    auto* as = static_cast<AudioStreamer*>(tech_pvt->pAudioStreamer);
-                    as->markCleanedUp();
-                    as->disconnect();
-                    delete as;
-                    tech_pvt->pAudioStreamer = nullptr;
-                }
-                return SWITCH_STATUS_FALSE;
+            /* NETPLAY v2.7: encoding runs through the shared g711 kernels, no FS codec needed */
+            tech_pvt->codec_initialized = 1;
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
+                "(%s) %s encoding enabled (g711 kernel: %s)\n", tech_pvt->sessionId, codec_name, g711_kernel_name());
+        }
+
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "(%s) stream_data_init\n", tech_pvt->sessionId);
+
+        return SWITCH_STATUS_SUCCESS;
+    }
+
+    /* Injection side of destroy_tech_pvt, on whichever thread injects last */
+    void release_playback(void *user_data) {
+        auto *tech_pvt = static_cast<private_t *>(user_data);
+        if (tech_pvt->playback_codec_initialized) {
+            switch_core_codec_destroy(&tech_pvt->playback_codec);
+            tech_pvt->playback_codec_initialized = 0;
+        }
+        playback_ring_destroy(tech_pvt->playback_ring);
+        tech_pvt->playback_ring = nullptr;
+        /* NETPLAY v2.7: cached clips still queued */
+        for (uint32_t tail = tech_pvt->playback_cues_tail; tail != tech_pvt->playback_cues_head; tail++) {
+            playback_clip_release(tech_pvt->playback_cues[tail % PLAYBACK_CUES].clip);
+            tech_pvt->playback_cues[tail % PLAYBACK_CUES].clip = nullptr;
+        }
+        tech_pvt->playback_cues_tail = tech_pvt->playback_cues_head;
+        /* Fed by every injected frame */
+        capture_echo_destroy(tech_pvt->echo);
+        tech_pvt->echo = nullptr;
+        /* Last: playback reports try it */
+        if (tech_pvt->mutex) {
+            switch_mutex_destroy(tech_pvt->mutex);
+            tech_pvt->mutex = nullptr;
+        }
+    }
+
+    void destroy_tech_pvt(private_t* tech_pvt) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "%s destroy_tech_pvt\n", tech_pvt->sessionId);
+        if (tech_pvt->resampler) {
+            speex_resampler_destroy(tech_pvt->resampler);
+            tech_pvt->resampler = nullptr;
+        }
+        tech_pvt->codec_initialized = 0;
+        if (tech_pvt->playback_resampler) {
+            speex_resampler_destroy(tech_pvt->playback_resampler);
+            tech_pvt->playback_resampler = nullptr;
+        }
+        /* NETPLAY v2.7: rings go back to the module slab; the bug is gone and the
+         * streamer unbound, so neither thread can reach them any more */
+        playback_ring_destroy(tech_pvt->preroll_ring);
+        tech_pvt->preroll_ring = nullptr;
+        playback_ring_destroy(tech_pvt->vad_ring);
+        tech_pvt->vad_ring = nullptr;
+        playback_ring_destroy(tech_pvt->resume_ring);
+        tech_pvt->resume_ring = nullptr;
+        /* NETPLAY v2.7: a pacer may still be inside a tick (blocked writing while the
+         * bug closes); what injection uses goes once its thread is out */
+        if (tech_pvt->playback_pacer) {
+            playback_pacer_stop(tech_pvt->playback_pacer, release_playback);
+        } else {
+            release_playback(tech_pvt);
+        }
+        /*if (tech_pvt->pAudioStreamer) {
+            auto* as = (AudioStreamer *) tech_pvt->pAudioStreamer;
+            delete as;
+            tech_pvt->pAudioStreamer = nullptr;
+        }*/
+    }
+
+    /* NETPLAY v2.7: no message reaches a call from here on; the close itself (queue
+     * drain, close handshake) and the delete run on a closer thread, see stream_closer.h */
+    void finish(AudioStreamer* audioStreamer) {
+        audioStreamer->markCleanedUp();
+        stream_closer::post(audioStreamer);
+    }
+
+    /* NETPLAY v2.7: a prepared streamer lives in the channel private MY_PREPARED_NAME
+     * until start adopts it or the channel hangs up */
+    std::mutex g_prepared_mutex;
+
+    AudioStreamer* take_prepared(switch_channel_t *channel) {
+        std::lock_guard<std::mutex> lock(g_prepared_mutex);
+        auto* as = static_cast<AudioStreamer*>(switch_channel_get_private(channel, MY_PREPARED_NAME));
+        if (as) {
+            switch_channel_set_private(channel, MY_PREPARED_NAME, nullptr);
+        }
+        return as;
+    }
+
+    /* NETPLAY v2.7: registry of streaming calls for uuid_audio_stream stats.
+     * A call is registered once its bug is attached (stream_session_attached) and removed at the top of
+     * stream_session_cleanup, so a tech_pvt found here under g_sessions_mutex is alive. */
+    struct StatField {
+        const char* name;
+        size_t offset;
+        bool gauge;     /* aggregated with max instead of sum */
+    };
+
+    #define STAT_FIELD(field, name) { name, offsetof(stream_stats_t, field), false }
+    #define STAT_GAUGE(field, name) { name, offsetof(stream_stats_t, field), true }
+    const StatField kStatFields[] = {
+        STAT_FIELD(frames_captured, "frames_captured_total"),
+        STAT_FIELD(frames_dropped, "frames_dropped_total"),
+        STAT_FIELD(preroll_dropped_bytes, "preroll_dropped_bytes_total"),
+        STAT_FIELD(messages_sent, "messages_sent_total"),
+        STAT_FIELD(bytes_sent, "bytes_sent_total"),
+        STAT_FIELD(send_hold_flushes, "send_hold_flushes_total"),
+        STAT_FIELD(send_batch_grows, "send_batch_grows_total"),
+        STAT_FIELD(send_batch_shrinks, "send_batch_shrinks_total"),
+        STAT_FIELD(outbound_dropped_messages, "outbound_dropped_messages_total"),
+        STAT_FIELD(outbound_dropped_bytes, "outbound_dropped_bytes_total"),
+        STAT_FIELD(outbound_coalesced, "outbound_coalesced_total"),
+        STAT_FIELD(outbound_high_water, "outbound_high_water_total"),
+        STAT_FIELD(vad_suppressed_frames, "vad_suppressed_frames_total"),
+        STAT_FIELD(vad_speech_segments, "vad_speech_segments_total"),
+        STAT_FIELD(vad_silence_markers, "vad_silence_markers_total"),
+        STAT_FIELD(playback_chunks, "playback_chunks_total"),
+        STAT_FIELD(playback_bytes, "playback_bytes_total"),
+        STAT_FIELD(playback_overruns, "playback_overruns_total"),
+        STAT_FIELD(playback_dropped_bytes, "playback_dropped_bytes_total"),
+        STAT_GAUGE(playback_max_buffered, "playback_max_buffered_bytes"),
+        STAT_FIELD(barge_ins, "barge_ins_total"),
+        STAT_FIELD(stale_chunks, "stale_chunks_total"),
+        STAT_FIELD(stale_bytes, "stale_bytes_total"),
+        STAT_FIELD(cached_plays, "cached_plays_total"),
+        STAT_FIELD(cached_bytes, "cached_bytes_total"),
+        STAT_FIELD(cached_errors, "cached_errors_total"),
+        STAT_FIELD(frames_injected, "frames_injected_total"),
+        STAT_FIELD(silence_injected, "silence_injected_total"),
+        STAT_FIELD(plc_frames, "plc_frames_total"),
+        STAT_FIELD(stretch_frames, "stretch_frames_total"),
+        STAT_FIELD(stretch_saved_us, "stretch_saved_us_total"),
+        STAT_FIELD(playback_underruns, "playback_underruns_total"),
+        STAT_GAUGE(underrun_streak_max, "underrun_streak_max"),
+        STAT_FIELD(connects, "connects_total"),
+        STAT_FIELD(disconnects, "disconnects_total"),
+        STAT_FIELD(errors, "errors_total"),
+        STAT_FIELD(reconnect_attempts, "reconnect_attempts_total"),
+        STAT_FIELD(reconnects, "reconnects_total"),
+        STAT_FIELD(resume_replayed_bytes, "resume_replayed_bytes_total"),
+        STAT_FIELD(resume_dropped_bytes, "resume_dropped_bytes_total"),
+    };
+    #undef STAT_FIELD
+    #undef STAT_GAUGE
+
+    std::mutex g_sessions_mutex;
+    std::unordered_map<std::string, private_t*> g_sessions;
+    stream_stats_t g_finished_stats;   /* calls already cleaned up, under g_sessions_mutex */
+    stream_latency_t g_finished_latency;
+    uint64_t g_calls_total = 0;
+
+    /* NETPLAY v2.7: set by a node graceful-shutdown, new streams are refused until cancel */
+    std::atomic<bool> g_draining{false};
+
+    /* Caller holds g_sessions_mutex: audio the backend sent that the caller has not heard yet */
+    bool playback_pending(private_t* tech_pvt) {
+        return playback_ring_inuse(tech_pvt->playback_ring) ||
+               __atomic_load_n(&tech_pvt->playback_cues_tail, __ATOMIC_ACQUIRE) !=
+               __atomic_load_n(&tech_pvt->playback_cues_head, __ATOMIC_ACQUIRE);
+    }
+
+    void latency_merge(stream_latency_t* dst, const stream_latency_t* src) {
+        stream_hist_merge(&dst->capture_to_send, &src->capture_to_send);
+        stream_hist_merge(&dst->receive_to_buffer, &src->receive_to_buffer);
+        stream_hist_merge(&dst->buffer_residency, &src->buffer_residency);
+        stream_hist_merge(&dst->barge_in, &src->barge_in);
+    }
+
+    cJSON* hist_json(const stream_hist_t* h) {
+        cJSON* obj = cJSON_CreateObject();
+        const uint64_t count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+        cJSON_AddNumberToObject(obj, "count", (double)count);
+        cJSON_AddNumberToObject(obj, "mean_us", count ? (double)(__atomic_load_n(&h->sum, __ATOMIC_RELAXED) / count) : 0);
+        cJSON_AddNumberToObject(obj, "p50_us", (double)stream_hist_quantile(h, 0.50));
+        cJSON_AddNumberToObject(obj, "p90_us", (double)stream_hist_quantile(h, 0.90));
+        cJSON_AddNumberToObject(obj, "p99_us", (double)stream_hist_quantile(h, 0.99));
+        cJSON_AddNumberToObject(obj, "p999_us", (double)stream_hist_quantile(h, 0.999));
+        cJSON_AddNumberToObject(obj, "max_us", (double)__atomic_load_n(&h->max, __ATOMIC_RELAXED));
+        return obj;
+    }
+
+    cJSON* latency_json(const stream_latency_t* l) {
+        cJSON* obj = cJSON_CreateObject();
+        cJSON_AddItemToObject(obj, "capture_to_send", hist_json(&l->capture_to_send));
+        cJSON_AddItemToObject(obj, "receive_to_buffer", hist_json(&l->receive_to_buffer));
+        cJSON_AddItemToObject(obj, "buffer_residency", hist_json(&l->buffer_residency));
+        cJSON_AddItemToObject(obj, "barge_in", hist_json(&l->barge_in));
+        return obj;
+    }
+
+    inline uint64_t* stat_at(stream_stats_t* stats, const StatField& f) {
+        return reinterpret_cast<uint64_t*>(reinterpret_cast<uint8_t*>(stats) + f.offset);
+    }
+
+    void stats_accumulate(stream_stats_t* total, stream_stats_t* stats) {
+        for (const auto& f : kStatFields) {
+            uint64_t* dst = stat_at(total, f);
+            const uint64_t v = stream_stat_get(stat_at(stats, f));
+            if (f.gauge) {
+                if (v > *dst) *dst = v;
+            } else {
+                *dst += v;
             }
-            tech_pvt->codec_initialized = 1;
-            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, 
-                "(%s) %s codec initialized successfully\n", tech_pvt->sessionId, codec_name);
         }
+    }
 
-        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "(%s) stream_data_init\n", tech_pvt->sessionId);
+    void stats_add_counters(cJSON* obj, stream_stats_t* stats) {
+        for (const auto& f : kStatFields) {
+            cJSON_AddNumberToObject(obj, f.name, (double)stream_stat_get(stat_at(stats, f)));
+        }
+    }
 
-        return SWITCH_STATUS_SUCCESS;
+    void register_session(private_t* tech_pvt) {
+        std::lock_guard<std::mutex> lock(g_sessions_mutex);
+        g_sessions[tech_pvt->sessionId] = tech_pvt;
+        g_calls_total++;
     }
 
-    void destroy_tech_pvt(private_t* tech_pvt) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "%s destroy_tech_pvt\n", tech_pvt->sessionId);
-        if (tech_pvt->resampler) {
-            speex_resampler_destroy(tech_pvt->resampler);
-            tech_pvt->resampler = nullptr;
+    void unregister_session(private_t* tech_pvt) {
+        std::lock_guard<std::mutex> lock(g_sessions_mutex);
+        auto it = g_sessions.find(tech_pvt->sessionId);
+        if (it == g_sessions.end() || it->second != tech_pvt) return;
+        stats_accumulate(&g_finished_stats, &tech_pvt->stats);
+        if (tech_pvt->latency) latency_merge(&g_finished_latency, tech_pvt->latency);
+        g_sessions.erase(it);
+    }
+
+    /* Caller holds g_sessions_mutex */
+    cJSON* session_stats_json(private_t* tech_pvt) {
+        auto* as = static_cast<AudioStreamer*>(tech_pvt->pAudioStreamer);
+        cJSON* obj = cJSON_CreateObject();
+        cJSON_AddStringToObject(obj, "uuid", tech_pvt->sessionId);
+        cJSON_AddStringToObject(obj, "ws_uri", tech_pvt->ws_uri);
+        cJSON_AddBoolToObject(obj, "connected", as && as->isConnected());
+        cJSON_AddBoolToObject(obj, "pooled", as && as->isPooled());
+        stats_add_counters(obj, &tech_pvt->stats);
+        cJSON_AddNumberToObject(obj, "send_pending_bytes", (double)tech_pvt->send_len);
+        cJSON_AddNumberToObject(obj, "send_batch_bytes", (double)__atomic_load_n(&tech_pvt->send_batch, __ATOMIC_RELAXED));
+        cJSON_AddNumberToObject(obj, "send_cost_us", (double)__atomic_load_n(&tech_pvt->send_cost_us, __ATOMIC_RELAXED));
+        cJSON_AddNumberToObject(obj, "send_queue_bytes", as ? (double)as->queuedBytes() : 0);
+        cJSON_AddNumberToObject(obj, "outbound_queue_bytes", as ? (double)as->sendQueueBytes() : 0);
+        cJSON_AddNumberToObject(obj, "preroll_buffered_bytes",
+                                tech_pvt->preroll_ring ? (double)playback_ring_inuse(tech_pvt->preroll_ring) : 0);
+        cJSON_AddNumberToObject(obj, "playback_buffered_bytes",
+                                tech_pvt->playback_ring ? (double)playback_ring_inuse(tech_pvt->playback_ring) : 0);
+        cJSON_AddBoolToObject(obj, "playback_active", tech_pvt->playback_active);
+        if (tech_pvt->playback_adaptive && tech_pvt->playback_bytes_per_ms) {
+            cJSON_AddNumberToObject(obj, "playback_target_ms",
+                                    (double)(__atomic_load_n(&tech_pvt->playback_target, __ATOMIC_RELAXED) / tech_pvt->playback_bytes_per_ms));
+            cJSON_AddNumberToObject(obj, "playback_jitter_ms",
+                                    (double)(__atomic_load_n(&tech_pvt->playback_jitter_us, __ATOMIC_RELAXED) / 1000));
         }
-        if (tech_pvt->codec_initialized) {
-            switch_core_codec_destroy(&tech_pvt->write_codec);
-            tech_pvt->codec_initialized = 0;
+        cJSON_AddNumberToObject(obj, "underrun_streak", tech_pvt->underrun_streak);
+        const uint64_t first = __atomic_load_n(&tech_pvt->first_audio_ts, __ATOMIC_RELAXED);
+        const uint64_t start = __atomic_load_n(&tech_pvt->playback_start_ts, __ATOMIC_RELAXED);
+        if (first && start >= first) {
+            cJSON_AddNumberToObject(obj, "first_playback_latency_ms", (double)((start - first) / 1000));
         }
-        if (tech_pvt->mutex) {
-            switch_mutex_destroy(tech_pvt->mutex);
-            tech_pvt->mutex = nullptr;
+        if (tech_pvt->latency) {
+            cJSON_AddItemToObject(obj, "latency", latency_json(tech_pvt->latency));
         }
-        if (tech_pvt->playback_buffer) {
-            switch_buffer_destroy(&tech_pvt->playback_buffer);
-            tech_pvt->playback_buffer = nullptr;
+        if (auto *sinks = static_cast<CaptureSinks *>(__atomic_load_n(&tech_pvt->sinks, __ATOMIC_ACQUIRE))) {
+            cJSON* list = cJSON_CreateArray();
+            std::lock_guard<std::mutex> lock(sinks->mutex);
+            for (CaptureSink *sink : sinks->list) {
+                stream_sink_stats_t *stats = sink->streamer->sinkStats();
+                cJSON* item = cJSON_CreateObject();
+                cJSON_AddStringToObject(item, "ws_uri", sink->streamer->uri().c_str());
+                cJSON_AddStringToObject(item, "format", sink->audio_format == AUDIO_FORMAT_PCMU ? "pcmu" :
+                                                        sink->audio_format == AUDIO_FORMAT_PCMA ? "pcma" : "l16");
+                cJSON_AddBoolToObject(item, "connected", sink->streamer->isConnected());
+                cJSON_AddNumberToObject(item, "messages_sent_total", (double)stream_stat_get(&stats->messages_sent));
+                cJSON_AddNumberToObject(item, "bytes_sent_total", (double)stream_stat_get(&stats->bytes_sent));
+                cJSON_AddNumberToObject(item, "dropped_bytes_total", (double)stream_stat_get(&stats->dropped_bytes));
+                cJSON_AddNumberToObject(item, "connects_total", (double)stream_stat_get(&stats->connects));
+                cJSON_AddNumberToObject(item, "disconnects_total", (double)stream_stat_get(&stats->disconnects));
+                cJSON_AddNumberToObject(item, "errors_total", (double)stream_stat_get(&stats->errors));
+                cJSON_AddNumberToObject(item, "reconnect_attempts_total", (double)stream_stat_get(&stats->reconnect_attempts));
+                cJSON_AddNumberToObject(item, "outbound_queue_bytes", (double)sink->streamer->sendQueueBytes());
+                cJSON_AddItemToArray(list, item);
+            }
+            cJSON_AddItemToObject(obj, "sinks", list);
         }
-        if (tech_pvt->playback_mutex) {
-            switch_mutex_destroy(tech_pvt->playback_mutex);
-            tech_pvt->playback_mutex = nullptr;
+        return obj;
+    }
+
+    /* NETPLAY v2.7: the frame in a sink's format, encoded on first use */
+    const uint8_t *sink_frame_data(CaptureSinks *sinks, SinkFrame &frame, int format, size_t &len) {
+        if (format == AUDIO_FORMAT_L16) {
+            len = frame.samples * sizeof(int16_t);
+            return reinterpret_cast<const uint8_t *>(frame.pcm);
         }
-        /*if (tech_pvt->pAudioStreamer) {
-            auto* as = (AudioStreamer *) tech_pvt->pAudioStreamer;
-            delete as;
-            tech_pvt->pAudioStreamer = nullptr;
-        }*/
+        len = frame.samples;
+        if (!frame.enc[format]) {
+            std::vector<uint8_t> &out = format == AUDIO_FORMAT_PCMU ? sinks->ulaw : sinks->alaw;
+            if (out.size() < frame.samples) out.resize(frame.samples);
+            if (format == AUDIO_FORMAT_PCMU) {
+                g711_ulaw_encode(frame.pcm, out.data(), frame.samples);
+            } else {
+                g711_alaw_encode(frame.pcm, out.data(), frame.samples);
+            }
+            frame.enc[format] = out.data();
+        }
+        return frame.enc[format];
     }
 
-    void finish(AudioStreamer* audioStreamer) {
-        audioStreamer->markCleanedUp();
-        audioStreamer->disconnect();
-        delete audioStreamer;
+    /* NETPLAY v2.7: a sink has no pre-roll or replay window: what it cannot take now is
+     * counted and dropped. Media thread only, with tech_pvt->mutex held. */
+    void sink_flush(private_t *tech_pvt, CaptureSink *sink) {
+        AudioStreamer *as = sink->streamer;
+        stream_sink_stats_t *stats = as->sinkStats();
+        if (as->isConnected()) {
+            SendQueuePush push;
+            as->sendInitialMetadata(tech_pvt);
+            as->writeBinary(sink->buf.data(), sink->len, &push);
+            /* DropNewest reports this very message in dropped_bytes: it was not sent */
+            if (push.queued) {
+                stream_stat_inc(&stats->messages_sent);
+                stream_stat_add(&stats->bytes_sent, sink->len);
+            }
+            if (push.dropped_bytes) stream_stat_add(&stats->dropped_bytes, push.dropped_bytes);
+        } else {
+            stream_stat_add(&stats->dropped_bytes, sink->len);
+        }
+        sink->len = 0;
+    }
+
+    void sinks_capture(private_t *tech_pvt, CaptureSinks *sinks, SinkFrame &frame) {
+        for (CaptureSink *sink : sinks->list) {
+            size_t len;
+            const uint8_t *data = sink_frame_data(sinks, frame, sink->audio_format, len);
+            if (len > sink->buf.size() - sink->len) len = sink->buf.size() - sink->len;
+            memcpy(sink->buf.data() + sink->len, data, len);
+            sink->len += len;
+            if (sink->len >= sink->batch) sink_flush(tech_pvt, sink);
+        }
+    }
+
+    void sinks_flush(private_t *tech_pvt, CaptureSinks *sinks) {
+        for (CaptureSink *sink : sinks->list) {
+            if (sink->len) sink_flush(tech_pvt, sink);
+        }
     }
 
 }
@@ -690,6 +2136,34 @@ extern "C" {
         return SWITCH_STATUS_SUCCESS;
     }
 
+    /* NETPLAY v2.7: the bug of a stream from stream_session_init is attached */
+    void stream_session_attached(private_t *tech_pvt) {
+        register_session(tech_pvt);
+    }
+
+    /* NETPLAY v2.7: the bug could not be attached; nothing but this thread knows the stream */
+    void stream_session_abort(switch_core_session_t *session, private_t *tech_pvt) {
+        auto* as = static_cast<AudioStreamer*>(tech_pvt->pAudioStreamer);
+        auto* sinks = static_cast<CaptureSinks*>(tech_pvt->sinks);
+        tech_pvt->pAudioStreamer = nullptr;
+        tech_pvt->sinks = nullptr;
+        tech_pvt->cleanup_started = 1;
+        if (sinks) {
+            for (CaptureSink *sink : sinks->list) {
+                sink->streamer->unbindSession();
+                finish(sink->streamer);
+                delete sink;
+            }
+            delete sinks;
+        }
+        if (as) {
+            as->unbindSession();
+            finish(as);
+        }
+        destroy_tech_pvt(tech_pvt);
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "stream_session_abort: stream discarded\n");
+    }
+
     switch_status_t stream_session_send_text(switch_core_session_t *session, char* text) {
         switch_channel_t *channel = switch_core_session_get_channel(session);
         auto *bug = (switch_media_bug_t*) switch_channel_get_private(channel, MY_BUG_NAME);
@@ -706,6 +2180,37 @@ extern "C" {
         return SWITCH_STATUS_SUCCESS;
     }
 
+    /* NETPLAY v2.7: uuid_audio_stream play_cached. The mutex keeps cleanup from removing
+     * the streamer under the call. */
+    switch_status_t stream_session_play_cached(switch_core_session_t *session, const char *id, const char *hash) {
+        switch_channel_t *channel = switch_core_session_get_channel(session);
+        auto *bug = (switch_media_bug_t*) switch_channel_get_private(channel, MY_BUG_NAME);
+        if (!bug) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "stream_session_play_cached failed because no bug\n");
+            return SWITCH_STATUS_FALSE;
+        }
+        auto *tech_pvt = (private_t*) switch_core_media_bug_get_user_data(bug);
+
+        if (!tech_pvt || !tech_pvt->mutex) return SWITCH_STATUS_FALSE;
+        switch_status_t status = SWITCH_STATUS_FALSE;
+        switch_mutex_lock(tech_pvt->mutex);
+        auto *pAudioStreamer = static_cast<AudioStreamer *>(tech_pvt->pAudioStreamer);
+        if (pAudioStreamer && !tech_pvt->cleanup_started && pAudioStreamer->playCachedCommand(session, tech_pvt, id, hash)) {
+            status = SWITCH_STATUS_SUCCESS;
+        }
+        switch_mutex_unlock(tech_pvt->mutex);
+        return status;
+    }
+
+    /* NETPLAY v2.7: playback report from the media thread, sent to the backend as is.
+     * trylock like stream_frame: cleanup holds the mutex while removing the bug. */
+    void stream_session_playback_report(private_t *tech_pvt, const char *json) {
+        if (switch_mutex_trylock(tech_pvt->mutex) != SWITCH_STATUS_SUCCESS) return;
+        auto *pAudioStreamer = static_cast<AudioStreamer *>(tech_pvt->pAudioStreamer);
+        if (pAudioStreamer && pAudioStreamer->isConnected()) pAudioStreamer->writeText(json);
+        switch_mutex_unlock(tech_pvt->mutex);
+    }
+
     switch_status_t stream_session_pauseresume(switch_core_session_t *session, int pause) {
         switch_channel_t *channel = switch_core_session_get_channel(session);
         auto *bug = (switch_media_bug_t*) switch_channel_get_private(channel, MY_BUG_NAME);
@@ -722,83 +2227,281 @@ extern "C" {
         return SWITCH_STATUS_SUCCESS;
     }
 
+    /* NETPLAY v2.7: re-read the STREAM_* variables of a running stream. Only logging
+     * follows; everything else was sized when the stream started. */
+    switch_status_t stream_session_refresh(switch_core_session_t *session) {
+        switch_channel_t *channel = switch_core_session_get_channel(session);
+        auto *bug = (switch_media_bug_t*) switch_channel_get_private(channel, MY_BUG_NAME);
+        if (!bug) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "stream_session_refresh failed because no bug\n");
+            return SWITCH_STATUS_FALSE;
+        }
+        auto *tech_pvt = (private_t*) switch_core_media_bug_get_user_data(bug);
+        if (!tech_pvt) return SWITCH_STATUS_FALSE;
+
+        stream_config_t cfg;
+        stream_config_load(session, &cfg);
+
+        switch_mutex_lock(tech_pvt->mutex);
+        auto *as = (AudioStreamer *) tech_pvt->pAudioStreamer;
+        if (as && !tech_pvt->cleanup_started) {
+            __atomic_store_n(&tech_pvt->config.log_level, cfg.log_level, __ATOMIC_RELAXED);
+            tech_pvt->config.suppress_log = cfg.suppress_log;
+            as->setSuppressLog(cfg.suppress_log != 0);
+            if (auto *sinks = static_cast<CaptureSinks *>(tech_pvt->sinks)) {
+                for (CaptureSink *sink : sinks->list) sink->streamer->setSuppressLog(cfg.suppress_log != 0);
+            }
+        }
+        switch_mutex_unlock(tech_pvt->mutex);
+
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
+                          "(%s) config refreshed (log level %s, suppress log %s)\n", tech_pvt->sessionId,
+                          cfg.log_level >= 0 ? switch_log_level2str((switch_log_level_t)cfg.log_level) : "default",
+                          cfg.suppress_log ? "on" : "off");
+        return SWITCH_STATUS_SUCCESS;
+    }
+
+    /* NETPLAY v2.7: one more destination for the running stream's capture. It takes the
+     * stream's rate, mix and connection variables; playback stays with the primary. */
+    switch_status_t stream_session_add_sink(switch_core_session_t *session, char *wsUri, int audio_format, char *metadata) {
+        switch_channel_t *channel = switch_core_session_get_channel(session);
+        auto *bug = (switch_media_bug_t*) switch_channel_get_private(channel, MY_BUG_NAME);
+        if (!bug) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "add_sink needs a running stream (start first)\n");
+            return SWITCH_STATUS_FALSE;
+        }
+        auto *tech_pvt = (private_t*) switch_core_media_bug_get_user_data(bug);
+        if (!tech_pvt) return SWITCH_STATUS_FALSE;
+        if (audio_format == AUDIO_FORMAT_OPUS) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "add_sink supports l16, pcmu and pcma\n");
+            return SWITCH_STATUS_FALSE;
+        }
+        if (audio_format != AUDIO_FORMAT_L16 && tech_pvt->sampling != 8000) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                              "add_sink: G.711 needs an 8000 Hz stream, this one is %d Hz\n", tech_pvt->sampling);
+            return SWITCH_STATUS_FALSE;
+        }
+
+        /* Same batch as the primary stream at its largest, in the sink's format */
+        const size_t bytes_per_ms = (size_t)tech_pvt->sampling / 1000 * (size_t)tech_pvt->channels *
+                                    (audio_format == AUDIO_FORMAT_L16 ? sizeof(int16_t) : 1);
+        const size_t batch_ms = tech_pvt->send_batch_max / tech_pvt->capture_bytes_per_ms;
+        const size_t frame_max = (size_t)tech_pvt->sampling * (size_t)tech_pvt->channels * SEND_BUF_MAX_PTIME_MS / 1000;
+
+        std::unique_ptr<CaptureSink> sink(new CaptureSink());
+        sink->audio_format = audio_format;
+        sink->batch = (batch_ms ? batch_ms : 20) * bytes_per_ms;
+        sink->buf.resize(sink->batch + frame_max * sizeof(int16_t));
+
+        stream_config_t cfg = tech_pvt->config;
+        cfg.binary_playback = 0;
+        sink->streamer = create_streamer(session, wsUri, tech_pvt->responseHandler, &cfg, true, metadata);
+
+        switch_mutex_lock(tech_pvt->mutex);
+        auto *as = (AudioStreamer *) tech_pvt->pAudioStreamer;
+        auto *sinks = static_cast<CaptureSinks *>(tech_pvt->sinks);
+        const char *refused = nullptr;
+        if (!as || tech_pvt->cleanup_started) {
+            refused = "the stream is stopping";
+        } else if (sinks && sinks->list.size() >= STREAM_MAX_SINKS) {
+            refused = "too many sinks";
+        } else if (sinks) {
+            for (CaptureSink *other : sinks->list) {
+                if (other->streamer->uri() == wsUri) refused = "already a sink";
+            }
+        }
+        if (refused) {
+            switch_mutex_unlock(tech_pvt->mutex);
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "add_sink %s: %s\n", wsUri, refused);
+            finish(sink->streamer);
+            return SWITCH_STATUS_FALSE;
+        }
+        if (const SendQueue *queue = as->sendQueue()) {
+            const size_t queue_ms = queue->limit() / tech_pvt->capture_bytes_per_ms;
+            sink->streamer->enableSendQueue(queue_ms * bytes_per_ms, queue_ms / 2 * bytes_per_ms, queue->policy());
+        }
+        if (!sinks) {
+            sinks = new CaptureSinks();
+            sinks->ulaw.resize(frame_max);
+            sinks->alaw.resize(frame_max);
+            __atomic_store_n(&tech_pvt->sinks, static_cast<void *>(sinks), __ATOMIC_RELEASE);
+        }
+        sink->streamer->bindSession(session, tech_pvt);
+        {
+            std::lock_guard<std::mutex> lock(sinks->mutex);
+            sinks->list.push_back(sink.release());
+        }
+        const size_t count = sinks->list.size();
+        switch_mutex_unlock(tech_pvt->mutex);
+
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "(%s) sink %zu: %s (%s, %zums batches)\n",
+                          tech_pvt->sessionId, count, wsUri,
+                          audio_format == AUDIO_FORMAT_PCMU ? "pcmu" : audio_format == AUDIO_FORMAT_PCMA ? "pcma" : "l16",
+                          batch_ms ? batch_ms : 20);
+        return SWITCH_STATUS_SUCCESS;
+    }
+
+    switch_status_t stream_session_remove_sink(switch_core_session_t *session, char *wsUri) {
+        switch_channel_t *channel = switch_core_session_get_channel(session);
+        auto *bug = (switch_media_bug_t*) switch_channel_get_private(channel, MY_BUG_NAME);
+        if (!bug) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "remove_sink failed because no bug\n");
+            return SWITCH_STATUS_FALSE;
+        }
+        auto *tech_pvt = (private_t*) switch_core_media_bug_get_user_data(bug);
+        if (!tech_pvt) return SWITCH_STATUS_FALSE;
+
+        CaptureSink *sink = nullptr;
+        switch_mutex_lock(tech_pvt->mutex);
+        if (auto *sinks = static_cast<CaptureSinks *>(tech_pvt->sinks)) {
+            for (auto it = sinks->list.begin(); it != sinks->list.end(); ++it) {
+                if ((*it)->streamer->uri() != wsUri) continue;
+                sink = *it;
+                if (sink->len) sink_flush(tech_pvt, sink);
+                std::lock_guard<std::mutex> lock(sinks->mutex);
+                sinks->list.erase(it);
+                break;
+            }
+        }
+        switch_mutex_unlock(tech_pvt->mutex);
+
+        if (!sink) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "remove_sink: %s is not a sink\n", wsUri);
+            return SWITCH_STATUS_FALSE;
+        }
+        /* Outside the mutex, as in stream_session_cleanup */
+        sink->streamer->unbindSession();
+        finish(sink->streamer);
+        delete sink;
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "(%s) sink removed: %s\n", tech_pvt->sessionId, wsUri);
+        return SWITCH_STATUS_SUCCESS;
+    }
+
+    switch_status_t stream_session_prepare(switch_core_session_t *session, responseHandler_t responseHandler, char *wsUri) {
+        switch_channel_t *channel = switch_core_session_get_channel(session);
+
+        if (switch_channel_get_private(channel, MY_BUG_NAME)) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "stream_session_prepare: stream already started\n");
+            return SWITCH_STATUS_FALSE;
+        }
+        if (g_draining.load(std::memory_order_acquire)) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "stream_session_prepare: node is draining (graceful-shutdown)\n");
+            return SWITCH_STATUS_FALSE;
+        }
+
+        stream_config_t cfg;
+        stream_config_load(session, &cfg);
+        auto* as = create_streamer(session, wsUri, responseHandler, &cfg);
+        AudioStreamer* previous = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(g_prepared_mutex);
+            previous = static_cast<AudioStreamer*>(switch_channel_get_private(channel, MY_PREPARED_NAME));
+            switch_channel_set_private(channel, MY_PREPARED_NAME, as);
+        }
+        if (previous) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
+                              "stream_session_prepare: replacing prepared connection to %s\n", previous->uri().c_str());
+            finish(previous);
+        }
+
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "stream_session_prepare: connecting to %s\n", wsUri);
+        return SWITCH_STATUS_SUCCESS;
+    }
+
+    void stream_session_release_prepared(switch_core_session_t *session) {
+        auto* as = take_prepared(switch_core_session_get_channel(session));
+        if (as) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
+                              "releasing unused prepared connection to %s\n", as->uri().c_str());
+            finish(as);
+        }
+    }
+
     switch_status_t stream_session_init(switch_core_session_t *session,
                                         responseHandler_t responseHandler,
                                         uint32_t samples_per_second,
                                         char *wsUri,
                                         int sampling,
                                         int channels,
+                                        int mix,
                                         int audio_format,
                                         char* metadata,
                                         void **ppUserData)
     {
-        int deflate = 0;
-        int heart_beat = 0;
-        bool suppressLog = false;
-        const char* buffer_size = NULL;
-        const char* extra_headers = NULL;
         int rtp_packets = 1; //20ms burst
-        bool no_reconnect = false;
-        const char* tls_cafile = NULL;
-        const char* tls_keyfile = NULL;
-        const char* tls_certfile = NULL;
-        bool tls_disable_hostname_validation = false;
+        uint32_t playback_in_rate = 8000;
 
         switch_channel_t *channel = switch_core_session_get_channel(session);
 
-        if (switch_channel_var_true(channel, "STREAM_MESSAGE_DEFLATE")) {
-            deflate = 1;
-        }
-
-        if (switch_channel_var_true(channel, "STREAM_SUPPRESS_LOG")) {
-            suppressLog = true;
-        }
-
-        if (switch_channel_var_true(channel, "STREAM_NO_RECONNECT")) {
-            no_reconnect = true;
+        if (g_draining.load(std::memory_order_acquire)) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "stream_session_init: node is draining (graceful-shutdown)\n");
+            return SWITCH_STATUS_FALSE;
         }
 
-        tls_cafile = switch_channel_get_variable(channel, "STREAM_TLS_CA_FILE");
-        tls_keyfile = switch_channel_get_variable(channel, "STREAM_TLS_KEY_FILE");
-        tls_certfile = switch_channel_get_variable(channel, "STREAM_TLS_CERT_FILE");
+        /* NETPLAY v2.7: every STREAM_* variable is read here, once for the whole stream */
+        stream_config_t cfg;
+        stream_config_load(session, &cfg);
 
-        if (switch_channel_var_true(channel, "STREAM_TLS_DISABLE_HOSTNAME_VALIDATION")) {
-            tls_disable_hostname_validation = true;
-        }
-
-        const char* heartBeat = switch_channel_get_variable(channel, "STREAM_HEART_BEAT");
-        if (heartBeat) {
-            char *endptr;
-            long value = strtol(heartBeat, &endptr, 10);
-            if (*endptr == '\0' && value <= INT_MAX && value >= INT_MIN) {
-                heart_beat = (int) value;
+        if (cfg.playback_sample_rate != STREAM_CONFIG_UNSET) {
+            if (stream_playback_rate_valid(STREAM_CODEC_L16, (uint32_t)cfg.playback_sample_rate)) {
+                playback_in_rate = (uint32_t)cfg.playback_sample_rate;
+            } else {
+                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING, "%s: invalid STREAM_PLAYBACK_SAMPLE_RATE %d, using 8000.\n",
+                                  switch_channel_get_name(channel), cfg.playback_sample_rate);
             }
         }
 
-        if ((buffer_size = switch_channel_get_variable(channel, "STREAM_BUFFER_SIZE"))) {
-            int bSize = atoi(buffer_size);
+        if (cfg.buffer_size_ms != STREAM_CONFIG_UNSET) {
+            int bSize = cfg.buffer_size_ms;
             if(bSize % 20 != 0) {
-                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING, "%s: Buffer size of %s is not a multiple of 20ms. Using default 20ms.\n",
-                                  switch_channel_get_name(channel), buffer_size);
+                switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING, "%s: Buffer size of %d is not a multiple of 20ms. Using default 20ms.\n",
+                                  switch_channel_get_name(channel), bSize);
             } else if(bSize >= 20){
                 rtp_packets = bSize/20;
             }
         }
 
-        extra_headers = switch_channel_get_variable(channel, "STREAM_EXTRA_HEADERS");
-
         // allocate per-session tech_pvt
-        auto* tech_pvt = (private_t *) switch_core_session_alloc(session, sizeof(private_t));
+        /* NETPLAY v2.7: session pool memory is only pointer aligned, private_t wants cache
+         * lines (see STREAM_CACHELINE_ALIGNED): over-allocate and align by hand */
+        auto* raw = (uint8_t *) switch_core_session_alloc(session, sizeof(private_t) + STREAM_CACHELINE);
+        private_t* tech_pvt = nullptr;
+        if (raw) {
+            const uintptr_t addr = (reinterpret_cast<uintptr_t>(raw) + STREAM_CACHELINE - 1) & ~(uintptr_t)(STREAM_CACHELINE - 1);
+            tech_pvt = reinterpret_cast<private_t *>(addr);
+        }
 
         if (!tech_pvt) {
             switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "error allocating memory!\n");
             return SWITCH_STATUS_FALSE;
         }
-        if (SWITCH_STATUS_SUCCESS != stream_data_init(tech_pvt, session, wsUri, samples_per_second, sampling, channels, audio_format, metadata, responseHandler, deflate, heart_beat,
-                                                        suppressLog, rtp_packets, extra_headers, no_reconnect, tls_cafile, tls_keyfile, tls_certfile, tls_disable_hostname_validation)) {
+
+        /* NETPLAY v2.7: adopt the connection opened by uuid_audio_stream prepare */
+        AudioStreamer* as = take_prepared(channel);
+        if (as && (as->hasFailed() || as->uri() != wsUri)) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
+                              "discarding prepared connection to %s (%s)\n", as->uri().c_str(),
+                              as->hasFailed() ? "failed" : "different url");
+            finish(as);
+            as = nullptr;
+        }
+        if (as) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
+                              "using prepared connection to %s (%s)\n", wsUri, as->isConnected() ? "connected" : "connecting");
+        } else {
+            as = create_streamer(session, wsUri, responseHandler, &cfg);
+        }
+
+        if (SWITCH_STATUS_SUCCESS != stream_data_init(tech_pvt, session, wsUri, samples_per_second, sampling, channels, mix, audio_format, metadata, responseHandler,
+                                                        rtp_packets, as, playback_in_rate, &cfg)) {
+            finish(as);
             destroy_tech_pvt(tech_pvt);
             return SWITCH_STATUS_FALSE;
         }
+        if (as->isConnected()) {
+            /* Opened while preparing, before there were stats to count it in */
+            stream_stat_inc(&tech_pvt->stats.connects);
+        }
 
         *ppUserData = tech_pvt;
 
@@ -806,6 +2509,9 @@ extern "C" {
     }
 
     /* Helper function to encode L16 PCM to G.711 
+     * 
+     * Output may alias the input (in-place): every output byte is written at or
+     * before the input sample it came from.
      * 
      * Note: G.711 requires 8kHz audio. If input is not 8kHz, encoding will fail.
      * The caller must ensure proper sample rate before calling this function.
@@ -816,7 +2522,7 @@ extern "C" {
     static size_t encode_g711(private_t *tech_pvt, const uint8_t *pcm_data, size_t pcm_len, uint8_t *g711_data, size_t g711_buflen) {
         if (!tech_pvt || !tech_pvt->codec_initialized) {
             switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, 
-                "encode_g711: codec not initialized\n");
+                "encode_g711: G.711 not enabled for this stream\n");
             return 0;
         }
         
@@ -843,43 +2549,249 @@ extern "C" {
             return 0;
         }
         
+        const size_t sample_count = pcm_len / 2;
         if (tech_pvt->audio_format == AUDIO_FORMAT_PCMU) {
-            const int16_t *samples = (const int16_t *)pcm_data;
-            const size_t sample_count = pcm_len / 2;
-            for (size_t i = 0; i < sample_count; ++i) {
-                g711_data[i] = linear_to_ulaw(samples[i]);
-            }
-            return sample_count;
+            g711_ulaw_encode((const int16_t *)pcm_data, g711_data, sample_count);
+        } else {
+            g711_alaw_encode((const int16_t *)pcm_data, g711_data, sample_count);
         }
-        
-        uint32_t encoded_len = (uint32_t)g711_buflen;
-        uint32_t encoded_rate = 8000;
-        unsigned int flags = 0;
-        
-        switch_status_t status = switch_core_codec_encode(
-            &tech_pvt->write_codec,
-            NULL,
-            (void *)pcm_data,
-            (uint32_t)pcm_len,
-            8000,  /* G.711 is always 8kHz */
-            g711_data,
-            &encoded_len,
-            &encoded_rate,
-            &flags
-        );
-        
-        if (status != SWITCH_STATUS_SUCCESS) {
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, 
-                "encode_g711: switch_core_codec_encode failed (pcm_len=%zu)\n", pcm_len);
+        return sample_count;
+    }
+
+    /* NETPLAY v2.7: Opus packets for the samples, length-prefixed (see stream_protocol.h).
+     * Less than 20 ms stays buffered in the encoder, so a frame may produce nothing. */
+    static size_t encode_opus(private_t *tech_pvt, const int16_t *pcm, size_t samples, uint8_t *dst, size_t room) {
+        const int n = capture_opus_encode(tech_pvt->opus, pcm, (uint32_t)samples, dst, room);
+        if (n < 0) {
+            stream_stat_inc(&tech_pvt->stats.frames_dropped);
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
+                "(%s) encode_opus: %s, frame dropped\n", tech_pvt->sessionId,
+                n == CAPTURE_OPUS_OVERFLOW ? "frame longer than the encoder input" : "encoder error");
             return 0;
         }
-        
-        return (size_t)encoded_len;
+        return (size_t)n;
+    }
+
+    /* NETPLAY v2.7: every capture message goes through here, so the outbound queue counters
+     * keep a single writer. Media thread only, with tech_pvt->mutex held. */
+    static void capture_send(switch_core_session_t *session, private_t *tech_pvt, AudioStreamer *pAudioStreamer,
+                             uint8_t *data, size_t len) {
+        SendQueuePush push;
+        pAudioStreamer->writeBinary(data, len, &push);
+        if (tech_pvt->resume_ring) {
+            playback_ring_write(tech_pvt->resume_ring, data, len, tech_pvt->resume_limit, nullptr);
+            tech_pvt->capture_pos += len;
+            tech_pvt->resume_sent_pos = tech_pvt->capture_pos;
+        }
+        if (push.queued) {
+            stream_stat_inc(&tech_pvt->stats.messages_sent);
+            stream_stat_add(&tech_pvt->stats.bytes_sent, len);
+        }
+        if (push.dropped_messages) {
+            stream_stat_add(&tech_pvt->stats.outbound_dropped_messages, push.dropped_messages);
+            stream_stat_add(&tech_pvt->stats.outbound_dropped_bytes, push.dropped_bytes);
+        }
+        if (push.coalesced) stream_stat_inc(&tech_pvt->stats.outbound_coalesced);
+        if (push.high_water) {
+            const SendQueue *queue = pAudioStreamer->sendQueue();
+            const size_t queued = pAudioStreamer->sendQueueBytes();
+            char json[160];
+            stream_stat_inc(&tech_pvt->stats.outbound_high_water);
+            switch_snprintf(json, sizeof(json), "{\"queuedBytes\":%zu,\"queuedMs\":%zu,\"limitMs\":%zu,\"policy\":\"%s\"}",
+                            queued, queued / tech_pvt->capture_bytes_per_ms, queue->limit() / tech_pvt->capture_bytes_per_ms,
+                            send_queue_policy_name(queue->policy()));
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
+                "(%s) outbound queue above high water: %s\n", tech_pvt->sessionId, json);
+            tech_pvt->responseHandler(session, EVENT_SEND_QUEUE_HIGH_WATER, json);
+        }
+    }
+
+    /* NETPLAY v2.7: send everything captured while connecting as a single message.
+     * Media thread only, with tech_pvt->mutex held. */
+    static void preroll_flush(switch_core_session_t *session, private_t *tech_pvt, AudioStreamer *pAudioStreamer) {
+        const switch_size_t len = playback_ring_read(tech_pvt->preroll_ring, tech_pvt->preroll_buf, tech_pvt->preroll_limit);
+        if (!len) return;
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "(%s) flushing %zuB of pre-roll (%zuB dropped while connecting)\n",
+                          tech_pvt->sessionId, len, tech_pvt->preroll_dropped);
+        capture_send(session, tech_pvt, pAudioStreamer, tech_pvt->preroll_buf, len);
+        if (tech_pvt->latency && tech_pvt->preroll_first_ts) {
+            stream_hist_record(&tech_pvt->latency->capture_to_send, (uint64_t)(switch_micro_time_now() - tech_pvt->preroll_first_ts));
+        }
+        tech_pvt->preroll_first_ts = 0;
+        tech_pvt->preroll_dropped = 0;
+    }
+
+    /* NETPLAY v2.7: the streamer is on a new connection. Tell the backend which session this
+     * is and replay the window: it starts at replayFrom and ends at position (capture bytes),
+     * so the backend drops what it already had. lostBytes is outage audio that no longer fit.
+     * Media thread only, with tech_pvt->mutex held. */
+    static void resume_replay(private_t *tech_pvt, AudioStreamer *pAudioStreamer) {
+        const switch_size_t len = playback_ring_read(tech_pvt->resume_ring, tech_pvt->resume_buf, tech_pvt->resume_limit);
+        const uint64_t from = tech_pvt->capture_pos - len;
+        const uint64_t lost = from > tech_pvt->resume_sent_pos ? from - tech_pvt->resume_sent_pos : 0;
+        char json[256];
+        switch_snprintf(json, sizeof(json),
+                        "{\"type\":\"resume\",\"resumeToken\":\"%s\",\"replayFrom\":%" SWITCH_UINT64_T_FMT
+                        ",\"position\":%" SWITCH_UINT64_T_FMT ",\"lostBytes\":%" SWITCH_UINT64_T_FMT ",\"epoch\":%u}",
+                        pAudioStreamer->resumeToken().c_str(), from, tech_pvt->capture_pos, lost,
+                        (unsigned)__atomic_load_n(&tech_pvt->playback_epoch, __ATOMIC_RELAXED));
+        pAudioStreamer->writeText(json);
+        if (len) {
+            pAudioStreamer->writeBinary(tech_pvt->resume_buf, len);
+            /* Still the newest audio: keep it for the next outage, without moving capture_pos */
+            playback_ring_write(tech_pvt->resume_ring, tech_pvt->resume_buf, len, tech_pvt->resume_limit, nullptr);
+        }
+        tech_pvt->resume_sent_pos = tech_pvt->capture_pos;
+        stream_stat_add(&tech_pvt->stats.resume_replayed_bytes, len);
+        stream_stat_add(&tech_pvt->stats.resume_dropped_bytes, lost);
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "(%s) resumed on connection %u: replayed %zuB from %" SWITCH_UINT64_T_FMT
+                          " (%" SWITCH_UINT64_T_FMT "B lost)\n", tech_pvt->sessionId, pAudioStreamer->linkId(), len, from, lost);
+    }
+
+    /* NETPLAY v2.7: tell the backend how much held back audio was discarded for good, so
+     * its timeline stays aligned: audio sent plus silence markers is the captured time */
+    static void vad_silence_marker(private_t *tech_pvt, AudioStreamer *pAudioStreamer) {
+        const uint64_t ms = tech_pvt->vad_pending_bytes / tech_pvt->vad_bytes_per_ms;
+        char json[64];
+        if (!ms) return;
+        switch_snprintf(json, sizeof(json), "{\"type\":\"silence\",\"durationMs\":%" SWITCH_UINT64_T_FMT "}", ms);
+        pAudioStreamer->writeText(json);
+        tech_pvt->vad_pending_bytes -= (switch_size_t)ms * tech_pvt->vad_bytes_per_ms;
+        stream_stat_inc(&tech_pvt->stats.vad_silence_markers);
+    }
+
+    /* NETPLAY v2.7: apply the VAD decision to the frame just appended to send_buf at
+     * frame_start. Returns false when the frame was held back. Media thread only, with
+     * tech_pvt->mutex held; during silence send_buf is always empty. */
+    static bool vad_gate(switch_core_session_t *session, private_t *tech_pvt, AudioStreamer *pAudioStreamer,
+                         size_t frame_start, capture_vad_result_t vad) {
+        char json[64];
+
+        if (vad == CAPTURE_VAD_SPEECH) return true;
+        if (vad == CAPTURE_VAD_START) {
+            if (tech_pvt->vad_cn_bytes) {
+                vad_silence_marker(tech_pvt, pAudioStreamer);
+            } else {
+                tech_pvt->vad_pending_bytes = 0;
+            }
+            const switch_size_t len = tech_pvt->vad_ring ?
+                playback_ring_read(tech_pvt->vad_ring, tech_pvt->vad_buf, tech_pvt->vad_limit) : 0;
+            if (len) capture_send(session, tech_pvt, pAudioStreamer, tech_pvt->vad_buf, len);
+            stream_stat_inc(&tech_pvt->stats.vad_speech_segments);
+            switch_snprintf(json, sizeof(json), "{\"noiseFloorDb\":%.1f}", capture_vad_noise_db(tech_pvt->vad));
+            tech_pvt->responseHandler(session, EVENT_SPEECH_START, json);
+            return true;
+        }
+        if (vad == CAPTURE_VAD_END) {
+            /* Hangover is over: speech still batched goes out now */
+            if (frame_start) capture_send(session, tech_pvt, pAudioStreamer, tech_pvt->send_buf, frame_start);
+            switch_snprintf(json, sizeof(json), "{\"noiseFloorDb\":%.1f}", capture_vad_noise_db(tech_pvt->vad));
+            tech_pvt->responseHandler(session, EVENT_SPEECH_END, json);
+        }
+
+        const size_t len = tech_pvt->send_len - frame_start;
+        switch_size_t dropped = len;
+        if (tech_pvt->vad_ring) {
+            playback_ring_write(tech_pvt->vad_ring, tech_pvt->send_buf + frame_start, len, tech_pvt->vad_limit, &dropped);
+        }
+        tech_pvt->vad_pending_bytes += dropped;
+        tech_pvt->send_len = 0;
+        stream_stat_inc(&tech_pvt->stats.vad_suppressed_frames);
+        if (tech_pvt->vad_cn_bytes && tech_pvt->vad_pending_bytes >= tech_pvt->vad_cn_bytes) {
+            vad_silence_marker(tech_pvt, pAudioStreamer);
+        }
+        return false;
+    }
+
+    /* NETPLAY v2.7: STREAM_SEND_ADAPTIVE. Handing a message to the websocket blocks while the
+     * link is backed up (libwsc send, or the pool connection lock held by a slow flush), so the
+     * average cost of that call is the backpressure signal; a pooled stream also sees the bytes
+     * waiting in the shared connection batch, and a queued one its outbound queue depth.
+     * Media thread only. */
+    static void send_batch_adapt(private_t *tech_pvt, AudioStreamer *pAudioStreamer, uint64_t cost_us) {
+        const uint64_t cost = (tech_pvt->send_cost_us * 7 + cost_us) / 8;
+        __atomic_store_n(&tech_pvt->send_cost_us, cost, __ATOMIC_RELAXED);
+        if (!tech_pvt->send_adaptive) return;
+
+        const size_t queued = pAudioStreamer->queuedBytes();
+        const size_t outbound = pAudioStreamer->sendQueueBytes();
+        size_t batch = tech_pvt->send_batch;
+        if (cost > SEND_CONGESTED_US || queued > WS_POOL_BATCH_BYTES / 2 || outbound > 2 * batch) {
+            if (batch >= tech_pvt->send_batch_max) return;
+            batch = batch * 2 < tech_pvt->send_batch_max ? batch * 2 : tech_pvt->send_batch_max;
+            stream_stat_inc(&tech_pvt->stats.send_batch_grows);
+        } else if (cost < SEND_IDLE_US && queued < WS_POOL_BATCH_BYTES / 8 && outbound <= batch) {
+            if (batch <= tech_pvt->send_batch_min) return;
+            batch = batch / 2 > tech_pvt->send_batch_min ? batch / 2 : tech_pvt->send_batch_min;
+            stream_stat_inc(&tech_pvt->stats.send_batch_shrinks);
+        } else {
+            return;
+        }
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "(%s) send batch %zuB -> %zuB (cost %" SWITCH_UINT64_T_FMT "us, queued %zuB)\n",
+                          tech_pvt->sessionId, tech_pvt->send_batch, batch, cost, queued);
+        __atomic_store_n(&tech_pvt->send_batch, batch, __ATOMIC_RELAXED);
+    }
+
+    /* NETPLAY v2.7: the primary stream's G.711, taken from the sinks' encoding when one
+     * of them already made it for this frame */
+    static size_t encode_g711_shared(private_t *tech_pvt, const SinkFrame *frame, const uint8_t *pcm, size_t pcm_len,
+                                     uint8_t *dst, size_t room) {
+        const uint8_t *enc = frame ? frame->enc[tech_pvt->audio_format] : nullptr;
+        if (enc && pcm_len / 2 <= room) {
+            memcpy(dst, enc, pcm_len / 2);
+            return pcm_len / 2;
+        }
+        return encode_g711(tech_pvt, pcm, pcm_len, dst, room);
+    }
+
+    /* NETPLAY v2.7: send the queued batch, or keep it in the pre-roll while connecting.
+     * Media thread only, with tech_pvt->mutex held. */
+    static void send_batch_flush(switch_core_session_t *session, private_t *tech_pvt, AudioStreamer *pAudioStreamer, bool connected) {
+        if (connected) {
+            const switch_time_t start = switch_time_now();
+            capture_send(session, tech_pvt, pAudioStreamer, tech_pvt->send_buf, tech_pvt->send_len);
+            const switch_time_t end = switch_time_now();
+            if (tech_pvt->latency) {
+                stream_hist_record(&tech_pvt->latency->capture_to_send,
+                                   (uint64_t)(switch_micro_time_now() - tech_pvt->send_batch_ts));
+            }
+            send_batch_adapt(tech_pvt, pAudioStreamer, end > start ? (uint64_t)(end - start) : 0);
+        } else if (tech_pvt->resume_ring && tech_pvt->resume_link) {
+            /* NETPLAY v2.7: connection lost, the batch waits in the replay window */
+            playback_ring_write(tech_pvt->resume_ring, tech_pvt->send_buf, tech_pvt->send_len,
+                                tech_pvt->resume_limit, nullptr);
+            tech_pvt->capture_pos += tech_pvt->send_len;
+        } else if (tech_pvt->preroll_ring) {
+            if (tech_pvt->latency && !playback_ring_inuse(tech_pvt->preroll_ring)) {
+                tech_pvt->preroll_first_ts = tech_pvt->send_batch_ts;
+            }
+            switch_size_t dropped = 0;
+            playback_ring_write(tech_pvt->preroll_ring, tech_pvt->send_buf, tech_pvt->send_len,
+                                tech_pvt->preroll_limit, &dropped);
+            tech_pvt->preroll_dropped += dropped;
+            stream_stat_add(&tech_pvt->stats.preroll_dropped_bytes, dropped);
+        } else {
+            stream_stat_add(&tech_pvt->stats.preroll_dropped_bytes, tech_pvt->send_len);
+        }
+        tech_pvt->send_len = 0;
     }
 
     switch_bool_t stream_frame(switch_media_bug_t *bug) {
         auto *tech_pvt = (private_t *)switch_core_media_bug_get_user_data(bug);
-        if (!tech_pvt || tech_pvt->audio_paused) return SWITCH_TRUE;
+        switch_core_session_t *session = switch_core_media_bug_get_session(bug);
+        if (!tech_pvt) return SWITCH_TRUE;
+        if (tech_pvt->audio_paused) {
+            /* NETPLAY v2.7: a partial batch is not held for the whole pause */
+            if ((tech_pvt->send_len || tech_pvt->sinks) && switch_mutex_trylock(tech_pvt->mutex) == SWITCH_STATUS_SUCCESS) {
+                auto *pAudioStreamer = static_cast<AudioStreamer *>(tech_pvt->pAudioStreamer);
+                if (pAudioStreamer && tech_pvt->send_len) {
+                    send_batch_flush(session, tech_pvt, pAudioStreamer, pAudioStreamer->isConnected());
+                }
+                if (tech_pvt->sinks) sinks_flush(tech_pvt, static_cast<CaptureSinks *>(tech_pvt->sinks));
+                switch_mutex_unlock(tech_pvt->mutex);
+            }
+            return SWITCH_TRUE;
+        }
         
         /* NETPLAY v2.5: Full-duplex mode - AEC no Python
          * 
@@ -893,17 +2805,6 @@ extern "C" {
          * 
          * Isso permite barge-in real durante a fala do agente.
          */
-        /*
-        auto flush_sbuffer = [&]() {
-            switch_size_t inuse = switch_buffer_inuse(tech_pvt->sbuffer);
-            if (inuse > 0) {
-                std::vector<uint8_t> tmp(inuse);
-                switch_buffer_read(tech_pvt->sbuffer, tmp.data(), inuse);
-                switch_buffer_zero(tech_pvt->sbuffer);
-                pAudioStreamer->writeBinary(tmp.data(), inuse);
-            }
-        };
-        */
         if (switch_mutex_trylock(tech_pvt->mutex) == SWITCH_STATUS_SUCCESS) {
 
             if (!tech_pvt->pAudioStreamer) {
@@ -912,139 +2813,159 @@ extern "C" {
             }
 
             auto *pAudioStreamer = static_cast<AudioStreamer *>(tech_pvt->pAudioStreamer);
+            if (!tech_pvt->streamer_bound) {
+                /* NETPLAY v2.7: the bug is running, callbacks may skip the session lookup */
+                pAudioStreamer->bindSession(session, tech_pvt);
+                tech_pvt->streamer_bound = 1;
+            }
 
-            if (!pAudioStreamer->isConnected()) {
+            /* NETPLAY v2.7: without pre-roll, audio captured before the connection is up is dropped;
+             * after it was up once, the replay window holds it while reconnecting */
+            const bool connected = pAudioStreamer->isConnected();
+            const bool resuming = tech_pvt->resume_ring && tech_pvt->resume_link;
+            if (!connected && !tech_pvt->preroll_ring && !resuming) {
+                stream_stat_inc(&tech_pvt->stats.frames_dropped);
                 switch_mutex_unlock(tech_pvt->mutex);
                 return SWITCH_TRUE;
             }
-
-            /* Check if we need G.711 encoding */
-            const bool use_g711 = (tech_pvt->audio_format == AUDIO_FORMAT_PCMU || tech_pvt->audio_format == AUDIO_FORMAT_PCMA);
-
-            if (nullptr == tech_pvt->resampler) {
-                
-                uint8_t data_buf[SWITCH_RECOMMENDED_BUFFER_SIZE];
-                uint8_t g711_buf[SWITCH_RECOMMENDED_BUFFER_SIZE / 2]; /* G.711 is half the size of L16 */
-                /* Pre-allocate buffer for reading from sbuffer to avoid allocation in hot path */
-                uint8_t sbuffer_tmp[SWITCH_RECOMMENDED_BUFFER_SIZE];
-                uint8_t sbuffer_g711[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
-                
-                switch_frame_t frame = {0};
-                frame.data = data_buf;
-                frame.buflen = SWITCH_RECOMMENDED_BUFFER_SIZE;
-                size_t available = switch_buffer_freespace(tech_pvt->sbuffer);
-
-                while (switch_core_media_bug_read(bug, &frame, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS) {
-                    if (frame.datalen) {
-                        if (1 == tech_pvt->rtp_packets) {
-                            if (use_g711 && tech_pvt->codec_initialized) {
-                                /* Encode L16 to G.711 before sending */
-                                size_t g711_len = encode_g711(tech_pvt, (uint8_t *)frame.data, frame.datalen, g711_buf, sizeof(g711_buf));
-                                if (g711_len > 0) {
-                                    pAudioStreamer->writeBinary(g711_buf, g711_len);
-                                }
-                            } else {
-                                pAudioStreamer->writeBinary((uint8_t *) frame.data, frame.datalen);
-                            }
-                            continue;
-                        }
-                        if (available >= frame.datalen) {
-                            switch_buffer_write(tech_pvt->sbuffer, static_cast<uint8_t *>(frame.data), frame.datalen);
-                        }
-                        if (0 == switch_buffer_freespace(tech_pvt->sbuffer)) {
-                            switch_size_t inuse = switch_buffer_inuse(tech_pvt->sbuffer);
-                            if (inuse > 0 && inuse <= sizeof(sbuffer_tmp)) {
-                                switch_buffer_read(tech_pvt->sbuffer, sbuffer_tmp, inuse);
-                                switch_buffer_zero(tech_pvt->sbuffer);
-                                
-                                if (use_g711 && tech_pvt->codec_initialized) {
-                                    /* Encode buffered L16 to G.711 before sending */
-                                    size_t g711_len = encode_g711(tech_pvt, sbuffer_tmp, inuse, sbuffer_g711, sizeof(sbuffer_g711));
-                                    if (g711_len > 0) {
-                                        pAudioStreamer->writeBinary(sbuffer_g711, g711_len);
-                                    }
-                                } else {
-                                    pAudioStreamer->writeBinary(sbuffer_tmp, inuse);
-                                }
-                            }
-                        }
+            if (connected) {
+                pAudioStreamer->sendInitialMetadata(tech_pvt);
+                if (tech_pvt->resume_ring && tech_pvt->resume_link != pAudioStreamer->linkId()) {
+                    if (tech_pvt->resume_link) {
+                        resume_replay(tech_pvt, pAudioStreamer);
+                    } else {
+                        char json[96];
+                        switch_snprintf(json, sizeof(json), "{\"type\":\"session\",\"resumeToken\":\"%s\"}",
+                                        pAudioStreamer->resumeToken().c_str());
+                        pAudioStreamer->writeText(json);
                     }
+                    tech_pvt->resume_link = pAudioStreamer->linkId();
                 }
-                
-            } else {
+                if (tech_pvt->preroll_ring && playback_ring_inuse(tech_pvt->preroll_ring)) {
+                    preroll_flush(session, tech_pvt, pAudioStreamer);
+                }
+            }
 
-                uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
-                uint8_t g711_buf[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
-                /* Pre-allocate buffers to avoid allocation in hot path */
-                uint8_t sbuffer_tmp[SWITCH_RECOMMENDED_BUFFER_SIZE];
-                uint8_t sbuffer_g711[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
-                /* Pre-allocate resampler output buffer to avoid VLA (stack overflow risk) */
-                spx_int16_t resampler_out[SWITCH_RECOMMENDED_BUFFER_SIZE / sizeof(spx_int16_t)];
-                const size_t max_out_samples = sizeof(resampler_out) / sizeof(spx_int16_t);
-                
-                switch_frame_t frame = {};
-                frame.data = data;
-                frame.buflen = SWITCH_RECOMMENDED_BUFFER_SIZE;
-                const size_t available = switch_buffer_freespace(tech_pvt->sbuffer);
-
-                while (switch_core_media_bug_read(bug, &frame, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS) {
-                    if(frame.datalen) {
-                        spx_uint32_t in_len = frame.samples;
-                        spx_uint32_t out_len = (spx_uint32_t)(max_out_samples / tech_pvt->channels);
-                        spx_int16_t *out = resampler_out;
-
-                        if(tech_pvt->channels == 1) {
-                            speex_resampler_process_int(tech_pvt->resampler,
-                                            0,
-                                            (const spx_int16_t *)frame.data,
-                                            &in_len,
-                                            &out[0],
-                                            &out_len);
-                        } else {
-                            speex_resampler_process_interleaved_int(tech_pvt->resampler,
-                                            (const spx_int16_t *)frame.data,
-                                            &in_len,
-                                            &out[0],
-                                            &out_len);
-                        }
-
-                        if(out_len > 0) {
-                            const size_t bytes_written = out_len * tech_pvt->channels * sizeof(spx_int16_t);
-                            if (tech_pvt->rtp_packets == 1) { //20ms packet
-                                if (use_g711 && tech_pvt->codec_initialized) {
-                                    /* Encode resampled L16 to G.711 before sending */
-                                    size_t g711_len = encode_g711(tech_pvt, (uint8_t *)out, bytes_written, g711_buf, sizeof(g711_buf));
-                                    if (g711_len > 0) {
-                                        pAudioStreamer->writeBinary(g711_buf, g711_len);
-                                    }
-                                } else {
-                                    pAudioStreamer->writeBinary((uint8_t *) out, bytes_written);
-                                }
-                                continue;
-                            }
-                            if (bytes_written <= available) {
-                                switch_buffer_write(tech_pvt->sbuffer, (const uint8_t *)out, bytes_written);
-                            }
-                        }
-
-                        if(switch_buffer_freespace(tech_pvt->sbuffer) == 0) {
-                            switch_size_t inuse = switch_buffer_inuse(tech_pvt->sbuffer);
-                            if (inuse > 0 && inuse <= sizeof(sbuffer_tmp)) {
-                                switch_buffer_read(tech_pvt->sbuffer, sbuffer_tmp, inuse);
-                                switch_buffer_zero(tech_pvt->sbuffer);
-                                
-                                if (use_g711 && tech_pvt->codec_initialized) {
-                                    /* Encode buffered L16 to G.711 before sending */
-                                    size_t g711_len = encode_g711(tech_pvt, sbuffer_tmp, inuse, sbuffer_g711, sizeof(sbuffer_g711));
-                                    if (g711_len > 0) {
-                                        pAudioStreamer->writeBinary(sbuffer_g711, g711_len);
-                                    }
-                                } else {
-                                    pAudioStreamer->writeBinary(sbuffer_tmp, inuse);
-                                }
-                            }
-                        }
+            /* NETPLAY v2.7: Zero-copy capture
+             *
+             * Frames are read, resampled and encoded straight into tech_pvt->send_buf,
+             * which is handed to the websocket as is once send_batch bytes are queued
+             * or the oldest of them has waited send_hold_us.
+             * Plain L16 without resampling is read by the media bug directly into
+             * send_buf; only the resample/encode paths need a scratch frame.
+             */
+            const bool use_g711 = (tech_pvt->audio_format == AUDIO_FORMAT_PCMU || tech_pvt->audio_format == AUDIO_FORMAT_PCMA)
+                                  && tech_pvt->codec_initialized;
+            const bool use_opus = nullptr != tech_pvt->opus;
+            const bool direct = !use_g711 && !use_opus && nullptr == tech_pvt->resampler;
+            /* VAD gating only applies to a live connection; the pre-roll keeps everything */
+            const bool gated = connected && tech_pvt->vad;
+            const bool widen = tech_pvt->echo && tech_pvt->mix == CAPTURE_MIX_REFERENCE;
+            /* NETPLAY v2.7: add_sink destinations get every frame, ungated */
+            auto *sinks = static_cast<CaptureSinks *>(tech_pvt->sinks);
+            if (sinks && sinks->list.empty()) sinks = nullptr;
+            SinkFrame sink_frame;
+
+            uint8_t scratch[SWITCH_RECOMMENDED_BUFFER_SIZE];
+            switch_frame_t frame = {};
+
+            for (;;) {
+                /* Invariant: send_len < send_batch <= send_batch_max here, so at least
+                 * send_cap - send_batch_max bytes (one max frame) are free */
+                if (direct) {
+                    frame.data = tech_pvt->send_buf + tech_pvt->send_len;
+                    frame.buflen = (uint32_t)(tech_pvt->send_cap - tech_pvt->send_len);
+                } else {
+                    frame.data = scratch;
+                    frame.buflen = sizeof(scratch);
+                }
+                /* Reference export widens the mono read to stereo in place */
+                if (widen) frame.buflen /= 2;
+
+                if (switch_core_media_bug_read(bug, &frame, SWITCH_TRUE) != SWITCH_STATUS_SUCCESS) {
+                    break;
+                }
+                if (!frame.datalen) {
+                    continue;
+                }
+                if (tech_pvt->echo) {
+                    /* frame.samples stays per channel, as the resampler takes it */
+                    frame.datalen = capture_echo_process(tech_pvt->echo, (int16_t *)frame.data, frame.samples) * sizeof(int16_t);
+                }
+                stream_stat_inc(&tech_pvt->stats.frames_captured);
+                const switch_time_t now = switch_micro_time_now();
+                if (tech_pvt->send_len == 0) {
+                    tech_pvt->send_batch_ts = now;
+                }
+
+                uint8_t *dst = tech_pvt->send_buf + tech_pvt->send_len;
+                const size_t room = tech_pvt->send_cap - tech_pvt->send_len;
+                const size_t frame_start = tech_pvt->send_len;
+                capture_vad_result_t vad = CAPTURE_VAD_SPEECH;
+
+                if (direct) {
+                    if (gated) vad = capture_vad_process(tech_pvt->vad, (const int16_t *)dst, frame.datalen / sizeof(int16_t));
+                    if (sinks) {
+                        sink_frame = SinkFrame{(const int16_t *)dst, frame.datalen / sizeof(int16_t), {}};
+                        sinks_capture(tech_pvt, sinks, sink_frame);
+                    }
+                    tech_pvt->send_len += frame.datalen;
+                } else if (tech_pvt->resampler) {
+                    /* Resample into send_buf; G.711 is then encoded in place over the L16 samples */
+                    spx_uint32_t in_len = frame.samples;
+                    spx_int16_t *out = (spx_int16_t *)dst;
+                    spx_uint32_t out_len = (spx_uint32_t)(room / sizeof(spx_int16_t) / tech_pvt->channels);
+
+                    if (tech_pvt->channels == 1) {
+                        speex_resampler_process_int(tech_pvt->resampler, 0,
+                                                    (const spx_int16_t *)frame.data, &in_len, out, &out_len);
+                    } else {
+                        speex_resampler_process_interleaved_int(tech_pvt->resampler,
+                                                    (const spx_int16_t *)frame.data, &in_len, out, &out_len);
+                    }
+
+                    const size_t pcm_len = out_len * tech_pvt->channels * sizeof(spx_int16_t);
+                    if (gated) vad = capture_vad_process(tech_pvt->vad, out, out_len * tech_pvt->channels);
+                    /* Before the in-place G.711 encode overwrites the samples */
+                    if (sinks) {
+                        sink_frame = SinkFrame{out, out_len * tech_pvt->channels, {}};
+                        sinks_capture(tech_pvt, sinks, sink_frame);
                     }
+                    if (use_g711) {
+                        tech_pvt->send_len += encode_g711_shared(tech_pvt, sinks ? &sink_frame : nullptr,
+                                                                 (const uint8_t *)out, pcm_len, dst, room);
+                    } else if (use_opus) {
+                        tech_pvt->send_len += encode_opus(tech_pvt, out, out_len * tech_pvt->channels, dst, room);
+                    } else {
+                        tech_pvt->send_len += pcm_len;
+                    }
+                } else if (use_opus) {
+                    if (gated) vad = capture_vad_process(tech_pvt->vad, (const int16_t *)frame.data, frame.datalen / sizeof(int16_t));
+                    if (sinks) {
+                        sink_frame = SinkFrame{(const int16_t *)frame.data, frame.datalen / sizeof(int16_t), {}};
+                        sinks_capture(tech_pvt, sinks, sink_frame);
+                    }
+                    tech_pvt->send_len += encode_opus(tech_pvt, (const int16_t *)frame.data, frame.datalen / sizeof(int16_t), dst, room);
+                } else {
+                    /* G.711 at the native rate: encode the frame straight into send_buf */
+                    if (gated) vad = capture_vad_process(tech_pvt->vad, (const int16_t *)frame.data, frame.datalen / sizeof(int16_t));
+                    if (sinks) {
+                        sink_frame = SinkFrame{(const int16_t *)frame.data, frame.datalen / sizeof(int16_t), {}};
+                        sinks_capture(tech_pvt, sinks, sink_frame);
+                    }
+                    tech_pvt->send_len += encode_g711_shared(tech_pvt, sinks ? &sink_frame : nullptr,
+                                                             (const uint8_t *)frame.data, frame.datalen, dst, room);
+                }
+
+                if (gated && !vad_gate(session, tech_pvt, pAudioStreamer, frame_start, vad)) {
+                    continue;
+                }
+
+                if (tech_pvt->send_len >= tech_pvt->send_batch) {
+                    send_batch_flush(session, tech_pvt, pAudioStreamer, connected);
+                } else if (tech_pvt->send_len && now - tech_pvt->send_batch_ts >= tech_pvt->send_hold_us) {
+                    stream_stat_inc(&tech_pvt->stats.send_hold_flushes);
+                    send_batch_flush(session, tech_pvt, pAudioStreamer, connected);
                 }
             }
             
@@ -1054,6 +2975,68 @@ extern "C" {
         return SWITCH_TRUE;
     }
 
+    void stream_module_configure(const stream_module_config_t *config) {
+        g_module_config = *config;
+        const std::vector<int> cpus(config->cpus, config->cpus + config->cpu_count);
+        const size_t threads = config->io_threads > 0 ? (size_t)config->io_threads : (size_t)switch_core_cpu_count();
+        send_queue::configure(threads, cpus);
+        stream_closer::configure(threads);
+        ws_pool::configure(cpus);
+        playback_cache_configure(config->audio_cache_dir);
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO,
+            "io-threads=%zu cpu-affinity=%d cpus pool-default=%s pool-max-streams=%d audio-cache-dir=%s drain-deadline-ms=%d\n",
+            threads, config->cpu_count, config->pool_default ? "true" : "false",
+            config->pool_max_streams > 0 ? config->pool_max_streams : WS_POOL_DEFAULT_MAX_STREAMS,
+            *config->audio_cache_dir ? config->audio_cache_dir : "(none)",
+            config->drain_deadline_ms > 0 ? config->drain_deadline_ms : STREAM_DRAIN_DEADLINE_MS);
+    }
+
+    void stream_pool_shutdown(void) {
+        /* Closes still running need the senders and the pool */
+        stream_closer::shutdown();
+        stream_reconnect::shutdown();
+        send_queue::shutdown();
+        ws_pool::shutdown();
+        playback_cache_shutdown();
+        playback_ring_slab_purge();
+    }
+
+    char* stream_stats_json(const char* uuid) {
+        const bool all = !uuid || !*uuid || !strcasecmp(uuid, "all");
+        cJSON* root = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(g_sessions_mutex);
+            if (!all) {
+                auto it = g_sessions.find(uuid);
+                if (it == g_sessions.end()) return nullptr;
+                root = session_stats_json(it->second);
+            } else {
+                stream_stats_t totals = g_finished_stats;
+                std::unique_ptr<stream_latency_t> latency(new stream_latency_t(g_finished_latency));
+                root = cJSON_CreateObject();
+                cJSON* calls = cJSON_CreateObject();
+                cJSON_AddNumberToObject(calls, "active", (double)g_sessions.size());
+                cJSON_AddNumberToObject(calls, "total", (double)g_calls_total);
+                cJSON_AddItemToObject(root, "calls", calls);
+                cJSON_AddBoolToObject(root, "draining", g_draining.load(std::memory_order_acquire));
+                cJSON* sessions = cJSON_CreateArray();
+                for (auto& entry : g_sessions) {
+                    stats_accumulate(&totals, &entry.second->stats);
+                    if (entry.second->latency) latency_merge(latency.get(), entry.second->latency);
+                    cJSON_AddItemToArray(sessions, session_stats_json(entry.second));
+                }
+                cJSON* aggregate = cJSON_CreateObject();
+                stats_add_counters(aggregate, &totals);
+                cJSON_AddItemToObject(root, "totals", aggregate);
+                cJSON_AddItemToObject(root, "latency", latency_json(latency.get()));
+                cJSON_AddItemToObject(root, "sessions", sessions);
+            }
+        }
+        char* json = cJSON_PrintUnformatted(root);
+        cJSON_Delete(root);
+        return json;
+    }
+
     switch_status_t stream_session_cleanup(switch_core_session_t *session, char* text, int channelIsClosing) {
         switch_channel_t *channel = switch_core_session_get_channel(session);
         auto *bug = (switch_media_bug_t*) switch_channel_get_private(channel, MY_BUG_NAME);
@@ -1076,6 +3059,8 @@ extern "C" {
 
             switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "(%s) stream_session_cleanup\n", sessionId);
 
+            unregister_session(tech_pvt);
+
             switch_channel_set_private(channel, MY_BUG_NAME, nullptr);
             if (!channelIsClosing) {
                 switch_core_media_bug_remove(session, &bug);
@@ -1084,10 +3069,23 @@ extern "C" {
             //auto* audioStreamer = (AudioStreamer *) tech_pvt->pAudioStreamer;
             audioStreamer = (AudioStreamer*) tech_pvt->pAudioStreamer;
             tech_pvt->pAudioStreamer = nullptr;
+            auto *sinks = static_cast<CaptureSinks *>(tech_pvt->sinks);
+            tech_pvt->sinks = nullptr;
 
             switch_mutex_unlock(tech_pvt->mutex);
 
+            if (sinks) {
+                for (CaptureSink *sink : sinks->list) {
+                    sink->streamer->unbindSession();
+                    finish(sink->streamer);
+                    delete sink;
+                }
+                delete sinks;
+            }
+
             if(audioStreamer) {
+                /* Outside the mutex: a callback being waited for may need it */
+                audioStreamer->unbindSession();
                 audioStreamer->deleteFiles();
                 if (text) audioStreamer->writeText(text);
                 finish(audioStreamer);
@@ -1102,5 +3100,77 @@ extern "C" {
         switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "stream_session_cleanup: no bug - websocket connection already closed\n");
         return SWITCH_STATUS_FALSE;
     }
+
+    /* NETPLAY v2.7: graceful-shutdown. Playback already buffered is let out until the
+     * deadline less DRAIN_CLOSE_MS, then every call is cleaned up at once (the closes
+     * run in parallel on the closer threads) and the rest of the deadline is spent
+     * waiting for them. uuid NULL drains the node and refuses new streams. */
+    char* stream_drain(const char* uuid, uint32_t deadline_ms) {
+        typedef std::chrono::steady_clock Clock;
+        if (!deadline_ms) {
+            deadline_ms = g_module_config.drain_deadline_ms > 0 ? (uint32_t)g_module_config.drain_deadline_ms : STREAM_DRAIN_DEADLINE_MS;
+        }
+        const uint32_t close_ms = deadline_ms / 2 < DRAIN_CLOSE_MS ? deadline_ms / 2 : DRAIN_CLOSE_MS;
+        const Clock::time_point start = Clock::now();
+        const Clock::time_point playback_until = start + std::chrono::milliseconds(deadline_ms - close_ms);
+        const Clock::time_point deadline = start + std::chrono::milliseconds(deadline_ms);
+        std::vector<std::string> calls;
+        size_t cut = 0, stopped = 0;
+
+        if (!uuid && !g_draining.exchange(true)) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "graceful-shutdown: draining, new streams are refused\n");
+        }
+
+        /* Calls that register meanwhile (a start already past the check) are drained too */
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(g_sessions_mutex);
+                calls.clear();
+                cut = 0;
+                for (auto& entry : g_sessions) {
+                    if (uuid && entry.first != uuid) continue;
+                    calls.push_back(entry.first);
+                    if (playback_pending(entry.second)) cut++;
+                }
+            }
+            if (uuid && calls.empty()) return nullptr;
+            if (!cut || Clock::now() >= playback_until) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_POLL_MS));
+        }
+
+        for (const auto& id : calls) {
+            switch_core_session_t* session = switch_core_session_locate(id.c_str());
+            if (!session) continue;
+            if (stream_session_cleanup(session, nullptr, 0) == SWITCH_STATUS_SUCCESS) stopped++;
+            switch_core_session_rwunlock(session);
+        }
+
+        const Clock::time_point now = Clock::now();
+        const size_t closing = stream_closer::wait_idle(now < deadline ?
+            (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() : 0);
+        const uint64_t elapsed_ms = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+
+        switch_log_printf(SWITCH_CHANNEL_LOG, closing ? SWITCH_LOG_WARNING : SWITCH_LOG_INFO,
+            "graceful-shutdown%s%s: %zu calls stopped (%zu with playback cut), %zu closes pending after %" SWITCH_UINT64_T_FMT " ms\n",
+            uuid ? " " : "", uuid ? uuid : "", stopped, cut, closing, elapsed_ms);
+
+        cJSON* root = cJSON_CreateObject();
+        cJSON_AddBoolToObject(root, "draining", g_draining.load(std::memory_order_acquire));
+        cJSON_AddNumberToObject(root, "calls", (double)calls.size());
+        cJSON_AddNumberToObject(root, "stopped", (double)stopped);
+        cJSON_AddNumberToObject(root, "playback_cut", (double)cut);
+        cJSON_AddNumberToObject(root, "closes_pending", (double)closing);
+        cJSON_AddNumberToObject(root, "elapsed_ms", (double)elapsed_ms);
+        cJSON_AddNumberToObject(root, "deadline_ms", (double)deadline_ms);
+        char* json = cJSON_PrintUnformatted(root);
+        cJSON_Delete(root);
+        return json;
+    }
+
+    void stream_drain_cancel(void) {
+        if (g_draining.exchange(false)) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "graceful-shutdown: cancelled, accepting new streams\n");
+        }
+    }
 }
 
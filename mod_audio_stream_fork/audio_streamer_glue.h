@@ -7,10 +7,24 @@
 int validate_ws_uri(const char* url, char *wsUri);
 switch_status_t is_valid_utf8(const char *str);
 switch_status_t stream_session_send_text(switch_core_session_t *session, char* text);
+void stream_session_playback_report(private_t *tech_pvt, const char *json);
+switch_status_t stream_session_play_cached(switch_core_session_t *session, const char *id, const char *hash);
 switch_status_t stream_session_pauseresume(switch_core_session_t *session, int pause);
+switch_status_t stream_session_refresh(switch_core_session_t *session);
 switch_status_t stream_session_init(switch_core_session_t *session, responseHandler_t responseHandler,
-    uint32_t samples_per_second, char *wsUri, int sampling, int channels, int audio_format, char* metadata, void **ppUserData);
+    uint32_t samples_per_second, char *wsUri, int sampling, int channels, int mix, int audio_format, char* metadata, void **ppUserData);
+switch_status_t stream_session_add_sink(switch_core_session_t *session, char *wsUri, int audio_format, char *metadata);
+switch_status_t stream_session_remove_sink(switch_core_session_t *session, char *wsUri);
+switch_status_t stream_session_prepare(switch_core_session_t *session, responseHandler_t responseHandler, char *wsUri);
+void stream_session_release_prepared(switch_core_session_t *session);
+void stream_session_attached(private_t *tech_pvt);
+void stream_session_abort(switch_core_session_t *session, private_t *tech_pvt);
 switch_bool_t stream_frame(switch_media_bug_t *bug);
 switch_status_t stream_session_cleanup(switch_core_session_t *session, char* text, int channelIsClosing);
+void stream_module_configure(const stream_module_config_t *config);
+void stream_pool_shutdown(void);
+char* stream_stats_json(const char* uuid);
+char* stream_drain(const char* uuid, uint32_t deadline_ms);
+void stream_drain_cancel(void);
 
 #endif //AUDIO_STREAMER_GLUE_H
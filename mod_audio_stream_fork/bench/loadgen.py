@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""
+loadgen: end-to-end load test for mod_audio_stream
+
+Runs a websocket echo server and starts N calls on a local FreeSWITCH, each
+streaming to it. Every capture batch the module sends is echoed back as a
+streamAudio message, so both pipelines (capture -> websocket, websocket ->
+playback ring -> injection) run at call rate for the whole test.
+
+Calls are loopback legs to the default dialplan echo extension (9196), so what
+the module injects is echoed into its own capture. At the end it prints:
+
+  - FreeSWITCH CPU per call (utime + stime of the process over the test)
+  - capture_to_send / receive_to_buffer p50/p99 from the module's latency
+    histograms (STREAM_LATENCY_HISTOGRAMS is set on every call)
+  - capture batch inter-arrival jitter p50/p99, measured by the echo server
+  - FreeSWITCH RSS growth per call; per-operation heap allocations are
+    reported by mod_audio_stream_bench
+
+    ./loadgen.py --calls 50 --duration 60 [--host 127.0.0.1] [--port 8765]
+
+Needs fs_cli on PATH (or --fs-cli) and `pip install websockets`.
+"""
+import argparse
+import asyncio
+import base64
+import json
+import os
+import statistics
+import subprocess
+import sys
+import time
+
+import websockets
+
+CLK_TCK = os.sysconf("SC_CLK_TCK")
+PAGE_SIZE = os.sysconf("SC_PAGE_SIZE")
+
+
+def quantile(values, q):
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(q * len(ordered)))]
+
+
+class EchoServer:
+    def __init__(self, rate, batch_ms):
+        self.rate = rate
+        self.batch_ms = batch_ms
+        self.jitter_ms = []
+        self.messages = 0
+        self.bytes = 0
+        self.connections = 0
+
+    async def handle(self, ws):
+        self.connections += 1
+        last = None
+        async for message in ws:
+            if not isinstance(message, bytes):
+                continue  # metadata, session/resume control
+            now = time.monotonic()
+            if last is not None:
+                self.jitter_ms.append(abs((now - last) * 1000.0 - self.batch_ms))
+            last = now
+            self.messages += 1
+            self.bytes += len(message)
+            await ws.send(json.dumps({
+                "type": "streamAudio",
+                "data": {
+                    "audioDataType": "raw",
+                    "sampleRate": self.rate,
+                    "audioData": base64.b64encode(message).decode("ascii"),
+                },
+            }))
+
+
+def fs_api(fs_cli, command):
+    result = subprocess.run([fs_cli, "-x", command], capture_output=True, text=True, timeout=30)
+    return result.stdout.strip()
+
+
+def fs_pid(pid):
+    if pid:
+        return pid
+    try:
+        return int(subprocess.run(["pidof", "freeswitch"], capture_output=True, text=True).stdout.split()[0])
+    except (IndexError, ValueError):
+        sys.exit("freeswitch is not running (or pass --fs-pid)")
+
+
+def proc_usage(pid):
+    with open(f"/proc/{pid}/stat") as f:
+        fields = f.read().rsplit(")", 1)[1].split()
+    cpu = (int(fields[11]) + int(fields[12])) / CLK_TCK  # utime, stime
+    rss = int(fields[21]) * PAGE_SIZE
+    return cpu, rss
+
+
+def start_call(args, url):
+    out = fs_api(args.fs_cli, "originate {STREAM_LATENCY_HISTOGRAMS=true,STREAM_BUFFER_SIZE=%d}loopback/9196/default &park()"
+                 % args.batch_ms)
+    if not out.startswith("+OK"):
+        print(f"originate failed: {out}", file=sys.stderr)
+        return None
+    uuid = out.split()[1]
+    out = fs_api(args.fs_cli, f"uuid_audio_stream {uuid} start {url} mono {args.rate // 1000}k")
+    if not out.startswith("+OK"):
+        print(f"uuid_audio_stream start failed on {uuid}: {out}", file=sys.stderr)
+    return uuid
+
+
+async def run(args):
+    server = EchoServer(args.rate, args.batch_ms)
+    url = f"ws://{args.host}:{args.port}/"
+    pid = fs_pid(args.fs_pid)
+
+    async with websockets.serve(server.handle, args.bind, args.port, max_size=None):
+        cpu0, rss0 = proc_usage(pid)
+        start = time.monotonic()
+        uuids = []
+        for _ in range(args.calls):
+            uuid = await asyncio.to_thread(start_call, args, url)
+            if uuid:
+                uuids.append(uuid)
+            await asyncio.sleep(args.ramp_ms / 1000.0)
+
+        await asyncio.sleep(args.duration)
+        stats = await asyncio.to_thread(fs_api, args.fs_cli, "uuid_audio_stream stats all")
+        cpu1, rss1 = proc_usage(pid)
+        elapsed = time.monotonic() - start
+
+        for uuid in uuids:
+            await asyncio.to_thread(fs_api, args.fs_cli, f"uuid_kill {uuid}")
+
+    calls = max(len(uuids), 1)
+    print(f"calls {len(uuids)}/{args.calls}, {elapsed:.1f}s, {server.connections} connections, "
+          f"{server.messages} capture messages ({server.bytes / 1e6:.1f} MB)")
+    print(f"freeswitch cpu   {100.0 * (cpu1 - cpu0) / elapsed / calls:.3f}% of a core per call "
+          f"({100.0 * (cpu1 - cpu0) / elapsed:.1f}% total)")
+    print(f"freeswitch rss   {(rss1 - rss0) / calls / 1024:.0f} KB growth per call")
+    print(f"capture jitter   p50 {quantile(server.jitter_ms, 0.50):.2f} ms  p99 {quantile(server.jitter_ms, 0.99):.2f} ms"
+          f"  (mean {statistics.fmean(server.jitter_ms) if server.jitter_ms else 0:.2f} ms)")
+    try:
+        latency = json.loads(stats).get("latency", {})
+    except ValueError:
+        print(f"no stats from the module: {stats[:200]}", file=sys.stderr)
+        return
+    for name in ("capture_to_send", "receive_to_buffer", "buffer_residency"):
+        h = latency.get(name, {})
+        print(f"{name:<16} p50 {h.get('p50_us', 0) / 1000:.2f} ms  p99 {h.get('p99_us', 0) / 1000:.2f} ms"
+              f"  ({int(h.get('count', 0))} samples)")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--calls", type=int, default=10)
+    parser.add_argument("--duration", type=float, default=30.0, help="seconds with every call up")
+    parser.add_argument("--ramp-ms", type=int, default=50, help="delay between call starts")
+    parser.add_argument("--rate", type=int, default=8000, choices=(8000, 16000))
+    parser.add_argument("--batch-ms", type=int, default=20, help="STREAM_BUFFER_SIZE")
+    parser.add_argument("--host", default="127.0.0.1", help="address FreeSWITCH connects to")
+    parser.add_argument("--bind", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=8765)
+    parser.add_argument("--fs-cli", default="fs_cli")
+    parser.add_argument("--fs-pid", type=int, default=0)
+    asyncio.run(run(parser.parse_args()))
+
+
+if __name__ == "__main__":
+    main()
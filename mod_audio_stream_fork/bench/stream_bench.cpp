@@ -0,0 +1,347 @@
+/*
+ * mod_audio_stream_bench: capture and playback pipelines, outside FreeSWITCH
+ *
+ * Runs the per-frame work of stream_frame (G.711 encode, resample, resample +
+ * in-place G.711) and of a streamAudio message on the websocket thread (scan,
+ * base64 decode, resample, playback ring write) on synthetic audio, one case at
+ * a time. For each case it prints throughput, p50/p99/max time per operation and
+ * heap allocations per operation, so a change to any of these paths can be
+ * compared against the previous build. Built only with -DBUILD_BENCHMARKS=ON.
+ *
+ *   ./mod_audio_stream_bench [iterations] [case]
+ *
+ * Before timing anything it checks that the split base64 decode used by the
+ * direct playback path agrees with the whole-buffer decode, and exits 1 if not.
+ *
+ * The end-to-end load test (websocket echo server + N calls) is bench/loadgen.py.
+ */
+#include "g711.h"
+#include "base64.h"
+#include "stream_base64.h"
+#include "stream_json.h"
+#include "stream_histogram.h"
+#include "playback_ring.h"
+#include <speex/speex_resampler.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <time.h>
+#include <vector>
+
+/* Every heap allocation of the process, operator new included (glibc) */
+static std::atomic<uint64_t> g_allocs(0);
+
+#ifdef __GLIBC__
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t n, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+
+    void *malloc(size_t size) {
+        g_allocs.fetch_add(1, std::memory_order_relaxed);
+        return __libc_malloc(size);
+    }
+    void *calloc(size_t n, size_t size) {
+        g_allocs.fetch_add(1, std::memory_order_relaxed);
+        return __libc_calloc(n, size);
+    }
+    void *realloc(void *ptr, size_t size) {
+        g_allocs.fetch_add(1, std::memory_order_relaxed);
+        return __libc_realloc(ptr, size);
+    }
+}
+#endif
+
+namespace {
+
+    const uint32_t FRAME_MS = 20;
+    const uint32_t CALL_RATE = 8000;
+    const uint32_t FRAME_SAMPLES = CALL_RATE * FRAME_MS / 1000;
+    const uint32_t TTS_RATE = 24000;           /* typical TTS output, resampled to the call */
+    const uint32_t TTS_CHUNK_MS = 100;
+    const uint32_t RESAMPLE_QUALITY = 3;        /* SWITCH_RESAMPLE_QUALITY */
+
+    volatile uint32_t g_sink;
+
+    inline uint64_t now_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    }
+
+    /* Speech-like spread of amplitudes, so every G.711 segment is exercised */
+    void fill_pcm(int16_t *pcm, size_t samples, unsigned seed) {
+        for (size_t i = 0; i < samples; i++) {
+            seed = seed * 1103515245u + 12345u;
+            pcm[i] = (int16_t)((int)(seed >> 16) - 32768) >> (i % 8);
+        }
+    }
+
+    struct Case {
+        const char *name;
+        const char *unit;             /* what one operation processes */
+        void *(*setup)();
+        void (*run)(void *state);
+        void (*teardown)(void *state);
+    };
+
+    /* capture: one frame through the dispatched kernel (encode_g711) */
+    struct G711State {
+        int16_t pcm[FRAME_SAMPLES];
+        uint8_t out[FRAME_SAMPLES];
+    };
+
+    void *g711_setup() {
+        auto *s = new G711State();
+        fill_pcm(s->pcm, FRAME_SAMPLES, 1);
+        return s;
+    }
+    void g711_run(void *state) {
+        auto *s = static_cast<G711State *>(state);
+        g711_ulaw_encode(s->pcm, s->out, FRAME_SAMPLES);
+        g_sink += s->out[0];
+    }
+    /* capture: the per-sample linear_to_ulaw loop the kernels replace */
+    void g711_scalar_run(void *state) {
+        auto *s = static_cast<G711State *>(state);
+        g711_ulaw_encode_scalar(s->pcm, s->out, FRAME_SAMPLES);
+        g_sink += s->out[0];
+    }
+    void g711_teardown(void *state) { delete static_cast<G711State *>(state); }
+
+    /* capture: the resampler path of stream_frame, 8 kHz call to a 16 kHz stream,
+     * and 16 kHz call to an 8 kHz G.711 stream encoded in place */
+    struct ResampleState {
+        SpeexResamplerState *resampler;
+        std::vector<int16_t> in;
+        std::vector<int16_t> out;
+        bool g711;
+    };
+
+    void *resample_make(uint32_t from, uint32_t to, bool g711) {
+        int err = 0;
+        auto *s = new ResampleState();
+        s->resampler = speex_resampler_init(1, from, to, RESAMPLE_QUALITY, &err);
+        s->in.resize(from * FRAME_MS / 1000);
+        s->out.resize(to * FRAME_MS / 1000 * 2);
+        s->g711 = g711;
+        fill_pcm(s->in.data(), s->in.size(), 2);
+        return s;
+    }
+    void *resample_up_setup() { return resample_make(CALL_RATE, 16000, false); }
+    void *resample_down_setup() { return resample_make(16000, CALL_RATE, true); }
+    void resample_run(void *state) {
+        auto *s = static_cast<ResampleState *>(state);
+        spx_uint32_t in_len = (spx_uint32_t)s->in.size();
+        spx_uint32_t out_len = (spx_uint32_t)s->out.size();
+        speex_resampler_process_int(s->resampler, 0, s->in.data(), &in_len, s->out.data(), &out_len);
+        if (s->g711) g711_ulaw_encode(s->out.data(), (uint8_t *)s->out.data(), out_len);
+        g_sink += out_len;
+    }
+    void resample_teardown(void *state) {
+        auto *s = static_cast<ResampleState *>(state);
+        speex_resampler_destroy(s->resampler);
+        delete s;
+    }
+
+    /* playback: base64 of one TTS chunk, the std::string decoder against the one
+     * streamAudio uses (caller buffer, no allocation) */
+    struct Base64State {
+        std::string text;
+        std::vector<uint8_t> out;
+    };
+
+    void *base64_setup() {
+        auto *s = new Base64State();
+        std::vector<int16_t> pcm(TTS_RATE * TTS_CHUNK_MS / 1000);
+        fill_pcm(pcm.data(), pcm.size(), 3);
+        s->text = base64_encode(reinterpret_cast<const unsigned char *>(pcm.data()), pcm.size() * sizeof(int16_t));
+        s->out.resize(stream_base64_decoded_max(s->text.size()));
+        return s;
+    }
+    void base64_legacy_run(void *state) {
+        auto *s = static_cast<Base64State *>(state);
+        const std::string decoded = base64_decode(s->text);
+        g_sink += (uint32_t)decoded.size();
+    }
+    void base64_run(void *state) {
+        auto *s = static_cast<Base64State *>(state);
+        g_sink += (uint32_t)stream_base64_decode(s->text.data(), s->text.size(), s->out.data());
+    }
+    void base64_teardown(void *state) { delete static_cast<Base64State *>(state); }
+
+    /* playback: a whole streamAudio message on the websocket thread, as in
+     * AudioStreamer::processScanned/streamAudio/writePlayback, with the media
+     * thread's reads interleaved so the ring does not just overflow */
+    struct StreamAudioState {
+        std::string message;
+        std::vector<uint8_t> scratch;
+        std::vector<int16_t> resampled;
+        SpeexResamplerState *resampler;
+        playback_ring_t *ring;
+        size_t limit;
+        uint8_t frame[FRAME_SAMPLES * sizeof(int16_t)];
+    };
+
+    void *stream_audio_setup() {
+        int err = 0;
+        auto *s = new StreamAudioState();
+        std::vector<int16_t> pcm(TTS_RATE * TTS_CHUNK_MS / 1000);
+        fill_pcm(pcm.data(), pcm.size(), 4);
+        s->message = "{\"type\":\"streamAudio\",\"data\":{\"audioDataType\":\"raw\",\"sampleRate\":" +
+                     std::to_string(TTS_RATE) + ",\"audioData\":\"" +
+                     base64_encode(reinterpret_cast<const unsigned char *>(pcm.data()), pcm.size() * sizeof(int16_t)) +
+                     "\"}}";
+        s->resampler = speex_resampler_init(1, TTS_RATE, CALL_RATE, RESAMPLE_QUALITY, &err);
+        s->resampled.resize(CALL_RATE * TTS_CHUNK_MS / 1000 * 2);
+        s->limit = CALL_RATE / 1000 * sizeof(int16_t) * 2000;    /* STREAM_PLAYBACK_BUFFER_MS default */
+        s->ring = playback_ring_create(s->limit);
+        return s;
+    }
+    void stream_audio_run(void *state) {
+        auto *s = static_cast<StreamAudioState *>(state);
+        stream_json_msg_t scan;
+        if (!stream_json_scan(s->message.data(), s->message.size(), &scan) || !scan.audio_data.ptr) return;
+        const size_t room = stream_base64_decoded_max(scan.audio_data.len);
+        if (s->scratch.size() < room) s->scratch.resize(room);
+        const long decoded = stream_base64_decode(scan.audio_data.ptr, scan.audio_data.len, s->scratch.data());
+        if (decoded <= 0) return;
+        spx_uint32_t in_len = (spx_uint32_t)(decoded / 2);
+        spx_uint32_t out_len = (spx_uint32_t)s->resampled.size();
+        speex_resampler_process_int(s->resampler, 0, (const spx_int16_t *)s->scratch.data(), &in_len,
+                                    s->resampled.data(), &out_len);
+        playback_ring_write(s->ring, s->resampled.data(), out_len * sizeof(int16_t), s->limit, nullptr);
+        for (uint32_t i = 0; i < TTS_CHUNK_MS / FRAME_MS; i++) {
+            g_sink += (uint32_t)playback_ring_read(s->ring, s->frame, sizeof(s->frame));
+        }
+    }
+    void stream_audio_teardown(void *state) {
+        auto *s = static_cast<StreamAudioState *>(state);
+        playback_ring_destroy(s->ring);
+        speex_resampler_destroy(s->resampler);
+        delete s;
+    }
+
+    /* playback: a streamAudio chunk already at the ring rate and format, decoded
+     * straight into the ring's free region (AudioStreamer::decodeIntoRing) */
+    struct DirectState {
+        std::string text;
+        playback_ring_t *ring;
+        size_t limit;
+        uint8_t frame[FRAME_SAMPLES * sizeof(int16_t)];
+    };
+
+    void *stream_audio_direct_setup() {
+        auto *s = new DirectState();
+        std::vector<int16_t> pcm(CALL_RATE * TTS_CHUNK_MS / 1000);
+        fill_pcm(pcm.data(), pcm.size(), 5);
+        s->text = base64_encode(reinterpret_cast<const unsigned char *>(pcm.data()), pcm.size() * sizeof(int16_t));
+        s->limit = CALL_RATE / 1000 * sizeof(int16_t) * 2000;
+        s->ring = playback_ring_create(s->limit);
+        return s;
+    }
+    void stream_audio_direct_run(void *state) {
+        auto *s = static_cast<DirectState *>(state);
+        const long len = stream_base64_decoded_len(s->text.data(), s->text.size());
+        playback_ring_span_t span;
+        if (len <= 0 || !playback_ring_reserve(s->ring, (size_t)len, s->limit, &span)) return;
+        if (stream_base64_decode_split(s->text.data(), s->text.size(), span.first, span.first_len,
+                                       span.second, span.second_len) != len) return;
+        playback_ring_commit(s->ring, &span, (size_t)len, s->limit, nullptr);
+        for (uint32_t i = 0; i < TTS_CHUNK_MS / FRAME_MS; i++) {
+            g_sink += (uint32_t)playback_ring_read(s->ring, s->frame, sizeof(s->frame));
+        }
+    }
+    void stream_audio_direct_teardown(void *state) {
+        auto *s = static_cast<DirectState *>(state);
+        playback_ring_destroy(s->ring);
+        delete s;
+    }
+
+    const Case CASES[] = {
+        {"encode_g711",           "20ms frame", g711_setup,          g711_run,          g711_teardown},
+        {"linear_to_ulaw",        "20ms frame", g711_setup,          g711_scalar_run,   g711_teardown},
+        {"capture_resample_up",   "20ms frame", resample_up_setup,   resample_run,      resample_teardown},
+        {"capture_resample_g711", "20ms frame", resample_down_setup, resample_run,      resample_teardown},
+        {"base64_decode",         "100ms chunk", base64_setup,       base64_legacy_run, base64_teardown},
+        {"stream_base64_decode",  "100ms chunk", base64_setup,       base64_run,        base64_teardown},
+        {"stream_audio",          "100ms chunk", stream_audio_setup, stream_audio_run,  stream_audio_teardown},
+        {"stream_audio_direct",   "100ms chunk", stream_audio_direct_setup, stream_audio_direct_run, stream_audio_direct_teardown},
+    };
+
+    /* decode_split must agree with the whole-buffer decode wherever the ring wraps:
+     * same result, same bytes, for valid input and for padding inside the payload */
+    bool verify_base64_split() {
+        const char *inputs[] = {"QUJD", "QUI=", "QUJDRA==", "QUJDREU=", "QUJDREVGR0g=",
+                                "QUI=QUJD", "QUJDQUI=QUJD", "QQ==QUJDRA==", "QUJD=QUJ", "QUJDREVG"};
+        for (const char *in : inputs) {
+            const size_t len = strlen(in);
+            uint8_t whole[16], split[16];
+            const long expect = stream_base64_decode(in, len, whole);
+            const long total = stream_base64_decoded_len(in, len);
+            for (size_t cap = 0; total > 0 && cap <= (size_t)total; cap++) {
+                memset(split, 0xa5, sizeof(split));
+                const long got = stream_base64_decode_split(in, len, split, cap, split + cap, sizeof(split) - cap);
+                if (got != expect || (got > 0 && memcmp(split, whole, (size_t)got) != 0)) {
+                    fprintf(stderr, "decode_split(\"%s\", cap=%zu) = %ld, decode = %ld\n", in, cap, got, expect);
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void run_case(const Case &c, long iterations) {
+        stream_hist_t hist;
+        memset(&hist, 0, sizeof(hist));
+        void *state = c.setup();
+
+        /* Warm up: caches, resampler history, scratch buffers at their final size */
+        for (long i = 0; i < iterations / 100 + 1; i++) c.run(state);
+
+        const uint64_t allocs = g_allocs.load(std::memory_order_relaxed);
+        const uint64_t start = now_ns();
+        for (long i = 0; i < iterations; i++) {
+            const uint64_t t0 = now_ns();
+            c.run(state);
+            stream_hist_record(&hist, now_ns() - t0);
+        }
+        const uint64_t elapsed = now_ns() - start;
+        const uint64_t allocated = g_allocs.load(std::memory_order_relaxed) - allocs;
+        c.teardown(state);
+
+        printf("%-22s %-12s %10.0f ops/s  p50 %7llu ns  p99 %7llu ns  max %8llu ns  allocs/op %.2f\n",
+               c.name, c.unit, (double)iterations * 1e9 / (double)elapsed,
+               (unsigned long long)stream_hist_quantile(&hist, 0.50),
+               (unsigned long long)stream_hist_quantile(&hist, 0.99),
+               (unsigned long long)hist.max, (double)allocated / (double)iterations);
+    }
+
+}
+
+int main(int argc, char **argv)
+{
+    const long iterations = argc > 1 ? atol(argv[1]) : 200000;
+    const char *only = argc > 2 ? argv[2] : nullptr;
+    bool ran = false;
+
+    g711_init();
+    stream_base64_init();
+    printf("mod_audio_stream_bench: %ld iterations per case, g711 kernel=%s, base64 kernel=%s\n",
+           iterations, g711_kernel_name(), stream_base64_kernel_name());
+    if (!verify_base64_split()) return 1;
+    for (const Case &c : CASES) {
+        if (only && strcmp(only, c.name) != 0) continue;
+        run_case(c, iterations);
+        ran = true;
+    }
+    if (!ran) {
+        fprintf(stderr, "unknown case %s\n", only);
+        return 1;
+    }
+    playback_ring_slab_purge();
+    return 0;
+}
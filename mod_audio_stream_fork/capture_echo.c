@@ -0,0 +1,115 @@
+/*
+ * NETPLAY v2.7: echo reference and cancellation, see capture_echo.h
+ */
+#include "capture_echo.h"
+#include "playback_ring.h"
+#include <speex/speex_echo.h>
+#include <speex/speex_preprocess.h>
+
+#define ECHO_BLOCK_MS       10    /* speex_echo frame */
+#define ECHO_LIMIT_MS       500   /* reference kept while the capture is not reading */
+#define ECHO_BACKLOG_MS     40    /* reference older than this beyond the frame is skipped */
+
+struct capture_echo {
+    uint32_t rate;
+    uint32_t block;                   /* samples per speex_echo frame */
+    uint32_t max_samples;
+    int reference;
+    SpeexEchoState *aec;              /* NULL without STREAM_AEC */
+    SpeexPreprocessState *residual;
+    playback_ring_t *ring;            /* played L16, injection -> capture */
+    switch_size_t limit;
+    switch_size_t backlog;
+    int16_t *ref;                     /* reference of the current frame */
+    int16_t *mic;                     /* canceller input */
+};
+
+capture_echo_t *capture_echo_create(switch_memory_pool_t *pool, uint32_t rate, uint32_t max_samples,
+                                    int reference, uint32_t tail_ms)
+{
+    capture_echo_t *echo;
+
+    if (!pool || rate < 8000 || !max_samples) return NULL;
+    echo = (capture_echo_t *)switch_core_alloc(pool, sizeof(*echo));
+    if (!echo) return NULL;
+
+    memset(echo, 0, sizeof(*echo));
+    echo->rate = rate;
+    echo->block = rate * ECHO_BLOCK_MS / 1000;
+    echo->max_samples = max_samples;
+    echo->reference = reference;
+    echo->limit = (switch_size_t)rate * ECHO_LIMIT_MS / 1000 * sizeof(int16_t);
+    echo->backlog = (switch_size_t)rate * ECHO_BACKLOG_MS / 1000 * sizeof(int16_t);
+    echo->ref = (int16_t *)switch_core_alloc(pool, max_samples * sizeof(int16_t));
+    echo->mic = (int16_t *)switch_core_alloc(pool, max_samples * sizeof(int16_t));
+    echo->ring = playback_ring_create(echo->limit);
+    if (!echo->ref || !echo->mic || !echo->ring) {
+        capture_echo_destroy(echo);
+        return NULL;
+    }
+
+    if (tail_ms) {
+        int srate = (int)rate;
+        int off = 0;
+        echo->aec = speex_echo_state_init((int)echo->block, (int)(rate * tail_ms / 1000));
+        echo->residual = echo->aec ? speex_preprocess_state_init((int)echo->block, srate) : NULL;
+        if (!echo->aec || !echo->residual) {
+            capture_echo_destroy(echo);
+            return NULL;
+        }
+        speex_echo_ctl(echo->aec, SPEEX_ECHO_SET_SAMPLING_RATE, &srate);
+        /* Residual echo suppression only: noise stays for the backend to judge */
+        speex_preprocess_ctl(echo->residual, SPEEX_PREPROCESS_SET_DENOISE, &off);
+        speex_preprocess_ctl(echo->residual, SPEEX_PREPROCESS_SET_ECHO_STATE, echo->aec);
+    }
+    return echo;
+}
+
+void capture_echo_destroy(capture_echo_t *echo)
+{
+    if (!echo) return;
+    if (echo->residual) speex_preprocess_state_destroy(echo->residual);
+    if (echo->aec) speex_echo_state_destroy(echo->aec);
+    playback_ring_destroy(echo->ring);
+    echo->residual = NULL;
+    echo->aec = NULL;
+    echo->ring = NULL;
+}
+
+void capture_echo_played(capture_echo_t *echo, const int16_t *pcm, uint32_t samples)
+{
+    playback_ring_write(echo->ring, pcm, (switch_size_t)samples * sizeof(int16_t), echo->limit, NULL);
+}
+
+uint32_t capture_echo_process(capture_echo_t *echo, int16_t *pcm, uint32_t samples)
+{
+    switch_size_t bytes, got;
+    uint32_t i;
+
+    if (samples > echo->max_samples) samples = echo->max_samples;
+    bytes = (switch_size_t)samples * sizeof(int16_t);
+
+    /* Capture fell behind the player: what is left over was played too long ago */
+    if (playback_ring_inuse(echo->ring) > bytes + echo->backlog) {
+        playback_ring_discard_to(echo->ring, playback_ring_write_pos(echo->ring) - bytes - echo->backlog);
+    }
+    got = playback_ring_read(echo->ring, echo->ref, bytes);
+    if (got < bytes) memset((uint8_t *)echo->ref + got, 0, bytes - got);
+
+    if (echo->aec) {
+        memcpy(echo->mic, pcm, bytes);
+        for (i = 0; i + echo->block <= samples; i += echo->block) {
+            speex_echo_cancellation(echo->aec, echo->mic + i, echo->ref + i, pcm + i);
+            speex_preprocess_run(echo->residual, pcm + i);
+        }
+    }
+
+    if (!echo->reference) return samples;
+    /* Widen to (caller, reference) from the end, so no mic sample is overwritten unread */
+    for (i = samples; i-- > 0;) {
+        const int16_t mic = pcm[i];
+        pcm[2 * i + 1] = echo->ref[i];
+        pcm[2 * i] = mic;
+    }
+    return samples * 2;
+}
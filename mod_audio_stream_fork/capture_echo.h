@@ -0,0 +1,52 @@
+#ifndef CAPTURE_ECHO_H
+#define CAPTURE_ECHO_H
+
+#include <switch.h>
+
+/*
+ * NETPLAY v2.7: Echo reference and cancellation for upstream capture
+ * (start ... reference, STREAM_AEC)
+ *
+ * Every frame written to the caller is handed over here as L16 at the capture
+ * read rate, through a lock-free ring (injection thread -> media thread). The
+ * capture takes the same number of samples from it for each mic frame, so the
+ * reference of a mic frame is what was played during the same ptime; older
+ * reference is skipped when capture falls behind, to keep the two aligned.
+ *
+ * With reference export the frame becomes stereo (caller, reference), sample
+ * interleaved. With AEC the mic is cleaned by the Speex echo canceller, plus
+ * its residual echo suppression, in 10 ms blocks before anything else runs.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAPTURE_ECHO_TAIL_MS 200   /* STREAM_AEC_TAIL_MS default: echo path the filter covers */
+
+typedef struct capture_echo capture_echo_t;
+
+/*
+ * max_samples is the largest mic frame that will be processed. reference: emit
+ * the stereo frame; tail_ms > 0 enables AEC. NULL on failure.
+ */
+capture_echo_t *capture_echo_create(switch_memory_pool_t *pool, uint32_t rate, uint32_t max_samples,
+                                    int reference, uint32_t tail_ms);
+
+/* Frees the ring and the canceller; neither thread may use echo afterwards. */
+void capture_echo_destroy(capture_echo_t *echo);
+
+/* Injection thread: a frame that was just written to the channel. */
+void capture_echo_played(capture_echo_t *echo, const int16_t *pcm, uint32_t samples);
+
+/*
+ * Media thread: process one mono mic frame in place. pcm must hold twice
+ * samples with reference export. Returns the samples now in pcm (all channels).
+ */
+uint32_t capture_echo_process(capture_echo_t *echo, int16_t *pcm, uint32_t samples);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //CAPTURE_ECHO_H
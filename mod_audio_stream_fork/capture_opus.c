@@ -0,0 +1,138 @@
+/*
+ * NETPLAY v2.7: upstream Opus encoding, see capture_opus.h
+ */
+#include "capture_opus.h"
+#include "stream_protocol.h"
+
+int capture_opus_rate_valid(uint32_t rate)
+{
+    return rate == 8000 || rate == 12000 || rate == 16000 || rate == 24000 || rate == 48000;
+}
+
+#ifdef HAVE_OPUS
+#include <opus.h>
+
+struct capture_opus {
+    OpusEncoder *encoder;     /* pool memory, opus_encoder_init */
+    uint32_t channels;
+    uint32_t frame;           /* samples per channel in one packet */
+    uint32_t bitrate;
+    int16_t *pcm;             /* input not encoded yet, interleaved */
+    uint32_t pcm_len;
+    uint32_t pcm_cap;
+};
+
+int capture_opus_available(void)
+{
+    return 1;
+}
+
+capture_opus_t *capture_opus_create(switch_memory_pool_t *pool, uint32_t rate, uint32_t channels,
+                                    uint32_t bitrate, uint32_t complexity, uint32_t max_input,
+                                    char *err, size_t err_len)
+{
+    capture_opus_t *enc;
+    int ret;
+
+    if (!capture_opus_rate_valid(rate) || channels < 1 || channels > 2) {
+        switch_snprintf(err, err_len, "unsupported opus input %u Hz x%u", rate, channels);
+        return NULL;
+    }
+    enc = (capture_opus_t *)switch_core_alloc(pool, sizeof(*enc));
+    if (!enc) {
+        switch_snprintf(err, err_len, "out of memory");
+        return NULL;
+    }
+    memset(enc, 0, sizeof(*enc));
+    enc->channels = channels;
+    enc->frame = rate / 1000 * CAPTURE_OPUS_FRAME_MS;
+    enc->bitrate = bitrate;
+    enc->pcm_cap = enc->frame * channels + max_input;
+    enc->pcm = (int16_t *)switch_core_alloc(pool, enc->pcm_cap * sizeof(int16_t));
+    enc->encoder = (OpusEncoder *)switch_core_alloc(pool, opus_encoder_get_size((int)channels));
+    if (!enc->pcm || !enc->encoder) {
+        switch_snprintf(err, err_len, "out of memory");
+        return NULL;
+    }
+
+    ret = opus_encoder_init(enc->encoder, (opus_int32)rate, (int)channels, OPUS_APPLICATION_VOIP);
+    if (ret != OPUS_OK) {
+        switch_snprintf(err, err_len, "opus_encoder_init: %s", opus_strerror(ret));
+        return NULL;
+    }
+    opus_encoder_ctl(enc->encoder, OPUS_SET_BITRATE((opus_int32)bitrate));
+    opus_encoder_ctl(enc->encoder, OPUS_SET_COMPLEXITY((opus_int32)complexity));
+    opus_encoder_ctl(enc->encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+    opus_encoder_ctl(enc->encoder, OPUS_SET_VBR(1));
+    opus_encoder_ctl(enc->encoder, OPUS_SET_VBR_CONSTRAINT(1));
+    return enc;
+}
+
+int capture_opus_encode(capture_opus_t *enc, const int16_t *pcm, uint32_t samples, uint8_t *out, size_t room)
+{
+    const uint32_t step = enc->frame * enc->channels;
+    uint32_t used = 0;
+    int written = 0;
+
+    if (samples > enc->pcm_cap - enc->pcm_len) return CAPTURE_OPUS_OVERFLOW;
+    memcpy(enc->pcm + enc->pcm_len, pcm, samples * sizeof(int16_t));
+    enc->pcm_len += samples;
+
+    while (enc->pcm_len - used >= step) {
+        size_t max = room - (size_t)written;
+        opus_int32 n;
+
+        if (max <= STREAM_OPUS_PACKET_HEADER_LEN) break;
+        max -= STREAM_OPUS_PACKET_HEADER_LEN;
+        if (max > CAPTURE_OPUS_MAX_PACKET) max = CAPTURE_OPUS_MAX_PACKET;
+        n = opus_encode(enc->encoder, enc->pcm + used, (int)enc->frame,
+                        out + written + STREAM_OPUS_PACKET_HEADER_LEN, (opus_int32)max);
+        if (n < 0) return CAPTURE_OPUS_ERROR;
+        stream_proto_write_u16(out + written, (uint16_t)n);
+        written += STREAM_OPUS_PACKET_HEADER_LEN + n;
+        used += step;
+    }
+    if (used) {
+        memmove(enc->pcm, enc->pcm + used, (enc->pcm_len - used) * sizeof(int16_t));
+        enc->pcm_len -= used;
+    }
+    return written;
+}
+
+size_t capture_opus_packet_bytes(const capture_opus_t *enc)
+{
+    /* Constrained VBR stays close to the average; allow twice that */
+    size_t bytes = (size_t)enc->bitrate / 8 * CAPTURE_OPUS_FRAME_MS / 1000 * 2;
+    if (bytes > CAPTURE_OPUS_MAX_PACKET) bytes = CAPTURE_OPUS_MAX_PACKET;
+    return bytes + STREAM_OPUS_PACKET_HEADER_LEN;
+}
+
+#else /* !HAVE_OPUS */
+
+int capture_opus_available(void)
+{
+    return 0;
+}
+
+capture_opus_t *capture_opus_create(switch_memory_pool_t *pool, uint32_t rate, uint32_t channels,
+                                    uint32_t bitrate, uint32_t complexity, uint32_t max_input,
+                                    char *err, size_t err_len)
+{
+    (void)pool; (void)rate; (void)channels; (void)bitrate; (void)complexity; (void)max_input;
+    switch_snprintf(err, err_len, "module built without libopus");
+    return NULL;
+}
+
+int capture_opus_encode(capture_opus_t *enc, const int16_t *pcm, uint32_t samples, uint8_t *out, size_t room)
+{
+    (void)enc; (void)pcm; (void)samples; (void)out; (void)room;
+    return CAPTURE_OPUS_ERROR;
+}
+
+size_t capture_opus_packet_bytes(const capture_opus_t *enc)
+{
+    (void)enc;
+    return 0;
+}
+
+#endif /* HAVE_OPUS */
@@ -0,0 +1,57 @@
+#ifndef CAPTURE_OPUS_H
+#define CAPTURE_OPUS_H
+
+#include <switch.h>
+
+/*
+ * NETPLAY v2.7: Opus encoding of the upstream capture (audio format "opus")
+ *
+ * Capture frames of any ptime are accumulated and encoded in 20 ms packets
+ * (VoIP application, constrained VBR). Each packet is written length-prefixed,
+ * see STREAM_OPUS_PACKET_HEADER_LEN in stream_protocol.h, so a websocket
+ * message batches rtp_packets of them like the other formats. Only available
+ * when the module is built with libopus (HAVE_OPUS); media thread only.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAPTURE_OPUS_FRAME_MS      20
+#define CAPTURE_OPUS_MAX_PACKET    1275   /* RFC 6716 limit for one frame */
+
+#define CAPTURE_OPUS_ERROR         -1     /* encoder error */
+#define CAPTURE_OPUS_OVERFLOW      -2     /* more input than max_input allows; nothing taken */
+
+typedef struct capture_opus capture_opus_t;
+
+/* Non-zero when the module was built with libopus. */
+int capture_opus_available(void);
+
+/* Opus input rates: 8, 12, 16, 24 or 48 kHz. */
+int capture_opus_rate_valid(uint32_t rate);
+
+/*
+ * Allocate from pool. max_input is the most samples (all channels) passed to one
+ * encode call. Returns NULL and an error message in err on failure.
+ */
+capture_opus_t *capture_opus_create(switch_memory_pool_t *pool, uint32_t rate, uint32_t channels,
+                                    uint32_t bitrate, uint32_t complexity, uint32_t max_input,
+                                    char *err, size_t err_len);
+
+/*
+ * Append interleaved samples (counting all channels) and encode every complete
+ * 20 ms into out. pcm may alias out: it is copied before anything is written.
+ * Returns the bytes written to out, CAPTURE_OPUS_ERROR, or CAPTURE_OPUS_OVERFLOW
+ * when the samples do not fit next to the input still buffered.
+ */
+int capture_opus_encode(capture_opus_t *enc, const int16_t *pcm, uint32_t samples, uint8_t *out, size_t room);
+
+/* Worst case bytes written for one packet, header included, at the configured bitrate. */
+size_t capture_opus_packet_bytes(const capture_opus_t *enc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //CAPTURE_OPUS_H
@@ -0,0 +1,110 @@
+/*
+ * NETPLAY v2.7: upstream voice activity detection, see capture_vad.h
+ */
+#include "capture_vad.h"
+#include <math.h>
+
+#define VAD_MIN_DB        -90.0   /* digital silence */
+#define VAD_ABS_MIN_DB    -55.0   /* never speech below this */
+#define VAD_LEARN_US      200000
+#define VAD_ATTACK_FRAMES 2
+#define VAD_TAU_DOWN_US   50000.0
+#define VAD_TAU_UP_US     1000000.0
+#define VAD_TAU_SPEECH_US 20000000.0
+
+struct capture_vad {
+    uint32_t rate;
+    uint32_t channels;
+    double threshold_db;
+    uint64_t hangover_us;
+    double noise_db;
+    uint64_t elapsed_us;      /* audio seen so far, for the learning period */
+    uint64_t quiet_us;        /* time since the last frame above threshold */
+    uint32_t attack;          /* consecutive frames above threshold */
+    int speech;
+};
+
+capture_vad_t *capture_vad_create(switch_memory_pool_t *pool, uint32_t rate, uint32_t channels,
+                                  int threshold_db, uint32_t hangover_ms)
+{
+    capture_vad_t *vad;
+
+    if (!pool || rate < 8000 || !channels) return NULL;
+    vad = (capture_vad_t *)switch_core_alloc(pool, sizeof(*vad));
+    if (!vad) return NULL;
+
+    memset(vad, 0, sizeof(*vad));
+    vad->rate = rate;
+    vad->channels = channels;
+    vad->threshold_db = threshold_db;
+    vad->hangover_us = (uint64_t)hangover_ms * 1000;
+    return vad;
+}
+
+static double frame_db(const int16_t *pcm, uint32_t samples)
+{
+    double energy = 0;
+    uint32_t i;
+
+    for (i = 0; i < samples; i++) {
+        energy += (double)pcm[i] * pcm[i];
+    }
+    energy /= samples;
+    if (energy < 1.0) return VAD_MIN_DB;
+    /* 0 dBFS is a full scale square wave */
+    return 10.0 * log10(energy / (32768.0 * 32768.0));
+}
+
+/* One-pole smoothing with time constant tau over a frame of frame_us */
+static double follow(double from, double to, uint64_t frame_us, double tau_us)
+{
+    const double alpha = frame_us >= tau_us ? 1.0 : frame_us / tau_us;
+    return from + (to - from) * alpha;
+}
+
+capture_vad_result_t capture_vad_process(capture_vad_t *vad, const int16_t *pcm, uint32_t samples)
+{
+    const uint64_t frame_us = (uint64_t)samples / vad->channels * 1000000 / vad->rate;
+    double db;
+    int loud;
+
+    if (!samples || !frame_us) return vad->speech ? CAPTURE_VAD_SPEECH : CAPTURE_VAD_SILENCE;
+    db = frame_db(pcm, samples);
+
+    if (vad->elapsed_us < VAD_LEARN_US) {
+        /* Learning: the floor is the quietest frame so far */
+        if (!vad->elapsed_us || db < vad->noise_db) vad->noise_db = db;
+        vad->elapsed_us += frame_us;
+        return CAPTURE_VAD_SILENCE;
+    }
+    vad->elapsed_us += frame_us;
+
+    loud = db > VAD_ABS_MIN_DB && db > vad->noise_db + vad->threshold_db;
+    if (db < vad->noise_db) {
+        vad->noise_db = follow(vad->noise_db, db, frame_us, VAD_TAU_DOWN_US);
+    } else {
+        vad->noise_db = follow(vad->noise_db, db, frame_us, loud ? VAD_TAU_SPEECH_US : VAD_TAU_UP_US);
+    }
+
+    if (loud) {
+        vad->quiet_us = 0;
+        if (vad->attack < VAD_ATTACK_FRAMES) vad->attack++;
+        if (!vad->speech && vad->attack >= VAD_ATTACK_FRAMES) {
+            vad->speech = 1;
+            return CAPTURE_VAD_START;
+        }
+    } else {
+        vad->attack = 0;
+        vad->quiet_us += frame_us;
+        if (vad->speech && vad->quiet_us > vad->hangover_us) {
+            vad->speech = 0;
+            return CAPTURE_VAD_END;
+        }
+    }
+    return vad->speech ? CAPTURE_VAD_SPEECH : CAPTURE_VAD_SILENCE;
+}
+
+double capture_vad_noise_db(const capture_vad_t *vad)
+{
+    return vad->noise_db;
+}
@@ -0,0 +1,45 @@
+#ifndef CAPTURE_VAD_H
+#define CAPTURE_VAD_H
+
+#include <switch.h>
+
+/*
+ * NETPLAY v2.7: Energy voice activity detector for upstream capture (STREAM_VAD)
+ *
+ * Frame energy is compared in dB against an adaptive noise floor: the floor
+ * follows quieter frames within ~50 ms, rises towards louder non-speech
+ * within ~1 s, and creeps up during "speech" with a ~20 s time constant so
+ * stationary sound such as hold music is eventually treated as background.
+ * Speech starts after two consecutive frames above floor + threshold and ends
+ * once the hangover has passed without one. The first 200 ms only learn the
+ * floor. L16 at the capture rate, media thread only.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    CAPTURE_VAD_SILENCE = 0,    /* not speech: hold the frame back */
+    CAPTURE_VAD_SPEECH,         /* speech or hangover: send */
+    CAPTURE_VAD_START,          /* first speech frame: send the pre-roll, then this frame */
+    CAPTURE_VAD_END             /* hangover expired on this frame: it is silence */
+} capture_vad_result_t;
+
+typedef struct capture_vad capture_vad_t;
+
+/* Allocate from pool. threshold_db is the margin over the noise floor. */
+capture_vad_t *capture_vad_create(switch_memory_pool_t *pool, uint32_t rate, uint32_t channels,
+                                  int threshold_db, uint32_t hangover_ms);
+
+/* Classify one frame of interleaved samples (samples counts all channels). */
+capture_vad_result_t capture_vad_process(capture_vad_t *vad, const int16_t *pcm, uint32_t samples);
+
+/* Current noise floor in dBFS, for logging and stats. */
+double capture_vad_noise_db(const capture_vad_t *vad);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //CAPTURE_VAD_H
@@ -0,0 +1,564 @@
+/*
+ * G.711 µ-law/A-law kernels with runtime CPU dispatch
+ *
+ * The vector encoders follow the scalar reference bit for bit:
+ *  - µ-law: clip to 32635, add the 0x84 bias, exponent = number of bias-added
+ *    magnitude thresholds (256 << k) crossed, mantissa = 4 bits below the leading one.
+ *  - A-law: 13-bit magnitude (one's complement for negatives), segment = number
+ *    of segment ends crossed, mantissa taken at shift max(1, segment).
+ * SSE2/AVX2 lack per-lane 16-bit shifts, so the mantissa is extracted with an
+ * unsigned high multiply by a per-lane power of two derived from the same masks.
+ */
+#include "g711.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define G711_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#define G711_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define ULAW_BIAS 0x84
+#define ULAW_CLIP 32635
+
+static int16_t ulaw_table[256];
+static int16_t alaw_table[256];
+
+/* ---------------------------------------------------------------------- */
+/* Scalar reference                                                        */
+/* ---------------------------------------------------------------------- */
+
+static inline uint8_t linear_to_ulaw(int16_t pcm)
+{
+    int mag = pcm;
+    int sign = 0;
+    int exponent = 0;
+    int mantissa;
+
+    if (mag < 0) {
+        sign = 0x80;
+        mag = -mag;
+    }
+    if (mag > ULAW_CLIP) mag = ULAW_CLIP;
+    mag += ULAW_BIAS;
+
+    while (exponent < 7 && mag >= (256 << exponent)) exponent++;
+    mantissa = (mag >> (exponent + 3)) & 0x0F;
+    return (uint8_t)~(sign | (exponent << 4) | mantissa);
+}
+
+static inline uint8_t linear_to_alaw(int16_t pcm)
+{
+    int val = pcm >> 3;
+    int mask = 0xD5;
+    int seg = 0;
+
+    if (val < 0) {
+        mask = 0x55;
+        val = -val - 1;
+    }
+    while (seg < 7 && val > (0x20 << seg) - 1) seg++;
+    return (uint8_t)(((seg << 4) | ((val >> (seg < 2 ? 1 : seg)) & 0x0F)) ^ mask);
+}
+
+static int16_t ulaw_to_linear(uint8_t u)
+{
+    int t;
+
+    u = (uint8_t)~u;
+    t = ((u & 0x0F) << 3) + ULAW_BIAS;
+    t <<= (u & 0x70) >> 4;
+    return (int16_t)((u & 0x80) ? (ULAW_BIAS - t) : (t - ULAW_BIAS));
+}
+
+static int16_t alaw_to_linear(uint8_t a)
+{
+    int t;
+    int seg;
+
+    a ^= 0x55;
+    t = (a & 0x0F) << 4;
+    seg = (a & 0x70) >> 4;
+    switch (seg) {
+        case 0:
+            t += 8;
+            break;
+        case 1:
+            t += 0x108;
+            break;
+        default:
+            t += 0x108;
+            t <<= seg - 1;
+    }
+    return (int16_t)((a & 0x80) ? t : -t);
+}
+
+void g711_ulaw_encode_scalar(const int16_t *in, uint8_t *out, size_t samples)
+{
+    size_t i;
+    for (i = 0; i < samples; i++) out[i] = linear_to_ulaw(in[i]);
+}
+
+void g711_alaw_encode_scalar(const int16_t *in, uint8_t *out, size_t samples)
+{
+    size_t i;
+    for (i = 0; i < samples; i++) out[i] = linear_to_alaw(in[i]);
+}
+
+void g711_ulaw_decode_scalar(const uint8_t *in, int16_t *out, size_t samples)
+{
+    size_t i;
+    for (i = 0; i < samples; i++) out[i] = ulaw_table[in[i]];
+}
+
+void g711_alaw_decode_scalar(const uint8_t *in, int16_t *out, size_t samples)
+{
+    size_t i;
+    for (i = 0; i < samples; i++) out[i] = alaw_table[in[i]];
+}
+
+/* ---------------------------------------------------------------------- */
+/* x86: SSE2 (baseline on x86_64) and AVX2                                 */
+/* ---------------------------------------------------------------------- */
+
+#ifdef G711_X86
+
+static inline __m128i ulaw_sse2_8(__m128i x)
+{
+    const __m128i clip = _mm_set1_epi16(ULAW_CLIP);
+    const __m128i sign = _mm_srai_epi16(x, 15);
+    __m128i mag, exp = _mm_setzero_si128(), mult = _mm_set1_epi16(1 << 13), mant, val;
+    int k;
+
+    x = _mm_max_epi16(_mm_min_epi16(x, clip), _mm_sub_epi16(_mm_setzero_si128(), clip));
+    mag = _mm_sub_epi16(_mm_xor_si128(x, sign), sign);
+    mag = _mm_add_epi16(mag, _mm_set1_epi16(ULAW_BIAS));
+
+    for (k = 0; k < 7; k++) {
+        const __m128i m = _mm_cmpgt_epi16(mag, _mm_set1_epi16((short)((256 << k) - 1)));
+        exp = _mm_sub_epi16(exp, m);
+        mult = _mm_sub_epi16(mult, _mm_and_si128(_mm_srli_epi16(mult, 1), m));
+    }
+    mant = _mm_and_si128(_mm_mulhi_epu16(mag, mult), _mm_set1_epi16(0x0F));
+    val = _mm_or_si128(_mm_or_si128(_mm_and_si128(sign, _mm_set1_epi16(0x80)), _mm_slli_epi16(exp, 4)), mant);
+    return _mm_xor_si128(val, _mm_set1_epi16(0xFF));
+}
+
+static inline __m128i alaw_sse2_8(__m128i x)
+{
+    const __m128i v = _mm_srai_epi16(x, 3);
+    const __m128i sign = _mm_srai_epi16(v, 15);
+    const __m128i p = _mm_xor_si128(v, sign);
+    __m128i seg = _mm_setzero_si128(), mult = _mm_set1_epi16((short)0x8000), mant, val, mask;
+    int k;
+
+    for (k = 0; k < 7; k++) {
+        const __m128i m = _mm_cmpgt_epi16(p, _mm_set1_epi16((short)((0x20 << k) - 1)));
+        seg = _mm_sub_epi16(seg, m);
+        if (k > 0) mult = _mm_sub_epi16(mult, _mm_and_si128(_mm_srli_epi16(mult, 1), m));
+    }
+    mant = _mm_and_si128(_mm_mulhi_epu16(p, mult), _mm_set1_epi16(0x0F));
+    val = _mm_or_si128(_mm_slli_epi16(seg, 4), mant);
+    mask = _mm_xor_si128(_mm_set1_epi16(0x55), _mm_andnot_si128(sign, _mm_set1_epi16(0x80)));
+    return _mm_xor_si128(val, mask);
+}
+
+static void ulaw_encode_sse2(const int16_t *in, uint8_t *out, size_t samples)
+{
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i *)(in + i));
+        const __m128i b = _mm_loadu_si128((const __m128i *)(in + i + 8));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(ulaw_sse2_8(a), ulaw_sse2_8(b)));
+    }
+    g711_ulaw_encode_scalar(in + i, out + i, samples - i);
+}
+
+static void alaw_encode_sse2(const int16_t *in, uint8_t *out, size_t samples)
+{
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i *)(in + i));
+        const __m128i b = _mm_loadu_si128((const __m128i *)(in + i + 8));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(alaw_sse2_8(a), alaw_sse2_8(b)));
+    }
+    g711_alaw_encode_scalar(in + i, out + i, samples - i);
+}
+
+/* SSE2 has no per-lane shift either: t << e becomes t * 2^e, built from the three exponent bits */
+static inline __m128i pow2_sse2(__m128i e)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i p1 = _mm_add_epi16(_mm_and_si128(e, one), one);
+    const __m128i p2 = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(e, 1), one), _mm_set1_epi16(3)), one);
+    const __m128i p4 = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(e, 2), one), _mm_set1_epi16(15)), one);
+    return _mm_mullo_epi16(_mm_mullo_epi16(p1, p2), p4);
+}
+
+static inline __m128i ulaw_decode_sse2_8(__m128i u)
+{
+    const __m128i bias = _mm_set1_epi16(ULAW_BIAS);
+    __m128i t, neg;
+
+    u = _mm_xor_si128(u, _mm_set1_epi16(0xFF));
+    t = _mm_add_epi16(_mm_slli_epi16(_mm_and_si128(u, _mm_set1_epi16(0x0F)), 3), bias);
+    t = _mm_mullo_epi16(t, pow2_sse2(_mm_and_si128(_mm_srli_epi16(u, 4), _mm_set1_epi16(7))));
+    t = _mm_sub_epi16(t, bias);
+    neg = _mm_cmpgt_epi16(u, _mm_set1_epi16(0x7F));
+    return _mm_sub_epi16(_mm_xor_si128(t, neg), neg);
+}
+
+static inline __m128i alaw_decode_sse2_8(__m128i a)
+{
+    __m128i seg, t, first, neg;
+
+    a = _mm_xor_si128(a, _mm_set1_epi16(0x55));
+    seg = _mm_and_si128(_mm_srli_epi16(a, 4), _mm_set1_epi16(7));
+    first = _mm_cmpeq_epi16(seg, _mm_setzero_si128());
+    t = _mm_slli_epi16(_mm_and_si128(a, _mm_set1_epi16(0x0F)), 4);
+    t = _mm_add_epi16(t, _mm_or_si128(_mm_and_si128(first, _mm_set1_epi16(8)),
+                                      _mm_andnot_si128(first, _mm_set1_epi16(0x108))));
+    t = _mm_mullo_epi16(t, pow2_sse2(_mm_subs_epu16(seg, _mm_set1_epi16(1))));
+    neg = _mm_cmplt_epi16(a, _mm_set1_epi16(0x80));
+    return _mm_sub_epi16(_mm_xor_si128(t, neg), neg);
+}
+
+static void ulaw_decode_sse2(const uint8_t *in, int16_t *out, size_t samples)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        const __m128i b = _mm_loadu_si128((const __m128i *)(in + i));
+        _mm_storeu_si128((__m128i *)(out + i), ulaw_decode_sse2_8(_mm_unpacklo_epi8(b, zero)));
+        _mm_storeu_si128((__m128i *)(out + i + 8), ulaw_decode_sse2_8(_mm_unpackhi_epi8(b, zero)));
+    }
+    for (; i < samples; i++) out[i] = ulaw_table[in[i]];
+}
+
+static void alaw_decode_sse2(const uint8_t *in, int16_t *out, size_t samples)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        const __m128i b = _mm_loadu_si128((const __m128i *)(in + i));
+        _mm_storeu_si128((__m128i *)(out + i), alaw_decode_sse2_8(_mm_unpacklo_epi8(b, zero)));
+        _mm_storeu_si128((__m128i *)(out + i + 8), alaw_decode_sse2_8(_mm_unpackhi_epi8(b, zero)));
+    }
+    for (; i < samples; i++) out[i] = alaw_table[in[i]];
+}
+
+#define G711_AVX2 __attribute__((target("avx2")))
+
+static inline G711_AVX2 __m256i ulaw_avx2_16(__m256i x)
+{
+    const __m256i clip = _mm256_set1_epi16(ULAW_CLIP);
+    const __m256i sign = _mm256_srai_epi16(x, 15);
+    __m256i mag, exp = _mm256_setzero_si256(), mult = _mm256_set1_epi16(1 << 13), mant, val;
+    int k;
+
+    x = _mm256_max_epi16(_mm256_min_epi16(x, clip), _mm256_sub_epi16(_mm256_setzero_si256(), clip));
+    mag = _mm256_sub_epi16(_mm256_xor_si256(x, sign), sign);
+    mag = _mm256_add_epi16(mag, _mm256_set1_epi16(ULAW_BIAS));
+
+    for (k = 0; k < 7; k++) {
+        const __m256i m = _mm256_cmpgt_epi16(mag, _mm256_set1_epi16((short)((256 << k) - 1)));
+        exp = _mm256_sub_epi16(exp, m);
+        mult = _mm256_sub_epi16(mult, _mm256_and_si256(_mm256_srli_epi16(mult, 1), m));
+    }
+    mant = _mm256_and_si256(_mm256_mulhi_epu16(mag, mult), _mm256_set1_epi16(0x0F));
+    val = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(sign, _mm256_set1_epi16(0x80)),
+                                          _mm256_slli_epi16(exp, 4)), mant);
+    return _mm256_xor_si256(val, _mm256_set1_epi16(0xFF));
+}
+
+static inline G711_AVX2 __m256i alaw_avx2_16(__m256i x)
+{
+    const __m256i v = _mm256_srai_epi16(x, 3);
+    const __m256i sign = _mm256_srai_epi16(v, 15);
+    const __m256i p = _mm256_xor_si256(v, sign);
+    __m256i seg = _mm256_setzero_si256(), mult = _mm256_set1_epi16((short)0x8000), mant, val, mask;
+    int k;
+
+    for (k = 0; k < 7; k++) {
+        const __m256i m = _mm256_cmpgt_epi16(p, _mm256_set1_epi16((short)((0x20 << k) - 1)));
+        seg = _mm256_sub_epi16(seg, m);
+        if (k > 0) mult = _mm256_sub_epi16(mult, _mm256_and_si256(_mm256_srli_epi16(mult, 1), m));
+    }
+    mant = _mm256_and_si256(_mm256_mulhi_epu16(p, mult), _mm256_set1_epi16(0x0F));
+    val = _mm256_or_si256(_mm256_slli_epi16(seg, 4), mant);
+    mask = _mm256_xor_si256(_mm256_set1_epi16(0x55), _mm256_andnot_si256(sign, _mm256_set1_epi16(0x80)));
+    return _mm256_xor_si256(val, mask);
+}
+
+/* packus works per 128-bit lane: restore sample order with a 64-bit permute */
+static G711_AVX2 void ulaw_encode_avx2(const int16_t *in, uint8_t *out, size_t samples)
+{
+    size_t i = 0;
+    for (; i + 32 <= samples; i += 32) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *)(in + i));
+        const __m256i b = _mm256_loadu_si256((const __m256i *)(in + i + 16));
+        const __m256i packed = _mm256_packus_epi16(ulaw_avx2_16(a), ulaw_avx2_16(b));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    ulaw_encode_sse2(in + i, out + i, samples - i);
+}
+
+static G711_AVX2 void alaw_encode_avx2(const int16_t *in, uint8_t *out, size_t samples)
+{
+    size_t i = 0;
+    for (; i + 32 <= samples; i += 32) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *)(in + i));
+        const __m256i b = _mm256_loadu_si256((const __m256i *)(in + i + 16));
+        const __m256i packed = _mm256_packus_epi16(alaw_avx2_16(a), alaw_avx2_16(b));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    alaw_encode_sse2(in + i, out + i, samples - i);
+}
+
+static inline G711_AVX2 __m256i pow2_avx2(__m256i e)
+{
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i p1 = _mm256_add_epi16(_mm256_and_si256(e, one), one);
+    const __m256i p2 = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi16(e, 1), one),
+                                                           _mm256_set1_epi16(3)), one);
+    const __m256i p4 = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi16(e, 2), one),
+                                                           _mm256_set1_epi16(15)), one);
+    return _mm256_mullo_epi16(_mm256_mullo_epi16(p1, p2), p4);
+}
+
+static inline G711_AVX2 __m256i ulaw_decode_avx2_16(__m256i u)
+{
+    const __m256i bias = _mm256_set1_epi16(ULAW_BIAS);
+    __m256i t, neg;
+
+    u = _mm256_xor_si256(u, _mm256_set1_epi16(0xFF));
+    t = _mm256_add_epi16(_mm256_slli_epi16(_mm256_and_si256(u, _mm256_set1_epi16(0x0F)), 3), bias);
+    t = _mm256_mullo_epi16(t, pow2_avx2(_mm256_and_si256(_mm256_srli_epi16(u, 4), _mm256_set1_epi16(7))));
+    t = _mm256_sub_epi16(t, bias);
+    neg = _mm256_cmpgt_epi16(u, _mm256_set1_epi16(0x7F));
+    return _mm256_sub_epi16(_mm256_xor_si256(t, neg), neg);
+}
+
+static inline G711_AVX2 __m256i alaw_decode_avx2_16(__m256i a)
+{
+    __m256i seg, t, first, neg;
+
+    a = _mm256_xor_si256(a, _mm256_set1_epi16(0x55));
+    seg = _mm256_and_si256(_mm256_srli_epi16(a, 4), _mm256_set1_epi16(7));
+    first = _mm256_cmpeq_epi16(seg, _mm256_setzero_si256());
+    t = _mm256_slli_epi16(_mm256_and_si256(a, _mm256_set1_epi16(0x0F)), 4);
+    t = _mm256_add_epi16(t, _mm256_blendv_epi8(_mm256_set1_epi16(0x108), _mm256_set1_epi16(8), first));
+    t = _mm256_mullo_epi16(t, pow2_avx2(_mm256_subs_epu16(seg, _mm256_set1_epi16(1))));
+    neg = _mm256_cmpgt_epi16(_mm256_set1_epi16(0x80), a);
+    return _mm256_sub_epi16(_mm256_xor_si256(t, neg), neg);
+}
+
+static G711_AVX2 void ulaw_decode_avx2(const uint8_t *in, int16_t *out, size_t samples)
+{
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        const __m256i u = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(in + i)));
+        _mm256_storeu_si256((__m256i *)(out + i), ulaw_decode_avx2_16(u));
+    }
+    for (; i < samples; i++) out[i] = ulaw_table[in[i]];
+}
+
+static G711_AVX2 void alaw_decode_avx2(const uint8_t *in, int16_t *out, size_t samples)
+{
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        const __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(in + i)));
+        _mm256_storeu_si256((__m256i *)(out + i), alaw_decode_avx2_16(a));
+    }
+    for (; i < samples; i++) out[i] = alaw_table[in[i]];
+}
+
+#endif /* G711_X86 */
+
+/* ---------------------------------------------------------------------- */
+/* ARM NEON: per-lane shifts and clz make the segment search direct        */
+/* ---------------------------------------------------------------------- */
+
+#ifdef G711_NEON
+
+static inline uint8x8_t ulaw_neon_8(int16x8_t x)
+{
+    const int16x8_t clip = vdupq_n_s16(ULAW_CLIP);
+    const uint16x8_t neg = vcltq_s16(x, vdupq_n_s16(0));
+    uint16x8_t mag, mant, val;
+    int16x8_t exp;
+
+    x = vmaxq_s16(vminq_s16(x, clip), vnegq_s16(clip));
+    mag = vaddq_u16(vreinterpretq_u16_s16(vabsq_s16(x)), vdupq_n_u16(ULAW_BIAS));
+    /* exponent = max(0, bit length - 8) */
+    exp = vmaxq_s16(vsubq_s16(vdupq_n_s16(8), vreinterpretq_s16_u16(vclzq_u16(mag))), vdupq_n_s16(0));
+    mant = vandq_u16(vshlq_u16(mag, vnegq_s16(vaddq_s16(exp, vdupq_n_s16(3)))), vdupq_n_u16(0x0F));
+    val = vorrq_u16(vorrq_u16(vandq_u16(neg, vdupq_n_u16(0x80)), vshlq_n_u16(vreinterpretq_u16_s16(exp), 4)), mant);
+    return vmovn_u16(veorq_u16(val, vdupq_n_u16(0xFF)));
+}
+
+static inline uint8x8_t alaw_neon_8(int16x8_t x)
+{
+    const int16x8_t v = vshrq_n_s16(x, 3);
+    const int16x8_t sign = vshrq_n_s16(v, 15);
+    const uint16x8_t p = vreinterpretq_u16_s16(veorq_s16(v, sign));
+    int16x8_t seg, shift;
+    uint16x8_t mant, val, mask;
+
+    /* segment = max(0, bit length - 5), mantissa shift = max(1, segment) */
+    seg = vmaxq_s16(vsubq_s16(vdupq_n_s16(11), vreinterpretq_s16_u16(vclzq_u16(p))), vdupq_n_s16(0));
+    shift = vmaxq_s16(seg, vdupq_n_s16(1));
+    mant = vandq_u16(vshlq_u16(p, vnegq_s16(shift)), vdupq_n_u16(0x0F));
+    val = vorrq_u16(vshlq_n_u16(vreinterpretq_u16_s16(seg), 4), mant);
+    mask = veorq_u16(vdupq_n_u16(0x55), vbicq_u16(vdupq_n_u16(0x80), vreinterpretq_u16_s16(sign)));
+    return vmovn_u16(veorq_u16(val, mask));
+}
+
+static void ulaw_encode_neon(const int16_t *in, uint8_t *out, size_t samples)
+{
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        const int16x8_t a = vld1q_s16(in + i);
+        const int16x8_t b = vld1q_s16(in + i + 8);
+        vst1q_u8(out + i, vcombine_u8(ulaw_neon_8(a), ulaw_neon_8(b)));
+    }
+    g711_ulaw_encode_scalar(in + i, out + i, samples - i);
+}
+
+static void alaw_encode_neon(const int16_t *in, uint8_t *out, size_t samples)
+{
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        const int16x8_t a = vld1q_s16(in + i);
+        const int16x8_t b = vld1q_s16(in + i + 8);
+        vst1q_u8(out + i, vcombine_u8(alaw_neon_8(a), alaw_neon_8(b)));
+    }
+    g711_alaw_encode_scalar(in + i, out + i, samples - i);
+}
+
+static inline int16x8_t ulaw_decode_neon_8(uint16x8_t u)
+{
+    const int16x8_t bias = vdupq_n_s16(ULAW_BIAS);
+    int16x8_t t, e;
+    uint16x8_t neg;
+
+    u = veorq_u16(u, vdupq_n_u16(0xFF));
+    e = vreinterpretq_s16_u16(vandq_u16(vshrq_n_u16(u, 4), vdupq_n_u16(7)));
+    t = vaddq_s16(vreinterpretq_s16_u16(vshlq_n_u16(vandq_u16(u, vdupq_n_u16(0x0F)), 3)), bias);
+    t = vsubq_s16(vshlq_s16(t, e), bias);
+    neg = vcgtq_u16(u, vdupq_n_u16(0x7F));
+    return vbslq_s16(neg, vnegq_s16(t), t);
+}
+
+static inline int16x8_t alaw_decode_neon_8(uint16x8_t a)
+{
+    int16x8_t t, seg;
+    uint16x8_t pos;
+
+    a = veorq_u16(a, vdupq_n_u16(0x55));
+    seg = vreinterpretq_s16_u16(vandq_u16(vshrq_n_u16(a, 4), vdupq_n_u16(7)));
+    t = vreinterpretq_s16_u16(vshlq_n_u16(vandq_u16(a, vdupq_n_u16(0x0F)), 4));
+    t = vaddq_s16(t, vbslq_s16(vceqq_s16(seg, vdupq_n_s16(0)), vdupq_n_s16(8), vdupq_n_s16(0x108)));
+    t = vshlq_s16(t, vmaxq_s16(vsubq_s16(seg, vdupq_n_s16(1)), vdupq_n_s16(0)));
+    pos = vcgtq_u16(a, vdupq_n_u16(0x7F));
+    return vbslq_s16(pos, t, vnegq_s16(t));
+}
+
+static void ulaw_decode_neon(const uint8_t *in, int16_t *out, size_t samples)
+{
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        const uint8x16_t b = vld1q_u8(in + i);
+        vst1q_s16(out + i, ulaw_decode_neon_8(vmovl_u8(vget_low_u8(b))));
+        vst1q_s16(out + i + 8, ulaw_decode_neon_8(vmovl_u8(vget_high_u8(b))));
+    }
+    for (; i < samples; i++) out[i] = ulaw_table[in[i]];
+}
+
+static void alaw_decode_neon(const uint8_t *in, int16_t *out, size_t samples)
+{
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16) {
+        const uint8x16_t b = vld1q_u8(in + i);
+        vst1q_s16(out + i, alaw_decode_neon_8(vmovl_u8(vget_low_u8(b))));
+        vst1q_s16(out + i + 8, alaw_decode_neon_8(vmovl_u8(vget_high_u8(b))));
+    }
+    for (; i < samples; i++) out[i] = alaw_table[in[i]];
+}
+
+#endif /* G711_NEON */
+
+/* ---------------------------------------------------------------------- */
+/* Dispatch                                                                */
+/* ---------------------------------------------------------------------- */
+
+static g711_encode_fn ulaw_encode_impl = g711_ulaw_encode_scalar;
+static g711_encode_fn alaw_encode_impl = g711_alaw_encode_scalar;
+static g711_decode_fn ulaw_decode_impl = g711_ulaw_decode_scalar;
+static g711_decode_fn alaw_decode_impl = g711_alaw_decode_scalar;
+static const char *kernel_name = "scalar";
+static volatile int g711_initialized = 0;
+
+void g711_init(void)
+{
+    int i;
+
+    if (g711_initialized) return;
+
+    for (i = 0; i < 256; i++) {
+        ulaw_table[i] = ulaw_to_linear((uint8_t)i);
+        alaw_table[i] = alaw_to_linear((uint8_t)i);
+    }
+
+#if defined(G711_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        ulaw_encode_impl = ulaw_encode_avx2;
+        alaw_encode_impl = alaw_encode_avx2;
+        ulaw_decode_impl = ulaw_decode_avx2;
+        alaw_decode_impl = alaw_decode_avx2;
+        kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        ulaw_encode_impl = ulaw_encode_sse2;
+        alaw_encode_impl = alaw_encode_sse2;
+        ulaw_decode_impl = ulaw_decode_sse2;
+        alaw_decode_impl = alaw_decode_sse2;
+        kernel_name = "sse2";
+    }
+#elif defined(G711_NEON)
+    ulaw_encode_impl = ulaw_encode_neon;
+    alaw_encode_impl = alaw_encode_neon;
+    ulaw_decode_impl = ulaw_decode_neon;
+    alaw_decode_impl = alaw_decode_neon;
+    kernel_name = "neon";
+#endif
+
+    g711_initialized = 1;
+}
+
+const char *g711_kernel_name(void)
+{
+    return kernel_name;
+}
+
+void g711_ulaw_encode(const int16_t *in, uint8_t *out, size_t samples)
+{
+    ulaw_encode_impl(in, out, samples);
+}
+
+void g711_alaw_encode(const int16_t *in, uint8_t *out, size_t samples)
+{
+    alaw_encode_impl(in, out, samples);
+}
+
+void g711_ulaw_decode(const uint8_t *in, int16_t *out, size_t samples)
+{
+    ulaw_decode_impl(in, out, samples);
+}
+
+void g711_alaw_decode(const uint8_t *in, int16_t *out, size_t samples)
+{
+    alaw_decode_impl(in, out, samples);
+}
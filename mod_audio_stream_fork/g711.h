@@ -0,0 +1,51 @@
+#ifndef G711_H
+#define G711_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * NETPLAY v2.7: Shared G.711 kernels
+ *
+ * One implementation of ITU-T G.711 µ-law/A-law used by both the capture path
+ * (encode_g711) and playback injection. Encoders and decoders have SSE2, AVX2
+ * and NEON variants selected once at runtime by g711_init(); short tails fall
+ * back to the scalar code. g711_init() must run before any kernel is used.
+ *
+ * Encoders may run in place (out == (uint8_t *)in): each output byte is stored
+ * at or before the input sample it came from.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*g711_encode_fn)(const int16_t *in, uint8_t *out, size_t samples);
+typedef void (*g711_decode_fn)(const uint8_t *in, int16_t *out, size_t samples);
+
+/* Pick the best kernels for this CPU. Idempotent; called from module load. */
+void g711_init(void);
+
+/* Name of the selected encoder kernel ("avx2", "sse2", "neon" or "scalar"). */
+const char *g711_kernel_name(void);
+
+void g711_ulaw_encode(const int16_t *in, uint8_t *out, size_t samples);
+void g711_alaw_encode(const int16_t *in, uint8_t *out, size_t samples);
+void g711_ulaw_decode(const uint8_t *in, int16_t *out, size_t samples);
+void g711_alaw_decode(const uint8_t *in, int16_t *out, size_t samples);
+
+/* Portable reference kernels, exposed for the benchmark */
+void g711_ulaw_encode_scalar(const int16_t *in, uint8_t *out, size_t samples);
+void g711_alaw_encode_scalar(const int16_t *in, uint8_t *out, size_t samples);
+void g711_ulaw_decode_scalar(const uint8_t *in, int16_t *out, size_t samples);
+void g711_alaw_decode_scalar(const uint8_t *in, int16_t *out, size_t samples);
+
+/* µ-law/A-law code for digital silence */
+#define G711_ULAW_SILENCE 0xFF
+#define G711_ALAW_SILENCE 0xD5
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //G711_H
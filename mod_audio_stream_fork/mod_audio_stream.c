@@ -3,6 +3,9 @@
  */
 #include "mod_audio_stream.h"
 #include "audio_streamer_glue.h"
+#include "g711.h"
+#include "stream_protocol.h"
+#include "stream_base64.h"
 
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_audio_stream_shutdown);
 SWITCH_MODULE_RUNTIME_FUNCTION(mod_audio_stream_runtime);
@@ -19,59 +22,556 @@ static void responseHandler(switch_core_session_t* session, const char* eventNam
     switch_event_fire(&event);
 }
 
-static switch_log_level_t get_stream_log_level(switch_core_session_t *session, switch_log_level_t default_level) {
-    switch_channel_t *channel = switch_core_session_get_channel(session);
-    const char *level = switch_channel_get_variable(channel, "STREAM_LOG_LEVEL");
-    if (zstr(level)) return default_level;
-    if (!strcasecmp(level, "ERROR")) return SWITCH_LOG_ERROR;
-    if (!strcasecmp(level, "WARNING")) return SWITCH_LOG_WARNING;
-    if (!strcasecmp(level, "INFO")) return SWITCH_LOG_INFO;
-    if (!strcasecmp(level, "DEBUG")) return SWITCH_LOG_DEBUG;
-    return default_level;
+static inline uint8_t playback_silence_byte(const private_t *tech_pvt)
+{
+    if (tech_pvt->playback_format == STREAM_CODEC_PCMU) return G711_ULAW_SILENCE;
+    if (tech_pvt->playback_format == STREAM_CODEC_PCMA) return G711_ALAW_SILENCE;
+    return 0;
 }
 
 /*
- * Linear 16-bit PCM to μ-law conversion
- * Standard ITU-T G.711 algorithm
+ * NETPLAY v2.7: write one frame taken from the playback ring.
+ * G.711 rings are written with the session write codec, so the core sends them
+ * untouched; L16 goes through playback_codec and the core encodes it once.
  */
-static inline uint8_t linear_to_ulaw(int16_t pcm_val)
+static void playback_write_frame(switch_core_session_t *session, private_t *tech_pvt, uint8_t *data)
 {
-    static const int16_t BIAS = 0x84;   /* Bias for linear code */
-    static const int16_t CLIP = 32635;
-    static const uint8_t exp_lut[256] = {
-        0,0,1,1,2,2,2,2,3,3,3,3,3,3,3,3,
-        4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
-        5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,
-        5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,
-        6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,
-        6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,
-        6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,
-        6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,
-        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
-        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
-        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
-        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
-        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
-        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
-        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,
-        7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7
-    };
-    
-    int sign, exponent, mantissa;
-    uint8_t ulawbyte;
-    
-    /* Get the sign and the magnitude */
-    sign = (pcm_val >> 8) & 0x80;
-    if (sign != 0) pcm_val = -pcm_val;
-    if (pcm_val > CLIP) pcm_val = CLIP;
+    switch_frame_t write_frame = { 0 };
+    const uint32_t samples = tech_pvt->playback_frame_samples;
+
+    if (tech_pvt->playback_format != STREAM_CODEC_L16) {
+        switch_codec_t *write_codec = switch_core_session_get_write_codec(session);
+        const char *law = tech_pvt->playback_format == STREAM_CODEC_PCMU ? "PCMU" : "PCMA";
+
+        if (write_codec && write_codec->implementation && write_codec->implementation->iananame &&
+            !strcasecmp(write_codec->implementation->iananame, law) &&
+            write_codec->implementation->actual_samples_per_second == tech_pvt->playback_rate) {
+            write_frame.data = data;
+            write_frame.datalen = samples;
+            write_frame.samples = samples;
+            write_frame.rate = tech_pvt->playback_rate;
+            write_frame.codec = write_codec;
+            switch_core_session_write_frame(session, &write_frame, SWITCH_IO_FLAG_NONE, 0);
+            /* NETPLAY v2.7: echo reference is L16 */
+            if (tech_pvt->echo) {
+                if (tech_pvt->playback_format == STREAM_CODEC_PCMU) {
+                    g711_ulaw_decode(data, tech_pvt->playback_pcm, samples);
+                } else {
+                    g711_alaw_decode(data, tech_pvt->playback_pcm, samples);
+                }
+                capture_echo_played(tech_pvt->echo, tech_pvt->playback_pcm, samples);
+            }
+            return;
+        }
+
+        /* Write codec changed under us (re-INVITE): decode and let the core transcode */
+        if (tech_pvt->playback_format == STREAM_CODEC_PCMU) {
+            g711_ulaw_decode(data, tech_pvt->playback_pcm, samples);
+        } else {
+            g711_alaw_decode(data, tech_pvt->playback_pcm, samples);
+        }
+        data = (uint8_t *)tech_pvt->playback_pcm;
+    }
+
+    if (!tech_pvt->playback_codec_initialized) return;
+    write_frame.data = data;
+    write_frame.datalen = samples * sizeof(int16_t);
+    write_frame.samples = samples;
+    write_frame.rate = tech_pvt->playback_rate;
+    write_frame.codec = &tech_pvt->playback_codec;
+    switch_core_session_write_frame(session, &write_frame, SWITCH_IO_FLAG_NONE, 0);
+    if (tech_pvt->echo) capture_echo_played(tech_pvt->echo, (const int16_t *)data, samples);
+}
+
+/* NETPLAY v2.7: adaptive playout depth. Twice the arrival jitter, never below the
+ * configured target, plus whatever real underruns have added; capped at the max. */
+static switch_size_t playback_adaptive_target(private_t *tech_pvt)
+{
+    const uint64_t jitter_us = __atomic_load_n(&tech_pvt->playback_jitter_us, __ATOMIC_RELAXED);
+    switch_size_t target = (switch_size_t)(jitter_us * 2 * tech_pvt->playback_bytes_per_ms / 1000);
+
+    if (target < tech_pvt->playback_target_min) target = tech_pvt->playback_target_min;
+    target += tech_pvt->playback_target_boost;
+    if (target > tech_pvt->playback_target_max) target = tech_pvt->playback_target_max;
+    __atomic_store_n(&tech_pvt->playback_target, target, __ATOMIC_RELAXED);
+    return target;
+}
+
+/* NETPLAY v2.7: L16 view of the frame in playback_frame, decoding G.711 into playback_pcm */
+static int16_t *playback_frame_pcm(private_t *tech_pvt)
+{
+    if (tech_pvt->playback_format == STREAM_CODEC_L16) return (int16_t *)tech_pvt->playback_frame;
+    if (tech_pvt->playback_format == STREAM_CODEC_PCMU) {
+        g711_ulaw_decode(tech_pvt->playback_frame, tech_pvt->playback_pcm, tech_pvt->playback_frame_samples);
+    } else {
+        g711_alaw_decode(tech_pvt->playback_frame, tech_pvt->playback_pcm, tech_pvt->playback_frame_samples);
+    }
+    return tech_pvt->playback_pcm;
+}
+
+/* Store pcm back into playback_frame in the ring format */
+static void playback_frame_store(private_t *tech_pvt, const int16_t *pcm)
+{
+    if (tech_pvt->playback_format == STREAM_CODEC_PCMU) {
+        g711_ulaw_encode(pcm, tech_pvt->playback_frame, tech_pvt->playback_frame_samples);
+    } else if (tech_pvt->playback_format == STREAM_CODEC_PCMA) {
+        g711_alaw_encode(pcm, tech_pvt->playback_frame, tech_pvt->playback_frame_samples);
+    }
+}
+
+/* NETPLAY v2.7: EVENT_PLAY for a cached clip, to event consumers and the backend */
+static void playback_cue_report(switch_core_session_t *session, private_t *tech_pvt, const playback_cue_t *cue,
+                                const char *status)
+{
+    char json[256];
+
+    switch_snprintf(json, sizeof(json),
+        "{\"type\":\"playCached\",\"id\":\"%s\",\"epoch\":%u,\"status\":\"%s\",\"playedMs\":%" SWITCH_UINT64_T_FMT "}",
+        playback_clip_id(cue->clip), cue->epoch, status, (uint64_t)(tech_pvt->playback_cue_off / tech_pvt->playback_bytes_per_ms));
+    responseHandler(session, EVENT_PLAY, json);
+    stream_session_playback_report(tech_pvt, json);
+}
+
+/* Done with the clip at the tail: report it and hand its reference back */
+static void playback_cue_pop(switch_core_session_t *session, private_t *tech_pvt, const char *status)
+{
+    playback_cue_t *cue = &tech_pvt->playback_cues[tech_pvt->playback_cues_tail % PLAYBACK_CUES];
+
+    playback_cue_report(session, tech_pvt, cue, status);
+    playback_clip_release(cue->clip);
+    cue->clip = NULL;
+    tech_pvt->playback_cue_off = 0;
+    __atomic_store_n(&tech_pvt->playback_cues_tail, tech_pvt->playback_cues_tail + 1, __ATOMIC_RELEASE);
+}
+
+/* NETPLAY v2.7: playback input not played yet, the ring and the cached clips queued in it */
+static switch_size_t playback_input(private_t *tech_pvt)
+{
+    const uint32_t head = __atomic_load_n(&tech_pvt->playback_cues_head, __ATOMIC_ACQUIRE);
+    switch_size_t bytes = playback_ring_inuse(tech_pvt->playback_ring);
+    uint32_t tail;
+
+    if (tech_pvt->playback_cues_tail == head) return bytes;
+    for (tail = tech_pvt->playback_cues_tail; tail != head; tail++) {
+        bytes += playback_clip_len(tech_pvt->playback_cues[tail % PLAYBACK_CUES].clip);
+    }
+    return bytes - tech_pvt->playback_cue_off;
+}
+
+/* NETPLAY v2.7: read up to len bytes of playback input: the ring, with each queued clip
+ * spliced in where the ring write position stood when it was queued. Clip audio is
+ * copied straight out of the cache, it never goes through the ring. */
+static switch_size_t playback_read(switch_core_session_t *session, private_t *tech_pvt, uint8_t *out, switch_size_t len)
+{
+    switch_size_t got = 0;
+
+    while (got < len) {
+        const uint32_t head = __atomic_load_n(&tech_pvt->playback_cues_head, __ATOMIC_ACQUIRE);
+        const playback_cue_t *cue;
+        uint64_t pos;
+        switch_size_t n;
+
+        if (tech_pvt->playback_cues_tail == head) {
+            return got + playback_ring_read(tech_pvt->playback_ring, out + got, len - got);
+        }
+        cue = &tech_pvt->playback_cues[tech_pvt->playback_cues_tail % PLAYBACK_CUES];
+        pos = playback_ring_read_pos(tech_pvt->playback_ring);
+        if (cue->pos > pos) {
+            /* Ring audio queued ahead of the clip */
+            n = (uint64_t)(len - got) < cue->pos - pos ? len - got : (switch_size_t)(cue->pos - pos);
+            n = playback_ring_read(tech_pvt->playback_ring, out + got, n);
+            if (!n) break;
+            got += n;
+            continue;
+        }
+        if (!tech_pvt->playback_cue_off) playback_cue_report(session, tech_pvt, cue, "started");
+        n = playback_clip_len(cue->clip) - tech_pvt->playback_cue_off;
+        if (n > len - got) n = len - got;
+        memcpy(out + got, playback_clip_data(cue->clip) + tech_pvt->playback_cue_off, n);
+        tech_pvt->playback_cue_off += n;
+        got += n;
+        if (tech_pvt->playback_cue_off == playback_clip_len(cue->clip)) playback_cue_pop(session, tech_pvt, "complete");
+    }
+    return got;
+}
+
+/* NETPLAY v2.7: speed for the next frame. Compress once the backlog is well above
+ * the playout target, ramping with the excess, and go back to 1.0 at the target. */
+static double playback_stretch_speed(private_t *tech_pvt, switch_size_t available, switch_size_t target)
+{
+    const switch_size_t floor_margin = 60 * tech_pvt->playback_bytes_per_ms;
+    const switch_size_t margin = target / 2 > floor_margin ? target / 2 : floor_margin;
+    double excess;
+
+    if (!tech_pvt->playback_stretching && available > target + margin) {
+        tech_pvt->playback_stretching = 1;
+    } else if (tech_pvt->playback_stretching && available <= target) {
+        tech_pvt->playback_stretching = 0;
+    }
+    if (!tech_pvt->playback_stretching) return 1.0;
+
+    excess = (double)(available - target) / (2 * margin);
+    if (excess > 1.0) excess = 1.0;
+    return TIME_STRETCH_MIN_SPEED + (TIME_STRETCH_MAX_SPEED - TIME_STRETCH_MIN_SPEED) * excess;
+}
+
+/* NETPLAY v2.7: next frame through the time stretch stage. The ring is moved into
+ * the stage a frame at a time (playback_frame doubles as the read buffer) until it
+ * holds enough lookahead, then one frame is pulled at the current speed. */
+static void playback_stretch_read(switch_core_session_t *session, private_t *tech_pvt, double speed)
+{
+    time_stretch_t *ts = tech_pvt->playback_stretch;
+    const uint32_t samples = tech_pvt->playback_frame_samples;
+    const switch_size_t sample_bytes = STREAM_CODEC_SAMPLE_BYTES(tech_pvt->playback_format);
+    const uint32_t want = (uint32_t)(samples * 2 * speed) + time_stretch_lookahead(ts, speed);
+    int16_t *pcm = tech_pvt->playback_format == STREAM_CODEC_L16 ? (int16_t *)tech_pvt->playback_frame : tech_pvt->playback_pcm;
+    uint32_t before, got;
+
+    while (time_stretch_pending(ts) < want && playback_input(tech_pvt) >= sample_bytes) {
+        uint32_t n = want - time_stretch_pending(ts);
+        if (n > samples) n = samples;
+        if (n > time_stretch_room(ts)) n = time_stretch_room(ts);
+        n = (uint32_t)(playback_read(session, tech_pvt, tech_pvt->playback_frame, n * sample_bytes) / sample_bytes);
+        if (!n) break;
+        if (tech_pvt->playback_format == STREAM_CODEC_PCMU) {
+            g711_ulaw_decode(tech_pvt->playback_frame, tech_pvt->playback_pcm, n);
+        } else if (tech_pvt->playback_format == STREAM_CODEC_PCMA) {
+            g711_alaw_decode(tech_pvt->playback_frame, tech_pvt->playback_pcm, n);
+        }
+        time_stretch_push(ts, pcm, n);
+    }
+
+    before = time_stretch_pending(ts);
+    got = time_stretch_pull(ts, pcm, samples, speed);
+    if (got < samples) {
+        /* Ring ran dry under the stage: pad with silence */
+        memset(pcm + got, 0, (samples - got) * sizeof(int16_t));
+    }
+    playback_frame_store(tech_pvt, pcm);
+
+    if (speed > 1.0) {
+        const uint32_t consumed = before - time_stretch_pending(ts);
+        stream_stat_inc(&tech_pvt->stats.stretch_frames);
+        if (consumed > got) {
+            stream_stat_add(&tech_pvt->stats.stretch_saved_us, (uint64_t)(consumed - got) * 1000000 / tech_pvt->playback_rate);
+        }
+    }
+}
+
+/* NETPLAY v2.7: tell event consumers and the backend how much of an epoch the caller
+ * heard, so a cancelled response can be truncated without asking */
+static void playback_report(switch_core_session_t *session, private_t *tech_pvt, uint32_t epoch,
+                            uint64_t bytes, const char *reason)
+{
+    char json[160];
+
+    switch_snprintf(json, sizeof(json),
+        "{\"type\":\"playbackDone\",\"epoch\":%u,\"playedMs\":%" SWITCH_UINT64_T_FMT ",\"reason\":\"%s\"}",
+        epoch, (uint64_t)(bytes / tech_pvt->playback_bytes_per_ms), reason);
+    responseHandler(session, EVENT_PLAYBACK_DONE, json);
+    stream_session_playback_report(tech_pvt, json);
+}
+
+/* NETPLAY v2.7: attribute the audio consumed since the last call to its epoch. Audio
+ * still waiting in the time stretch stage has left the ring but was not played yet.
+ * An epoch whose successor has started playing is complete. */
+static void playback_epoch_account(switch_core_session_t *session, private_t *tech_pvt)
+{
+    const uint32_t head = __atomic_load_n(&tech_pvt->playback_marks_head, __ATOMIC_ACQUIRE);
+    uint32_t tail = tech_pvt->playback_marks_tail;
+    uint64_t pos = playback_ring_read_pos(tech_pvt->playback_ring);
+
+    if (tech_pvt->playback_stretch) {
+        pos -= (uint64_t)time_stretch_pending(tech_pvt->playback_stretch) * STREAM_CODEC_SAMPLE_BYTES(tech_pvt->playback_format);
+    }
+    while (tail != head && tech_pvt->playback_marks[tail % PLAYBACK_EPOCH_MARKS].pos <= pos) {
+        const playback_epoch_mark_t *mark = &tech_pvt->playback_marks[tail % PLAYBACK_EPOCH_MARKS];
+        if (mark->pos > tech_pvt->playback_play_pos) {
+            tech_pvt->playback_play_bytes += mark->pos - tech_pvt->playback_play_pos;
+            tech_pvt->playback_play_pos = mark->pos;
+        }
+        if (tech_pvt->playback_play_bytes) {
+            playback_report(session, tech_pvt, tech_pvt->playback_play_epoch, tech_pvt->playback_play_bytes, "complete");
+        }
+        tech_pvt->playback_play_epoch = mark->epoch;
+        tech_pvt->playback_play_bytes = 0;
+        tail++;
+    }
+    __atomic_store_n(&tech_pvt->playback_marks_tail, tail, __ATOMIC_RELEASE);
+    if (pos > tech_pvt->playback_play_pos) {
+        tech_pvt->playback_play_bytes += pos - tech_pvt->playback_play_pos;
+        tech_pvt->playback_play_pos = pos;
+    }
+}
+
+/* NETPLAY v2.7: playback paused on an empty buffer, which is usually the end of a
+ * response: report the epoch so far (the count keeps growing if more of it arrives) */
+static void playback_epoch_drained(switch_core_session_t *session, private_t *tech_pvt)
+{
+    playback_epoch_account(session, tech_pvt);
+    if (tech_pvt->playback_play_bytes) {
+        playback_report(session, tech_pvt, tech_pvt->playback_play_epoch, tech_pvt->playback_play_bytes, "drained");
+    }
+}
+
+/* NETPLAY v2.7: last frame before a barge-in cut, ramped linearly to zero over
+ * playback_fade_samples and silent after that */
+static void playback_fade_out(switch_core_session_t *session, private_t *tech_pvt)
+{
+    const uint32_t samples = tech_pvt->playback_frame_samples;
+    const uint32_t fade = tech_pvt->playback_fade_samples;
+    int16_t *pcm;
+    uint32_t i;
+
+    if (tech_pvt->playback_stretch) {
+        tech_pvt->playback_stretching = 0;
+        playback_stretch_read(session, tech_pvt, 1.0);
+    } else if (playback_read(session, tech_pvt, tech_pvt->playback_frame, tech_pvt->playback_frame_bytes) <
+               tech_pvt->playback_frame_bytes) {
+        memset(tech_pvt->playback_frame, playback_silence_byte(tech_pvt), tech_pvt->playback_frame_bytes);
+    }
+    pcm = playback_frame_pcm(tech_pvt);
+    for (i = 0; i < fade && i < samples; i++) {
+        pcm[i] = (int16_t)((int32_t)pcm[i] * (int32_t)(fade - i) / (int32_t)fade);
+    }
+    if (i < samples) memset(pcm + i, 0, (samples - i) * sizeof(int16_t));
+    playback_frame_store(tech_pvt, pcm);
+    playback_write_frame(session, tech_pvt, tech_pvt->playback_frame);
+    stream_stat_inc(&tech_pvt->stats.frames_injected);
+}
+
+/* NETPLAY v2.7: stopAudio (barge-in). Fade out what is playing, report how much of the
+ * interrupted epoch was heard and drop everything written before the stop; audio of a
+ * newer epoch that already arrived stays queued. */
+static void playback_barge_in(switch_core_session_t *session, private_t *tech_pvt)
+{
+    const uint64_t stop_pos = __atomic_load_n(&tech_pvt->playback_stop_pos, __ATOMIC_RELAXED);
+    const uint64_t stop_ts = __atomic_load_n(&tech_pvt->barge_in_ts, __ATOMIC_RELAXED);
+    const switch_size_t sample_bytes = STREAM_CODEC_SAMPLE_BYTES(tech_pvt->playback_format);
+    uint32_t head, tail;
+    uint64_t played;
+
+    playback_epoch_account(session, tech_pvt);
+    played = tech_pvt->playback_play_bytes;
+    if (tech_pvt->playback_active && tech_pvt->playback_fade_samples &&
+        (playback_input(tech_pvt) ||
+         (tech_pvt->playback_stretch && time_stretch_pending(tech_pvt->playback_stretch)))) {
+        playback_fade_out(session, tech_pvt);
+        played += (uint64_t)tech_pvt->playback_fade_samples * sample_bytes;
+    }
+    if (tech_pvt->latency && tech_pvt->playback_active && stop_ts) {
+        stream_hist_record(&tech_pvt->latency->barge_in, (uint64_t)(switch_micro_time_now() - stop_ts));
+    }
+    if (played) {
+        playback_report(session, tech_pvt, tech_pvt->playback_play_epoch, played, "interrupted");
+    }
+
+    /* Cached clips queued before the stop go with it */
+    head = __atomic_load_n(&tech_pvt->playback_cues_head, __ATOMIC_ACQUIRE);
+    while (tech_pvt->playback_cues_tail != head &&
+           (int32_t)(tech_pvt->playback_cues[tech_pvt->playback_cues_tail % PLAYBACK_CUES].stop_seq - tech_pvt->playback_stop_seen) < 0) {
+        playback_cue_pop(session, tech_pvt, tech_pvt->playback_cue_off ? "interrupted" : "cancelled");
+    }
+
+    if (tech_pvt->playback_stretch) time_stretch_reset(tech_pvt->playback_stretch);
+    playback_ring_discard_to(tech_pvt->playback_ring, stop_pos);
+
+    /* Epochs queued behind the cut were cancelled before a sample was played */
+    head = __atomic_load_n(&tech_pvt->playback_marks_head, __ATOMIC_ACQUIRE);
+    tail = tech_pvt->playback_marks_tail;
+    while (tail != head && tech_pvt->playback_marks[tail % PLAYBACK_EPOCH_MARKS].pos <= playback_ring_read_pos(tech_pvt->playback_ring)) {
+        tech_pvt->playback_play_epoch = tech_pvt->playback_marks[tail % PLAYBACK_EPOCH_MARKS].epoch;
+        tail++;
+    }
+    __atomic_store_n(&tech_pvt->playback_marks_tail, tail, __ATOMIC_RELEASE);
+    tech_pvt->playback_play_pos = playback_ring_read_pos(tech_pvt->playback_ring);
+    tech_pvt->playback_play_bytes = 0;
+
+    tech_pvt->playback_active = 0;
+    tech_pvt->underrun_streak = 0;
+    tech_pvt->playback_underrun_ts = 0;
+    tech_pvt->playback_stretching = 0;
+    if (tech_pvt->playback_plc) playback_plc_reset(tech_pvt->playback_plc);
+}
+
+/* NETPLAY v2.1: Inject playback audio during READ callback
+ * This is called every ptime when receiving audio from caller.
+ * We use this opportunity to also send audio TO the caller.
+ */
+static void playback_inject(switch_core_session_t *session, private_t *tech_pvt)
+{
+    const switch_size_t frame_size = tech_pvt->playback_frame_bytes;
+    const uint32_t stop_seq = __atomic_load_n(&tech_pvt->playback_stop_seq, __ATOMIC_ACQUIRE);
+    switch_size_t available;
+
+    if (stop_seq != tech_pvt->playback_stop_seen) {
+        tech_pvt->playback_stop_seen = stop_seq;
+        playback_barge_in(session, tech_pvt);
+        return;
+    }
+
+    available = playback_input(tech_pvt);
+    if (tech_pvt->playback_stretch) {
+        /* Audio already moved into the stretch stage is still queued for playback */
+        available += (switch_size_t)time_stretch_pending(tech_pvt->playback_stretch) *
+                     STREAM_CODEC_SAMPLE_BYTES(tech_pvt->playback_format);
+    }
     
-    /* Convert from 16 bit linear to ulaw */
-    pcm_val = pcm_val + BIAS;
-    exponent = exp_lut[(pcm_val >> 7) & 0xFF];
-    mantissa = (pcm_val >> (exponent + 3)) & 0x0F;
-    ulawbyte = ~(sign | (exponent << 4) | mantissa);
+    /* NETPLAY v2.5.2: Increased buffer thresholds to reduce audio choppiness
+     * 
+     * Problem: With OpenAI Realtime API, audio arrives in bursts with varying latency.
+     * A 100ms warmup buffer is not enough to smooth out network jitter.
+     * 
+     * Solution:
+     * - Warmup threshold: 400ms (20 frames) - wait for more data before starting
+     * - Low water mark: 160ms (8 frames) - only pause if buffer gets critically low
+     * - This creates a "buffer zone" that absorbs latency spikes
+     */
+    const switch_size_t warmup_threshold = tech_pvt->warmup_threshold ? tech_pvt->warmup_threshold : (frame_size * 20);
+    const switch_size_t low_water_mark = tech_pvt->low_water_mark ? tech_pvt->low_water_mark : (frame_size * 8);
+    int start = !tech_pvt->playback_active && available >= warmup_threshold;
+
+    /* NETPLAY v2.7: adaptive playout starts at the current target, or with whatever is
+     * buffered once the backend has gone quiet for that long (end of a short reply) */
+    if (tech_pvt->playback_adaptive && !tech_pvt->playback_active) {
+        const switch_size_t target = playback_adaptive_target(tech_pvt);
+        const uint64_t last_arrival = __atomic_load_n(&tech_pvt->playback_last_arrival_ts, __ATOMIC_RELAXED);
+        const uint64_t target_us = (uint64_t)target * 1000 / tech_pvt->playback_bytes_per_ms;
+        start = available >= target ||
+                (available >= frame_size && last_arrival && (uint64_t)switch_micro_time_now() - last_arrival >= target_us);
+        if (start && tech_pvt->playback_underrun_ts &&
+            switch_micro_time_now() - tech_pvt->playback_underrun_ts < 1000000) {
+            /* Ran dry mid-utterance: this call needs more depth */
+            const switch_size_t step = 20 * tech_pvt->playback_bytes_per_ms;
+            if (tech_pvt->playback_target_min + tech_pvt->playback_target_boost < tech_pvt->playback_target_max) {
+                tech_pvt->playback_target_boost += step;
+            }
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), stream_log_level(&tech_pvt->config, SWITCH_LOG_DEBUG),
+                "[PLAYBACK] underrun mid-utterance, target now %zums\n",
+                playback_adaptive_target(tech_pvt) / tech_pvt->playback_bytes_per_ms);
+        }
+        if (start) tech_pvt->playback_underrun_ts = 0;
+    }
+
+    /* Warmup: wait until we have enough buffer */
+    if (start) {
+        tech_pvt->playback_active = 1;
+        tech_pvt->underrun_streak = 0;
+        tech_pvt->playback_start_ts = switch_micro_time_now();
+        if (tech_pvt->first_audio_ts > 0) {
+            uint64_t latency_ms = (tech_pvt->playback_start_ts - tech_pvt->first_audio_ts) / 1000;
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), stream_log_level(&tech_pvt->config, SWITCH_LOG_INFO),
+                "[PLAYBACK] started buffer=%zu bytes, latency=%" SWITCH_UINT64_T_FMT "ms\n",
+                available, latency_ms);
+        } else {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), stream_log_level(&tech_pvt->config, SWITCH_LOG_INFO),
+                "[PLAYBACK] started buffer=%zu bytes\n", available);
+        }
+    }
     
-    return ulawbyte;
+    if (tech_pvt->playback_active && available >= frame_size) {
+        /* NETPLAY v2.7: the ring drains in real time, so the audio queued ahead is its residency */
+        if (tech_pvt->latency) {
+            const uint64_t bytes_per_sec = (uint64_t)tech_pvt->playback_rate * STREAM_CODEC_SAMPLE_BYTES(tech_pvt->playback_format);
+            stream_hist_record(&tech_pvt->latency->buffer_residency, (uint64_t)available * 1000000 / bytes_per_sec);
+        }
+        if (tech_pvt->playback_stretch) {
+            playback_stretch_read(session, tech_pvt, playback_stretch_speed(tech_pvt, available,
+                                  tech_pvt->playback_adaptive ? tech_pvt->playback_target : warmup_threshold));
+        } else if (playback_read(session, tech_pvt, tech_pvt->playback_frame, frame_size) < frame_size) {
+            /* Short read: play the frame as silence */
+            memset(tech_pvt->playback_frame, playback_silence_byte(tech_pvt), frame_size);
+        }
+        if (tech_pvt->playback_plc) {
+            int16_t *pcm = playback_frame_pcm(tech_pvt);
+            if (playback_plc_good(tech_pvt->playback_plc, pcm, tech_pvt->playback_frame_samples)) {
+                playback_frame_store(tech_pvt, pcm);
+            }
+            /* A long clean run gives back some of the depth added by underruns */
+            if (++tech_pvt->playback_clean_frames >= 500 && tech_pvt->playback_target_boost) {
+                const switch_size_t step = 10 * tech_pvt->playback_bytes_per_ms;
+                tech_pvt->playback_target_boost -= tech_pvt->playback_target_boost < step ? tech_pvt->playback_target_boost : step;
+                tech_pvt->playback_clean_frames = 0;
+            }
+        }
+        playback_write_frame(session, tech_pvt, tech_pvt->playback_frame);
+        stream_stat_inc(&tech_pvt->stats.frames_injected);
+        tech_pvt->underrun_streak = 0;
+        playback_epoch_account(session, tech_pvt);
+    } else if (tech_pvt->playback_active && available < frame_size) {
+        /* Underrun - opcionalmente injeta silêncio antes de pausar */
+        stream_stat_inc(&tech_pvt->stats.playback_underruns);
+        tech_pvt->underrun_streak++;
+        stream_stat_max(&tech_pvt->stats.underrun_streak_max, tech_pvt->underrun_streak);
+        tech_pvt->playback_clean_frames = 0;
+        if (tech_pvt->underrun_streak <= tech_pvt->underrun_grace_frames && tech_pvt->playback_plc) {
+            /* NETPLAY v2.7: adaptive mode bridges the gap with concealment */
+            int16_t *pcm = tech_pvt->playback_format == STREAM_CODEC_L16 ? (int16_t *)tech_pvt->playback_frame : tech_pvt->playback_pcm;
+            playback_plc_conceal(tech_pvt->playback_plc, pcm, tech_pvt->playback_frame_samples);
+            playback_frame_store(tech_pvt, pcm);
+            playback_write_frame(session, tech_pvt, tech_pvt->playback_frame);
+            stream_stat_inc(&tech_pvt->stats.plc_frames);
+        } else if (tech_pvt->underrun_streak <= tech_pvt->underrun_grace_frames) {
+            memset(tech_pvt->playback_frame, playback_silence_byte(tech_pvt), frame_size);
+            playback_write_frame(session, tech_pvt, tech_pvt->playback_frame);
+            stream_stat_inc(&tech_pvt->stats.silence_injected);
+        } else if (tech_pvt->playback_adaptive) {
+            tech_pvt->playback_active = 0;
+            tech_pvt->underrun_streak = 0;
+            tech_pvt->playback_underrun_ts = switch_micro_time_now();
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), stream_log_level(&tech_pvt->config, SWITCH_LOG_DEBUG),
+                "[BUFFER] empty (%zu bytes), waiting for %zums\n", available,
+                playback_adaptive_target(tech_pvt) / tech_pvt->playback_bytes_per_ms);
+            playback_epoch_drained(session, tech_pvt);
+        } else if (available < low_water_mark) {
+            /* Buffer critically low - pause playback to allow refill */
+            tech_pvt->playback_active = 0;
+            tech_pvt->underrun_streak = 0;
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), stream_log_level(&tech_pvt->config, SWITCH_LOG_DEBUG),
+                "[BUFFER] low (%zu bytes), pausing to refill\n", available);
+            playback_epoch_drained(session, tech_pvt);
+        }
+    }
+}
+
+/* NETPLAY v2.7: STREAM_PLAYBACK_PACING, one frame per timer tick instead of per READ */
+static void playback_pacer_tick(switch_core_session_t *session, void *user_data)
+{
+    private_t *tech_pvt = (private_t *)user_data;
+
+    if (tech_pvt->close_requested || tech_pvt->cleanup_started) return;
+    /* READ may still be injecting a frame; it hands over on its next callback */
+    if (!__atomic_load_n(&tech_pvt->playback_paced, __ATOMIC_ACQUIRE)) return;
+    if (!switch_channel_media_ready(switch_core_session_get_channel(session))) return;
+    playback_inject(session, tech_pvt);
+}
+
+/* NETPLAY v2.7: start the pacer of a stream whose bug is attached. READ keeps injecting
+ * until it sees the pacer and hands over (playback_paced), so the two never overlap; under
+ * the mutex, so a cleanup that already started (hangup right after the bug add) wins. */
+static void playback_pacer_attach(switch_core_session_t *session, private_t *tech_pvt)
+{
+    uint32_t interval_ms;
+    playback_pacer_t *pacer;
+
+    if (!tech_pvt->config.playback_pacing || !tech_pvt->playback_ring) return;
+    interval_ms = tech_pvt->playback_frame_samples * 1000 / tech_pvt->playback_rate;
+    switch_mutex_lock(tech_pvt->mutex);
+    if (tech_pvt->cleanup_started) {
+        switch_mutex_unlock(tech_pvt->mutex);
+        return;
+    }
+    pacer = playback_pacer_start(session, interval_ms, tech_pvt->playback_frame_samples, playback_pacer_tick, tech_pvt);
+    __atomic_store_n(&tech_pvt->playback_pacer, pacer, __ATOMIC_RELEASE);
+    switch_mutex_unlock(tech_pvt->mutex);
+
+    if (pacer) {
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
+                          "[PLAYBACK] paced by a %ums timer\n", interval_ms);
+    } else {
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING,
+                          "[PLAYBACK] cannot pace a %ums ptime (10, 20 or 30), injecting on READ\n", interval_ms);
+    }
 }
 
 static switch_bool_t capture_callback(switch_media_bug_t *bug, void *user_data, switch_abc_type_t type)
@@ -89,10 +589,10 @@ static switch_bool_t capture_callback(switch_media_bug_t *bug, void *user_data,
                 switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Got SWITCH_ABC_TYPE_CLOSE.\n");
                 if (tech_pvt) {
                     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO,
-                        "[BUFFER] stats: overruns=%u underruns=%u max_used=%zuB\n",
-                        tech_pvt->buffer_overruns,
-                        tech_pvt->buffer_underruns,
-                        tech_pvt->buffer_max_used);
+                        "[BUFFER] stats: overruns=%" SWITCH_UINT64_T_FMT " underruns=%" SWITCH_UINT64_T_FMT " max_used=%" SWITCH_UINT64_T_FMT "B\n",
+                        stream_stat_get(&tech_pvt->stats.playback_overruns),
+                        stream_stat_get(&tech_pvt->stats.playback_underruns),
+                        stream_stat_get(&tech_pvt->stats.playback_max_buffered));
                 }
                 // Check if this is a normal channel closure or a requested closure
                 channel_closing = tech_pvt->close_requested ? 0 : 1;
@@ -108,104 +608,14 @@ static switch_bool_t capture_callback(switch_media_bug_t *bug, void *user_data,
             /* NETPLAY v2.1: Inject playback audio during READ callback
              * This is called every 20ms when receiving audio from caller.
              * We use this opportunity to also send audio TO the caller.
+             * NETPLAY v2.7: not when a pacer thread owns injection.
              */
-            if (tech_pvt->playback_buffer && tech_pvt->playback_mutex) {
-                switch_mutex_lock(tech_pvt->playback_mutex);
-                
-                switch_size_t available = switch_buffer_inuse(tech_pvt->playback_buffer);
-                const switch_size_t l16_frame_size = 320;  /* L16 @ 8kHz, 20ms = 160 samples * 2 bytes */
-                
-                /* NETPLAY v2.5.2: Increased buffer thresholds to reduce audio choppiness
-                 * 
-                 * Problem: With OpenAI Realtime API, audio arrives in bursts with varying latency.
-                 * A 100ms warmup buffer is not enough to smooth out network jitter.
-                 * 
-                 * Solution:
-                 * - Warmup threshold: 400ms (20 frames) - wait for more data before starting
-                 * - Low water mark: 160ms (8 frames) - only pause if buffer gets critically low
-                 * - This creates a "buffer zone" that absorbs latency spikes
-                 */
-                const switch_size_t warmup_threshold = tech_pvt->warmup_threshold ? tech_pvt->warmup_threshold : (l16_frame_size * 20);
-                const switch_size_t low_water_mark = tech_pvt->low_water_mark ? tech_pvt->low_water_mark : (l16_frame_size * 8);
-                
-                /* Warmup: wait until we have enough buffer */
-                if (!tech_pvt->playback_active && available >= warmup_threshold) {
-                    tech_pvt->playback_active = 1;
-                    tech_pvt->underrun_streak = 0;
-                    tech_pvt->playback_start_ts = switch_micro_time_now();
-                    if (tech_pvt->first_audio_ts > 0) {
-                        uint64_t latency_ms = (tech_pvt->playback_start_ts - tech_pvt->first_audio_ts) / 1000;
-                        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), get_stream_log_level(session, SWITCH_LOG_INFO),
-                            "[PLAYBACK] started buffer=%zu bytes, latency=%" SWITCH_UINT64_T_FMT "ms\n",
-                            available, latency_ms);
-                    } else {
-                        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), get_stream_log_level(session, SWITCH_LOG_INFO),
-                            "[PLAYBACK] started buffer=%zu bytes\n", available);
-                    }
+            if (tech_pvt->playback_ring) {
+                if (!__atomic_load_n(&tech_pvt->playback_pacer, __ATOMIC_ACQUIRE)) {
+                    playback_inject(session, tech_pvt);
+                } else if (!tech_pvt->playback_paced) {
+                    __atomic_store_n(&tech_pvt->playback_paced, 1, __ATOMIC_RELEASE);
                 }
-                
-                if (tech_pvt->playback_active && available >= l16_frame_size) {
-                    /* Read L16 audio from buffer */
-                    int16_t l16_data[160];  /* 160 samples of L16 */
-                    uint8_t pcmu_data[160]; /* 160 bytes of PCMU */
-                    int i;
-                    
-                    switch_buffer_read(tech_pvt->playback_buffer, l16_data, l16_frame_size);
-                    
-                    /* Convert L16 to PCMU using FreeSWITCH's built-in function */
-                    for (i = 0; i < 160; i++) {
-                        pcmu_data[i] = linear_to_ulaw(l16_data[i]);
-                    }
-                    
-                    /* Get write codec (PCMU) */
-                    switch_codec_t *write_codec = switch_core_session_get_write_codec(session);
-                    
-                    if (write_codec) {
-                        switch_frame_t write_frame = { 0 };
-                        write_frame.data = pcmu_data;
-                        write_frame.datalen = 160;  /* PCMU: 160 bytes for 160 samples */
-                        write_frame.samples = 160;
-                        write_frame.rate = 8000;
-                        write_frame.codec = write_codec;
-                        
-                        switch_core_session_write_frame(session, &write_frame, SWITCH_IO_FLAG_NONE, 0);
-                    }
-                    tech_pvt->underrun_streak = 0;
-                } else if (tech_pvt->playback_active && available < l16_frame_size) {
-                    /* Underrun - opcionalmente injeta silêncio antes de pausar */
-                    tech_pvt->buffer_underruns++;
-                    tech_pvt->underrun_streak++;
-                    if (tech_pvt->underrun_streak <= tech_pvt->underrun_grace_frames) {
-                        int16_t silence_l16[160] = {0};
-                        uint8_t silence_pcmu[160];
-                        int i;
-                        for (i = 0; i < 160; i++) {
-                            silence_pcmu[i] = linear_to_ulaw(silence_l16[i]);
-                        }
-                        switch_codec_t *write_codec = switch_core_session_get_write_codec(session);
-                        if (write_codec) {
-                            switch_frame_t write_frame = { 0 };
-                            write_frame.data = silence_pcmu;
-                            write_frame.datalen = 160;
-                            write_frame.samples = 160;
-                            write_frame.rate = 8000;
-                            write_frame.codec = write_codec;
-                            switch_core_session_write_frame(session, &write_frame, SWITCH_IO_FLAG_NONE, 0);
-                        }
-                    } else if (available < low_water_mark) {
-                        /* Buffer critically low - pause playback to allow refill */
-                        tech_pvt->playback_active = 0;
-                        tech_pvt->underrun_streak = 0;
-                        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), get_stream_log_level(session, SWITCH_LOG_DEBUG),
-                            "[BUFFER] low (%zu bytes), pausing to refill\n", available);
-                    }
-                }
-                
-                if (available > tech_pvt->buffer_max_used) {
-                    tech_pvt->buffer_max_used = available;
-                }
-                
-                switch_mutex_unlock(tech_pvt->playback_mutex);
             }
             
             return stream_frame(bug);
@@ -225,6 +635,7 @@ static switch_status_t start_capture(switch_core_session_t *session,
                                      switch_media_bug_flag_t flags,
                                      char* wsUri,
                                      int sampling,
+                                     int mix,
                                      int audio_format,
                                      char* metadata)
 {
@@ -234,10 +645,12 @@ static switch_status_t start_capture(switch_core_session_t *session,
     switch_codec_t* read_codec;
 
     void *pUserData = NULL;
-    int channels = (flags & SMBF_STEREO) ? 2 : 1;
+    private_t *tech_pvt;
+    /* NETPLAY v2.7: reference capture is a mono bug widened to (caller, playback) */
+    int channels = ((flags & SMBF_STEREO) || mix == CAPTURE_MIX_REFERENCE) ? 2 : 1;
 
     if (switch_channel_get_private(channel, MY_BUG_NAME)) {
-        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "mod_audio_stream: bug already attached!\n");
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "mod_audio_stream: bug already attached! (add_sink streams to another destination)\n");
         return SWITCH_STATUS_FALSE;
     }
 
@@ -252,6 +665,7 @@ static switch_status_t start_capture(switch_core_session_t *session,
     const char* format_name = "L16";
     if (audio_format == 1) format_name = "PCMU (G.711 μ-law)";
     else if (audio_format == 2) format_name = "PCMA (G.711 A-law)";
+    else if (audio_format == AUDIO_FORMAT_OPUS) format_name = "OPUS";
     
     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_NOTICE, 
         "[NETPLAY] Stream starting: format=%s, sampling=%dHz, channels=%d\n",
@@ -259,21 +673,67 @@ static switch_status_t start_capture(switch_core_session_t *session,
 
     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "calling stream_session_init.\n");
     if (SWITCH_STATUS_FALSE == stream_session_init(session, responseHandler, read_codec->implementation->actual_samples_per_second,
-                                                 wsUri, sampling, channels, audio_format, metadata, &pUserData)) {
+                                                 wsUri, sampling, channels, mix, audio_format, metadata, &pUserData)) {
         switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error initializing mod_audio_stream session.\n");
         return SWITCH_STATUS_FALSE;
     }
+    tech_pvt = (private_t *)pUserData;
     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "adding bug.\n");
     if ((status = switch_core_media_bug_add(session, MY_BUG_NAME, NULL, capture_callback, pUserData, 0, flags, &bug)) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "mod_audio_stream: cannot add media bug\n");
+        stream_session_abort(session, tech_pvt);
         return status;
     }
     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "setting bug private data.\n");
     switch_channel_set_private(channel, MY_BUG_NAME, bug);
+    /* NETPLAY v2.7: only now visible to stats and graceful-shutdown */
+    stream_session_attached(tech_pvt);
+    playback_pacer_attach(session, tech_pvt);
 
     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "exiting start_capture.\n");
     return SWITCH_STATUS_SUCCESS;
 }
 
+/* NETPLAY v2.7: a prepared connection that was never started is closed on hangup */
+static switch_status_t prepared_on_hangup(switch_core_session_t *session)
+{
+    stream_session_release_prepared(session);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_state_handler_table_t prepared_state_handlers = {
+    /*.on_init */ NULL,
+    /*.on_routing */ NULL,
+    /*.on_execute */ NULL,
+    /*.on_hangup */ prepared_on_hangup,
+    /*.on_exchange_media */ NULL,
+    /*.on_soft_execute */ NULL,
+    /*.on_consume_media */ NULL,
+    /*.on_hibernate */ NULL,
+    /*.on_reset */ NULL,
+    /*.on_park */ NULL,
+    /*.on_reporting */ NULL,
+    /*.on_destroy */ NULL
+};
+
+/* NETPLAY v2.7: open (and authenticate) the websocket during ringing, so start finds it
+ * connected. Channel variables that configure the connection must be set before prepare. */
+static switch_status_t do_prepare(switch_core_session_t *session, char* wsUri)
+{
+    switch_channel_t *channel = switch_core_session_get_channel(session);
+    switch_status_t status;
+
+    switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "mod_audio_stream: prepare %s\n", wsUri);
+    status = stream_session_prepare(session, responseHandler, wsUri);
+    /* Once per channel: the handler stays for the channel's lifetime and a repeated
+     * prepare must not stack another one */
+    if (status == SWITCH_STATUS_SUCCESS && !switch_channel_get_private(channel, MY_PREPARED_HANDLER_NAME)) {
+        switch_channel_add_state_handler(channel, &prepared_state_handlers);
+        switch_channel_set_private(channel, MY_PREPARED_HANDLER_NAME, &prepared_state_handlers);
+    }
+    return status;
+}
+
 static switch_status_t do_stop(switch_core_session_t *session, char* text)
 {
     switch_status_t status = SWITCH_STATUS_SUCCESS;
@@ -314,7 +774,7 @@ static switch_status_t send_text(switch_core_session_t *session, char* text) {
     return status;
 }
 
-#define STREAM_API_SYNTAX "<uuid> [start | stop | send_text | pause | resume | graceful-shutdown ] [wss-url | path] [mono | mixed | stereo] [8000 | 16000] [l16 | pcmu | pcma] [metadata]"
+#define STREAM_API_SYNTAX "<uuid> [start | prepare | stop | send_text | pause | resume | refresh | graceful-shutdown ] [wss-url | path] [mono | mixed | stereo | reference] [8000 | 16000] [l16 | pcmu | pcma | opus] [metadata] | <uuid> add_sink wss-url [l16 | pcmu | pcma] [metadata] | <uuid> remove_sink wss-url | <uuid> play_cached id [hash] | stats [uuid | all] | cache | graceful-shutdown [deadline-ms | cancel]"
 SWITCH_STANDARD_API(stream_function)
 {
     char *mycmd = NULL, *argv[7] = { 0 };
@@ -328,7 +788,51 @@ SWITCH_STANDARD_API(stream_function)
     assert(cmd);
     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "mod_audio_stream cmd: %s\n", cmd ? cmd : "");
 
-    if (zstr(cmd) || argc < 2 || (0 == strcmp(argv[1], "start") && argc < 4)) {
+    /* NETPLAY v2.7: uuid_audio_stream stats [uuid|all] returns JSON */
+    if (argc >= 1 && !strcasecmp(argv[0], "stats")) {
+        char *json = stream_stats_json(argc > 1 ? argv[1] : NULL);
+        if (json) {
+            stream->write_function(stream, "%s\n", json);
+            free(json);
+        } else {
+            stream->write_function(stream, "-ERR no stream for %s\n", argv[1]);
+        }
+        goto done;
+    }
+
+    /* NETPLAY v2.7: uuid_audio_stream cache lists the shared prompt cache as JSON */
+    if (argc == 1 && !strcasecmp(argv[0], "cache")) {
+        char *json = playback_cache_json();
+        stream->write_function(stream, "%s\n", json ? json : "{}");
+        switch_safe_free(json);
+        goto done;
+    }
+
+    /* NETPLAY v2.7: graceful-shutdown [deadline-ms | cancel] drains the node,
+     * <uuid> graceful-shutdown [deadline-ms] one call; both return a JSON report */
+    if (argc >= 1 && !strcasecmp(argv[0], "graceful-shutdown")) {
+        if (argc > 1 && !strcasecmp(argv[1], "cancel")) {
+            stream_drain_cancel();
+            stream->write_function(stream, "+OK accepting new streams\n");
+        } else {
+            char *json = stream_drain(NULL, argc > 1 && atoi(argv[1]) > 0 ? (uint32_t)atoi(argv[1]) : 0);
+            stream->write_function(stream, "%s\n", json ? json : "{}");
+            switch_safe_free(json);
+        }
+        goto done;
+    }
+    if (argc >= 2 && !strcasecmp(argv[1], "graceful-shutdown")) {
+        char *json = stream_drain(argv[0], argc > 2 && atoi(argv[2]) > 0 ? (uint32_t)atoi(argv[2]) : 0);
+        if (json) {
+            stream->write_function(stream, "%s\n", json);
+            free(json);
+        } else {
+            stream->write_function(stream, "-ERR no stream for %s\n", argv[0]);
+        }
+        goto done;
+    }
+
+    if (zstr(cmd) || argc < 2 || (0 == strcmp(argv[1], "start") && argc < 4) || (0 == strcmp(argv[1], "prepare") && argc < 3)) {
         switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error with command %s %s %s.\n", cmd, argv[0], argv[1]);
         stream->write_function(stream, "-USAGE: %s\n", STREAM_API_SYNTAX);
         goto done;
@@ -347,6 +851,9 @@ SWITCH_STANDARD_API(stream_function)
                 status = do_pauseresume(lsession, 1);
             } else if (!strcasecmp(argv[1], "resume")) {
                 status = do_pauseresume(lsession, 0);
+            } else if (!strcasecmp(argv[1], "refresh")) {
+                /* NETPLAY v2.7: re-read STREAM_LOG_LEVEL / STREAM_SUPPRESS_LOG of a running stream */
+                status = stream_session_refresh(lsession);
             } else if (!strcasecmp(argv[1], "send_text")) {
                 if (argc < 3) {
                     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
@@ -361,6 +868,51 @@ SWITCH_STANDARD_API(stream_function)
                     goto done;
                 }
                 status = send_text(lsession, argv[2]);
+            } else if (!strcasecmp(argv[1], "play_cached")) {
+                /* NETPLAY v2.7: a clip of audio-cache-dir, queued behind the buffered playback */
+                if (argc < 3) {
+                    switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                                      "play_cached requires a clip id\n");
+                } else {
+                    status = stream_session_play_cached(lsession, argv[2], argc > 3 ? argv[3] : NULL);
+                }
+            } else if (!strcasecmp(argv[1], "add_sink") || !strcasecmp(argv[1], "remove_sink")) {
+                /* NETPLAY v2.7: capture fan-out to more websockets, see stream_session_add_sink */
+                char wsUri[MAX_WS_URI];
+                int audio_format = AUDIO_FORMAT_L16;
+                char *metadata = NULL;
+                if (argc > 3) {
+                    if (0 == strcasecmp(argv[3], "pcmu") || 0 == strcasecmp(argv[3], "ulaw") || 0 == strcasecmp(argv[3], "mulaw")) {
+                        audio_format = AUDIO_FORMAT_PCMU;
+                        metadata = argc > 4 ? argv[4] : NULL;
+                    } else if (0 == strcasecmp(argv[3], "pcma") || 0 == strcasecmp(argv[3], "alaw")) {
+                        audio_format = AUDIO_FORMAT_PCMA;
+                        metadata = argc > 4 ? argv[4] : NULL;
+                    } else if (0 == strcasecmp(argv[3], "l16") || 0 == strcasecmp(argv[3], "linear") || 0 == strcasecmp(argv[3], "pcm")) {
+                        metadata = argc > 4 ? argv[4] : NULL;
+                    } else {
+                        metadata = argv[3];
+                    }
+                }
+                if (argc < 3 || !validate_ws_uri(argv[2], &wsUri[0])) {
+                    switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                                      "invalid websocket uri: %s\n", argc > 2 ? argv[2] : "");
+                } else if (metadata && is_valid_utf8(metadata) != SWITCH_STATUS_SUCCESS) {
+                    switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                                      "%s contains invalid utf8 characters\n", metadata);
+                } else if (!strcasecmp(argv[1], "add_sink")) {
+                    status = stream_session_add_sink(lsession, wsUri, audio_format, metadata);
+                } else {
+                    status = stream_session_remove_sink(lsession, wsUri);
+                }
+            } else if (!strcasecmp(argv[1], "prepare")) {
+                char wsUri[MAX_WS_URI];
+                if (!validate_ws_uri(argv[2], &wsUri[0])) {
+                    switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                                      "invalid websocket uri: %s\n", argv[2]);
+                } else {
+                    status = do_prepare(lsession, wsUri);
+                }
             } else if (!strcasecmp(argv[1], "start")) {
                 //switch_channel_t *channel = switch_core_session_get_channel(lsession);
                 char wsUri[MAX_WS_URI];
@@ -374,6 +926,7 @@ SWITCH_STANDARD_API(stream_function)
                  * The Python service has both mic and speaker reference for proper AEC.
                  */
                 switch_media_bug_flag_t flags = SMBF_READ_STREAM | SMBF_WRITE_REPLACE;
+                int mix = CAPTURE_MIX_MONO;
                 char *metadata = NULL;
                 
                 /* Parse format parameter (argv[5]) and metadata (argv[6]) */
@@ -384,6 +937,9 @@ SWITCH_STANDARD_API(stream_function)
                     } else if (0 == strcasecmp(argv[5], "pcma") || 0 == strcasecmp(argv[5], "alaw")) {
                         audio_format = AUDIO_FORMAT_PCMA;
                         metadata = argc > 6 ? argv[6] : NULL;
+                    } else if (0 == strcasecmp(argv[5], "opus")) {
+                        audio_format = AUDIO_FORMAT_OPUS;
+                        metadata = argc > 6 ? argv[6] : NULL;
                     } else if (0 == strcasecmp(argv[5], "l16") || 0 == strcasecmp(argv[5], "linear") || 0 == strcasecmp(argv[5], "pcm")) {
                         audio_format = AUDIO_FORMAT_L16;
                         metadata = argc > 6 ? argv[6] : NULL;
@@ -401,12 +957,17 @@ SWITCH_STANDARD_API(stream_function)
                 }
                 if (0 == strcmp(argv[3], "mixed")) {
                     flags |= SMBF_WRITE_STREAM;
+                    mix = CAPTURE_MIX_MIXED;
                 } else if (0 == strcmp(argv[3], "stereo")) {
                     flags |= SMBF_WRITE_STREAM;
                     flags |= SMBF_STEREO;
+                    mix = CAPTURE_MIX_STEREO;
+                } else if (0 == strcmp(argv[3], "reference")) {
+                    /* NETPLAY v2.7: caller only from the bug, the right channel is our own playback */
+                    mix = CAPTURE_MIX_REFERENCE;
                 } else if (0 != strcmp(argv[3], "mono")) {
                     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
-                                      "invalid mix type: %s, must be mono, mixed, or stereo\n", argv[3]);
+                                      "invalid mix type: %s, must be mono, mixed, stereo or reference\n", argv[3]);
                     switch_core_session_rwunlock(lsession);
                     goto done;
                 }
@@ -425,11 +986,17 @@ SWITCH_STANDARD_API(stream_function)
                 } else if (sampling % 8000 != 0) {
                     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
                                       "invalid sample rate: %s\n", argv[4]);
-                } else if (audio_format != AUDIO_FORMAT_L16 && sampling != 8000) {
+                } else if ((audio_format == AUDIO_FORMAT_PCMU || audio_format == AUDIO_FORMAT_PCMA) && sampling != 8000) {
                     switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
                                       "G.711 (pcmu/pcma) only supports 8000 Hz sample rate\n");
+                } else if (audio_format == AUDIO_FORMAT_OPUS && !capture_opus_available()) {
+                    switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                                      "opus requested but mod_audio_stream was built without libopus\n");
+                } else if (audio_format == AUDIO_FORMAT_OPUS && !capture_opus_rate_valid((uint32_t)sampling)) {
+                    switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                                      "opus only supports 8000, 16000, 24000 or 48000 Hz\n");
                 } else {
-                    status = start_capture(lsession, flags, wsUri, sampling, audio_format, metadata);
+                    status = start_capture(lsession, flags, wsUri, sampling, mix, audio_format, metadata);
                 }
             } else {
                 switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
@@ -465,11 +1032,89 @@ done:
  *   - SMBF_WRITE_REPLACE for frame injection
  *   - Barge-in support via stopAudio command
  * ======================================== */
-#define MOD_AUDIO_STREAM_VERSION "2.6.1-netplay"
+#define MOD_AUDIO_STREAM_VERSION "2.7.0-netplay"
 #define MOD_AUDIO_STREAM_BUILD_DATE "2026-01-23"
 
+/*
+ * NETPLAY v2.7: "auto" (every CPU) or a list such as "0-3,8,10-11".
+ * Returns the number of CPUs written to cpus, or -1 on a malformed list.
+ */
+static int parse_cpu_list(const char *value, int *cpus, int max)
+{
+    const char *p = value;
+    int count = 0;
+
+    if (!strcasecmp(value, "auto")) {
+        int i, n = (int)switch_core_cpu_count();
+        for (i = 0; i < n && count < max; i++) cpus[count++] = i;
+        return count;
+    }
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10), last;
+        if (end == p || first < 0) return -1;
+        last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) return -1;
+        }
+        for (; first <= last && count < max; first++) cpus[count++] = (int)first;
+        p = end;
+        if (*p == ',') p++;
+        else if (*p) return -1;
+    }
+    return count;
+}
+
+static void load_config(stream_module_config_t *config)
+{
+    switch_xml_t xml, cfg, settings, param;
+
+    memset(config, 0, sizeof(*config));
+    if (!(xml = switch_xml_open_cfg("audio_stream.conf", &cfg, NULL))) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "audio_stream.conf not found, using defaults\n");
+        return;
+    }
+    if ((settings = switch_xml_child(cfg, "settings"))) {
+        for (param = switch_xml_child(settings, "param"); param; param = switch_xml_next(param)) {
+            const char *name = switch_xml_attr_soft(param, "name");
+            const char *value = switch_xml_attr_soft(param, "value");
+
+            if (!strcasecmp(name, "io-threads")) {
+                int threads = atoi(value);
+                if (threads < 0 || threads > STREAM_MAX_IO_THREADS) {
+                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "audio_stream.conf: io-threads %s out of range\n", value);
+                } else {
+                    config->io_threads = threads;
+                }
+            } else if (!strcasecmp(name, "cpu-affinity")) {
+                int count = zstr(value) ? 0 : parse_cpu_list(value, config->cpus, STREAM_MAX_AFFINITY);
+                if (count < 0) {
+                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "audio_stream.conf: invalid cpu-affinity %s\n", value);
+                    count = 0;
+                }
+                config->cpu_count = count;
+            } else if (!strcasecmp(name, "pool-default")) {
+                config->pool_default = switch_true(value);
+            } else if (!strcasecmp(name, "pool-max-streams")) {
+                config->pool_max_streams = atoi(value) > 0 ? atoi(value) : 0;
+            } else if (!strcasecmp(name, "audio-cache-dir")) {
+                switch_copy_string(config->audio_cache_dir, value, sizeof(config->audio_cache_dir));
+            } else if (!strcasecmp(name, "drain-deadline-ms")) {
+                config->drain_deadline_ms = atoi(value) > 0 ? atoi(value) : 0;
+            } else {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "audio_stream.conf: unknown param %s\n", name);
+            }
+        }
+    }
+    switch_xml_free(xml);
+}
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_audio_stream_load)
 {
+    stream_module_config_t config;
+
     switch_api_interface_t *api_interface;
 
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, 
@@ -478,12 +1123,18 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_audio_stream_load)
         "mod_audio_stream NETPLAY FORK v%s\n", MOD_AUDIO_STREAM_VERSION);
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, 
         "Build: %s\n", MOD_AUDIO_STREAM_BUILD_DATE);
+    g711_init();
+    stream_base64_init();
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, 
-        "G.711 Native: ENABLED | Streaming Playback: ENABLED\n");
+        "G.711 Native: ENABLED (%s) | Streaming Playback: ENABLED (base64 %s)\n", g711_kernel_name(),
+        stream_base64_kernel_name());
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, 
         "========================================\n");
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_audio_stream API loading..\n");
 
+    load_config(&config);
+    stream_module_configure(&config);
+
     /* connect my internal structure to the blank pointer passed to me */
     *module_interface = switch_loadable_module_create_module_interface(pool, modname);
 
@@ -491,17 +1142,32 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_audio_stream_load)
     if (switch_event_reserve_subclass(EVENT_JSON) != SWITCH_STATUS_SUCCESS ||
         switch_event_reserve_subclass(EVENT_CONNECT) != SWITCH_STATUS_SUCCESS ||
         switch_event_reserve_subclass(EVENT_ERROR) != SWITCH_STATUS_SUCCESS ||
-        switch_event_reserve_subclass(EVENT_DISCONNECT) != SWITCH_STATUS_SUCCESS) {
+        switch_event_reserve_subclass(EVENT_DISCONNECT) != SWITCH_STATUS_SUCCESS ||
+        switch_event_reserve_subclass(EVENT_SINK) != SWITCH_STATUS_SUCCESS ||
+        switch_event_reserve_subclass(EVENT_SINK_JSON) != SWITCH_STATUS_SUCCESS ||
+        switch_event_reserve_subclass(EVENT_PLAYBACK_DONE) != SWITCH_STATUS_SUCCESS ||
+        switch_event_reserve_subclass(EVENT_SPEECH_START) != SWITCH_STATUS_SUCCESS ||
+        switch_event_reserve_subclass(EVENT_SPEECH_END) != SWITCH_STATUS_SUCCESS ||
+        switch_event_reserve_subclass(EVENT_SEND_QUEUE_HIGH_WATER) != SWITCH_STATUS_SUCCESS ||
+        switch_event_reserve_subclass(EVENT_RECONNECTING) != SWITCH_STATUS_SUCCESS ||
+        switch_event_reserve_subclass(EVENT_PLAY) != SWITCH_STATUS_SUCCESS) {
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't register an event subclass for mod_audio_stream API.\n");
         return SWITCH_STATUS_TERM;
     }
     SWITCH_ADD_API(api_interface, "uuid_audio_stream", "audio_stream API", stream_function, STREAM_API_SYNTAX);
     switch_console_set_complete("add uuid_audio_stream ::console::list_uuid start wss-url metadata");
     switch_console_set_complete("add uuid_audio_stream ::console::list_uuid start wss-url");
+    switch_console_set_complete("add uuid_audio_stream ::console::list_uuid prepare wss-url");
     switch_console_set_complete("add uuid_audio_stream ::console::list_uuid stop");
+    switch_console_set_complete("add uuid_audio_stream stats ::console::list_uuid");
+    switch_console_set_complete("add uuid_audio_stream stats all");
     switch_console_set_complete("add uuid_audio_stream ::console::list_uuid pause");
     switch_console_set_complete("add uuid_audio_stream ::console::list_uuid resume");
     switch_console_set_complete("add uuid_audio_stream ::console::list_uuid send_text");
+    switch_console_set_complete("add uuid_audio_stream ::console::list_uuid play_cached");
+    switch_console_set_complete("add uuid_audio_stream cache");
+    switch_console_set_complete("add uuid_audio_stream ::console::list_uuid graceful-shutdown");
+    switch_console_set_complete("add uuid_audio_stream graceful-shutdown cancel");
 
     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "mod_audio_stream API successfully loaded\n");
 
@@ -514,10 +1180,23 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_audio_stream_load)
   Macro expands to: switch_status_t mod_audio_stream_shutdown() */
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_audio_stream_shutdown)
 {
+    /* NETPLAY v2.7: calls still streaming (unload with calls up) go the graceful-shutdown way */
+    char *json = stream_drain(NULL, 0);
+
+    switch_safe_free(json);
+    stream_pool_shutdown();
     switch_event_free_subclass(EVENT_JSON);
     switch_event_free_subclass(EVENT_CONNECT);
     switch_event_free_subclass(EVENT_DISCONNECT);
     switch_event_free_subclass(EVENT_ERROR);
+    switch_event_free_subclass(EVENT_SINK);
+    switch_event_free_subclass(EVENT_SINK_JSON);
+    switch_event_free_subclass(EVENT_PLAYBACK_DONE);
+    switch_event_free_subclass(EVENT_SPEECH_START);
+    switch_event_free_subclass(EVENT_SPEECH_END);
+    switch_event_free_subclass(EVENT_SEND_QUEUE_HIGH_WATER);
+    switch_event_free_subclass(EVENT_RECONNECTING);
+    switch_event_free_subclass(EVENT_PLAY);
 
     return SWITCH_STATUS_SUCCESS;
 }
@@ -3,8 +3,21 @@
 
 #include <switch.h>
 #include <speex/speex_resampler.h>
+#include "playback_ring.h"
+#include "stream_stats.h"
+#include "stream_histogram.h"
+#include "playback_plc.h"
+#include "time_stretch.h"
+#include "capture_vad.h"
+#include "capture_opus.h"
+#include "stream_config.h"
+#include "playback_pacer.h"
+#include "capture_echo.h"
+#include "playback_cache.h"
 
 #define MY_BUG_NAME "audio_stream"
+#define MY_PREPARED_NAME "audio_stream_prepared"   /* NETPLAY v2.7: streamer opened by uuid_audio_stream prepare */
+#define MY_PREPARED_HANDLER_NAME "audio_stream_prepared_handler"   /* NETPLAY v2.7: hangup handler of prepare added */
 #define MAX_SESSION_ID (256)
 #define MAX_WS_URI (4096)
 #define MAX_METADATA_LEN (8192)
@@ -14,46 +27,193 @@
 #define EVENT_ERROR             "mod_audio_stream::error"
 #define EVENT_JSON              "mod_audio_stream::json"
 #define EVENT_PLAY              "mod_audio_stream::play"
+#define EVENT_SPEECH_START      "mod_audio_stream::speech_start"    /* NETPLAY v2.7: STREAM_VAD */
+#define EVENT_SPEECH_END        "mod_audio_stream::speech_end"
+#define EVENT_PLAYBACK_DONE     "mod_audio_stream::playback_done"   /* NETPLAY v2.7: played ms per epoch */
+#define EVENT_SEND_QUEUE_HIGH_WATER "mod_audio_stream::send_queue_high_water" /* NETPLAY v2.7: STREAM_SEND_QUEUE_MS */
+#define EVENT_RECONNECTING      "mod_audio_stream::reconnecting"    /* NETPLAY v2.7: connection lost, retrying */
+#define EVENT_SINK              "mod_audio_stream::sink"            /* NETPLAY v2.7: add_sink connection events */
+#define EVENT_SINK_JSON         "mod_audio_stream::sink_json"       /* NETPLAY v2.7: messages from a sink backend */
+
+#define STREAM_MAX_SINKS 4      /* NETPLAY v2.7: add_sink destinations per call, besides the primary stream */
 
 /* Audio format types */
 #define AUDIO_FORMAT_L16    0   /* Linear PCM 16-bit (default) */
 #define AUDIO_FORMAT_PCMU   1   /* G.711 µ-law */
 #define AUDIO_FORMAT_PCMA   2   /* G.711 A-law */
+#define AUDIO_FORMAT_OPUS   3   /* NETPLAY v2.7: Opus, 20 ms length-prefixed packets (HAVE_OPUS) */
+
+/* NETPLAY v2.7: start mix types */
+#define CAPTURE_MIX_MONO       0   /* Caller only */
+#define CAPTURE_MIX_MIXED      1   /* Caller and channel output, summed */
+#define CAPTURE_MIX_STEREO     2   /* Caller left, channel output right */
+#define CAPTURE_MIX_REFERENCE  3   /* Caller left, this module's injected playback right (echo reference) */
+
+/* NETPLAY v2.7: start of a playback epoch in the ring, websocket thread -> media thread */
+#define PLAYBACK_EPOCH_MARKS 16
+typedef struct playback_epoch_mark {
+    uint32_t epoch;
+    uint64_t pos;                        /* Ring write position of its first byte */
+} playback_epoch_mark_t;
+
+/* NETPLAY v2.7: a cached clip queued for playback (playCached), websocket thread -> media thread */
+#define PLAYBACK_CUES 8
+typedef struct playback_cue {
+    playback_clip_t *clip;               /* Released by the media thread once played or cancelled */
+    uint64_t pos;                        /* Ring write position when queued: plays once the ring is read up to it */
+    uint32_t stop_seq;                   /* playback_stop_seq when queued; a later stopAudio cancels it */
+    uint32_t epoch;
+} playback_cue_t;
+
+/* NETPLAY v2.7: module settings (audio_stream.conf), read once at load */
+#define STREAM_MAX_IO_THREADS   64
+#define STREAM_MAX_AFFINITY     256
+#define STREAM_DRAIN_DEADLINE_MS 5000  /* graceful-shutdown when neither the command nor the conf says */
+typedef struct stream_module_config {
+    int io_threads;                      /* Outbound sender threads, 0 = one per core */
+    int cpus[STREAM_MAX_AFFINITY];       /* cpu-affinity: module threads run on these CPUs */
+    int cpu_count;                       /* 0 = not pinned */
+    int pool_default;                    /* STREAM_POOL for calls that do not set it */
+    int pool_max_streams;                /* STREAM_POOL_MAX_STREAMS default, 0 = built-in */
+    char audio_cache_dir[1024];          /* <id>.wav files for playCached, "" = no cache */
+    int drain_deadline_ms;               /* graceful-shutdown deadline, 0 = STREAM_DRAIN_DEADLINE_MS */
+} stream_module_config_t;
 
 typedef void (*responseHandler_t)(switch_core_session_t* session, const char* eventName, const char* json);
 
+/* NETPLAY v2.7: private_t is laid out by thread: configuration first, then the state
+ * the media thread writes on every frame, then the playback input written by the
+ * websocket thread, each section on its own cache lines so the two threads do not
+ * invalidate each other's. private_t must come from stream_session_init (aligned). */
+#define STREAM_CACHELINE 64
+#define STREAM_CACHELINE_ALIGNED __attribute__((aligned(STREAM_CACHELINE)))
+
 struct private_data {
+    /* Cold: identity and configuration, set up by stream_data_init */
     switch_mutex_t *mutex;
     char sessionId[MAX_SESSION_ID];
-    SpeexResamplerState *resampler;
+    char *ws_uri;                        /* Session pool, exact size */
+    char *initialMetadata;               /* Session pool, exact size; NULL when none (up to MAX_METADATA_LEN - 1) */
     responseHandler_t responseHandler;
     void *pAudioStreamer;
-    char ws_uri[MAX_WS_URI];
     int sampling;
     int channels;
+    int mix;                             /* NETPLAY v2.7: CAPTURE_MIX_* */
+    int rtp_packets;
+    int audio_format;           /* AUDIO_FORMAT_L16, AUDIO_FORMAT_PCMU, AUDIO_FORMAT_PCMA */
+    switch_codec_t playback_codec;     /* L16 codec for injection when the write codec is not G.711 */
+    stream_latency_t *latency;           /* NETPLAY v2.7: histograms, NULL unless STREAM_LATENCY_HISTOGRAMS */
+    stream_config_t config;              /* NETPLAY v2.7: STREAM_* snapshot taken at start, see stream_config.h */
+    playback_pacer_t *playback_pacer;    /* NETPLAY v2.7: injection thread (STREAM_PLAYBACK_PACING), NULL = READ callback; set once the bug is attached */
+    int playback_paced;                  /* NETPLAY v2.7: READ saw the pacer and stopped injecting, the pacer may start */
+    void *sinks;                         /* NETPLAY v2.7: capture fan-out (add_sink), NULL until the first */
     /* Bitfields grouped together for proper alignment */
     int audio_paused:1;
     int close_requested:1;
     int cleanup_started:1;
-    int codec_initialized:1;    /* Flag indicating if G.711 codec is initialized */
+    int codec_initialized:1;    /* Flag indicating G.711 encoding is enabled */
     int playback_active:1;      /* NETPLAY: Flag indicating playback is active */
-    char initialMetadata[8192];
-    switch_buffer_t *sbuffer;
-    switch_buffer_t *playback_buffer;  /* NETPLAY: Buffer for streaming playback */
-    switch_mutex_t *playback_mutex;    /* NETPLAY: Mutex for playback buffer */
-    int rtp_packets;
-    int audio_format;           /* AUDIO_FORMAT_L16, AUDIO_FORMAT_PCMU, AUDIO_FORMAT_PCMA */
-    switch_codec_t write_codec; /* Codec for encoding L16 to PCMU/PCMA */
+    int binary_playback:1;      /* NETPLAY v2.7: binary playback framing negotiated */
+    int playback_seq_valid:1;   /* NETPLAY v2.7: playback_seq holds a received sequence */
+    int playback_codec_initialized:1; /* NETPLAY v2.7: playback_codec is ready */
+    int playback_adaptive:1;    /* NETPLAY v2.7: adaptive playout (STREAM_PLAYBACK_ADAPTIVE) */
+    int playback_stretching:1;  /* NETPLAY v2.7: backlog above target, playing faster */
+    int streamer_bound:1;       /* NETPLAY v2.7: session and tech_pvt handed to the streamer callbacks */
+    int send_adaptive:1;        /* NETPLAY v2.7: send_batch follows websocket backpressure (STREAM_SEND_ADAPTIVE) */
+
+    /* Hot, media thread: capture (bug READ) */
+    SpeexResamplerState *resampler STREAM_CACHELINE_ALIGNED;
+    uint8_t *send_buf;                 /* NETPLAY v2.7: outgoing websocket payload, written in place */
+    switch_size_t send_len;            /* Bytes queued in send_buf */
+    switch_size_t send_batch;          /* Flush threshold (rtp_packets worth of encoded audio) */
+    switch_size_t send_batch_min;      /* NETPLAY v2.7: adaptive range of send_batch */
+    switch_size_t send_batch_max;
+    switch_size_t send_cap;            /* send_buf capacity: send_batch_max + one max frame */
+    switch_size_t capture_bytes_per_ms;  /* Outgoing bytes per ms of capture (Opus: average bitrate) */
+    switch_time_t send_hold_us;        /* Flush once the oldest queued frame is this old (STREAM_SEND_MAX_HOLD_MS) */
+    switch_time_t send_batch_ts;         /* Capture time of the first frame in send_buf (hold time) */
+    uint64_t send_cost_us;             /* EWMA of the time spent handing a message to the websocket */
+    playback_ring_t *preroll_ring;     /* NETPLAY v2.7: capture held while the websocket connects (STREAM_PREROLL_MS) */
+    uint8_t *preroll_buf;              /* Pre-roll flushed as one message, preroll_limit long */
+    switch_size_t preroll_limit;       /* Max pre-roll bytes, oldest audio is dropped beyond it */
+    switch_size_t preroll_dropped;     /* Pre-roll bytes dropped before the connection came up */
+    switch_time_t preroll_first_ts;      /* Capture time of the oldest batch in the pre-roll */
+    playback_ring_t *resume_ring;      /* NETPLAY v2.7: newest capture (STREAM_RECONNECT_BUFFER_MS), replayed after a reconnect */
+    uint8_t *resume_buf;               /* resume_limit long, for the replay */
+    switch_size_t resume_limit;
+    uint64_t capture_pos;              /* Audio bytes produced for the stream so far (backend dedup position) */
+    uint64_t resume_sent_pos;          /* capture_pos up to which audio was handed to a connection */
+    uint32_t resume_link;              /* Connection the capture was last sent on, 0 before the first */
+    capture_opus_t *opus;              /* NETPLAY v2.7: upstream encoder for AUDIO_FORMAT_OPUS */
+    capture_vad_t *vad;                /* NETPLAY v2.7: upstream gating (STREAM_VAD), NULL when off */
+    capture_echo_t *echo;              /* NETPLAY v2.7: reference export / STREAM_AEC, fed by injection; NULL when off */
+    playback_ring_t *vad_ring;         /* Encoded frames held back during silence, sent on speech start */
+    uint8_t *vad_buf;                  /* vad_limit long, for flushing vad_ring */
+    switch_size_t vad_limit;           /* STREAM_VAD_PREROLL_MS in outgoing bytes */
+    switch_size_t vad_bytes_per_ms;    /* Outgoing bytes per ms of capture */
+    switch_size_t vad_pending_bytes;   /* Held back audio discarded and not yet reported */
+    switch_size_t vad_cn_bytes;        /* Silence marker interval (STREAM_VAD_CN_INTERVAL_MS), 0 = none */
+
+    /* Hot, media thread: injection (bug READ_REPLACE) */
+    playback_ring_t *playback_ring STREAM_CACHELINE_ALIGNED; /* NETPLAY v2.7: lock-free SPSC ring for streaming playback */
+    uint8_t *playback_frame;           /* One injected frame, playback_frame_bytes long */
+    int16_t *playback_pcm;             /* L16 decode of a G.711 frame when the write codec changed */
+    switch_size_t playback_frame_bytes;  /* Ring bytes per injected frame (write codec ptime) */
+    uint32_t playback_frame_samples;     /* Samples per injected frame */
+    uint32_t playback_rate;              /* Sample rate of the audio held in the ring */
+    uint8_t playback_format;             /* STREAM_CODEC_* held in the ring: G.711 passthrough or L16 */
     switch_size_t playback_buflen;       /* Playback buffer size in bytes */
     switch_size_t warmup_threshold;      /* Warmup threshold in bytes */
     switch_size_t low_water_mark;        /* Low water mark in bytes */
-    uint64_t first_audio_ts;             /* Timestamp of first streamAudio chunk */
     uint64_t playback_start_ts;          /* Timestamp when playback starts */
-    uint32_t buffer_overruns;            /* Buffer overrun counter */
-    uint32_t buffer_underruns;           /* Buffer underrun counter */
-    switch_size_t buffer_max_used;       /* Max buffered bytes observed */
     uint32_t underrun_streak;            /* Consecutive underrun frames */
     uint32_t underrun_grace_frames;      /* Grace frames before pausing */
+    /* NETPLAY v2.7: playback epochs. stopAudio publishes stop_pos then bumps stop_seq;
+     * the media thread fades out, discards up to stop_pos and reports what was played */
+    uint32_t playback_stop_seen;         /* stop_seq last handled by the media thread */
+    uint32_t playback_marks_tail;        /* Written by the media thread */
+    uint32_t playback_play_epoch;        /* Epoch being played, media thread */
+    uint64_t playback_play_pos;          /* Ring position accounted so far, media thread */
+    uint64_t playback_play_bytes;        /* Bytes of playback_play_epoch played, media thread */
+    uint32_t playback_fade_samples;      /* Fade-out length on barge-in (STREAM_PLAYBACK_FADE_MS) */
+    /* NETPLAY v2.7: adaptive playout. Targets are ring bytes; the media thread owns them,
+     * jitter and arrival times are written by the websocket thread only */
+    switch_size_t playback_bytes_per_ms;
+    switch_size_t playback_target;       /* Depth needed to (re)start playback */
+    switch_size_t playback_target_min;
+    switch_size_t playback_target_max;
+    switch_size_t playback_target_boost; /* Growth earned by mid-utterance underruns */
+    uint32_t playback_clean_frames;      /* Frames played since the last underrun */
+    switch_time_t playback_underrun_ts;  /* When playback paused on an underrun */
+    playback_plc_t *playback_plc;        /* Concealment for underrun grace frames */
+    time_stretch_t *playback_stretch;    /* NETPLAY v2.7: WSOLA stage after the ring (STREAM_PLAYBACK_TIME_STRETCH) */
+    uint32_t playback_cues_tail;         /* NETPLAY v2.7: cached clips, written by the media thread */
+    switch_size_t playback_cue_off;      /* Bytes played of the clip at the tail */
+
+    /* Hot, websocket thread: playback input */
+    uint32_t playback_stop_seq STREAM_CACHELINE_ALIGNED; /* stopAudio count, websocket thread */
+    uint64_t playback_stop_pos;          /* Ring write position when stopAudio arrived */
+    uint64_t barge_in_ts;                /* Receive time of the last stopAudio, set by the websocket thread */
+    uint32_t playback_epoch;             /* Epoch of the last accepted chunk, websocket thread */
+    uint32_t playback_epoch_floor;       /* Chunks of older epochs are stale, websocket thread */
+    uint32_t playback_marks_head;        /* Written by the websocket thread */
+    playback_epoch_mark_t playback_marks[PLAYBACK_EPOCH_MARKS];
+    uint32_t playback_cues_head;         /* Written by the websocket thread (or an API call, serialized with it) */
+    playback_cue_t playback_cues[PLAYBACK_CUES];
+    uint32_t playback_in_rate;           /* NETPLAY v2.7: declared backend rate (STREAM_PLAYBACK_SAMPLE_RATE) */
+    SpeexResamplerState *playback_resampler; /* Backend rate -> playback_rate, websocket thread only */
+    uint32_t playback_resampler_rate;    /* Input rate playback_resampler is set up for */
+    uint32_t playback_seq;               /* Last binary playback frame sequence */
+    uint32_t playback_seq_gaps;          /* Binary playback sequence discontinuities */
+    uint64_t first_audio_ts;             /* Timestamp of first streamAudio chunk */
+    uint64_t playback_jitter_us;         /* EWMA of chunk lateness */
+    uint64_t playback_last_arrival_ts;
+    uint64_t playback_last_chunk_us;     /* Duration of the previous chunk */
+    stream_log_limit_t log_overrun;      /* NETPLAY v2.7: rate-limited warnings, websocket thread */
+    stream_log_limit_t log_seq_gap;
+
+    /* Both threads, single writer per counter */
+    stream_stats_t stats STREAM_CACHELINE_ALIGNED; /* NETPLAY v2.7: counters for uuid_audio_stream stats */
 };
 
 typedef struct private_data private_t;
@@ -62,6 +222,7 @@ enum notifyEvent_t {
     CONNECT_SUCCESS,
     CONNECT_ERROR,
     CONNECTION_DROPPED,
+    RECONNECTING,               /* NETPLAY v2.7: drop or error that will be retried */
     MESSAGE
 };
 
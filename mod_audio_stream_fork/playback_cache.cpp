@@ -0,0 +1,417 @@
+#include "playback_cache.h"
+#include "stream_protocol.h"
+#include "g711.h"
+#include <switch_json.h>
+#include <speex/speex_resampler.h>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+    /* One ring format of a file: its data chunk as is, or a conversion made for it */
+    struct Variant {
+        uint8_t codec;
+        uint32_t rate;
+        const uint8_t* data;
+        size_t len;
+        std::vector<uint8_t> owned;
+    };
+
+    struct Source {
+        std::string id;
+        std::vector<uint8_t> file;         /* the whole file, read at load: never changes under a call */
+        off_t size = 0;
+        time_t mtime = 0;
+        ino_t ino = 0;
+        uint8_t codec = STREAM_CODEC_L16;
+        uint32_t rate = 0;
+        const uint8_t* data = nullptr;     /* WAV data chunk, inside file */
+        size_t len = 0;
+        char hash[17] = {0};
+        std::vector<std::unique_ptr<Variant>> variants; /* Cache::mutex; entries never move */
+        std::atomic<uint64_t> plays{0};
+    };
+
+    struct Cache {
+        std::mutex mutex;
+        std::string dir;
+        std::unordered_map<std::string, std::shared_ptr<Source>> files;
+    };
+
+    Cache& cache() {
+        static Cache c;
+        return c;
+    }
+
+    inline uint32_t le16(const uint8_t* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+    }
+
+    inline uint32_t le32(const uint8_t* p) {
+        return le16(p) | (le16(p + 2) << 16);
+    }
+
+    uint64_t fnv1a64(const uint8_t* p, size_t len) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < len; i++) {
+            h ^= p[i];
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    bool valid_id(const char* id) {
+        size_t n = 0;
+        if (!id || !*id || *id == '.') return false;
+        for (; id[n]; n++) {
+            const char c = id[n];
+            if (n >= PLAYBACK_CACHE_ID_MAX) return false;
+            if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                  c == '_' || c == '-' || c == '.')) return false;
+        }
+        return true;
+    }
+
+    /* RIFF/WAVE: the fmt chunk, then data. A data chunk running past the end of the
+     * file (size 0xFFFFFFFF from a streaming writer) is cut at the end of the file. */
+    bool parse_wav(Source& src) {
+        const uint8_t* p = src.file.data();
+        const size_t n = src.file.size();
+        uint32_t format = 0, channels = 0, bits = 0, rate = 0;
+        bool fmt = false;
+        size_t off = 12;
+
+        if (n < 12 || memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0) return false;
+        while (off + 8 <= n) {
+            const uint8_t* chunk = p + off;
+            size_t size = le32(chunk + 4);
+            const size_t body = off + 8;
+            if (size > n - body) {
+                if (memcmp(chunk, "data", 4) != 0) return false;
+                size = n - body;
+            }
+            if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+                format = le16(p + body);
+                channels = le16(p + body + 2);
+                rate = le32(p + body + 4);
+                bits = le16(p + body + 14);
+                /* WAVE_FORMAT_EXTENSIBLE: the real format leads the subformat GUID */
+                if (format == 0xFFFE && size >= 26) format = le16(p + body + 24);
+                fmt = true;
+            } else if (memcmp(chunk, "data", 4) == 0) {
+                if (!fmt) return false;
+                src.data = p + body;
+                src.len = size;
+                break;
+            }
+            off = body + size + (size & 1);
+        }
+        if (!src.data || channels != 1 || rate < 8000 || rate > 48000) return false;
+        if (format == 1 && bits == 16) src.codec = STREAM_CODEC_L16;
+        else if (format == 6 && bits == 8) src.codec = STREAM_CODEC_PCMA;
+        else if (format == 7 && bits == 8) src.codec = STREAM_CODEC_PCMU;
+        else return false;
+        if (src.codec == STREAM_CODEC_L16) src.len &= ~(size_t)1;
+        src.rate = rate;
+        return src.len > 0;
+    }
+
+    std::shared_ptr<Source> load(const std::string& id, const std::string& path, const struct stat& st,
+                                 playback_cache_status_t& status) {
+        std::shared_ptr<Source> src = std::make_shared<Source>();
+        src->id = id;
+        src->size = st.st_size;
+        src->mtime = st.st_mtime;
+        src->ino = st.st_ino;
+
+        /* Read, not mapped: a file rewritten or truncated in place (instead of renamed over)
+         * would change the audio, or SIGBUS, under every call still playing it */
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            status = PLAYBACK_CACHE_NOT_FOUND;
+            return nullptr;
+        }
+        try {
+            src->file.resize((size_t)st.st_size);
+        } catch (const std::bad_alloc&) {
+            close(fd);
+            status = PLAYBACK_CACHE_NO_MEMORY;
+            return nullptr;
+        }
+        size_t got = 0;
+        while (got < src->file.size()) {
+            const ssize_t n = read(fd, src->file.data() + got, src->file.size() - got);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            got += (size_t)n;
+        }
+        close(fd);
+        /* Shorter than at the stat: being rewritten, parse what is there */
+        src->file.resize(got);
+        if (!parse_wav(*src)) {
+            status = PLAYBACK_CACHE_BAD_FORMAT;
+            return nullptr;
+        }
+        switch_snprintf(src->hash, sizeof(src->hash), "%016llx",
+                        (unsigned long long)fnv1a64(src->file.data(), src->file.size()));
+        return src;
+    }
+
+    /* Whole clip through a resampler: alignment kept (skip_zeros) and the tail flushed */
+    bool resample(std::vector<int16_t>& pcm, uint32_t from, uint32_t to) {
+        int err = 0;
+        SpeexResamplerState* rs = speex_resampler_init(1, from, to, SWITCH_RESAMPLE_QUALITY, &err);
+        if (!rs || err) {
+            if (rs) speex_resampler_destroy(rs);
+            return false;
+        }
+        speex_resampler_skip_zeros(rs);
+        pcm.insert(pcm.end(), (size_t)speex_resampler_get_input_latency(rs), 0);
+        spx_uint32_t in_len = (spx_uint32_t)pcm.size();
+        spx_uint32_t out_len = (spx_uint32_t)((uint64_t)in_len * to / from) + 64;
+        std::vector<int16_t> out(out_len);
+        speex_resampler_process_int(rs, 0, pcm.data(), &in_len, out.data(), &out_len);
+        speex_resampler_destroy(rs);
+        out.resize(out_len);
+        pcm.swap(out);
+        return true;
+    }
+
+    /* Under Cache::mutex */
+    const Variant* find_variant(const Source& src, uint8_t codec, uint32_t rate) {
+        for (const auto& v : src.variants) {
+            if (v->codec == codec && v->rate == rate) return v.get();
+        }
+        return nullptr;
+    }
+
+    /* Without the mutex: only reads the file data, which never changes after load */
+    std::unique_ptr<Variant> make_variant(const Source& src, uint8_t codec, uint32_t rate) {
+        std::unique_ptr<Variant> v(new (std::nothrow) Variant());
+        if (!v) return nullptr;
+        v->codec = codec;
+        v->rate = rate;
+        if (codec == src.codec && rate == src.rate) {
+            v->data = src.data;
+            v->len = src.len;
+        } else {
+            std::vector<int16_t> pcm;
+            if (src.codec == STREAM_CODEC_L16) {
+                pcm.resize(src.len / 2);
+                memcpy(pcm.data(), src.data, src.len);
+            } else {
+                pcm.resize(src.len);
+                if (src.codec == STREAM_CODEC_PCMU) g711_ulaw_decode(src.data, pcm.data(), pcm.size());
+                else g711_alaw_decode(src.data, pcm.data(), pcm.size());
+            }
+            if (rate != src.rate && !resample(pcm, src.rate, rate)) return nullptr;
+            if (codec == STREAM_CODEC_L16) {
+                v->owned.resize(pcm.size() * 2);
+                memcpy(v->owned.data(), pcm.data(), v->owned.size());
+            } else {
+                v->owned.resize(pcm.size());
+                if (codec == STREAM_CODEC_PCMU) g711_ulaw_encode(pcm.data(), v->owned.data(), pcm.size());
+                else g711_alaw_encode(pcm.data(), v->owned.data(), pcm.size());
+            }
+            v->data = v->owned.data();
+            v->len = v->owned.size();
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[CACHE] %s: %s@%u converted to %s@%u (%zuB)\n",
+                src.id.c_str(), stream_codec_name(src.codec), src.rate, stream_codec_name(codec), rate, v->len);
+        }
+        if (!v->len) return nullptr;
+        return v;
+    }
+
+}
+
+struct playback_clip {
+    std::shared_ptr<Source> source;
+    const Variant* variant;
+};
+
+extern "C" {
+
+    void playback_cache_configure(const char *dir) {
+        Cache& c = cache();
+        std::lock_guard<std::mutex> lock(c.mutex);
+        c.dir = dir ? dir : "";
+        while (c.dir.size() > 1 && c.dir.back() == '/') c.dir.pop_back();
+        c.files.clear();
+    }
+
+    playback_clip_t *playback_cache_acquire(const char *id, const char *hash, uint8_t codec, uint32_t rate,
+                                            playback_cache_status_t *status) {
+        playback_cache_status_t ignored;
+        playback_cache_status_t& st = status ? *status : ignored;
+        Cache& c = cache();
+
+        if (!valid_id(id)) {
+            st = PLAYBACK_CACHE_INVALID_ID;
+            return nullptr;
+        }
+        /* The mutex only covers the lookups and inserts: stat, reading, hashing and
+         * converting a file run without it, so one large first load holds up nobody.
+         * Two calls loading the same file at once both do the work, the first insert wins. */
+        std::string path;
+        {
+            std::lock_guard<std::mutex> lock(c.mutex);
+            if (c.dir.empty()) {
+                st = PLAYBACK_CACHE_DISABLED;
+                return nullptr;
+            }
+            path = c.dir + "/" + id + ".wav";
+        }
+
+        struct stat sb;
+        if (stat(path.c_str(), &sb) != 0 || !S_ISREG(sb.st_mode)) {
+            std::lock_guard<std::mutex> lock(c.mutex);
+            c.files.erase(id);
+            st = PLAYBACK_CACHE_NOT_FOUND;
+            return nullptr;
+        }
+        auto current = [&sb](const std::shared_ptr<Source>& s) {
+            return s->size == sb.st_size && s->mtime == sb.st_mtime && s->ino == sb.st_ino;
+        };
+        std::shared_ptr<Source> src;
+        {
+            std::lock_guard<std::mutex> lock(c.mutex);
+            auto it = c.files.find(id);
+            if (it != c.files.end() && current(it->second)) src = it->second;
+        }
+        if (!src) {
+            src = load(id, path, sb, st);
+            if (!src) {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[CACHE] %s: %s\n", path.c_str(),
+                                  playback_cache_status_name(st));
+                std::lock_guard<std::mutex> lock(c.mutex);
+                c.files.erase(id);
+                return nullptr;
+            }
+            bool inserted = false;
+            {
+                std::lock_guard<std::mutex> lock(c.mutex);
+                auto& slot = c.files[id];
+                if (slot && current(slot)) {
+                    src = slot;
+                } else {
+                    slot = src;
+                    inserted = true;
+                }
+            }
+            if (inserted) {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[CACHE] %s: loaded %s@%u, %zuB, hash %s\n",
+                                  path.c_str(), stream_codec_name(src->codec), src->rate, src->len, src->hash);
+            }
+        }
+
+        if (hash && *hash && strcasecmp(hash, src->hash) != 0) {
+            st = PLAYBACK_CACHE_HASH_MISMATCH;
+            return nullptr;
+        }
+        const Variant* v = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(c.mutex);
+            v = find_variant(*src, codec, rate);
+        }
+        if (!v) {
+            std::unique_ptr<Variant> made = make_variant(*src, codec, rate);
+            if (made) {
+                std::lock_guard<std::mutex> lock(c.mutex);
+                v = find_variant(*src, codec, rate);
+                if (!v) {
+                    src->variants.push_back(std::move(made));
+                    v = src->variants.back().get();
+                }
+            }
+        }
+        playback_clip_t* clip = v ? new (std::nothrow) playback_clip() : nullptr;
+        if (!clip) {
+            st = PLAYBACK_CACHE_NO_MEMORY;
+            return nullptr;
+        }
+        clip->source = src;
+        clip->variant = v;
+        src->plays.fetch_add(1, std::memory_order_relaxed);
+        st = PLAYBACK_CACHE_OK;
+        return clip;
+    }
+
+    void playback_clip_release(playback_clip_t *clip) {
+        delete clip;
+    }
+
+    const uint8_t *playback_clip_data(const playback_clip_t *clip) {
+        return clip->variant->data;
+    }
+
+    switch_size_t playback_clip_len(const playback_clip_t *clip) {
+        return clip->variant->len;
+    }
+
+    const char *playback_clip_id(const playback_clip_t *clip) {
+        return clip->source->id.c_str();
+    }
+
+    const char *playback_cache_status_name(playback_cache_status_t status) {
+        switch (status) {
+            case PLAYBACK_CACHE_OK: return "ok";
+            case PLAYBACK_CACHE_DISABLED: return "disabled";
+            case PLAYBACK_CACHE_INVALID_ID: return "invalid id";
+            case PLAYBACK_CACHE_NOT_FOUND: return "not found";
+            case PLAYBACK_CACHE_BAD_FORMAT: return "unsupported format";
+            case PLAYBACK_CACHE_HASH_MISMATCH: return "hash mismatch";
+            case PLAYBACK_CACHE_NO_MEMORY: return "out of memory";
+        }
+        return "unknown";
+    }
+
+    char *playback_cache_json(void) {
+        Cache& c = cache();
+        cJSON* root = cJSON_CreateObject();
+        cJSON* files = cJSON_CreateArray();
+        {
+            std::lock_guard<std::mutex> lock(c.mutex);
+            cJSON_AddStringToObject(root, "dir", c.dir.c_str());
+            for (const auto& entry : c.files) {
+                const Source& src = *entry.second;
+                cJSON* file = cJSON_CreateObject();
+                cJSON* variants = cJSON_CreateArray();
+                char name[32];
+                cJSON_AddStringToObject(file, "id", src.id.c_str());
+                cJSON_AddStringToObject(file, "codec", stream_codec_name(src.codec));
+                cJSON_AddNumberToObject(file, "rate", src.rate);
+                cJSON_AddNumberToObject(file, "bytes", (double)src.len);
+                cJSON_AddNumberToObject(file, "ms", (double)(src.len / STREAM_CODEC_SAMPLE_BYTES(src.codec)) * 1000 / src.rate);
+                cJSON_AddStringToObject(file, "hash", src.hash);
+                cJSON_AddNumberToObject(file, "plays", (double)src.plays.load(std::memory_order_relaxed));
+                for (const auto& v : src.variants) {
+                    switch_snprintf(name, sizeof(name), "%s@%u", stream_codec_name(v->codec), v->rate);
+                    cJSON_AddItemToArray(variants, cJSON_CreateString(name));
+                }
+                cJSON_AddItemToObject(file, "variants", variants);
+                cJSON_AddItemToArray(files, file);
+            }
+        }
+        cJSON_AddItemToObject(root, "files", files);
+        char* json = cJSON_PrintUnformatted(root);
+        cJSON_Delete(root);
+        return json;
+    }
+
+    void playback_cache_shutdown(void) {
+        Cache& c = cache();
+        std::lock_guard<std::mutex> lock(c.mutex);
+        c.files.clear();
+    }
+
+}
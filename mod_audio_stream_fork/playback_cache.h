@@ -0,0 +1,72 @@
+#ifndef PLAYBACK_CACHE_H
+#define PLAYBACK_CACHE_H
+
+#include <switch.h>
+
+/*
+ * NETPLAY v2.7: Shared prompt cache (playCached, uuid_audio_stream play_cached)
+ *
+ * Audio every call plays - greetings, "one moment please" fillers - lives in
+ * audio-cache-dir (audio_stream.conf) as <id>.wav: mono, PCM 16-bit, A-law or
+ * µ-law, 8 to 48 kHz. A file is read into memory the first time a call asks for
+ * it and shared by every call from then on. A call whose playback ring holds
+ * another format or rate gets a variant converted once and kept with the file.
+ *
+ * Clips are played by reference: the media thread copies frames straight out of
+ * the clip, so there is no websocket, base64 or ring write per call. A file whose
+ * size, mtime or inode changed is read again on the next request; calls still
+ * playing the old copy keep it until they release their clip, so the file on disk
+ * may be replaced or rewritten at any time.
+ *
+ * The content hash is FNV-1a 64 of the whole file, 16 lowercase hex digits.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PLAYBACK_CACHE_ID_MAX 128      /* [A-Za-z0-9_.-], not starting with '.' */
+
+typedef enum {
+    PLAYBACK_CACHE_OK = 0,
+    PLAYBACK_CACHE_DISABLED,           /* no audio-cache-dir */
+    PLAYBACK_CACHE_INVALID_ID,
+    PLAYBACK_CACHE_NOT_FOUND,
+    PLAYBACK_CACHE_BAD_FORMAT,         /* not a WAV file this cache can play */
+    PLAYBACK_CACHE_HASH_MISMATCH,      /* the file is not the content the caller expects */
+    PLAYBACK_CACHE_NO_MEMORY
+} playback_cache_status_t;
+
+typedef struct playback_clip playback_clip_t;
+
+/* Directory of the <id>.wav files (module load); NULL or "" disables the cache. */
+void playback_cache_configure(const char *dir);
+
+/*
+ * Clip of id in codec (STREAM_CODEC_*) at rate, read and converted on first use.
+ * hash, when not NULL or empty, must match the file. Returns NULL with *status
+ * set on failure. Websocket or API thread: it may read and convert a file.
+ */
+playback_clip_t *playback_cache_acquire(const char *id, const char *hash, uint8_t codec, uint32_t rate,
+                                        playback_cache_status_t *status);
+
+/* Drop a reference from playback_cache_acquire; any thread, never blocks. */
+void playback_clip_release(playback_clip_t *clip);
+
+const uint8_t *playback_clip_data(const playback_clip_t *clip);
+switch_size_t playback_clip_len(const playback_clip_t *clip);
+const char *playback_clip_id(const playback_clip_t *clip);
+
+const char *playback_cache_status_name(playback_cache_status_t status);
+
+/* Cached files as JSON, for uuid_audio_stream cache; caller frees. */
+char *playback_cache_json(void);
+
+/* Forget every file (module unload); clips still held stay valid until released. */
+void playback_cache_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //PLAYBACK_CACHE_H
@@ -0,0 +1,106 @@
+/*
+ * NETPLAY v2.7: playback pacing thread, see playback_pacer.h
+ */
+#include "playback_pacer.h"
+
+struct playback_pacer {
+    switch_core_session_t *session;    /* read locked until the thread exits */
+    switch_mutex_t *mutex;             /* exited / release handoff */
+    switch_timer_t timer;
+    playback_pacer_tick_t tick;
+    void *user_data;
+    playback_pacer_release_t release;
+    int stop;                          /* atomic */
+    int stopped;                       /* stop requested, under mutex */
+    int exited;                        /* under mutex */
+};
+
+int playback_pacer_interval_valid(uint32_t interval_ms)
+{
+    return interval_ms == 10 || interval_ms == 20 || interval_ms == 30;
+}
+
+static void *SWITCH_THREAD_FUNC playback_pacer_run(switch_thread_t *thread, void *obj)
+{
+    playback_pacer_t *pacer = (playback_pacer_t *)obj;
+    switch_core_session_t *session = pacer->session;
+    playback_pacer_release_t release;
+    (void)thread;
+
+    while (!__atomic_load_n(&pacer->stop, __ATOMIC_ACQUIRE)) {
+        if (switch_core_timer_next(&pacer->timer) != SWITCH_STATUS_SUCCESS) {
+            switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                              "[PLAYBACK] pacing timer failed, playback stops\n");
+            break;
+        }
+        if (__atomic_load_n(&pacer->stop, __ATOMIC_ACQUIRE)) break;
+        pacer->tick(session, pacer->user_data);
+    }
+    switch_core_timer_destroy(&pacer->timer);
+
+    switch_mutex_lock(pacer->mutex);
+    pacer->exited = 1;
+    release = pacer->stopped ? pacer->release : NULL;
+    switch_mutex_unlock(pacer->mutex);
+
+    if (release) release(pacer->user_data);
+
+    /* pacer lives in the session pool: nothing touches it from here on */
+    switch_core_session_rwunlock(session);
+    return NULL;
+}
+
+playback_pacer_t *playback_pacer_start(switch_core_session_t *session, uint32_t interval_ms, uint32_t samples,
+                                       playback_pacer_tick_t tick, void *user_data)
+{
+    switch_memory_pool_t *pool = switch_core_session_get_pool(session);
+    switch_threadattr_t *thd_attr = NULL;
+    switch_thread_t *thread = NULL;
+    playback_pacer_t *pacer;
+
+    if (!playback_pacer_interval_valid(interval_ms)) return NULL;
+
+    pacer = (playback_pacer_t *)switch_core_session_alloc(session, sizeof(*pacer));
+    if (!pacer) return NULL;
+    memset(pacer, 0, sizeof(*pacer));
+    pacer->session = session;
+    pacer->tick = tick;
+    pacer->user_data = user_data;
+
+    if (switch_mutex_init(&pacer->mutex, SWITCH_MUTEX_NESTED, pool) != SWITCH_STATUS_SUCCESS) return NULL;
+    /* Own pool: the timer is used and destroyed on the pacer thread */
+    if (switch_core_timer_init(&pacer->timer, "soft", (int)interval_ms, (int)samples, NULL) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR,
+                          "[PLAYBACK] cannot create %ums pacing timer\n", interval_ms);
+        return NULL;
+    }
+    if (switch_core_session_read_lock(session) != SWITCH_STATUS_SUCCESS) {
+        switch_core_timer_destroy(&pacer->timer);
+        return NULL;
+    }
+
+    switch_threadattr_create(&thd_attr, pool);
+    switch_threadattr_detach_set(thd_attr, 1);
+    switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+    switch_threadattr_priority_set(thd_attr, SWITCH_PRI_REALTIME);
+    if (switch_thread_create(&thread, thd_attr, playback_pacer_run, pacer, pool) != SWITCH_STATUS_SUCCESS) {
+        switch_core_timer_destroy(&pacer->timer);
+        switch_core_session_rwunlock(session);
+        return NULL;
+    }
+    return pacer;
+}
+
+void playback_pacer_stop(playback_pacer_t *pacer, playback_pacer_release_t release)
+{
+    int exited;
+
+    switch_mutex_lock(pacer->mutex);
+    pacer->release = release;
+    pacer->stopped = 1;
+    __atomic_store_n(&pacer->stop, 1, __ATOMIC_RELEASE);
+    exited = pacer->exited;
+    switch_mutex_unlock(pacer->mutex);
+
+    if (exited && release) release(pacer->user_data);
+}
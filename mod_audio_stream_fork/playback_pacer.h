@@ -0,0 +1,49 @@
+#ifndef PLAYBACK_PACER_H
+#define PLAYBACK_PACER_H
+
+#include <switch.h>
+
+/*
+ * NETPLAY v2.7: Playback clock independent of inbound RTP (STREAM_PLAYBACK_PACING)
+ *
+ * By default a frame is injected from the READ callback, so the caller hears
+ * the bot at the pace the caller's own packets arrive: silence suppression,
+ * DTX or bursty RTP stall or bunch the playback. A pacer is a thread per call
+ * driven by a soft switch_timer at the write ptime (10, 20 or 30 ms) that calls
+ * tick once per frame instead; it becomes the only injection thread, so the
+ * playback ring stays single consumer.
+ *
+ * The thread holds a session read lock for its whole life. Stopping it never
+ * waits: the pacer can be blocked writing a frame while the media bug is being
+ * closed under the session's bug lock, so whatever tick uses is handed to a
+ * release callback that runs once the thread is out.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct playback_pacer playback_pacer_t;
+
+typedef void (*playback_pacer_tick_t)(switch_core_session_t *session, void *user_data);
+typedef void (*playback_pacer_release_t)(void *user_data);
+
+/* Frame intervals the pacer runs at. */
+int playback_pacer_interval_valid(uint32_t interval_ms);
+
+/* Start ticking every interval_ms (samples per frame for the timer). NULL on failure. */
+playback_pacer_t *playback_pacer_start(switch_core_session_t *session, uint32_t interval_ms, uint32_t samples,
+                                       playback_pacer_tick_t tick, void *user_data);
+
+/*
+ * Ask the thread to stop after the current tick; returns at once. release (may
+ * be NULL) gets the user_data when no tick can run any more: here if the thread
+ * has already exited, otherwise on the pacer thread as it leaves.
+ */
+void playback_pacer_stop(playback_pacer_t *pacer, playback_pacer_release_t release);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //PLAYBACK_PACER_H
@@ -0,0 +1,155 @@
+/*
+ * NETPLAY v2.7: playback packet-loss concealment, see playback_plc.h
+ */
+#include "playback_plc.h"
+
+struct playback_plc {
+    uint32_t rate;
+    uint32_t min_period;      /* 2.5 ms, 400 Hz */
+    uint32_t max_period;      /* 15 ms, ~66 Hz */
+    uint32_t block;           /* 10 ms: attenuation step */
+    uint32_t fade_len;        /* 4 ms cross-fade into the first good frame */
+    uint32_t hist_len;
+    uint32_t hist_fill;       /* valid samples at the end of hist */
+    int16_t *hist;
+    int16_t *fade;
+    int concealing;
+    uint32_t period;
+    uint32_t pos;             /* position inside the repeated period */
+    uint32_t concealed;       /* samples synthesized in this episode */
+};
+
+playback_plc_t *playback_plc_create(switch_memory_pool_t *pool, uint32_t rate, uint32_t frame_samples)
+{
+    playback_plc_t *plc;
+
+    if (!pool || rate < 8000) return NULL;
+    plc = (playback_plc_t *)switch_core_alloc(pool, sizeof(*plc));
+    if (!plc) return NULL;
+
+    memset(plc, 0, sizeof(*plc));
+    plc->rate = rate;
+    plc->min_period = rate / 400;
+    plc->max_period = rate / 66;
+    plc->block = rate / 100;
+    plc->fade_len = rate / 250;
+    if (frame_samples && plc->fade_len > frame_samples) plc->fade_len = frame_samples;
+    plc->hist_len = plc->max_period * 3;
+    plc->hist = (int16_t *)switch_core_alloc(pool, plc->hist_len * sizeof(int16_t));
+    plc->fade = (int16_t *)switch_core_alloc(pool, plc->fade_len * sizeof(int16_t));
+    if (!plc->hist || !plc->fade) return NULL;
+    return plc;
+}
+
+static double period_score(const int16_t *x, uint32_t window, uint32_t lag, uint32_t stride)
+{
+    const int16_t *y = x - lag;
+    double corr = 0, energy = 0;
+    uint32_t i;
+
+    for (i = 0; i < window; i += stride) {
+        corr += (double)x[i] * y[i];
+        energy += (double)y[i] * y[i];
+    }
+    return (corr > 0 && energy > 0) ? corr * corr / energy : 0;
+}
+
+/* Pitch period of the most recent audio by normalized autocorrelation:
+ * a decimated search over the whole range, refined around the best lag. */
+static uint32_t find_period(const playback_plc_t *plc)
+{
+    const uint32_t window = plc->max_period;
+    const int16_t *x = plc->hist + plc->hist_len - window;
+    const uint32_t stride = plc->rate >= 16000 ? plc->rate / 8000 : 1;
+    uint32_t lag, best = plc->min_period, lo, hi;
+    double score, best_score = 0;
+
+    for (lag = plc->min_period; lag <= plc->max_period; lag += stride) {
+        score = period_score(x, window, lag, stride);
+        if (score > best_score) {
+            best_score = score;
+            best = lag;
+        }
+    }
+    if (stride > 1) {
+        lo = best > plc->min_period + stride ? best - stride : plc->min_period;
+        hi = best + stride < plc->max_period ? best + stride : plc->max_period;
+        best_score = 0;
+        for (lag = lo; lag <= hi; lag++) {
+            score = period_score(x, window, lag, 1);
+            if (score > best_score) {
+                best_score = score;
+                best = lag;
+            }
+        }
+    }
+    return best;
+}
+
+static void synthesize(playback_plc_t *plc, int16_t *out, uint32_t samples)
+{
+    const int16_t *src = plc->hist + plc->hist_len - plc->period;
+    uint32_t i;
+
+    for (i = 0; i < samples; i++) {
+        double gain = 1.0;
+        if (plc->concealed > plc->block) {
+            gain = 1.0 - 0.2 * (double)(plc->concealed - plc->block) / plc->block;
+            if (gain < 0) gain = 0;
+        }
+        out[i] = (int16_t)(src[plc->pos] * gain);
+        if (++plc->pos == plc->period) plc->pos = 0;
+        plc->concealed++;
+    }
+}
+
+void playback_plc_conceal(playback_plc_t *plc, int16_t *out, uint32_t samples)
+{
+    if (!plc->concealing) {
+        plc->concealing = 1;
+        plc->concealed = 0;
+        plc->pos = 0;
+        plc->period = plc->hist_fill >= plc->max_period * 2 ? find_period(plc) : 0;
+    }
+    if (!plc->period) {
+        /* Not enough history to conceal from */
+        memset(out, 0, samples * sizeof(int16_t));
+        return;
+    }
+    synthesize(plc, out, samples);
+}
+
+int playback_plc_good(playback_plc_t *plc, int16_t *pcm, uint32_t samples)
+{
+    int modified = 0;
+
+    if (plc->concealing) {
+        const uint32_t k = samples < plc->fade_len ? samples : plc->fade_len;
+        if (plc->period && k) {
+            uint32_t i;
+            synthesize(plc, plc->fade, k);
+            for (i = 0; i < k; i++) {
+                pcm[i] = (int16_t)(((int32_t)plc->fade[i] * (int32_t)(k - i) + (int32_t)pcm[i] * (int32_t)i) / (int32_t)k);
+            }
+            modified = 1;
+        }
+        plc->concealing = 0;
+    }
+
+    if (samples >= plc->hist_len) {
+        memcpy(plc->hist, pcm + samples - plc->hist_len, plc->hist_len * sizeof(int16_t));
+        plc->hist_fill = plc->hist_len;
+    } else {
+        memmove(plc->hist, plc->hist + samples, (plc->hist_len - samples) * sizeof(int16_t));
+        memcpy(plc->hist + plc->hist_len - samples, pcm, samples * sizeof(int16_t));
+        plc->hist_fill = plc->hist_fill + samples > plc->hist_len ? plc->hist_len : plc->hist_fill + samples;
+    }
+    return modified;
+}
+
+void playback_plc_reset(playback_plc_t *plc)
+{
+    plc->hist_fill = 0;
+    plc->concealing = 0;
+    memset(plc->hist, 0, plc->hist_len * sizeof(int16_t));
+}
@@ -0,0 +1,42 @@
+#ifndef PLAYBACK_PLC_H
+#define PLAYBACK_PLC_H
+
+#include <switch.h>
+
+/*
+ * NETPLAY v2.7: Packet-loss concealment for playback underruns
+ *
+ * Pitch-synchronous waveform repetition in the spirit of G.711 Appendix I:
+ * when the playback ring runs dry mid-utterance, the last pitch period of the
+ * played audio is repeated, attenuated by 20% per 10 ms after the first 10 ms
+ * and muted after 60 ms. The first good frame afterwards is cross-faded in.
+ * Works on L16 at the playback rate; media thread only.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct playback_plc playback_plc_t;
+
+/* Allocate from pool for audio at rate, played in frames of frame_samples. */
+playback_plc_t *playback_plc_create(switch_memory_pool_t *pool, uint32_t rate, uint32_t frame_samples);
+
+/*
+ * Feed a frame that is about to be played. After a concealment the head of
+ * pcm is cross-faded from the synthetic signal, so the function may modify
+ * pcm; returns non-zero when it did.
+ */
+int playback_plc_good(playback_plc_t *plc, int16_t *pcm, uint32_t samples);
+
+/* Synthesize samples of concealment into out. */
+void playback_plc_conceal(playback_plc_t *plc, int16_t *out, uint32_t samples);
+
+/* Forget the history (barge-in): the next concealment starts from silence. */
+void playback_plc_reset(playback_plc_t *plc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //PLAYBACK_PLC_H
@@ -0,0 +1,265 @@
+#include "playback_ring.h"
+#include <atomic>
+#include <new>
+#include <cstring>
+#include <cstdlib>
+#include <mutex>
+
+#define PLAYBACK_RING_CACHELINE 64
+
+struct playback_ring {
+    alignas(PLAYBACK_RING_CACHELINE) std::atomic<uint64_t> read_pos;
+    alignas(PLAYBACK_RING_CACHELINE) std::atomic<uint64_t> write_pos;
+    std::atomic<uint32_t> flushes;
+    alignas(PLAYBACK_RING_CACHELINE) uint64_t mask;
+    uint8_t *data;
+    playback_ring *next_free;       /* slab free list */
+};
+
+namespace {
+
+    inline switch_size_t round_up_pow2(switch_size_t v) {
+        switch_size_t cap = 1;
+        while (cap < v) cap <<= 1;
+        return cap;
+    }
+
+    /* Header and data in one block; the data starts on its own cache line */
+    const size_t kHeaderBytes = (sizeof(playback_ring) + PLAYBACK_RING_CACHELINE - 1) & ~(size_t)(PLAYBACK_RING_CACHELINE - 1);
+
+    struct Slab {
+        std::mutex mutex;
+        playback_ring* free[PLAYBACK_RING_SLAB_MAX_SHIFT - PLAYBACK_RING_SLAB_MIN_SHIFT + 1] = {};
+        size_t cached = 0;          /* data bytes held on the free lists */
+    };
+
+    Slab& slab() {
+        static Slab s;
+        return s;
+    }
+
+    /* Class of a power-of-two capacity, -1 when it is too large to be cached */
+    int slab_class(switch_size_t cap) {
+        int shift = PLAYBACK_RING_SLAB_MIN_SHIFT;
+        while (((switch_size_t)1 << shift) < cap) shift++;
+        return shift <= PLAYBACK_RING_SLAB_MAX_SHIFT ? shift - PLAYBACK_RING_SLAB_MIN_SHIFT : -1;
+    }
+
+    inline void copy_in(playback_ring_t *ring, uint64_t pos, const uint8_t *src, switch_size_t len) {
+        const switch_size_t cap = (switch_size_t)ring->mask + 1;
+        const switch_size_t off = (switch_size_t)(pos & ring->mask);
+        const switch_size_t first = (len < cap - off) ? len : cap - off;
+        memcpy(ring->data + off, src, first);
+        if (len > first) memcpy(ring->data, src + first, len - first);
+    }
+
+    /* Producer: advance the read index so len more bytes after w keep at most limit buffered */
+    switch_size_t make_room(playback_ring_t *ring, uint64_t w, switch_size_t len, switch_size_t limit) {
+        uint64_t r = ring->read_pos.load(std::memory_order_acquire);
+        while ((switch_size_t)(w - r) + len > limit) {
+            const uint64_t need = (uint64_t)((switch_size_t)(w - r) + len - limit);
+            if (ring->read_pos.compare_exchange_weak(r, r + need, std::memory_order_acq_rel,
+                                                     std::memory_order_acquire)) {
+                return (switch_size_t)need;
+            }
+        }
+        return 0;
+    }
+
+    inline void copy_out(const playback_ring_t *ring, uint64_t pos, uint8_t *dst, switch_size_t len) {
+        const switch_size_t cap = (switch_size_t)ring->mask + 1;
+        const switch_size_t off = (switch_size_t)(pos & ring->mask);
+        const switch_size_t first = (len < cap - off) ? len : cap - off;
+        memcpy(dst, ring->data + off, first);
+        if (len > first) memcpy(dst + first, ring->data, len - first);
+    }
+
+}
+
+extern "C" {
+
+    playback_ring_t *playback_ring_create(switch_size_t min_capacity) {
+        switch_size_t cap = round_up_pow2(min_capacity ? min_capacity : 1);
+        const int cls = slab_class(cap);
+        playback_ring_t *ring = nullptr;
+
+        if (cls >= 0) {
+            cap = (switch_size_t)1 << (cls + PLAYBACK_RING_SLAB_MIN_SHIFT);
+            Slab& sl = slab();
+            std::lock_guard<std::mutex> lock(sl.mutex);
+            ring = sl.free[cls];
+            if (ring) {
+                sl.free[cls] = ring->next_free;
+                sl.cached -= cap;
+            }
+        }
+        if (!ring) {
+            void *block = nullptr;
+            if (posix_memalign(&block, PLAYBACK_RING_CACHELINE, kHeaderBytes + cap)) return nullptr;
+            ring = new (block) playback_ring_t;
+            ring->data = static_cast<uint8_t *>(block) + kHeaderBytes;
+        }
+        /* A recycled block keeps its old bytes: nothing is read before it is written */
+        ring->read_pos.store(0, std::memory_order_relaxed);
+        ring->write_pos.store(0, std::memory_order_relaxed);
+        ring->flushes.store(0, std::memory_order_relaxed);
+        ring->mask = cap - 1;
+        ring->next_free = nullptr;
+        return ring;
+    }
+
+    void playback_ring_destroy(playback_ring_t *ring) {
+        if (!ring) return;
+        const switch_size_t cap = (switch_size_t)ring->mask + 1;
+        const int cls = slab_class(cap);
+        if (cls >= 0) {
+            Slab& sl = slab();
+            std::lock_guard<std::mutex> lock(sl.mutex);
+            if (sl.cached + cap <= PLAYBACK_RING_SLAB_CACHE) {
+                ring->next_free = sl.free[cls];
+                sl.free[cls] = ring;
+                sl.cached += cap;
+                return;
+            }
+        }
+        ring->~playback_ring_t();
+        free(ring);
+    }
+
+    void playback_ring_slab_purge(void) {
+        Slab& sl = slab();
+        std::lock_guard<std::mutex> lock(sl.mutex);
+        for (auto& head : sl.free) {
+            while (head) {
+                playback_ring_t *ring = head;
+                head = ring->next_free;
+                ring->~playback_ring_t();
+                free(ring);
+            }
+        }
+        sl.cached = 0;
+    }
+
+    switch_size_t playback_ring_capacity(const playback_ring_t *ring) {
+        return (switch_size_t)ring->mask + 1;
+    }
+
+    switch_size_t playback_ring_inuse(const playback_ring_t *ring) {
+        const uint64_t r = ring->read_pos.load(std::memory_order_acquire);
+        const uint64_t w = ring->write_pos.load(std::memory_order_acquire);
+        return (switch_size_t)(w - r);
+    }
+
+    switch_size_t playback_ring_write(playback_ring_t *ring, const void *data, switch_size_t len,
+                                      switch_size_t limit, switch_size_t *dropped) {
+        const switch_size_t cap = (switch_size_t)ring->mask + 1;
+        auto *src = static_cast<const uint8_t *>(data);
+        switch_size_t discarded = 0;
+
+        if (limit == 0 || limit > cap) limit = cap;
+        if (len > limit) {
+            /* Payload alone exceeds the ring: keep only its newest bytes */
+            discarded += len - limit;
+            src += len - limit;
+            len = limit;
+        }
+
+        const uint64_t w = ring->write_pos.load(std::memory_order_relaxed);
+        discarded += make_room(ring, w, len, limit);
+
+        copy_in(ring, w, src, len);
+        ring->write_pos.store(w + len, std::memory_order_release);
+
+        if (dropped) *dropped = discarded;
+        return len;
+    }
+
+    switch_size_t playback_ring_reserve(playback_ring_t *ring, switch_size_t len, switch_size_t limit,
+                                        playback_ring_span_t *span) {
+        const switch_size_t cap = (switch_size_t)ring->mask + 1;
+        if (limit == 0 || limit > cap) limit = cap;
+        if (len > limit) return 0;
+
+        const uint64_t w = ring->write_pos.load(std::memory_order_relaxed);
+        /* Only what the new bytes would overwrite; the limit is applied on commit */
+        const switch_size_t discarded = make_room(ring, w, len, cap);
+        const switch_size_t off = (switch_size_t)(w & ring->mask);
+        span->first = ring->data + off;
+        span->first_len = len < cap - off ? len : cap - off;
+        span->second = ring->data;
+        span->second_len = len - span->first_len;
+        span->dropped = discarded;
+        return len;
+    }
+
+    switch_size_t playback_ring_commit(playback_ring_t *ring, const playback_ring_span_t *span, switch_size_t len,
+                                       switch_size_t limit, switch_size_t *dropped) {
+        const switch_size_t cap = (switch_size_t)ring->mask + 1;
+        const uint64_t w = ring->write_pos.load(std::memory_order_relaxed);
+        switch_size_t discarded = span->dropped;
+
+        if (limit == 0 || limit > cap) limit = cap;
+        if (len > span->first_len + span->second_len) len = span->first_len + span->second_len;
+        if (len > limit) len = limit;
+        discarded += make_room(ring, w, len, limit);
+        ring->write_pos.store(w + len, std::memory_order_release);
+
+        if (dropped) *dropped = discarded;
+        return len;
+    }
+
+    switch_size_t playback_ring_read(playback_ring_t *ring, void *out, switch_size_t len) {
+        auto *dst = static_cast<uint8_t *>(out);
+        uint64_t r = ring->read_pos.load(std::memory_order_acquire);
+        for (;;) {
+            const uint64_t w = ring->write_pos.load(std::memory_order_acquire);
+            const switch_size_t avail = (switch_size_t)(w - r);
+            const switch_size_t n = len < avail ? len : avail;
+            if (n == 0) return 0;
+            copy_out(ring, r, dst, n);
+            /* If the producer dropped data meanwhile the copy may be stale: retry */
+            if (ring->read_pos.compare_exchange_strong(r, r + n, std::memory_order_acq_rel,
+                                                       std::memory_order_acquire)) {
+                return n;
+            }
+        }
+    }
+
+    uint64_t playback_ring_write_pos(const playback_ring_t *ring) {
+        return ring->write_pos.load(std::memory_order_acquire);
+    }
+
+    uint64_t playback_ring_read_pos(const playback_ring_t *ring) {
+        return ring->read_pos.load(std::memory_order_acquire);
+    }
+
+    switch_size_t playback_ring_discard_to(playback_ring_t *ring, uint64_t pos) {
+        uint64_t r = ring->read_pos.load(std::memory_order_acquire);
+        for (;;) {
+            const uint64_t w = ring->write_pos.load(std::memory_order_acquire);
+            const uint64_t target = pos < w ? pos : w;
+            if (target <= r) return 0;
+            if (ring->read_pos.compare_exchange_weak(r, target, std::memory_order_acq_rel,
+                                                     std::memory_order_acquire)) {
+                return (switch_size_t)(target - r);
+            }
+        }
+    }
+
+    void playback_ring_clear(playback_ring_t *ring) {
+        uint64_t r = ring->read_pos.load(std::memory_order_acquire);
+        for (;;) {
+            const uint64_t w = ring->write_pos.load(std::memory_order_acquire);
+            if (r == w || ring->read_pos.compare_exchange_weak(r, w, std::memory_order_acq_rel,
+                                                               std::memory_order_acquire)) {
+                break;
+            }
+        }
+        ring->flushes.fetch_add(1, std::memory_order_release);
+    }
+
+    uint32_t playback_ring_flushes(const playback_ring_t *ring) {
+        return ring->flushes.load(std::memory_order_acquire);
+    }
+
+}
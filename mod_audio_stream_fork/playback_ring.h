@@ -0,0 +1,103 @@
+#ifndef PLAYBACK_RING_H
+#define PLAYBACK_RING_H
+
+#include <switch.h>
+
+/*
+ * NETPLAY v2.7: Lock-free playback ring
+ *
+ * Single-producer/single-consumer byte ring shared by the websocket thread
+ * (producer, streamAudio) and the media thread (consumer, READ callback).
+ * Indices are monotonic 64-bit counters masked by a power-of-two capacity,
+ * so neither side ever takes a lock.
+ *
+ * Drop-oldest on overrun is O(1): the producer advances the read index with a
+ * compare-and-swap before writing. The consumer commits its read with the same
+ * compare-and-swap and simply retries if the producer moved the index under it,
+ * so a slow decode on the network thread can never stall the media thread.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct playback_ring playback_ring_t;
+
+/*
+ * NETPLAY v2.7: rings come from a module slab instead of the session pool. Capacities
+ * are powers of two, so each class from 4 KB to 1 MB keeps a free list of destroyed
+ * rings for the next call, up to PLAYBACK_RING_SLAB_CACHE bytes in total; larger
+ * rings, and any beyond that, go back to the allocator.
+ */
+#define PLAYBACK_RING_SLAB_MIN_SHIFT 12
+#define PLAYBACK_RING_SLAB_MAX_SHIFT 20
+#define PLAYBACK_RING_SLAB_CACHE     (64 * 1024 * 1024)
+
+/* Capacity is min_capacity rounded up to a power of two (4 KB at least). NULL when out of memory. */
+playback_ring_t *playback_ring_create(switch_size_t min_capacity);
+
+/* Hand the ring back to the slab. Neither side may use it afterwards. */
+void playback_ring_destroy(playback_ring_t *ring);
+
+/* Free the rings cached by the slab (module unload). */
+void playback_ring_slab_purge(void);
+
+switch_size_t playback_ring_capacity(const playback_ring_t *ring);
+switch_size_t playback_ring_inuse(const playback_ring_t *ring);
+
+/*
+ * Producer: append len bytes, keeping at most limit bytes buffered
+ * (limit is clamped to the ring capacity). Oldest data is dropped to make room;
+ * the number of dropped bytes is returned in *dropped when not NULL.
+ * Returns the number of bytes written (the newest limit bytes if len > limit).
+ */
+switch_size_t playback_ring_write(playback_ring_t *ring, const void *data, switch_size_t len,
+                                  switch_size_t limit, switch_size_t *dropped);
+
+/*
+ * NETPLAY v2.7: producer, write in place. reserve hands out the next len bytes
+ * as up to two spans, dropping only data they would overwrite; commit publishes
+ * the first len of them, applying limit like playback_ring_write (*dropped
+ * includes what reserve dropped). Nothing is visible to the consumer before
+ * commit, and a reserve that is not committed is simply abandoned. reserve
+ * returns 0 when len exceeds limit (clamped to the capacity).
+ */
+typedef struct playback_ring_span {
+    uint8_t *first;
+    switch_size_t first_len;
+    uint8_t *second;                 /* Start of the ring, when the region wraps */
+    switch_size_t second_len;
+    switch_size_t dropped;           /* Dropped by reserve */
+} playback_ring_span_t;
+
+switch_size_t playback_ring_reserve(playback_ring_t *ring, switch_size_t len, switch_size_t limit,
+                                    playback_ring_span_t *span);
+switch_size_t playback_ring_commit(playback_ring_t *ring, const playback_ring_span_t *span, switch_size_t len,
+                                   switch_size_t limit, switch_size_t *dropped);
+
+/* Consumer: copy up to len bytes out of the ring. Returns the number of bytes read. */
+switch_size_t playback_ring_read(playback_ring_t *ring, void *out, switch_size_t len);
+
+/*
+ * NETPLAY v2.7: absolute stream positions, in bytes since the ring was created.
+ * write_pos is where the next byte will be written, read_pos the next byte to be
+ * read; overrun drops and clears advance read_pos as if the bytes were read.
+ */
+uint64_t playback_ring_write_pos(const playback_ring_t *ring);
+uint64_t playback_ring_read_pos(const playback_ring_t *ring);
+
+/* Consumer: discard everything before pos (at most up to write_pos), keeping
+ * data the producer wrote after it. Returns the number of bytes discarded. */
+switch_size_t playback_ring_discard_to(playback_ring_t *ring, uint64_t pos);
+
+/* Discard all buffered data. Safe from either side. */
+void playback_ring_clear(playback_ring_t *ring);
+
+/* Number of times the ring was cleared, lets the consumer notice a barge-in. */
+uint32_t playback_ring_flushes(const playback_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //PLAYBACK_RING_H
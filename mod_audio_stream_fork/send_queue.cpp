@@ -0,0 +1,265 @@
+#include "send_queue.h"
+#include "stream_affinity.h"
+#include <switch.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+namespace {
+
+    struct Sender {
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<SendQueue*> ready;
+        std::thread thread;
+    };
+
+    struct Senders {
+        std::mutex mutex;               /* configure / start / shutdown */
+        std::vector<std::unique_ptr<Sender>> workers;   /* fixed while running */
+        size_t threads = SEND_QUEUE_THREADS;
+        std::vector<int> cpus;
+        std::atomic<bool> running{false};
+        std::atomic<size_t> next{0};
+    };
+
+    Senders& senders() {
+        static Senders s;
+        return s;
+    }
+
+    void sender_loop(Sender* w) {
+        std::unique_lock<std::mutex> lock(w->mutex);
+        for (;;) {
+            w->cond.wait(lock, [w] { return !w->ready.empty() || !senders().running.load(std::memory_order_acquire); });
+            /* On shutdown, queues still scheduled are drained first: close() waits for them */
+            if (w->ready.empty()) break;
+            SendQueue* q = w->ready.front();
+            w->ready.pop_front();
+            lock.unlock();
+            const bool more = q->drain();
+            lock.lock();
+            if (more) w->ready.push_back(q);
+        }
+    }
+
+    size_t sender_assign() {
+        Senders& s = senders();
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (!s.running.load(std::memory_order_acquire)) {
+                s.running.store(true, std::memory_order_release);
+                s.workers.clear();
+                for (size_t i = 0; i < s.threads; i++) {
+                    s.workers.emplace_back(new Sender());
+                    Sender* w = s.workers.back().get();
+                    w->thread = std::thread(sender_loop, w);
+                    /* One CPU per sender, round robin over the configured set */
+                    if (!s.cpus.empty()) {
+                        const int cpu = s.cpus[i % s.cpus.size()];
+                        const int err = stream_set_affinity(w->thread.native_handle(), &cpu, 1);
+                        if (err) {
+                            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
+                                "send queue: cannot pin sender %zu to cpu %d: %s\n", i, cpu, strerror(err));
+                        }
+                    }
+                }
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "send queue: %zu sender threads started%s\n",
+                                  s.threads, s.cpus.empty() ? "" : " (pinned)");
+            }
+            return s.next.fetch_add(1, std::memory_order_relaxed) % s.workers.size();
+        }
+    }
+
+    void sender_schedule(size_t worker, SendQueue* q) {
+        Sender& w = *senders().workers[worker];
+        {
+            std::lock_guard<std::mutex> lock(w.mutex);
+            w.ready.push_back(q);
+        }
+        w.cond.notify_one();
+    }
+
+}
+
+bool send_queue_parse_policy(const char* name, SendQueuePolicy& policy) {
+    if (!name) return false;
+    if (!strcasecmp(name, "drop_oldest")) policy = SendQueuePolicy::DropOldest;
+    else if (!strcasecmp(name, "drop_newest")) policy = SendQueuePolicy::DropNewest;
+    else if (!strcasecmp(name, "coalesce")) policy = SendQueuePolicy::Coalesce;
+    else return false;
+    return true;
+}
+
+const char* send_queue_policy_name(SendQueuePolicy policy) {
+    switch (policy) {
+        case SendQueuePolicy::DropNewest: return "drop_newest";
+        case SendQueuePolicy::Coalesce: return "coalesce";
+        default: return "drop_oldest";
+    }
+}
+
+SendQueue::SendQueue(SendQueueSink* sink, size_t limit, size_t high_water, SendQueuePolicy policy)
+    : m_sink(sink), m_limit(limit), m_highWater(high_water < limit ? high_water : limit), m_policy(policy),
+      m_worker(sender_assign()) {
+}
+
+SendQueue::~SendQueue() {
+    close(0);
+}
+
+std::vector<uint8_t> SendQueue::takeBuffer() {
+    if (m_free.empty()) return std::vector<uint8_t>();
+    std::vector<uint8_t> buf = std::move(m_free.back());
+    m_free.pop_back();
+    return buf;
+}
+
+void SendQueue::recycleLocked(std::vector<uint8_t>& buf) {
+    if (m_free.size() >= SEND_QUEUE_FREE_BUFFERS) return;
+    buf.clear();
+    m_free.push_back(std::move(buf));
+}
+
+void SendQueue::scheduleLocked(std::unique_lock<std::mutex>& lock) {
+    if (m_scheduled) return;
+    m_scheduled = true;
+    lock.unlock();
+    sender_schedule(m_worker, this);
+}
+
+/* Whole audio messages go, oldest first, until need more bytes fit; text stays */
+void SendQueue::dropOldestLocked(size_t need, SendQueuePush& result) {
+    for (auto it = m_messages.begin(); it != m_messages.end() && m_bytes + need > m_limit;) {
+        if (it->text) {
+            ++it;
+            continue;
+        }
+        m_bytes -= it->data.size();
+        result.dropped_messages++;
+        result.dropped_bytes += it->data.size();
+        recycleLocked(it->data);
+        it = m_messages.erase(it);
+    }
+}
+
+void SendQueue::pushBinary(const uint8_t* data, size_t len, SendQueuePush& result) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_closed || !len) return;
+
+    if (m_bytes + len > m_limit) {
+        if (m_policy == SendQueuePolicy::DropNewest) {
+            result.dropped_messages = 1;
+            result.dropped_bytes = len;
+            return;
+        }
+        /* A single message larger than the limit (a long pre-roll) still goes, alone */
+        dropOldestLocked(len, result);
+    }
+
+    /* The last message is still waiting, so the link is behind: ride along with it */
+    if (m_policy == SendQueuePolicy::Coalesce && !m_messages.empty() && !m_messages.back().text &&
+        m_messages.back().data.size() + len <= SEND_QUEUE_COALESCE_MAX) {
+        auto& tail = m_messages.back().data;
+        tail.insert(tail.end(), data, data + len);
+        result.coalesced = true;
+    } else {
+        Message msg;
+        msg.data = takeBuffer();
+        msg.data.assign(data, data + len);
+        m_messages.push_back(std::move(msg));
+    }
+    m_bytes += len;
+    result.queued = true;
+    if (!m_aboveHighWater && m_bytes >= m_highWater) {
+        m_aboveHighWater = true;
+        result.high_water = true;
+    }
+    scheduleLocked(lock);
+}
+
+void SendQueue::pushText(const char* text) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_closed || !text) return;
+    Message msg;
+    msg.data = takeBuffer();
+    msg.data.assign(text, text + strlen(text) + 1);
+    msg.text = true;
+    m_messages.push_back(std::move(msg));
+    scheduleLocked(lock);
+}
+
+size_t SendQueue::queuedBytes() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+bool SendQueue::drain() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (int sent = 0; sent < SEND_QUEUE_DRAIN_BATCH; sent++) {
+        if (m_messages.empty()) {
+            m_scheduled = false;
+            m_cond.notify_all();
+            return false;
+        }
+        Message msg = std::move(m_messages.front());
+        m_messages.pop_front();
+        if (!msg.text) m_bytes -= msg.data.size();
+        if (m_aboveHighWater && m_bytes < m_highWater / 2) m_aboveHighWater = false;
+        lock.unlock();
+
+        if (msg.text) {
+            m_sink->sendQueuedText(reinterpret_cast<const char*>(msg.data.data()));
+        } else {
+            m_sink->sendQueuedBinary(msg.data.data(), msg.data.size());
+        }
+
+        lock.lock();
+        recycleLocked(msg.data);
+        if (m_closed) m_cond.notify_all();
+    }
+    return true;
+}
+
+void SendQueue::close(uint32_t drain_ms) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_closed = true;
+    if (drain_ms) {
+        m_cond.wait_for(lock, std::chrono::milliseconds(drain_ms), [this] { return m_messages.empty(); });
+    }
+    m_messages.clear();
+    m_bytes = 0;
+    /* A sender may still be on its way to this queue or inside a send */
+    m_cond.wait(lock, [this] { return !m_scheduled; });
+}
+
+namespace send_queue {
+
+    void configure(size_t threads, const std::vector<int>& cpus) {
+        Senders& s = senders();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.running.load(std::memory_order_acquire)) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "send queue: already running, new settings apply after reload\n");
+        }
+        s.threads = threads ? (threads < SEND_QUEUE_MAX_THREADS ? threads : SEND_QUEUE_MAX_THREADS) : SEND_QUEUE_THREADS;
+        s.cpus = cpus;
+    }
+
+    void shutdown() {
+        Senders& s = senders();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.running.load(std::memory_order_acquire)) return;
+        s.running.store(false, std::memory_order_release);
+        for (auto& w : s.workers) {
+            {
+                std::lock_guard<std::mutex> wlock(w->mutex);
+            }
+            w->cond.notify_all();
+            if (w->thread.joinable()) w->thread.join();
+        }
+        s.workers.clear();
+    }
+
+}
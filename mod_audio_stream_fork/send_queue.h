@@ -0,0 +1,119 @@
+#ifndef SEND_QUEUE_H
+#define SEND_QUEUE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * NETPLAY v2.7: Bounded outbound queue per call (STREAM_SEND_QUEUE_MS)
+ *
+ * The media thread only appends to the queue; a fixed set of module sender
+ * threads (io-threads in audio_stream.conf) hands the messages to the websocket, so a stalled backend blocks a
+ * sender instead of RTP, and what a call can hold is capped at its limit.
+ * When audio does not fit, the policy decides what goes: the oldest queued
+ * audio, the new message, or (coalesce) the oldest audio after new batches
+ * have been merged into the last one still waiting. Text is never dropped or
+ * merged, and keeps its order relative to the audio around it.
+ */
+
+#define SEND_QUEUE_THREADS       2       /* when audio_stream.conf does not say */
+#define SEND_QUEUE_MAX_THREADS   64
+#define SEND_QUEUE_COALESCE_MAX  65536   /* largest message built by merging batches */
+#define SEND_QUEUE_DRAIN_BATCH   8       /* messages sent per turn before yielding to other calls */
+#define SEND_QUEUE_FREE_BUFFERS  8       /* recycled message buffers kept per call */
+
+enum class SendQueuePolicy {
+    DropOldest,
+    DropNewest,
+    Coalesce
+};
+
+/* Parses "drop_oldest", "drop_newest" or "coalesce"; false for anything else. */
+bool send_queue_parse_policy(const char* name, SendQueuePolicy& policy);
+const char* send_queue_policy_name(SendQueuePolicy policy);
+
+/* Performs the actual sends, on a sender thread. */
+class SendQueueSink {
+public:
+    virtual ~SendQueueSink() = default;
+    virtual void sendQueuedBinary(const uint8_t* data, size_t len) = 0;
+    virtual void sendQueuedText(const char* text) = 0;
+};
+
+/* What one push did, for the caller's counters */
+struct SendQueuePush {
+    size_t dropped_messages = 0;
+    size_t dropped_bytes = 0;
+    bool coalesced = false;
+    bool queued = false;         /* this message was queued or coalesced, not dropped */
+    bool high_water = false;     /* queue crossed the high-water mark with this push */
+};
+
+class SendQueue {
+public:
+    /* limit and high_water are bytes of queued audio. */
+    SendQueue(SendQueueSink* sink, size_t limit, size_t high_water, SendQueuePolicy policy);
+    ~SendQueue();
+
+    SendQueue(const SendQueue&) = delete;
+    SendQueue& operator=(const SendQueue&) = delete;
+
+    void pushBinary(const uint8_t* data, size_t len, SendQueuePush& result);
+    void pushText(const char* text);
+
+    /* Wait up to drain_ms for the queue to empty, then discard the rest and
+     * wait for a send in progress. No push is accepted afterwards. */
+    void close(uint32_t drain_ms);
+
+    size_t queuedBytes();
+    size_t limit() const { return m_limit; }
+    SendQueuePolicy policy() const { return m_policy; }
+
+    /* Sender thread: send up to SEND_QUEUE_DRAIN_BATCH messages. Returns true
+     * when more are waiting and the queue was left scheduled. */
+    bool drain();
+
+private:
+    struct Message {
+        std::vector<uint8_t> data;
+        bool text = false;
+    };
+
+    void scheduleLocked(std::unique_lock<std::mutex>& lock);
+    std::vector<uint8_t> takeBuffer();
+    void recycleLocked(std::vector<uint8_t>& buf);
+    void dropOldestLocked(size_t need, SendQueuePush& result);
+
+    SendQueueSink* m_sink;
+    const size_t m_limit;
+    const size_t m_highWater;
+    const SendQueuePolicy m_policy;
+    const size_t m_worker;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;        /* close() waits for drained / idle */
+    std::deque<Message> m_messages;
+    std::vector<std::vector<uint8_t>> m_free;   /* recycled buffers, no allocation in steady state */
+    size_t m_bytes = 0;                    /* audio bytes queued; text is not counted */
+    bool m_scheduled = false;              /* on a sender's ready list or being drained */
+    bool m_closed = false;
+    bool m_aboveHighWater = false;
+};
+
+namespace send_queue {
+
+    /* Sender thread count and CPUs (audio_stream.conf io-threads, cpu-affinity).
+     * Takes effect when the senders start with the first queue. */
+    void configure(size_t threads, const std::vector<int>& cpus);
+
+    /* Stop the sender threads (module unload); queues must be closed first. */
+    void shutdown();
+
+}
+
+#endif //SEND_QUEUE_H
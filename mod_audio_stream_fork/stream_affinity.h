@@ -0,0 +1,38 @@
+#ifndef STREAM_AFFINITY_H
+#define STREAM_AFFINITY_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <pthread.h>
+#include <sched.h>
+
+/*
+ * NETPLAY v2.7: CPU pinning of the module threads (audio_stream.conf cpu-affinity)
+ *
+ * Restrict thread to the count CPUs listed in cpus. Returns 0 on success, or
+ * the pthread error; count 0 leaves the thread where the scheduler put it.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline int stream_set_affinity(pthread_t thread, const int *cpus, int count)
+{
+    cpu_set_t set;
+    int i;
+
+    if (count <= 0) return 0;
+    CPU_ZERO(&set);
+    for (i = 0; i < count; i++) {
+        if (cpus[i] >= 0 && cpus[i] < CPU_SETSIZE) CPU_SET(cpus[i], &set);
+    }
+    return pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //STREAM_AFFINITY_H
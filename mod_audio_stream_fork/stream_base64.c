@@ -0,0 +1,255 @@
+/*
+ * NETPLAY v2.7: base64 decoding, see stream_base64.h
+ */
+#include "stream_base64.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define B64_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#define B64_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define B64_INVALID 0xff
+
+/* Sextet of each character, B64_INVALID for anything outside both alphabets */
+static const uint8_t b64_value[256] = {
+#define X B64_INVALID
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, 62, X, 62, X, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, X, X, X, X, X, X,
+    X, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, X, X, X, X, 63,
+    X, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X
+#undef X
+};
+
+/* Vector kernels: decode whole blocks of full characters (no padding among them) while
+ * every character is valid and the block output fits in cap. Returns the characters used. */
+typedef size_t (*b64_blocks_fn)(const uint8_t *src, size_t full, uint8_t *out, size_t cap);
+
+static size_t decode_blocks_none(const uint8_t *src, size_t full, uint8_t *out, size_t cap)
+{
+    (void)src; (void)full; (void)out; (void)cap;
+    return 0;
+}
+
+#if defined(B64_X86)
+#define B64_AVX2 __attribute__((target("avx2")))
+
+static inline B64_AVX2 __m256i b64_in_range_avx2(__m256i c, char lo, char hi)
+{
+    return _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8((char)(lo - 1))),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(hi + 1)), c));
+}
+
+/* 32 characters -> 24 bytes. Sextets by range (bytes >= 0x80 compare negative and
+ * match none), merged pairwise with multiply-adds, then compacted with a shuffle.
+ * The store is 32 bytes wide, hence o + 32 <= cap; it stays behind the block being
+ * read, so in-place decoding holds. */
+static B64_AVX2 size_t decode_blocks_avx2(const uint8_t *src, size_t full, uint8_t *out, size_t cap)
+{
+    const __m256i pack_bytes = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i pack_lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    size_t i = 0, o = 0;
+
+    for (; i + 32 <= full && o + 32 <= cap; i += 32, o += 24) {
+        const __m256i c = _mm256_loadu_si256((const __m256i *)(src + i));
+        const __m256i upper = b64_in_range_avx2(c, 'A', 'Z');
+        const __m256i lower = b64_in_range_avx2(c, 'a', 'z');
+        const __m256i digit = b64_in_range_avx2(c, '0', '9');
+        const __m256i s62 = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('+')),
+                                            _mm256_cmpeq_epi8(c, _mm256_set1_epi8('-')));
+        const __m256i s63 = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('/')),
+                                            _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_')));
+        const __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower),
+                                              _mm256_or_si256(digit, _mm256_or_si256(s62, s63)));
+        __m256i v;
+
+        if (_mm256_movemask_epi8(valid) != -1) break;
+        v = _mm256_and_si256(upper, _mm256_sub_epi8(c, _mm256_set1_epi8('A')));
+        v = _mm256_or_si256(v, _mm256_and_si256(lower, _mm256_sub_epi8(c, _mm256_set1_epi8('a' - 26))));
+        v = _mm256_or_si256(v, _mm256_and_si256(digit, _mm256_add_epi8(c, _mm256_set1_epi8(52 - '0'))));
+        v = _mm256_or_si256(v, _mm256_and_si256(s62, _mm256_set1_epi8(62)));
+        v = _mm256_or_si256(v, _mm256_and_si256(s63, _mm256_set1_epi8(63)));
+
+        /* [a b c d] -> a<<6|b, c<<6|d -> a<<18|b<<12|c<<6|d per 32-bit lane */
+        v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+        v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+        v = _mm256_shuffle_epi8(v, pack_bytes);
+        v = _mm256_permutevar8x32_epi32(v, pack_lanes);
+        _mm256_storeu_si256((__m256i *)(out + o), v);
+    }
+    return i;
+}
+#endif
+
+#if defined(B64_NEON)
+static inline uint8x16_t b64_sextets_neon(uint8x16_t c, uint8x16_t *valid)
+{
+    const uint8x16_t upper = vandq_u8(vcgeq_u8(c, vdupq_n_u8('A')), vcleq_u8(c, vdupq_n_u8('Z')));
+    const uint8x16_t lower = vandq_u8(vcgeq_u8(c, vdupq_n_u8('a')), vcleq_u8(c, vdupq_n_u8('z')));
+    const uint8x16_t digit = vandq_u8(vcgeq_u8(c, vdupq_n_u8('0')), vcleq_u8(c, vdupq_n_u8('9')));
+    const uint8x16_t s62 = vorrq_u8(vceqq_u8(c, vdupq_n_u8('+')), vceqq_u8(c, vdupq_n_u8('-')));
+    const uint8x16_t s63 = vorrq_u8(vceqq_u8(c, vdupq_n_u8('/')), vceqq_u8(c, vdupq_n_u8('_')));
+    uint8x16_t v;
+
+    *valid = vandq_u8(*valid, vorrq_u8(vorrq_u8(upper, lower), vorrq_u8(digit, vorrq_u8(s62, s63))));
+    v = vandq_u8(upper, vsubq_u8(c, vdupq_n_u8('A')));
+    v = vorrq_u8(v, vandq_u8(lower, vsubq_u8(c, vdupq_n_u8('a' - 26))));
+    v = vorrq_u8(v, vandq_u8(digit, vaddq_u8(c, vdupq_n_u8(52 - '0'))));
+    v = vorrq_u8(v, vandq_u8(s62, vdupq_n_u8(62)));
+    return vorrq_u8(v, vandq_u8(s63, vdupq_n_u8(63)));
+}
+
+/* 64 characters -> 48 bytes: vld4 splits the quantum positions, vst3 interleaves the bytes */
+static size_t decode_blocks_neon(const uint8_t *src, size_t full, uint8_t *out, size_t cap)
+{
+    size_t i = 0, o = 0;
+
+    for (; i + 64 <= full && o + 48 <= cap; i += 64, o += 48) {
+        const uint8x16x4_t chars = vld4q_u8(src + i);
+        uint8x16_t valid = vdupq_n_u8(0xFF);
+        const uint8x16_t a = b64_sextets_neon(chars.val[0], &valid);
+        const uint8x16_t b = b64_sextets_neon(chars.val[1], &valid);
+        const uint8x16_t c = b64_sextets_neon(chars.val[2], &valid);
+        const uint8x16_t d = b64_sextets_neon(chars.val[3], &valid);
+        const uint64x2_t all = vreinterpretq_u64_u8(valid);
+        uint8x16x3_t bytes;
+
+        if ((vgetq_lane_u64(all, 0) & vgetq_lane_u64(all, 1)) != UINT64_MAX) break;
+        bytes.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+        bytes.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+        bytes.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+        vst3q_u8(out + o, bytes);
+    }
+    return i;
+}
+#endif
+
+static b64_blocks_fn decode_blocks = decode_blocks_none;
+static const char *kernel_name = "scalar";
+
+void stream_base64_init(void)
+{
+#if defined(B64_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        decode_blocks = decode_blocks_avx2;
+        kernel_name = "avx2";
+    }
+#elif defined(B64_NEON)
+    decode_blocks = decode_blocks_neon;
+    kernel_name = "neon";
+#endif
+}
+
+const char *stream_base64_kernel_name(void)
+{
+    return kernel_name;
+}
+
+/* Up to two padding characters at the end */
+static size_t strip_padding(const uint8_t *src, size_t len)
+{
+    size_t i;
+    for (i = 0; i < 2 && len && (src[len - 1] == '=' || src[len - 1] == '.'); i++) len--;
+    return len;
+}
+
+long stream_base64_decoded_len(const char *in, size_t len)
+{
+    len = strip_padding((const uint8_t *)in, len);
+    if (len % 4 == 1) return STREAM_BASE64_INVALID;
+    return (long)(len / 4 * 3 + (len % 4 ? len % 4 - 1 : 0));
+}
+
+long stream_base64_decode_into(const char *in, size_t len, uint8_t *out, size_t cap)
+{
+    const uint8_t *src = (const uint8_t *)in;
+    size_t i, full, o;
+    uint32_t rest;
+
+    len = strip_padding(src, len);
+    rest = (uint32_t)(len % 4);
+    if (rest == 1) return STREAM_BASE64_INVALID;
+    full = len - rest;
+    if (full / 4 * 3 + (rest ? rest - 1 : 0) > cap) return STREAM_BASE64_NO_ROOM;
+
+    i = decode_blocks(src, full, out, cap);
+    o = i / 4 * 3;
+    for (; i < full; i += 4) {
+        const uint32_t a = b64_value[src[i]], b = b64_value[src[i + 1]];
+        const uint32_t c = b64_value[src[i + 2]], d = b64_value[src[i + 3]];
+        uint32_t v;
+        if ((a | b | c | d) > 63) return STREAM_BASE64_INVALID;
+        v = a << 18 | b << 12 | c << 6 | d;
+        out[o++] = (uint8_t)(v >> 16);
+        out[o++] = (uint8_t)(v >> 8);
+        out[o++] = (uint8_t)v;
+    }
+    if (rest) {
+        const uint32_t a = b64_value[src[full]], b = b64_value[src[full + 1]];
+        const uint32_t c = rest == 3 ? b64_value[src[full + 2]] : 0;
+        if ((a | b | c) > 63) return STREAM_BASE64_INVALID;
+        out[o++] = (uint8_t)((a << 2) | (b >> 4));
+        if (rest == 3) out[o++] = (uint8_t)((b << 4) | (c >> 2));
+    }
+    return (long)o;
+}
+
+long stream_base64_decode_split(const char *in, size_t len, uint8_t *out, size_t cap,
+                                uint8_t *out2, size_t cap2)
+{
+    const long total = stream_base64_decoded_len(in, len);
+    size_t head, head_chars, rem, used = 0;
+    uint8_t quantum[3];
+    long n, tail;
+
+    if (total < 0) return STREAM_BASE64_INVALID;
+    if ((size_t)total <= cap) return stream_base64_decode_into(in, len, out, cap);
+    if ((size_t)total > cap + cap2) return STREAM_BASE64_NO_ROOM;
+
+    /* Whole quanta into out (they hold no padding: the last, partial one is past cap),
+     * the quantum across the boundary through a bounce buffer, the rest into out2. Each
+     * section strips trailing padding, so a '=' inside the payload shows up as a section
+     * decoding short: that is invalid, as it is for the whole-buffer decode */
+    head = cap / 3 * 3;
+    head_chars = head / 3 * 4;
+    n = stream_base64_decode_into(in, head_chars, out, head);
+    if (n < 0) return n;
+    if ((size_t)n != head) return STREAM_BASE64_INVALID;
+    rem = cap - head;
+    if (rem) {
+        const size_t chars = len - head_chars < 4 ? len - head_chars : 4;
+        n = stream_base64_decode_into(in + head_chars, chars, quantum, sizeof(quantum));
+        if (n < 0) return n;
+        if ((size_t)n < rem) return STREAM_BASE64_INVALID;
+        memcpy(out + head, quantum, rem);
+        used = (size_t)n - rem;
+        memcpy(out2, quantum + rem, used);
+        head_chars += chars;
+    }
+    tail = stream_base64_decode_into(in + head_chars, len - head_chars, out2 + used, cap2 - used);
+    if (tail < 0) return tail;
+    if (head + rem + used + (size_t)tail != (size_t)total) return STREAM_BASE64_INVALID;
+    return total;
+}
+
+long stream_base64_decode(const char *in, size_t len, uint8_t *out)
+{
+    return stream_base64_decode_into(in, len, out, stream_base64_decoded_max(len));
+}
@@ -0,0 +1,62 @@
+#ifndef STREAM_BASE64_H
+#define STREAM_BASE64_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * NETPLAY v2.7: base64 decoding into a caller buffer (streamAudio payloads)
+ *
+ * Accepts the same input as base64_decode(): standard and URL-safe alphabets,
+ * '=' or '.' padding, or none. Output is never longer than 3/4 of the input and
+ * is written behind the read position, so out may point at the input itself to
+ * decode in place.
+ *
+ * Whole 32 (AVX2) or 64 (NEON) character blocks are validated and decoded with
+ * vector code selected once by stream_base64_init(); the rest, and any block
+ * holding a character outside the alphabets, goes through the 256 entry table.
+ * Errors are return codes: nothing here throws or allocates.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STREAM_BASE64_INVALID  (-1)   /* not base64 */
+#define STREAM_BASE64_NO_ROOM  (-2)   /* decoded length exceeds cap, nothing written */
+
+/* Select the vector kernel for this CPU; before the first decode (module load). */
+void stream_base64_init(void);
+const char *stream_base64_kernel_name(void);
+
+/* Bytes needed to decode len characters. */
+static inline size_t stream_base64_decoded_max(size_t len)
+{
+    return len / 4 * 3 + 2;
+}
+
+/* Exact decoded length of in, STREAM_BASE64_INVALID when no input of that length is valid. */
+long stream_base64_decoded_len(const char *in, size_t len);
+
+/*
+ * Decode len characters into out, which holds cap bytes. Returns the decoded
+ * length, or STREAM_BASE64_INVALID / STREAM_BASE64_NO_ROOM. On
+ * STREAM_BASE64_INVALID part of out may have been written.
+ */
+long stream_base64_decode_into(const char *in, size_t len, uint8_t *out, size_t cap);
+
+/*
+ * decode_into over two buffers, as a wrapping ring region hands them out: out
+ * is filled first, then out2. Returns the total decoded length.
+ */
+long stream_base64_decode_split(const char *in, size_t len, uint8_t *out, size_t cap,
+                                uint8_t *out2, size_t cap2);
+
+/* decode_into with cap = stream_base64_decoded_max(len). */
+long stream_base64_decode(const char *in, size_t len, uint8_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //STREAM_BASE64_H
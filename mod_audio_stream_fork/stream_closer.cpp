@@ -0,0 +1,113 @@
+#include "stream_closer.h"
+#include <switch.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    struct Closers {
+        std::mutex mutex;
+        std::condition_variable cond;            /* close posted, shutdown */
+        std::condition_variable idle;            /* close finished */
+        std::deque<CloseTarget*> queue;
+        std::vector<std::thread> threads;
+        size_t count = STREAM_CLOSER_THREADS;
+        size_t running = 0;                      /* closes in progress */
+        bool started = false;
+        bool stopping = false;
+    };
+
+    Closers& closers() {
+        static Closers c;
+        return c;
+    }
+
+    void close_target(CloseTarget* target) {
+        target->closeNow();
+        delete target;
+    }
+
+    void closer_loop(Closers* c) {
+        std::unique_lock<std::mutex> lock(c->mutex);
+        for (;;) {
+            c->cond.wait(lock, [c] { return !c->queue.empty() || c->stopping; });
+            /* On shutdown the queue is emptied first: every close still has to run */
+            if (c->queue.empty()) break;
+            CloseTarget* target = c->queue.front();
+            c->queue.pop_front();
+            c->running++;
+            lock.unlock();
+            close_target(target);
+            lock.lock();
+            c->running--;
+            c->idle.notify_all();
+        }
+    }
+
+}
+
+namespace stream_closer {
+
+    void configure(size_t threads) {
+        Closers& c = closers();
+        std::lock_guard<std::mutex> lock(c.mutex);
+        c.count = threads ? (threads < STREAM_CLOSER_MAX_THREADS ? threads : STREAM_CLOSER_MAX_THREADS) : STREAM_CLOSER_THREADS;
+    }
+
+    void post(CloseTarget* target) {
+        Closers& c = closers();
+        {
+            std::lock_guard<std::mutex> lock(c.mutex);
+            if (!c.stopping) {
+                if (!c.started) {
+                    c.started = true;
+                    for (size_t i = 0; i < c.count; i++) c.threads.emplace_back(closer_loop, &c);
+                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "closer: %zu threads started\n", c.count);
+                }
+                c.queue.push_back(target);
+                c.cond.notify_one();
+                return;
+            }
+        }
+        close_target(target);
+    }
+
+    size_t pending() {
+        Closers& c = closers();
+        std::lock_guard<std::mutex> lock(c.mutex);
+        return c.queue.size() + c.running;
+    }
+
+    size_t wait_idle(uint32_t timeout_ms) {
+        Closers& c = closers();
+        std::unique_lock<std::mutex> lock(c.mutex);
+        c.idle.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&c] { return c.queue.empty() && !c.running; });
+        return c.queue.size() + c.running;
+    }
+
+    void shutdown() {
+        Closers& c = closers();
+        {
+            std::lock_guard<std::mutex> lock(c.mutex);
+            if (!c.started) return;
+            c.stopping = true;
+            if (!c.queue.empty() || c.running) {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "closer: waiting for %zu closes\n",
+                                  c.queue.size() + c.running);
+            }
+        }
+        c.cond.notify_all();
+        for (auto& t : c.threads) {
+            if (t.joinable()) t.join();
+        }
+        std::lock_guard<std::mutex> lock(c.mutex);
+        c.threads.clear();
+        c.started = false;
+        c.stopping = false;
+    }
+
+}
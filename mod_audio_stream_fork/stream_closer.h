@@ -0,0 +1,49 @@
+#ifndef STREAM_CLOSER_H
+#define STREAM_CLOSER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * NETPLAY v2.7: Asynchronous websocket close (cleanup, graceful-shutdown)
+ *
+ * Closing a stream drains its outbound queue and waits for the close
+ * handshake. Done on the thread that ends the call, one call after another,
+ * that held up hangups for seconds under load. Cleanup hands the streamer
+ * over instead, and module closer threads (as many as the io-threads senders,
+ * started with the first close) close and delete streamers in parallel. They
+ * are not the senders themselves: a close waits for its sender to drain.
+ */
+
+#define STREAM_CLOSER_THREADS     2       /* when audio_stream.conf does not say */
+#define STREAM_CLOSER_MAX_THREADS 64
+
+/* Closed and deleted on a closer thread. */
+class CloseTarget {
+public:
+    virtual ~CloseTarget() = default;
+    virtual void closeNow() = 0;
+};
+
+namespace stream_closer {
+
+    /* Closer thread count (audio_stream.conf io-threads). Takes effect when the
+     * closers start with the first close. */
+    void configure(size_t threads);
+
+    /* Take target over: closeNow() then delete, on a closer thread. Runs inline
+     * while the closers shut down. */
+    void post(CloseTarget* target);
+
+    /* Closes posted and not finished yet */
+    size_t pending();
+
+    /* Wait up to timeout_ms for pending() to reach 0; returns what is still pending. */
+    size_t wait_idle(uint32_t timeout_ms);
+
+    /* Finish every close posted and stop the closer threads (module unload). */
+    void shutdown();
+
+}
+
+#endif //STREAM_CLOSER_H
@@ -0,0 +1,95 @@
+/*
+ * NETPLAY v2.7: channel variable snapshot, see stream_config.h
+ */
+#include "stream_config.h"
+#include "capture_echo.h"
+
+static int var_int(switch_channel_t *channel, const char *name, int default_value)
+{
+    const char *value = switch_channel_get_variable(channel, name);
+    return value ? atoi(value) : default_value;
+}
+
+static const char *var_str(switch_core_session_t *session, switch_channel_t *channel, const char *name)
+{
+    const char *value = switch_channel_get_variable(channel, name);
+    return value ? switch_core_session_strdup(session, value) : NULL;
+}
+
+static int parse_log_level(const char *level)
+{
+    if (!level || !*level) return -1;
+    if (!strcasecmp(level, "ERROR")) return SWITCH_LOG_ERROR;
+    if (!strcasecmp(level, "WARNING")) return SWITCH_LOG_WARNING;
+    if (!strcasecmp(level, "INFO")) return SWITCH_LOG_INFO;
+    if (!strcasecmp(level, "DEBUG")) return SWITCH_LOG_DEBUG;
+    return -1;
+}
+
+void stream_config_load(switch_core_session_t *session, stream_config_t *cfg)
+{
+    switch_channel_t *channel = switch_core_session_get_channel(session);
+    const char *value;
+
+    memset(cfg, 0, sizeof(*cfg));
+
+    cfg->log_level = parse_log_level(switch_channel_get_variable(channel, "STREAM_LOG_LEVEL"));
+    cfg->suppress_log = switch_channel_var_true(channel, "STREAM_SUPPRESS_LOG");
+
+    cfg->deflate = switch_channel_var_true(channel, "STREAM_MESSAGE_DEFLATE");
+    cfg->no_reconnect = switch_channel_var_true(channel, "STREAM_NO_RECONNECT");
+    cfg->reconnect_backoff_ms = var_int(channel, "STREAM_RECONNECT_BACKOFF_MS", STREAM_RECONNECT_BACKOFF_MS);
+    cfg->reconnect_backoff_max_ms = var_int(channel, "STREAM_RECONNECT_BACKOFF_MAX_MS", STREAM_RECONNECT_BACKOFF_MAX_MS);
+    cfg->reconnect_timeout_ms = var_int(channel, "STREAM_RECONNECT_TIMEOUT_MS", STREAM_RECONNECT_TIMEOUT_MS);
+    cfg->reconnect_buffer_ms = var_int(channel, "STREAM_RECONNECT_BUFFER_MS", STREAM_RECONNECT_BUFFER_MS);
+    cfg->binary_playback = switch_channel_var_true(channel, "STREAM_PLAYBACK_BINARY");
+    cfg->tls_disable_hostname_validation = switch_channel_var_true(channel, "STREAM_TLS_DISABLE_HOSTNAME_VALIDATION");
+    value = switch_channel_get_variable(channel, "STREAM_POOL");
+    cfg->pool = value ? switch_true(value) : STREAM_CONFIG_UNSET;
+    cfg->pool_max_streams = var_int(channel, "STREAM_POOL_MAX_STREAMS", 0);
+    if (cfg->pool_max_streams < 0) cfg->pool_max_streams = 0;
+    if ((value = switch_channel_get_variable(channel, "STREAM_HEART_BEAT"))) {
+        char *endptr;
+        long beat = strtol(value, &endptr, 10);
+        if (*endptr == '\0' && beat <= INT_MAX && beat >= INT_MIN) {
+            cfg->heart_beat = (int)beat;
+        }
+    }
+    cfg->tls_cafile = var_str(session, channel, "STREAM_TLS_CA_FILE");
+    cfg->tls_keyfile = var_str(session, channel, "STREAM_TLS_KEY_FILE");
+    cfg->tls_certfile = var_str(session, channel, "STREAM_TLS_CERT_FILE");
+    cfg->extra_headers = var_str(session, channel, "STREAM_EXTRA_HEADERS");
+
+    cfg->buffer_size_ms = var_int(channel, "STREAM_BUFFER_SIZE", STREAM_CONFIG_UNSET);
+    cfg->opus_bitrate = var_int(channel, "STREAM_OPUS_BITRATE", 24000);
+    cfg->opus_complexity = var_int(channel, "STREAM_OPUS_COMPLEXITY", 5);
+    cfg->send_adaptive = switch_channel_var_true(channel, "STREAM_SEND_ADAPTIVE");
+    cfg->send_batch_min_ms = var_int(channel, "STREAM_SEND_BATCH_MIN_MS", 20);
+    cfg->send_batch_max_ms = var_int(channel, "STREAM_SEND_BATCH_MAX_MS", STREAM_CONFIG_UNSET);
+    cfg->send_max_hold_ms = var_int(channel, "STREAM_SEND_MAX_HOLD_MS", STREAM_CONFIG_UNSET);
+    cfg->send_queue_ms = var_int(channel, "STREAM_SEND_QUEUE_MS", 2000);
+    cfg->send_queue_high_water_ms = var_int(channel, "STREAM_SEND_QUEUE_HIGH_WATER_MS", STREAM_CONFIG_UNSET);
+    cfg->send_queue_policy = var_str(session, channel, "STREAM_SEND_QUEUE_POLICY");
+    cfg->preroll_ms = var_int(channel, "STREAM_PREROLL_MS", 500);
+    cfg->vad = switch_channel_var_true(channel, "STREAM_VAD");
+    cfg->vad_threshold_db = var_int(channel, "STREAM_VAD_THRESHOLD_DB", 9);
+    cfg->vad_hangover_ms = var_int(channel, "STREAM_VAD_HANGOVER_MS", 300);
+    cfg->vad_preroll_ms = var_int(channel, "STREAM_VAD_PREROLL_MS", 200);
+    cfg->vad_cn_interval_ms = var_int(channel, "STREAM_VAD_CN_INTERVAL_MS", 1000);
+    cfg->aec = switch_channel_var_true(channel, "STREAM_AEC");
+    cfg->aec_tail_ms = var_int(channel, "STREAM_AEC_TAIL_MS", CAPTURE_ECHO_TAIL_MS);
+
+    cfg->playback_sample_rate = var_int(channel, "STREAM_PLAYBACK_SAMPLE_RATE", STREAM_CONFIG_UNSET);
+    cfg->playback_buffer_ms = var_int(channel, "STREAM_PLAYBACK_BUFFER_MS", 2000);
+    cfg->playback_warmup_ms = var_int(channel, "STREAM_PLAYBACK_WARMUP_MS", STREAM_CONFIG_UNSET);
+    cfg->playback_low_water_ms = var_int(channel, "STREAM_PLAYBACK_LOW_WATER_MS", 160);
+    cfg->playback_underrun_grace_ms = var_int(channel, "STREAM_PLAYBACK_UNDERRUN_GRACE_MS", 60);
+    cfg->playback_fade_ms = var_int(channel, "STREAM_PLAYBACK_FADE_MS", 8);
+    cfg->playback_time_stretch = switch_channel_var_true(channel, "STREAM_PLAYBACK_TIME_STRETCH");
+    cfg->playback_adaptive = switch_channel_var_true(channel, "STREAM_PLAYBACK_ADAPTIVE");
+    cfg->playback_target_ms = var_int(channel, "STREAM_PLAYBACK_TARGET_MS", 80);
+    cfg->playback_target_max_ms = var_int(channel, "STREAM_PLAYBACK_TARGET_MAX_MS", 400);
+    value = switch_channel_get_variable(channel, "STREAM_PLAYBACK_PACING");
+    cfg->playback_pacing = value && (!strcasecmp(value, "timer") || switch_true(value));
+    cfg->latency_histograms = switch_channel_var_true(channel, "STREAM_LATENCY_HISTOGRAMS");
+}
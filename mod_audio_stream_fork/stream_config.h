@@ -0,0 +1,137 @@
+#ifndef STREAM_CONFIG_H
+#define STREAM_CONFIG_H
+
+#include <switch.h>
+
+/*
+ * NETPLAY v2.7: Per-session snapshot of the STREAM_* channel variables
+ *
+ * Every knob is read once, when the websocket is opened (prepare or start) and
+ * when the stream starts, instead of a switch_channel_get_variable (channel
+ * hash + lock) wherever it is used. Values are as set on the channel, with the
+ * fixed defaults applied; knobs whose default depends on other settings stay
+ * STREAM_CONFIG_UNSET and are resolved by stream_data_init. Strings are copied
+ * to the session pool.
+ *
+ * Buffers are sized from the snapshot when the stream starts, so only the
+ * logging settings follow uuid_audio_stream <uuid> refresh on a running stream.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STREAM_CONFIG_UNSET INT_MIN
+
+/* NETPLAY v2.7: reconnect defaults, see stream_reconnect.h */
+#define STREAM_RECONNECT_BACKOFF_MS      250     /* first retry */
+#define STREAM_RECONNECT_BACKOFF_MAX_MS  5000
+#define STREAM_RECONNECT_TIMEOUT_MS      30000   /* outage after which the stream gives up */
+#define STREAM_RECONNECT_BUFFER_MS       2000    /* capture kept for replay after a reconnect */
+
+typedef struct stream_config {
+    /* Logging, refreshable */
+    int log_level;                   /* STREAM_LOG_LEVEL, -1 = each message keeps its own level */
+    int suppress_log;                /* STREAM_SUPPRESS_LOG */
+
+    /* Connection, read when the websocket is opened */
+    int deflate;                     /* STREAM_MESSAGE_DEFLATE */
+    int heart_beat;                  /* STREAM_HEART_BEAT, 0 = off */
+    int no_reconnect;                /* STREAM_NO_RECONNECT */
+    int reconnect_backoff_ms;        /* STREAM_RECONNECT_BACKOFF_MS */
+    int reconnect_backoff_max_ms;    /* STREAM_RECONNECT_BACKOFF_MAX_MS */
+    int reconnect_timeout_ms;        /* STREAM_RECONNECT_TIMEOUT_MS */
+    int reconnect_buffer_ms;         /* STREAM_RECONNECT_BUFFER_MS, 0 = no replay */
+    int binary_playback;             /* STREAM_PLAYBACK_BINARY */
+    int pool;                        /* STREAM_POOL, UNSET = audio_stream.conf pool-default */
+    int pool_max_streams;            /* STREAM_POOL_MAX_STREAMS, 0 = default */
+    int tls_disable_hostname_validation;
+    const char *tls_cafile;          /* STREAM_TLS_CA_FILE */
+    const char *tls_keyfile;         /* STREAM_TLS_KEY_FILE */
+    const char *tls_certfile;        /* STREAM_TLS_CERT_FILE */
+    const char *extra_headers;       /* STREAM_EXTRA_HEADERS */
+
+    /* Capture */
+    int buffer_size_ms;              /* STREAM_BUFFER_SIZE, UNSET = 20 ms */
+    int opus_bitrate;                /* STREAM_OPUS_BITRATE */
+    int opus_complexity;             /* STREAM_OPUS_COMPLEXITY */
+    int send_adaptive;               /* STREAM_SEND_ADAPTIVE */
+    int send_batch_min_ms;           /* STREAM_SEND_BATCH_MIN_MS */
+    int send_batch_max_ms;           /* STREAM_SEND_BATCH_MAX_MS, UNSET = from STREAM_BUFFER_SIZE */
+    int send_max_hold_ms;            /* STREAM_SEND_MAX_HOLD_MS, UNSET = batch max + 20 */
+    int send_queue_ms;               /* STREAM_SEND_QUEUE_MS */
+    int send_queue_high_water_ms;    /* STREAM_SEND_QUEUE_HIGH_WATER_MS, UNSET = half the queue */
+    const char *send_queue_policy;   /* STREAM_SEND_QUEUE_POLICY, NULL = drop_oldest */
+    int preroll_ms;                  /* STREAM_PREROLL_MS */
+    int vad;                         /* STREAM_VAD */
+    int vad_threshold_db;            /* STREAM_VAD_THRESHOLD_DB */
+    int vad_hangover_ms;             /* STREAM_VAD_HANGOVER_MS */
+    int vad_preroll_ms;              /* STREAM_VAD_PREROLL_MS */
+    int vad_cn_interval_ms;          /* STREAM_VAD_CN_INTERVAL_MS */
+    int aec;                         /* STREAM_AEC, mono and reference capture */
+    int aec_tail_ms;                 /* STREAM_AEC_TAIL_MS */
+
+    /* Playback */
+    int playback_sample_rate;        /* STREAM_PLAYBACK_SAMPLE_RATE, UNSET = 8000 */
+    int playback_buffer_ms;          /* STREAM_PLAYBACK_BUFFER_MS */
+    int playback_warmup_ms;          /* STREAM_PLAYBACK_WARMUP_MS, UNSET = 400 ms, 120 ms paced */
+    int playback_low_water_ms;       /* STREAM_PLAYBACK_LOW_WATER_MS */
+    int playback_underrun_grace_ms;  /* STREAM_PLAYBACK_UNDERRUN_GRACE_MS */
+    int playback_fade_ms;            /* STREAM_PLAYBACK_FADE_MS */
+    int playback_time_stretch;       /* STREAM_PLAYBACK_TIME_STRETCH */
+    int playback_adaptive;           /* STREAM_PLAYBACK_ADAPTIVE */
+    int playback_target_ms;          /* STREAM_PLAYBACK_TARGET_MS */
+    int playback_target_max_ms;      /* STREAM_PLAYBACK_TARGET_MAX_MS */
+    int playback_pacing;             /* STREAM_PLAYBACK_PACING=timer */
+    int latency_histograms;          /* STREAM_LATENCY_HISTOGRAMS */
+} stream_config_t;
+
+/* Read every STREAM_* variable of the session's channel into cfg. */
+void stream_config_load(switch_core_session_t *session, stream_config_t *cfg);
+
+/* STREAM_LOG_LEVEL override of a message's level; safe from any thread. */
+static inline switch_log_level_t stream_log_level(const stream_config_t *cfg, switch_log_level_t level)
+{
+    const int override = __atomic_load_n(&cfg->log_level, __ATOMIC_RELAXED);
+    return override >= 0 ? (switch_log_level_t)override : level;
+}
+
+/*
+ * NETPLAY v2.7: per-session rate limit for messages that can repeat on every chunk
+ * or frame. Up to STREAM_LOG_LIMIT_BURST messages per second go out; the first one
+ * of the next second reports how many were held back. One writer thread per limit.
+ */
+#define STREAM_LOG_LIMIT_BURST      5
+#define STREAM_LOG_LIMIT_WINDOW_US  1000000
+
+typedef struct stream_log_limit {
+    switch_time_t window;            /* Start of the current second */
+    uint32_t logged;
+    uint32_t suppressed;
+} stream_log_limit_t;
+
+/* Non-zero when the message may be logged; *suppressed is what was held back before it. */
+static inline int stream_log_limit(stream_log_limit_t *limit, uint32_t *suppressed)
+{
+    const switch_time_t now = switch_micro_time_now();
+
+    *suppressed = 0;
+    if (now - limit->window >= STREAM_LOG_LIMIT_WINDOW_US) {
+        *suppressed = limit->suppressed;
+        limit->window = now;
+        limit->logged = 0;
+        limit->suppressed = 0;
+    }
+    if (limit->logged < STREAM_LOG_LIMIT_BURST) {
+        limit->logged++;
+        return 1;
+    }
+    limit->suppressed++;
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //STREAM_CONFIG_H
@@ -0,0 +1,53 @@
+/*
+ * NETPLAY v2.7: log-linear latency histograms, see stream_histogram.h
+ */
+#include "stream_histogram.h"
+
+uint64_t stream_hist_bucket_upper(unsigned index)
+{
+    unsigned group, shift;
+    if (index < STREAM_HIST_SUB) return index;
+    group = index / STREAM_HIST_SUB;
+    shift = group - 1;
+    return (((uint64_t)(STREAM_HIST_SUB + index % STREAM_HIST_SUB)) << shift) + ((uint64_t)1 << shift) - 1;
+}
+
+void stream_hist_merge(stream_hist_t *dst, const stream_hist_t *src)
+{
+    unsigned i;
+    uint64_t max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+
+    for (i = 0; i < STREAM_HIST_BUCKETS; i++) {
+        dst->buckets[i] += __atomic_load_n(&src->buckets[i], __ATOMIC_RELAXED);
+    }
+    dst->count += __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+    dst->sum += __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+    if (max > dst->max) dst->max = max;
+}
+
+uint64_t stream_hist_quantile(const stream_hist_t *h, double q)
+{
+    uint64_t total = 0, rank, seen = 0, max;
+    unsigned i;
+
+    /* Sum the buckets rather than trusting count, which a live writer may not have bumped yet */
+    for (i = 0; i < STREAM_HIST_BUCKETS; i++) {
+        total += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+    }
+    if (!total) return 0;
+
+    if (q < 0) q = 0;
+    if (q > 1) q = 1;
+    rank = (uint64_t)(q * (double)total + 0.5);
+    if (rank < 1) rank = 1;
+
+    max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    for (i = 0; i < STREAM_HIST_BUCKETS; i++) {
+        seen += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+        if (seen >= rank) {
+            uint64_t upper = stream_hist_bucket_upper(i);
+            return (max && upper > max) ? max : upper;
+        }
+    }
+    return max;
+}
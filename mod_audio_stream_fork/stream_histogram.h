@@ -0,0 +1,74 @@
+#ifndef STREAM_HISTOGRAM_H
+#define STREAM_HISTOGRAM_H
+
+#include <stdint.h>
+
+/*
+ * NETPLAY v2.7: Log-linear latency histograms (STREAM_LATENCY_HISTOGRAMS)
+ *
+ * HDR-style buckets in microseconds: values below 8 have one bucket each, then
+ * every power of two is split in 8 linear sub-buckets, so any recorded value is
+ * reported within 12.5% up to 2^32 us. Like stream_stats_t, a histogram has a
+ * single writer thread and recording is a handful of relaxed loads and stores.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STREAM_HIST_SUB_BITS 3
+#define STREAM_HIST_SUB      (1 << STREAM_HIST_SUB_BITS)
+#define STREAM_HIST_MAX_MSB  31
+#define STREAM_HIST_BUCKETS  ((STREAM_HIST_MAX_MSB - STREAM_HIST_SUB_BITS + 2) * STREAM_HIST_SUB)
+
+typedef struct stream_hist {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[STREAM_HIST_BUCKETS];
+} stream_hist_t;
+
+/* The four latencies of a call, all in microseconds */
+typedef struct stream_latency {
+    stream_hist_t capture_to_send;   /* media thread: frame read -> websocket send (batching, pre-roll) */
+    stream_hist_t receive_to_buffer; /* websocket thread: message received -> playback ring write */
+    stream_hist_t buffer_residency;  /* media thread: audio queued ahead of each injected frame */
+    stream_hist_t barge_in;          /* media thread: stopAudio received -> injection stopped */
+} stream_latency_t;
+
+static inline unsigned stream_hist_index(uint64_t us)
+{
+    unsigned msb;
+    if (us < STREAM_HIST_SUB) return (unsigned)us;
+    if (us >> (STREAM_HIST_MAX_MSB + 1)) return STREAM_HIST_BUCKETS - 1;
+    msb = 63 - (unsigned)__builtin_clzll(us);
+    return (msb - STREAM_HIST_SUB_BITS + 1) * STREAM_HIST_SUB +
+           (unsigned)((us >> (msb - STREAM_HIST_SUB_BITS)) & (STREAM_HIST_SUB - 1));
+}
+
+/* Single writer per histogram */
+static inline void stream_hist_record(stream_hist_t *h, uint64_t us)
+{
+    uint64_t *bucket = &h->buckets[stream_hist_index(us)];
+    __atomic_store_n(bucket, __atomic_load_n(bucket, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->sum, __atomic_load_n(&h->sum, __ATOMIC_RELAXED) + us, __ATOMIC_RELAXED);
+    if (us > __atomic_load_n(&h->max, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&h->max, us, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&h->count, __atomic_load_n(&h->count, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+}
+
+/* Largest value that falls in bucket index */
+uint64_t stream_hist_bucket_upper(unsigned index);
+
+/* Add src into dst. src may be live; dst must not be written concurrently. */
+void stream_hist_merge(stream_hist_t *dst, const stream_hist_t *src);
+
+/* Value at quantile q (0..1), as the upper bound of its bucket capped at max. 0 when empty. */
+uint64_t stream_hist_quantile(const stream_hist_t *h, double q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //STREAM_HISTOGRAM_H
@@ -0,0 +1,237 @@
+/*
+ * NETPLAY v2.7: control message scanner, see stream_json.h
+ */
+#include "stream_json.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+typedef struct {
+    const char *p;
+    const char *end;
+} cursor_t;
+
+static void skip_ws(cursor_t *c)
+{
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r')) c->p++;
+}
+
+/* At the opening quote. Returns 0 on a malformed string; escaped tells whether the
+ * span must be unescaped to be used. */
+static int scan_string(cursor_t *c, stream_json_span_t *span, int *escaped)
+{
+    const char *start = ++c->p;
+
+    *escaped = 0;
+    while (c->p < c->end) {
+        const char ch = *c->p;
+        if (ch == '"') {
+            span->ptr = start;
+            span->len = (size_t)(c->p - start);
+            c->p++;
+            return 1;
+        }
+        if (ch == '\\') {
+            *escaped = 1;
+            if (++c->p == c->end) return 0;
+        } else if ((unsigned char)ch < 0x20) {
+            return 0;
+        }
+        c->p++;
+    }
+    return 0;
+}
+
+static int scan_number(cursor_t *c, double *value)
+{
+    char buf[32];
+    const char *start = c->p;
+    size_t len;
+    char *endp;
+
+    while (c->p < c->end && (strchr("+-.eE", *c->p) || (*c->p >= '0' && *c->p <= '9'))) c->p++;
+    len = (size_t)(c->p - start);
+    if (!len || len >= sizeof(buf)) return 0;
+    memcpy(buf, start, len);
+    buf[len] = '\0';
+    *value = strtod(buf, &endp);
+    return endp == buf + len;
+}
+
+static int skip_value(cursor_t *c, int depth);
+
+static int skip_container(cursor_t *c, int depth, char close)
+{
+    const int object = close == '}';
+
+    if (depth >= STREAM_JSON_MAX_DEPTH) return 0;
+    c->p++;
+    skip_ws(c);
+    if (c->p < c->end && *c->p == close) {
+        c->p++;
+        return 1;
+    }
+    for (;;) {
+        if (object) {
+            stream_json_span_t key;
+            int escaped;
+            skip_ws(c);
+            if (c->p == c->end || *c->p != '"' || !scan_string(c, &key, &escaped)) return 0;
+            skip_ws(c);
+            if (c->p == c->end || *c->p != ':') return 0;
+            c->p++;
+        }
+        if (!skip_value(c, depth + 1)) return 0;
+        skip_ws(c);
+        if (c->p == c->end) return 0;
+        if (*c->p == close) {
+            c->p++;
+            return 1;
+        }
+        if (*c->p != ',') return 0;
+        c->p++;
+    }
+}
+
+static int skip_literal(cursor_t *c, const char *word)
+{
+    const size_t len = strlen(word);
+    if ((size_t)(c->end - c->p) < len || memcmp(c->p, word, len)) return 0;
+    c->p += len;
+    return 1;
+}
+
+static int skip_value(cursor_t *c, int depth)
+{
+    stream_json_span_t span;
+    double number;
+    int escaped;
+
+    skip_ws(c);
+    if (c->p == c->end) return 0;
+    switch (*c->p) {
+        case '"': return scan_string(c, &span, &escaped);
+        case '{': return skip_container(c, depth, '}');
+        case '[': return skip_container(c, depth, ']');
+        case 't': return skip_literal(c, "true");
+        case 'f': return skip_literal(c, "false");
+        case 'n': return skip_literal(c, "null");
+        default: return scan_number(c, &number);
+    }
+}
+
+static int key_is(const stream_json_span_t *key, const char *name)
+{
+    return strlen(name) == key->len && !strncasecmp(key->ptr, name, key->len);
+}
+
+/* A string field: absent (NULL) unless the value is a plain string */
+static int take_string(cursor_t *c, stream_json_span_t *field, int *seen, int depth)
+{
+    int escaped;
+
+    if (*seen) return skip_value(c, depth);
+    *seen = 1;
+    skip_ws(c);
+    if (c->p < c->end && *c->p == '"') {
+        if (!scan_string(c, field, &escaped)) return 0;
+        if (escaped) return 0;
+        return 1;
+    }
+    return skip_value(c, depth);
+}
+
+static int take_number(cursor_t *c, double *field, int *has, int *seen, int depth)
+{
+    if (*seen) return skip_value(c, depth);
+    *seen = 1;
+    skip_ws(c);
+    if (c->p < c->end && (*c->p == '-' || (*c->p >= '0' && *c->p <= '9'))) {
+        if (!scan_number(c, field)) return 0;
+        *has = 1;
+        return 1;
+    }
+    return skip_value(c, depth);
+}
+
+/* Records the fields of interest of one object. level 0 is the message, 1 is "data" */
+static int scan_object(cursor_t *c, stream_json_msg_t *msg, int level)
+{
+    int seen[4] = { 0, 0, 0, 0 };
+
+    c->p++;
+    skip_ws(c);
+    if (c->p < c->end && *c->p == '}') {
+        c->p++;
+        return 1;
+    }
+    for (;;) {
+        stream_json_span_t key;
+        int escaped, ok;
+
+        skip_ws(c);
+        if (c->p == c->end || *c->p != '"' || !scan_string(c, &key, &escaped)) return 0;
+        /* An escaped key might spell one of ours */
+        if (escaped) return 0;
+        skip_ws(c);
+        if (c->p == c->end || *c->p != ':') return 0;
+        c->p++;
+
+        if (level == 0 && key_is(&key, "type")) {
+            ok = take_string(c, &msg->type, &seen[0], 1);
+        } else if (level == 0 && key_is(&key, "epoch")) {
+            ok = take_number(c, &msg->epoch, &msg->has_epoch, &seen[1], 1);
+        } else if (level == 0 && key_is(&key, "data")) {
+            if (seen[2]) {
+                ok = skip_value(c, 1);
+            } else {
+                seen[2] = 1;
+                skip_ws(c);
+                if (c->p < c->end && *c->p == '{') {
+                    msg->has_data = 1;
+                    ok = scan_object(c, msg, 1);
+                } else {
+                    ok = skip_value(c, 1);
+                }
+            }
+        } else if (level == 1 && key_is(&key, "audioData")) {
+            ok = take_string(c, &msg->audio_data, &seen[0], 2);
+        } else if (level == 1 && key_is(&key, "audioDataType")) {
+            ok = take_string(c, &msg->audio_data_type, &seen[1], 2);
+        } else if (level == 1 && key_is(&key, "sampleRate")) {
+            ok = take_number(c, &msg->sample_rate, &msg->has_sample_rate, &seen[2], 2);
+        } else if (level == 1 && key_is(&key, "epoch")) {
+            ok = take_number(c, &msg->data_epoch, &msg->has_data_epoch, &seen[3], 2);
+        } else {
+            ok = skip_value(c, level + 1);
+        }
+        if (!ok) return 0;
+
+        skip_ws(c);
+        if (c->p == c->end) return 0;
+        if (*c->p == '}') {
+            c->p++;
+            return 1;
+        }
+        if (*c->p != ',') return 0;
+        c->p++;
+    }
+}
+
+int stream_json_scan(const char *json, size_t len, stream_json_msg_t *msg)
+{
+    cursor_t c;
+
+    memset(msg, 0, sizeof(*msg));
+    c.p = json;
+    c.end = json + len;
+    skip_ws(&c);
+    if (c.p == c.end || *c.p != '{') return 0;
+    /* Like cJSON_Parse, whatever follows the object is ignored */
+    return scan_object(&c, msg, 0);
+}
+
+int stream_json_span_eq(const stream_json_span_t *span, const char *str)
+{
+    return span->ptr && strlen(str) == span->len && !memcmp(span->ptr, str, span->len);
+}
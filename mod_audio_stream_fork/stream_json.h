@@ -0,0 +1,57 @@
+#ifndef STREAM_JSON_H
+#define STREAM_JSON_H
+
+#include <stddef.h>
+
+/*
+ * NETPLAY v2.7: Allocation-free scan of downstream control messages
+ *
+ * stopAudio and streamAudio are the only JSON messages the module acts on, and
+ * streamAudio carries most of the traffic. Instead of building a cJSON tree (and
+ * copying the base64 audio into it), the scanner walks the message once and
+ * records where the few fields it needs are: the top level "type" and "epoch",
+ * and "audioData", "audioDataType", "sampleRate" and "epoch" inside "data".
+ * Everything else is skipped without being looked at. Spans point into the
+ * message. Like cJSON_GetObjectItem, keys match case-insensitively and the first
+ * occurrence of a key wins.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STREAM_JSON_MAX_DEPTH 32
+
+typedef struct stream_json_span {
+    const char *ptr;     /* NULL when absent or not a string */
+    size_t len;
+} stream_json_span_t;
+
+typedef struct stream_json_msg {
+    stream_json_span_t type;
+    int has_epoch;
+    double epoch;
+    int has_data;                      /* "data" is an object */
+    stream_json_span_t audio_data;     /* base64, as in the message */
+    stream_json_span_t audio_data_type;
+    int has_sample_rate;
+    double sample_rate;
+    int has_data_epoch;
+    double data_epoch;
+} stream_json_msg_t;
+
+/*
+ * Scan a message of len bytes. Returns 1 when it is a JSON object and every field
+ * of interest could be taken as is, 0 otherwise (not JSON, too deep, or a field
+ * that needs unescaping): the caller then falls back to cJSON.
+ */
+int stream_json_scan(const char *json, size_t len, stream_json_msg_t *msg);
+
+/* Case-sensitive comparison of a span with a literal, like strcmp() == 0. */
+int stream_json_span_eq(const stream_json_span_t *span, const char *str);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //STREAM_JSON_H
@@ -0,0 +1,184 @@
+#ifndef STREAM_PROTOCOL_H
+#define STREAM_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <strings.h>
+
+/*
+ * NETPLAY v2.7: Binary playback framing
+ *
+ * When STREAM_PLAYBACK_BINARY is enabled the module advertises it in the
+ * websocket handshake (STREAM_PLAYBACK_HANDSHAKE_HEADER) and accepts binary
+ * websocket frames carrying playback audio, prefixed with a fixed header.
+ * All multi-byte fields are little-endian.
+ *
+ *   offset  size  field
+ *   0       1     magic        STREAM_FRAME_MAGIC
+ *   1       1     type         STREAM_FRAME_TYPE_*
+ *   2       1     codec        STREAM_CODEC_*
+ *   3       1     flags        STREAM_FRAME_FLAG_*, other bits reserved (0)
+ *   4       4     seq          per-stream frame sequence number
+ *   8       4     sample_rate  sample rate of the payload in Hz, 0 = STREAM_PLAYBACK_SAMPLE_RATE
+ *   12      4     epoch        only with STREAM_FRAME_FLAG_EPOCH
+ *   12/16   ...   payload
+ *
+ * Epochs (NETPLAY v2.7): a backend tags the audio of each response with an
+ * increasing epoch id. stopAudio cancels its "epoch" (default: the latest one);
+ * chunks of that or an older epoch still in flight are dropped on arrival.
+ *
+ * The JSON "streamAudio" message remains supported for backends that do not
+ * negotiate binary playback.
+ */
+
+#define STREAM_PLAYBACK_HANDSHAKE_HEADER "X-Audio-Stream-Playback"
+#define STREAM_PLAYBACK_HANDSHAKE_VALUE  "binary; version=1"
+
+#define STREAM_FRAME_MAGIC       0xA5
+#define STREAM_FRAME_HEADER_LEN  12
+
+#define STREAM_FRAME_TYPE_AUDIO  1
+
+#define STREAM_FRAME_FLAG_EPOCH  0x01
+
+#define STREAM_CODEC_L16         0
+#define STREAM_CODEC_PCMU        1
+#define STREAM_CODEC_PCMA        2
+
+/*
+ * NETPLAY v2.7: Connection pool multiplexing (STREAM_POOL)
+ *
+ * Pooled calls share one websocket per ws_uri. The handshake carries
+ * STREAM_MUX_HANDSHAKE_HEADER, and every binary message, in both directions,
+ * is a batch of per-stream records:
+ *
+ *   offset  size  field
+ *   0       1     magic        STREAM_MUX_MAGIC
+ *   1       1     version      STREAM_MUX_VERSION
+ *   2       2     count        number of records
+ *   4       ...   records      count x { stream_id u32, length u32, payload }
+ *
+ * Upstream payloads are the capture audio of one stream; downstream payloads
+ * are complete playback frames (STREAM_FRAME_MAGIC header included).
+ * Text messages are JSON objects carrying a numeric "streamId". The module
+ * announces each stream with {"type":"streamStart","streamId":N,"uuid":"..."}
+ * and ends it with {"type":"streamEnd","streamId":N}.
+ */
+#define STREAM_MUX_HANDSHAKE_HEADER "X-Audio-Stream-Mux"
+#define STREAM_MUX_HANDSHAKE_VALUE  "version=1"
+
+#define STREAM_MUX_MAGIC             0xA6
+#define STREAM_MUX_VERSION           1
+#define STREAM_MUX_HEADER_LEN        4
+#define STREAM_MUX_RECORD_HEADER_LEN 8
+
+static inline void stream_proto_write_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/*
+ * NETPLAY v2.7: Opus capture (uuid_audio_stream start ... opus)
+ *
+ * Upstream binary messages carry one or more 20 ms Opus packets, each
+ * prefixed with its length:
+ *
+ *   offset  size  field
+ *   0       2     length       packet bytes, little-endian
+ *   2       ...   packet       one Opus packet (RFC 6716)
+ *
+ * Decode at the sample rate and channel count of the start command.
+ */
+#define STREAM_OPUS_PACKET_HEADER_LEN 2
+
+static inline void stream_proto_write_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+/* Bytes per sample of a playback codec */
+#define STREAM_CODEC_SAMPLE_BYTES(codec) ((codec) == STREAM_CODEC_L16 ? 2 : 1)
+
+typedef struct stream_frame_header {
+    uint8_t  type;
+    uint8_t  codec;
+    uint8_t  flags;
+    uint32_t seq;
+    uint32_t sample_rate;
+    uint32_t epoch;         /* valid with STREAM_FRAME_FLAG_EPOCH */
+    uint32_t header_len;    /* payload offset */
+} stream_frame_header_t;
+
+static inline uint32_t stream_proto_read_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * Parse the header at the start of a binary frame.
+ * Returns 0 and fills hdr on success, -1 if the frame is not a valid stream frame.
+ */
+static inline int stream_frame_header_parse(const uint8_t *buf, size_t len, stream_frame_header_t *hdr)
+{
+    if (!buf || len < STREAM_FRAME_HEADER_LEN || buf[0] != STREAM_FRAME_MAGIC) {
+        return -1;
+    }
+    hdr->type = buf[1];
+    hdr->codec = buf[2];
+    hdr->flags = buf[3];
+    hdr->seq = stream_proto_read_u32(buf + 4);
+    hdr->sample_rate = stream_proto_read_u32(buf + 8);
+    hdr->epoch = 0;
+    hdr->header_len = STREAM_FRAME_HEADER_LEN;
+    if (hdr->flags & STREAM_FRAME_FLAG_EPOCH) {
+        if (len < STREAM_FRAME_HEADER_LEN + 4) return -1;
+        hdr->epoch = stream_proto_read_u32(buf + STREAM_FRAME_HEADER_LEN);
+        hdr->header_len += 4;
+    }
+    return 0;
+}
+
+/*
+ * Map a JSON "audioDataType" to a STREAM_CODEC_* value ("raw" is L16).
+ * Returns -1 for unknown names.
+ */
+static inline int stream_codec_from_name(const char *name)
+{
+    if (!name) return -1;
+    if (!strcasecmp(name, "raw") || !strcasecmp(name, "l16")) return STREAM_CODEC_L16;
+    if (!strcasecmp(name, "pcmu") || !strcasecmp(name, "ulaw") || !strcasecmp(name, "mulaw")) return STREAM_CODEC_PCMU;
+    if (!strcasecmp(name, "pcma") || !strcasecmp(name, "alaw")) return STREAM_CODEC_PCMA;
+    return -1;
+}
+
+/* Playback input rates the module resamples from; G.711 is 8 kHz only */
+#define STREAM_PLAYBACK_RATE_MIN 8000
+#define STREAM_PLAYBACK_RATE_MAX 48000
+
+static inline int stream_playback_rate_valid(int codec, uint32_t rate)
+{
+    if (codec != STREAM_CODEC_L16) return rate == 8000;
+    return rate >= STREAM_PLAYBACK_RATE_MIN && rate <= STREAM_PLAYBACK_RATE_MAX;
+}
+
+/* Wrap-safe epoch order: non-zero when a is older than b */
+static inline int stream_epoch_before(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) < 0;
+}
+
+static inline const char *stream_codec_name(int codec)
+{
+    switch (codec) {
+        case STREAM_CODEC_L16: return "L16";
+        case STREAM_CODEC_PCMU: return "PCMU";
+        case STREAM_CODEC_PCMA: return "PCMA";
+        default: return "unknown";
+    }
+}
+
+#endif //STREAM_PROTOCOL_H
@@ -0,0 +1,111 @@
+#include "stream_reconnect.h"
+#include <switch.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+
+namespace {
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Scheduler {
+        std::mutex mutex;
+        std::condition_variable cond;            /* new earliest attempt, attempt done, shutdown */
+        std::multimap<Clock::time_point, ReconnectTarget*> due;
+        ReconnectTarget* running = nullptr;
+        std::thread thread;
+        bool started = false;
+        bool stopping = false;
+    };
+
+    Scheduler& scheduler() {
+        static Scheduler s;
+        return s;
+    }
+
+    void scheduler_loop(Scheduler* s) {
+        std::unique_lock<std::mutex> lock(s->mutex);
+        while (!s->stopping) {
+            if (s->due.empty()) {
+                s->cond.wait(lock);
+                continue;
+            }
+            auto first = s->due.begin();
+            if (first->first > Clock::now()) {
+                s->cond.wait_until(lock, first->first);
+                continue;
+            }
+            ReconnectTarget* target = first->second;
+            s->due.erase(first);
+            s->running = target;
+            lock.unlock();
+            target->reconnectNow();
+            lock.lock();
+            s->running = nullptr;
+            s->cond.notify_all();
+        }
+    }
+
+    void erase_locked(Scheduler& s, ReconnectTarget* target) {
+        for (auto it = s.due.begin(); it != s.due.end();) {
+            if (it->second == target) it = s.due.erase(it);
+            else ++it;
+        }
+    }
+
+}
+
+namespace stream_reconnect {
+
+    uint32_t backoff_ms(uint32_t attempt, uint32_t base_ms, uint32_t max_ms) {
+        static thread_local std::minstd_rand rng(std::random_device{}());
+        uint64_t delay = base_ms ? base_ms : 1;
+        for (uint32_t i = 0; i < attempt && delay < max_ms; i++) delay *= 2;
+        if (delay > max_ms) delay = max_ms;
+        const uint64_t spread = delay / 5;
+        if (spread) delay = delay - spread + rng() % (2 * spread + 1);
+        return (uint32_t)delay;
+    }
+
+    void schedule(ReconnectTarget* target, uint32_t delay_ms) {
+        Scheduler& s = scheduler();
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (s.stopping) return;
+            if (!s.started) {
+                s.started = true;
+                s.thread = std::thread(scheduler_loop, &s);
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "reconnect: scheduler thread started\n");
+            }
+            erase_locked(s, target);
+            s.due.emplace(Clock::now() + std::chrono::milliseconds(delay_ms), target);
+        }
+        s.cond.notify_all();
+    }
+
+    void cancel(ReconnectTarget* target) {
+        Scheduler& s = scheduler();
+        std::unique_lock<std::mutex> lock(s.mutex);
+        erase_locked(s, target);
+        s.cond.wait(lock, [&s, target] { return s.running != target; });
+    }
+
+    void shutdown() {
+        Scheduler& s = scheduler();
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (!s.started) return;
+            s.stopping = true;
+            s.due.clear();
+        }
+        s.cond.notify_all();
+        if (s.thread.joinable()) s.thread.join();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.started = false;
+        s.stopping = false;
+    }
+
+}
@@ -0,0 +1,41 @@
+#ifndef STREAM_RECONNECT_H
+#define STREAM_RECONNECT_H
+
+#include <cstdint>
+
+/*
+ * NETPLAY v2.7: Websocket reconnect scheduler (STREAM_NO_RECONNECT)
+ *
+ * A dropped connection is reopened with exponential backoff, but never from
+ * the websocket thread that reported the drop (the old client is torn down as
+ * part of the reconnect) nor from the media thread. One module thread, started
+ * with the first reconnect, waits for the earliest due attempt and runs it.
+ */
+
+/* Defaults (STREAM_RECONNECT_*_MS) are in stream_config.h */
+
+/* Reopens its connection, on the scheduler thread. */
+class ReconnectTarget {
+public:
+    virtual ~ReconnectTarget() = default;
+    virtual void reconnectNow() = 0;
+};
+
+namespace stream_reconnect {
+
+    /* Backoff before attempt n (0 based): doubled each time from base, capped at
+     * max_ms, with +/-20% jitter so calls dropped together do not retry together. */
+    uint32_t backoff_ms(uint32_t attempt, uint32_t base_ms, uint32_t max_ms);
+
+    /* Run target->reconnectNow() in delay_ms. A target is scheduled at most once. */
+    void schedule(ReconnectTarget* target, uint32_t delay_ms);
+
+    /* Drop a pending attempt; waits while one is running. No schedule may follow. */
+    void cancel(ReconnectTarget* target);
+
+    /* Stop the scheduler thread (module unload); targets must be cancelled first. */
+    void shutdown();
+
+}
+
+#endif //STREAM_RECONNECT_H
@@ -0,0 +1,111 @@
+#ifndef STREAM_STATS_H
+#define STREAM_STATS_H
+
+#include <stdint.h>
+
+/*
+ * NETPLAY v2.7: Per-call counters (uuid_audio_stream stats)
+ *
+ * Every counter has exactly one writer thread: capture and injection counters
+ * belong to the media thread, playback-in and connection counters to the
+ * websocket thread. Updates are relaxed atomic loads and stores, so keeping
+ * them costs a plain add on the hot path, and the stats API can read them from
+ * any thread without locking the call.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct stream_stats {
+    /* Capture, media thread */
+    uint64_t frames_captured;        /* Frames read from the media bug */
+    uint64_t frames_dropped;         /* READ callbacks skipped while disconnected (no pre-roll), or Opus could not take */
+    uint64_t preroll_dropped_bytes;  /* Pre-roll overflow while connecting */
+    uint64_t messages_sent;          /* Binary messages handed to the websocket */
+    uint64_t bytes_sent;             /* Audio payload bytes handed to the websocket */
+    uint64_t send_hold_flushes;      /* Batches sent short because STREAM_SEND_MAX_HOLD_MS expired */
+    uint64_t send_batch_grows;       /* STREAM_SEND_ADAPTIVE: batch doubled under backpressure */
+    uint64_t send_batch_shrinks;     /* STREAM_SEND_ADAPTIVE: batch halved on an idle link */
+    uint64_t outbound_dropped_messages; /* Capture messages dropped by the outbound queue policy */
+    uint64_t outbound_dropped_bytes;
+    uint64_t outbound_coalesced;     /* Batches merged into a message still waiting (coalesce) */
+    uint64_t outbound_high_water;    /* send_queue_high_water events */
+    uint64_t vad_suppressed_frames;  /* Frames held back as silence by STREAM_VAD */
+    uint64_t vad_speech_segments;    /* speech_start events */
+    uint64_t vad_silence_markers;    /* Silence markers sent in place of held back audio */
+    uint64_t resume_replayed_bytes;  /* Capture sent again after a reconnect (STREAM_RECONNECT_BUFFER_MS) */
+    uint64_t resume_dropped_bytes;   /* Outage capture that did not fit the replay window */
+
+    /* Playback input, websocket thread */
+    uint64_t playback_chunks;        /* streamAudio messages and binary frames accepted */
+    uint64_t playback_bytes;         /* Bytes written to the playback ring */
+    uint64_t playback_overruns;      /* Chunks that pushed old audio out of the ring */
+    uint64_t playback_dropped_bytes; /* Bytes discarded by those overruns */
+    uint64_t playback_max_buffered;  /* High-water mark of the ring, in bytes */
+    uint64_t barge_ins;              /* stopAudio requests */
+    uint64_t stale_chunks;           /* Chunks of a cancelled epoch dropped before decoding */
+    uint64_t stale_bytes;            /* Encoded payload bytes of those chunks */
+    uint64_t cached_plays;           /* playCached clips queued from the shared cache */
+    uint64_t cached_bytes;           /* Bytes of those clips, played without going through the ring */
+    uint64_t cached_errors;          /* playCached requests turned down (not found, hash mismatch, ...) */
+
+    /* Playback output, media thread */
+    uint64_t frames_injected;        /* Frames of backend audio written to the channel */
+    uint64_t silence_injected;       /* Silence frames written during underrun grace */
+    uint64_t plc_frames;             /* Concealment frames written during underrun grace (adaptive) */
+    uint64_t stretch_frames;         /* Frames played faster than real time to drain backlog */
+    uint64_t stretch_saved_us;       /* Backlog removed by time compression */
+    uint64_t playback_underruns;     /* Frames with not enough audio buffered */
+    uint64_t underrun_streak_max;    /* Longest run of consecutive underrun frames */
+
+    /* Connection, websocket thread */
+    uint64_t connects;
+    uint64_t disconnects;
+    uint64_t errors;
+    uint64_t reconnect_attempts;     /* NETPLAY v2.7: retries scheduled after a drop or error */
+    uint64_t reconnects;             /* Connections reopened */
+} stream_stats_t;
+
+/* NETPLAY v2.7: one add_sink destination, same single-writer rule */
+typedef struct stream_sink_stats {
+    /* Media thread */
+    uint64_t messages_sent;
+    uint64_t bytes_sent;
+    uint64_t dropped_bytes;          /* Batches dropped while disconnected or by the outbound queue */
+
+    /* Websocket thread */
+    uint64_t connects;
+    uint64_t disconnects;
+    uint64_t errors;
+    uint64_t reconnect_attempts;
+} stream_sink_stats_t;
+
+static inline uint64_t stream_stat_get(const uint64_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/* Single writer: no read-modify-write instruction needed */
+static inline void stream_stat_add(uint64_t *counter, uint64_t value)
+{
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+static inline void stream_stat_inc(uint64_t *counter)
+{
+    stream_stat_add(counter, 1);
+}
+
+static inline void stream_stat_max(uint64_t *counter, uint64_t value)
+{
+    if (value > __atomic_load_n(counter, __ATOMIC_RELAXED)) {
+        __atomic_store_n(counter, value, __ATOMIC_RELAXED);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //STREAM_STATS_H
@@ -0,0 +1,180 @@
+/*
+ * NETPLAY v2.7: WSOLA playback time compression, see time_stretch.h
+ */
+#include "time_stretch.h"
+#include <math.h>
+
+struct time_stretch {
+    uint32_t hop;             /* 10 ms: output per step and cross-fade length */
+    uint32_t tolerance;       /* +-7.5 ms search around the nominal position */
+    uint32_t stride;          /* decimation of the coarse search */
+    uint32_t cap;
+    int16_t *in;
+    uint32_t len;             /* valid input samples */
+    uint32_t natural;         /* next input sample that continues the output */
+    double ideal;             /* where natural would be at exactly the requested speed */
+    float *rise;              /* Hann half window, hop long */
+    int16_t *out;             /* one step of output */
+    uint32_t out_len;
+    uint32_t out_pos;
+};
+
+time_stretch_t *time_stretch_create(switch_memory_pool_t *pool, uint32_t rate, uint32_t max_frame)
+{
+    time_stretch_t *ts;
+    uint32_t i;
+
+    if (!pool || rate < 8000) return NULL;
+    ts = (time_stretch_t *)switch_core_alloc(pool, sizeof(*ts));
+    if (!ts) return NULL;
+
+    memset(ts, 0, sizeof(*ts));
+    ts->hop = rate / 100;
+    ts->tolerance = rate * 3 / 400;
+    ts->stride = rate >= 16000 ? rate / 8000 : 1;
+    /* Two frames at full speed plus a step's lookahead */
+    ts->cap = (uint32_t)(max_frame * 2 * TIME_STRETCH_MAX_SPEED) + time_stretch_lookahead(ts, TIME_STRETCH_MAX_SPEED);
+    ts->in = (int16_t *)switch_core_alloc(pool, ts->cap * sizeof(int16_t));
+    ts->rise = (float *)switch_core_alloc(pool, ts->hop * sizeof(float));
+    ts->out = (int16_t *)switch_core_alloc(pool, ts->hop * sizeof(int16_t));
+    if (!ts->in || !ts->rise || !ts->out) return NULL;
+
+    for (i = 0; i < ts->hop; i++) {
+        ts->rise[i] = (float)(0.5 - 0.5 * cos(M_PI * (i + 0.5) / ts->hop));
+    }
+    return ts;
+}
+
+static void compact(time_stretch_t *ts)
+{
+    if (!ts->natural) return;
+    memmove(ts->in, ts->in + ts->natural, (ts->len - ts->natural) * sizeof(int16_t));
+    ts->len -= ts->natural;
+    ts->ideal -= ts->natural;
+    ts->natural = 0;
+}
+
+uint32_t time_stretch_room(const time_stretch_t *ts)
+{
+    return ts->cap - (ts->len - ts->natural);
+}
+
+uint32_t time_stretch_lookahead(const time_stretch_t *ts, double speed)
+{
+    /* ideal may run up to tolerance + hop * (speed - 1) ahead of natural */
+    return 2 * ts->tolerance + 2 * ts->hop + (uint32_t)(ts->hop * (speed - 1.0)) + 1;
+}
+
+uint32_t time_stretch_push(time_stretch_t *ts, const int16_t *pcm, uint32_t samples)
+{
+    uint32_t n;
+
+    compact(ts);
+    n = ts->cap - ts->len;
+    if (samples < n) n = samples;
+    memcpy(ts->in + ts->len, pcm, n * sizeof(int16_t));
+    ts->len += n;
+    return n;
+}
+
+uint32_t time_stretch_pending(const time_stretch_t *ts)
+{
+    return ts->len - ts->natural + (ts->out_len - ts->out_pos);
+}
+
+static double similarity(const int16_t *a, const int16_t *b, uint32_t n, uint32_t stride)
+{
+    double corr = 0, energy = 0;
+    uint32_t i;
+
+    for (i = 0; i < n; i += stride) {
+        corr += (double)a[i] * b[i];
+        energy += (double)b[i] * b[i];
+    }
+    if (energy <= 0) return corr >= 0 ? 0 : -1;
+    return (corr >= 0 ? corr * corr : -corr * corr) / energy;
+}
+
+/* One WSOLA step: hop samples of output, cross-faded from the natural continuation
+ * into the best matching segment near the nominal position. */
+static int step(time_stretch_t *ts, double speed)
+{
+    const double ideal = ts->ideal + ts->hop * speed;
+    const double nominal = ideal - ts->hop;
+    const int16_t *tmpl = ts->in + ts->natural;
+    uint32_t lo, hi, p, best, i;
+    double score, best_score;
+
+    lo = nominal - ts->tolerance > ts->natural ? (uint32_t)(nominal - ts->tolerance) : ts->natural;
+    hi = nominal + ts->tolerance > lo ? (uint32_t)(nominal + ts->tolerance) : lo;
+    if ((uint64_t)hi + ts->hop > ts->len) return 0;
+
+    best = lo;
+    best_score = -2;
+    for (p = lo; p <= hi; p += ts->stride) {
+        score = similarity(tmpl, ts->in + p, ts->hop, ts->stride);
+        if (score > best_score) {
+            best_score = score;
+            best = p;
+        }
+    }
+    if (ts->stride > 1) {
+        const uint32_t from = best > lo + ts->stride ? best - ts->stride : lo;
+        const uint32_t to = best + ts->stride < hi ? best + ts->stride : hi;
+        best_score = -2;
+        for (p = from; p <= to; p++) {
+            score = similarity(tmpl, ts->in + p, ts->hop, 1);
+            if (score > best_score) {
+                best_score = score;
+                best = p;
+            }
+        }
+    }
+
+    for (i = 0; i < ts->hop; i++) {
+        const float r = ts->rise[i];
+        ts->out[i] = (int16_t)((1.0f - r) * tmpl[i] + r * ts->in[best + i]);
+    }
+    ts->out_len = ts->hop;
+    ts->out_pos = 0;
+    ts->natural = best + ts->hop;
+    ts->ideal = ideal;
+    return 1;
+}
+
+uint32_t time_stretch_pull(time_stretch_t *ts, int16_t *out, uint32_t samples, double speed)
+{
+    uint32_t produced = 0, n;
+
+    while (produced < samples) {
+        if (ts->out_pos < ts->out_len) {
+            n = ts->out_len - ts->out_pos;
+            if (n > samples - produced) n = samples - produced;
+            memcpy(out + produced, ts->out + ts->out_pos, n * sizeof(int16_t));
+            ts->out_pos += n;
+            produced += n;
+            continue;
+        }
+        if (speed > 1.0 && step(ts, speed)) {
+            continue;
+        }
+        /* 1.0x (or not enough lookahead left): the input is the output */
+        n = ts->len - ts->natural;
+        if (n > samples - produced) n = samples - produced;
+        if (!n) break;
+        memcpy(out + produced, ts->in + ts->natural, n * sizeof(int16_t));
+        ts->natural += n;
+        ts->ideal = ts->natural;
+        produced += n;
+    }
+    return produced;
+}
+
+void time_stretch_reset(time_stretch_t *ts)
+{
+    ts->len = 0;
+    ts->natural = 0;
+    ts->ideal = 0;
+    ts->out_len = 0;
+    ts->out_pos = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef TIME_STRETCH_H
+#define TIME_STRETCH_H
+
+#include <switch.h>
+
+/*
+ * NETPLAY v2.7: WSOLA time compression for playback backlog
+ *
+ * Sits between the playback ring and injection when STREAM_PLAYBACK_TIME_STRETCH
+ * is on. At speed 1.0 samples pass through untouched; above 1.0 every 10 ms of
+ * output is a Hann cross-fade from the natural continuation of the audio into
+ * the most similar segment near the nominal (faster) analysis position, so whole
+ * pitch periods are skipped instead of the ring dropping its oldest bytes.
+ * L16 at the playback rate, media thread only.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TIME_STRETCH_MIN_SPEED 1.05
+#define TIME_STRETCH_MAX_SPEED 1.15
+
+typedef struct time_stretch time_stretch_t;
+
+/* Allocate from pool; max_frame is the largest number of samples pulled at once. */
+time_stretch_t *time_stretch_create(switch_memory_pool_t *pool, uint32_t rate, uint32_t max_frame);
+
+/* Samples that can be pushed right now. */
+uint32_t time_stretch_room(const time_stretch_t *ts);
+
+/* Samples a pull at speed needs buffered to run a full cross-fade step. */
+uint32_t time_stretch_lookahead(const time_stretch_t *ts, double speed);
+
+/* Append input; returns the number of samples accepted. */
+uint32_t time_stretch_push(time_stretch_t *ts, const int16_t *pcm, uint32_t samples);
+
+/* Input samples not played yet. */
+uint32_t time_stretch_pending(const time_stretch_t *ts);
+
+/*
+ * Produce up to samples of output at speed (1.0 or above). Without enough
+ * lookahead for a step the remaining input is played at 1.0. Returns the
+ * number of samples written to out.
+ */
+uint32_t time_stretch_pull(time_stretch_t *ts, int16_t *out, uint32_t samples, double speed);
+
+/* Drop all buffered audio (barge-in). */
+void time_stretch_reset(time_stretch_t *ts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //TIME_STRETCH_H
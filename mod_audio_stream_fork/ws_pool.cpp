@@ -0,0 +1,492 @@
+#include "ws_pool.h"
+#include "WebSocketClient.h"
+#include "stream_protocol.h"
+#include "stream_affinity.h"
+#include <switch.h>
+#include <switch_json.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+    inline uint64_t now_ms() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /* Cheap "streamId" lookup so downstream text is routed without a second full JSON parse */
+    bool find_stream_id(const std::string& msg, uint32_t& id) {
+        size_t pos = msg.find("\"streamId\"");
+        if (pos == std::string::npos) return false;
+        pos += 10;
+        while (pos < msg.size() && (msg[pos] == ' ' || msg[pos] == '\t')) pos++;
+        if (pos >= msg.size() || msg[pos] != ':') return false;
+        pos++;
+        while (pos < msg.size() && (msg[pos] == ' ' || msg[pos] == '\t')) pos++;
+        uint64_t v = 0;
+        size_t digits = 0;
+        while (pos < msg.size() && msg[pos] >= '0' && msg[pos] <= '9' && digits < 10) {
+            v = v * 10 + (uint64_t)(msg[pos] - '0');
+            pos++;
+            digits++;
+        }
+        if (digits == 0 || v > UINT32_MAX) return false;
+        id = (uint32_t)v;
+        return true;
+    }
+
+    /* JSON objects get a "streamId" member, anything else is wrapped as {"streamId":N,"text":...} */
+    std::string wrap_text(uint32_t id, const char* text) {
+        cJSON* root = cJSON_Parse(text);
+        if (!root || root->type != cJSON_Object) {
+            if (root) cJSON_Delete(root);
+            root = cJSON_CreateObject();
+            cJSON_AddStringToObject(root, "text", text);
+        }
+        cJSON_DeleteItemFromObject(root, "streamId");
+        cJSON_AddNumberToObject(root, "streamId", id);
+        char* json_str = cJSON_PrintUnformatted(root);
+        std::string wrapped(json_str ? json_str : "");
+        switch_safe_free(json_str);
+        cJSON_Delete(root);
+        return wrapped;
+    }
+
+    std::string pool_key(const WsPoolOptions& opts) {
+        std::string key = opts.uri;
+        key += '\x1f'; key += opts.extra_headers;
+        key += '\x1f'; key += opts.tls_cafile;
+        key += '\x1f'; key += opts.tls_keyfile;
+        key += '\x1f'; key += opts.tls_certfile;
+        key += '\x1f'; key += opts.tls_disable_hostname_validation ? '1' : '0';
+        key += '\x1f'; key += opts.binary_playback ? '1' : '0';
+        key += '\x1f'; key += std::to_string(opts.deflate) + ":" + std::to_string(opts.heart_beat);
+        return key;
+    }
+
+}
+
+class WsPoolConnection {
+public:
+    WsPoolConnection(const WsPoolOptions& opts, std::string key)
+        : m_key(std::move(key)), m_uri(opts.uri), m_maxStreams(opts.max_streams > 0 ? opts.max_streams : WS_POOL_DEFAULT_MAX_STREAMS),
+          m_idleSince(now_ms()) {
+        WebSocketHeaders hdrs;
+        WebSocketTLSOptions tls;
+
+        if (!opts.extra_headers.empty()) {
+            cJSON *headers_json = cJSON_Parse(opts.extra_headers.c_str());
+            if (headers_json) {
+                cJSON *iterator = headers_json->child;
+                while (iterator) {
+                    if (iterator->type == cJSON_String && iterator->valuestring != nullptr) {
+                        hdrs.set(iterator->string, iterator->valuestring);
+                    }
+                    iterator = iterator->next;
+                }
+                cJSON_Delete(headers_json);
+            }
+        }
+
+        m_client.setUrl(opts.uri);
+        tls.caFile = opts.tls_cafile;
+        tls.keyFile = opts.tls_keyfile;
+        tls.certFile = opts.tls_certfile;
+        tls.disableHostnameValidation = opts.tls_disable_hostname_validation;
+        m_client.setTLSOptions(tls);
+
+        if (opts.heart_beat)
+            m_client.setPingInterval(opts.heart_beat);
+        if (opts.deflate)
+            m_client.enableCompression(false);
+
+        hdrs.set(STREAM_MUX_HANDSHAKE_HEADER, STREAM_MUX_HANDSHAKE_VALUE);
+        if (opts.binary_playback)
+            hdrs.set(STREAM_PLAYBACK_HANDSHAKE_HEADER, STREAM_PLAYBACK_HANDSHAKE_VALUE);
+        m_client.setHeaders(hdrs);
+
+        m_client.setMessageCallback([this](const std::string& message) { onMessage(message); });
+        m_client.setBinaryCallback([this](const void* data, size_t len) {
+            onBinary(static_cast<const uint8_t*>(data), len);
+        });
+        m_client.setOpenCallback([this]() { onOpen(); });
+        m_client.setErrorCallback([this](int code, const std::string& msg) { onError(code, msg); });
+        m_client.setCloseCallback([this](int code, const std::string& reason) { onClose(code, reason); });
+    }
+
+    void connect() {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[POOL] opening shared connection to %s\n", m_uri.c_str());
+        m_client.connect();
+    }
+
+    void close() {
+        m_closed.store(true, std::memory_order_release);
+        m_open.store(false, std::memory_order_release);
+        m_client.setMessageCallback({});
+        m_client.setBinaryCallback({});
+        m_client.disconnect();
+    }
+
+    const std::string& key() const { return m_key; }
+    bool isOpen() const { return m_open.load(std::memory_order_acquire); }
+    bool isFailed() const { return m_failed.load(std::memory_order_acquire); }
+
+    bool hasCapacity() {
+        std::lock_guard<std::recursive_mutex> lock(m_sinksMutex);
+        return (int)m_sinks.size() < m_maxStreams;
+    }
+
+    bool isIdleFor(uint64_t now, uint64_t timeout_ms) {
+        std::lock_guard<std::recursive_mutex> lock(m_sinksMutex);
+        return m_sinks.empty() && (isFailed() || now - m_idleSince >= timeout_ms);
+    }
+
+    uint32_t attach(const std::string& uuid, WsPoolSink* sink) {
+        std::lock_guard<std::recursive_mutex> lock(m_sinksMutex);
+        uint32_t id = m_nextId++;
+        if (m_nextId == 0) m_nextId = 1;
+        Entry& entry = m_sinks[id];
+        entry.sink = sink;
+        entry.uuid = uuid;
+        if (isOpen()) {
+            /* Already up: announce now, let the flusher deliver the open event */
+            announce(id, entry);
+            entry.open_pending = true;
+        }
+        return id;
+    }
+
+    void detach(uint32_t id) {
+        std::lock_guard<std::recursive_mutex> lock(m_sinksMutex);
+        auto it = m_sinks.find(id);
+        if (it == m_sinks.end()) return;
+        if (it->second.announced && isOpen()) {
+            flush();
+            std::string end = "{\"type\":\"streamEnd\",\"streamId\":" + std::to_string(id) + "}";
+            m_client.sendMessage(end.c_str(), end.size());
+        }
+        m_sinks.erase(it);
+        if (m_sinks.empty()) m_idleSince = now_ms();
+    }
+
+    bool queueBinary(uint32_t id, const uint8_t* data, size_t len) {
+        if (!isOpen() || len > UINT32_MAX) return false;
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        if (m_batch.empty()) {
+            m_batch.resize(STREAM_MUX_HEADER_LEN);
+            m_batchCount = 0;
+        }
+        const size_t off = m_batch.size();
+        m_batch.resize(off + STREAM_MUX_RECORD_HEADER_LEN + len);
+        stream_proto_write_u32(&m_batch[off], id);
+        stream_proto_write_u32(&m_batch[off + 4], (uint32_t)len);
+        memcpy(&m_batch[off + STREAM_MUX_RECORD_HEADER_LEN], data, len);
+        m_batchCount++;
+        if (m_batch.size() >= WS_POOL_BATCH_BYTES || m_batchCount == UINT16_MAX) {
+            sendBatchLocked();
+        }
+        return true;
+    }
+
+    bool sendText(uint32_t id, const char* text) {
+        if (!isOpen()) return false;
+        const std::string wrapped = wrap_text(id, text);
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        /* Keep text ordered after the audio queued before it */
+        sendBatchLocked();
+        return m_client.sendMessage(wrapped.c_str(), wrapped.size());
+    }
+
+    void flush() {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        sendBatchLocked();
+    }
+
+    size_t queuedBytes() {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        return m_batch.size();
+    }
+
+    void deliverPendingOpens() {
+        if (!isOpen()) return;
+        std::lock_guard<std::recursive_mutex> lock(m_sinksMutex);
+        for (uint32_t id : snapshot()) {
+            auto it = m_sinks.find(id);
+            if (it == m_sinks.end() || !it->second.open_pending) continue;
+            it->second.open_pending = false;
+            it->second.sink->onPoolOpen();
+        }
+    }
+
+private:
+    struct Entry {
+        WsPoolSink* sink = nullptr;
+        std::string uuid;
+        bool announced = false;
+        bool open_pending = false;
+    };
+
+    /* Ids are re-looked up after each callback: a sink may detach itself (or others) from inside it */
+    std::vector<uint32_t> snapshot() {
+        std::vector<uint32_t> ids;
+        ids.reserve(m_sinks.size());
+        for (const auto& kv : m_sinks) ids.push_back(kv.first);
+        return ids;
+    }
+
+    void announce(uint32_t id, Entry& entry) {
+        cJSON* root = cJSON_CreateObject();
+        cJSON_AddStringToObject(root, "type", "streamStart");
+        cJSON_AddNumberToObject(root, "streamId", id);
+        cJSON_AddStringToObject(root, "uuid", entry.uuid.c_str());
+        char* json_str = cJSON_PrintUnformatted(root);
+        if (json_str) m_client.sendMessage(json_str, strlen(json_str));
+        switch_safe_free(json_str);
+        cJSON_Delete(root);
+        entry.announced = true;
+    }
+
+    void sendBatchLocked() {
+        if (m_batch.size() <= STREAM_MUX_HEADER_LEN) return;
+        m_batch[0] = STREAM_MUX_MAGIC;
+        m_batch[1] = STREAM_MUX_VERSION;
+        m_batch[2] = (uint8_t)m_batchCount;
+        m_batch[3] = (uint8_t)(m_batchCount >> 8);
+        m_client.sendBinary(m_batch.data(), m_batch.size());
+        m_batch.clear();
+        m_batchCount = 0;
+    }
+
+    void onOpen() {
+        if (m_closed.load(std::memory_order_acquire)) return;
+        m_failed.store(false, std::memory_order_release);
+        m_open.store(true, std::memory_order_release);
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[POOL] connected to %s\n", m_uri.c_str());
+        std::lock_guard<std::recursive_mutex> lock(m_sinksMutex);
+        for (auto& kv : m_sinks) {
+            announce(kv.first, kv.second);
+            kv.second.open_pending = false;
+        }
+        for (uint32_t id : snapshot()) {
+            auto it = m_sinks.find(id);
+            if (it != m_sinks.end()) it->second.sink->onPoolOpen();
+        }
+    }
+
+    void onMessage(const std::string& message) {
+        uint32_t id = 0;
+        if (!find_stream_id(message, id)) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "[POOL] message without streamId dropped\n");
+            return;
+        }
+        std::lock_guard<std::recursive_mutex> lock(m_sinksMutex);
+        auto it = m_sinks.find(id);
+        if (it != m_sinks.end()) it->second.sink->onPoolMessage(message);
+    }
+
+    void onBinary(const uint8_t* data, size_t len) {
+        if (len < STREAM_MUX_HEADER_LEN || data[0] != STREAM_MUX_MAGIC) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[POOL] invalid binary message (%zuB) dropped\n", len);
+            return;
+        }
+        const uint16_t count = (uint16_t)(data[2] | (data[3] << 8));
+        size_t off = STREAM_MUX_HEADER_LEN;
+        std::lock_guard<std::recursive_mutex> lock(m_sinksMutex);
+        for (uint16_t i = 0; i < count; i++) {
+            if (len - off < STREAM_MUX_RECORD_HEADER_LEN) break;
+            const uint32_t id = stream_proto_read_u32(data + off);
+            const uint32_t rec_len = stream_proto_read_u32(data + off + 4);
+            off += STREAM_MUX_RECORD_HEADER_LEN;
+            if (rec_len > len - off) break;
+            auto it = m_sinks.find(id);
+            if (it != m_sinks.end()) it->second.sink->onPoolBinary(data + off, rec_len);
+            off += rec_len;
+        }
+    }
+
+    void onError(int code, const std::string& msg) {
+        m_open.store(false, std::memory_order_release);
+        m_failed.store(true, std::memory_order_release);
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "[POOL] connection to %s failed: %d %s\n",
+                          m_uri.c_str(), code, msg.c_str());
+        std::lock_guard<std::recursive_mutex> lock(m_sinksMutex);
+        for (uint32_t id : snapshot()) {
+            auto it = m_sinks.find(id);
+            if (it == m_sinks.end()) continue;
+            it->second.announced = false;
+            it->second.sink->onPoolError(code, msg);
+        }
+    }
+
+    void onClose(int code, const std::string& reason) {
+        m_open.store(false, std::memory_order_release);
+        m_failed.store(true, std::memory_order_release);
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[POOL] connection to %s closed: %d %s\n",
+                          m_uri.c_str(), code, reason.c_str());
+        std::lock_guard<std::recursive_mutex> lock(m_sinksMutex);
+        for (uint32_t id : snapshot()) {
+            auto it = m_sinks.find(id);
+            if (it == m_sinks.end()) continue;
+            it->second.announced = false;
+            it->second.sink->onPoolClose(code, reason);
+        }
+    }
+
+    std::string m_key;
+    std::string m_uri;
+    int m_maxStreams;
+    WebSocketClient m_client;
+    std::atomic<bool> m_open{false};
+    std::atomic<bool> m_failed{false};
+    std::atomic<bool> m_closed{false};
+
+    std::recursive_mutex m_sinksMutex;   /* held while delivering events, so detach waits for them */
+    std::unordered_map<uint32_t, Entry> m_sinks;
+    uint32_t m_nextId = 1;
+    uint64_t m_idleSince;
+
+    std::mutex m_sendMutex;
+    std::vector<uint8_t> m_batch;
+    uint16_t m_batchCount = 0;
+};
+
+namespace {
+
+    struct Pool {
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<std::shared_ptr<WsPoolConnection>> conns;
+        std::thread flusher;
+        bool running = false;
+        std::vector<int> cpus;      /* flusher affinity, audio_stream.conf cpu-affinity */
+    };
+
+    Pool& pool() {
+        static Pool p;
+        return p;
+    }
+
+    void flusher_loop() {
+        Pool& p = pool();
+        std::unique_lock<std::mutex> lock(p.mutex);
+        while (p.running) {
+            p.cond.wait_for(lock, std::chrono::milliseconds(WS_POOL_FLUSH_INTERVAL_MS));
+            if (!p.running) break;
+
+            std::vector<std::shared_ptr<WsPoolConnection>> conns = p.conns;
+            std::vector<std::shared_ptr<WsPoolConnection>> reaped;
+            const uint64_t now = now_ms();
+            for (auto it = p.conns.begin(); it != p.conns.end();) {
+                if ((*it)->isIdleFor(now, WS_POOL_IDLE_TIMEOUT_MS)) {
+                    reaped.push_back(*it);
+                    it = p.conns.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            lock.unlock();
+
+            for (auto& conn : conns) {
+                conn->deliverPendingOpens();
+                conn->flush();
+            }
+            for (auto& conn : reaped) {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "[POOL] closing idle connection\n");
+                conn->close();
+            }
+            conns.clear();
+            reaped.clear();
+
+            lock.lock();
+        }
+    }
+
+}
+
+namespace ws_pool {
+
+    bool attach(const WsPoolOptions& opts, const std::string& uuid, WsPoolSink* sink, WsPoolStream& out) {
+        const std::string key = pool_key(opts);
+        std::shared_ptr<WsPoolConnection> conn;
+        bool created = false;
+        {
+            Pool& p = pool();
+            std::lock_guard<std::mutex> lock(p.mutex);
+            for (auto& c : p.conns) {
+                if (c->key() == key && !c->isFailed() && c->hasCapacity()) {
+                    conn = c;
+                    break;
+                }
+            }
+            if (!conn) {
+                conn = std::make_shared<WsPoolConnection>(opts, key);
+                p.conns.push_back(conn);
+                created = true;
+            }
+            if (!p.running) {
+                p.running = true;
+                p.flusher = std::thread(flusher_loop);
+                if (!p.cpus.empty()) {
+                    stream_set_affinity(p.flusher.native_handle(), p.cpus.data(), (int)p.cpus.size());
+                }
+            }
+            out.conn = conn;
+            out.id = conn->attach(uuid, sink);
+        }
+        if (created) conn->connect();
+        return true;
+    }
+
+    void detach(WsPoolStream& stream) {
+        if (!stream.conn) return;
+        stream.conn->detach(stream.id);
+        stream.conn.reset();
+        stream.id = 0;
+    }
+
+    bool isConnected(const WsPoolStream& stream) {
+        return stream.conn && stream.conn->isOpen();
+    }
+
+    bool sendBinary(const WsPoolStream& stream, const uint8_t* data, size_t len) {
+        return stream.conn && stream.conn->queueBinary(stream.id, data, len);
+    }
+
+    bool sendText(const WsPoolStream& stream, const char* text) {
+        return stream.conn && text && stream.conn->sendText(stream.id, text);
+    }
+
+    size_t queuedBytes(const WsPoolStream& stream) {
+        return stream.conn ? stream.conn->queuedBytes() : 0;
+    }
+
+    void configure(const std::vector<int>& cpus) {
+        Pool& p = pool();
+        std::lock_guard<std::mutex> lock(p.mutex);
+        p.cpus = cpus;
+    }
+
+    void shutdown() {
+        Pool& p = pool();
+        std::vector<std::shared_ptr<WsPoolConnection>> conns;
+        {
+            std::lock_guard<std::mutex> lock(p.mutex);
+            if (!p.running) return;
+            p.running = false;
+            conns.swap(p.conns);
+        }
+        p.cond.notify_all();
+        if (p.flusher.joinable()) p.flusher.join();
+        for (auto& conn : conns) {
+            conn->flush();
+            conn->close();
+        }
+    }
+
+}
@@ -0,0 +1,87 @@
+#ifndef WS_POOL_H
+#define WS_POOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * NETPLAY v2.7: Shared websocket connection pool (STREAM_POOL)
+ *
+ * Calls with the same ws_uri, headers and TLS options share a persistent
+ * WebSocketClient instead of paying a TCP+TLS handshake per call. Each call is
+ * a stream on the connection, identified by a per-connection stream id; the
+ * wire format is described in stream_protocol.h.
+ *
+ * Upstream audio is appended to a per-connection batch that is flushed by one
+ * module thread every WS_POOL_FLUSH_INTERVAL_MS, or inline once it reaches
+ * WS_POOL_BATCH_BYTES. Connections without streams are closed after
+ * WS_POOL_IDLE_TIMEOUT_MS.
+ */
+
+#define WS_POOL_DEFAULT_MAX_STREAMS 64
+#define WS_POOL_FLUSH_INTERVAL_MS   5
+#define WS_POOL_BATCH_BYTES         32768
+#define WS_POOL_IDLE_TIMEOUT_MS     60000
+
+/* Receives the events of one stream. Called on the websocket thread, except
+ * onPoolOpen for a stream attached to an already open connection, which is
+ * delivered by the flusher thread so the caller can finish its setup first. */
+class WsPoolSink {
+public:
+    virtual ~WsPoolSink() = default;
+    virtual void onPoolOpen() = 0;
+    virtual void onPoolMessage(const std::string& message) = 0;
+    virtual void onPoolBinary(const uint8_t* data, size_t len) = 0;
+    virtual void onPoolError(int code, const std::string& message) = 0;
+    virtual void onPoolClose(int code, const std::string& reason) = 0;
+};
+
+struct WsPoolOptions {
+    std::string uri;
+    std::string extra_headers;       /* STREAM_EXTRA_HEADERS JSON */
+    std::string tls_cafile;
+    std::string tls_keyfile;
+    std::string tls_certfile;
+    bool tls_disable_hostname_validation = false;
+    int deflate = 0;
+    int heart_beat = 0;
+    bool binary_playback = false;
+    int max_streams = WS_POOL_DEFAULT_MAX_STREAMS;
+};
+
+class WsPoolConnection;
+
+/* One call's membership in a pooled connection */
+struct WsPoolStream {
+    std::shared_ptr<WsPoolConnection> conn;
+    uint32_t id = 0;
+};
+
+namespace ws_pool {
+
+    /* Attach sink to a connection matching opts, opening one if needed. */
+    bool attach(const WsPoolOptions& opts, const std::string& uuid, WsPoolSink* sink, WsPoolStream& out);
+
+    /* Announce streamEnd and stop delivering events to the sink. Blocks while
+     * an event for this stream is being delivered on another thread. */
+    void detach(WsPoolStream& stream);
+
+    bool isConnected(const WsPoolStream& stream);
+    bool sendBinary(const WsPoolStream& stream, const uint8_t* data, size_t len);
+    bool sendText(const WsPoolStream& stream, const char* text);
+
+    /* Bytes waiting in the connection batch, shared by all its streams (stats). */
+    size_t queuedBytes(const WsPoolStream& stream);
+
+    /* CPUs the flusher thread may run on (audio_stream.conf cpu-affinity). */
+    void configure(const std::vector<int>& cpus);
+
+    /* Close every pooled connection and stop the flusher (module unload). */
+    void shutdown();
+
+}
+
+#endif //WS_POOL_H